@@ -0,0 +1,169 @@
+#pragma once
+/*
+ * Контрольная сумма Internet (RFC 1071) и её инкрементальное обновление (RFC 1624)
+ *
+ * Сумма в обратном коде не зависит от ширины слагаемых: данные суммируются 32-битными словами
+ * в 64-битные аккумуляторы, переносы сворачиваются в конце. Используются векторные ядра:
+ * - SSE2 - два 64-битных аккумулятора на 16 байт данных
+ * - AVX2 - четыре 64-битных аккумулятора на 32 байта данных
+ * Ядро выбирается один раз при первом вызове по возможностям процессора (__builtin_cpu_supports),
+ * на других архитектурах используется скалярное ядро.
+ *
+ * Все значения - в том порядке байт, в котором они лежат в пакете: результат Compute записывается
+ * в поле контрольной суммы без htons, аргументы Update* берутся из пакета как есть.
+ *
+ * Инкрементальное обновление (RFC 1624, формула 3): HC' = ~(~HC + ~m + m')
+ * позволяет изменить одно поле (sequence, IP id, адрес) без пересчёта по всему пакету.
+ *
+ * USAGE:
+ * hdr->checksum = 0;
+ * hdr->checksum = checksum::Compute(hdr, len);
+ * hdr->checksum = checksum::Update16(hdr->checksum, old_seq, new_seq);
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <string.h>
+
+namespace checksum {
+
+/* Ядро суммирования: прибавляет data к аккумулятору sum, результат не свёрнут */
+using Kernel = unsigned long long (*)(const unsigned char* data, int len, unsigned long long sum);
+
+/* Свёртка 64-битного аккумулятора в 16-битную сумму в обратном коде */
+inline unsigned short Fold(unsigned long long sum) {
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (unsigned short)sum;
+}
+
+/* Скалярное ядро: 32-битные слова в 64-битный аккумулятор, хвост - 16 бит и байт */
+inline unsigned long long SumScalar(const unsigned char* data, int len, unsigned long long sum) {
+    for (; len >= 4; len -= 4, data += 4) {
+        unsigned int word;
+        memcpy(&word, data, sizeof(word));
+        sum += word;
+    }
+    if (len >= 2) {
+        unsigned short half;
+        memcpy(&half, data, sizeof(half));
+        sum += half;
+        len -= 2;
+        data += 2;
+    }
+    if (len == 1) {
+        // последний нечётный байт дополняется нулём (RFC 1071)
+        unsigned short half = 0;
+        memcpy(&half, data, 1);
+        sum += half;
+    }
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* SSE2: 32-битные слова расширяются до 64 бит чередованием с нулями */
+__attribute__((target("sse2")))
+inline unsigned long long SumSse2(const unsigned char* data, int len, unsigned long long sum) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero;
+    __m128i acc1 = zero;
+    for (; len >= 32; len -= 32, data += 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)data);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(data + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+    }
+    if (len >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)data);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+        len -= 16;
+        data += 16;
+    }
+    unsigned long long lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+    return SumScalar(data, len, sum + Fold(lanes[0]) + Fold(lanes[1]));
+}
+
+/* AVX2: то же на 256-битных регистрах, два независимых аккумулятора на итерацию */
+__attribute__((target("avx2")))
+inline unsigned long long SumAvx2(const unsigned char* data, int len, unsigned long long sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero;
+    __m256i acc1 = zero;
+    for (; len >= 64; len -= 64, data += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)data);
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(data + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+    }
+    unsigned long long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+    sum += Fold(lanes[0]) + Fold(lanes[1]) + Fold(lanes[2]) + Fold(lanes[3]);
+    return SumSse2(data, len, sum);
+}
+#endif
+
+/* Выбор ядра по возможностям процессора */
+inline Kernel SelectKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SumAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SumSse2;
+    }
+#endif
+    return SumScalar;
+}
+
+/* Ядро выбирается при первом вызове. Статическая переменная с константной инициализацией
+ * не требует защиты __cxa_guard (libstdc++), гонка безвредна - все потоки запишут одно значение */
+inline Kernel GetKernel() {
+    static Kernel kernel = nullptr;
+    Kernel k = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (k == nullptr) {
+        k = SelectKernel();
+        __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+/* Короче этой длины векторное ядро не даёт выигрыша (заголовки IP/ICMP) */
+constexpr int VECTOR_MIN_LEN = 64;
+
+/* Сумма в обратном коде (без инверсии) - для составных сумм, например с псевдозаголовком
+ * - initial - ранее посчитанная сумма (результат Sum) */
+inline unsigned short Sum(const void* data, int len, unsigned short initial = 0) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    unsigned long long sum = (len < VECTOR_MIN_LEN) ? SumScalar(bytes, len, initial) : GetKernel()(bytes, len, initial);
+    return Fold(sum);
+}
+
+/* Контрольная сумма: поле контрольной суммы в data должно быть обнулено */
+inline unsigned short Compute(const void* data, int len) {
+    return ~Sum(data, len);
+}
+
+/* Обновление контрольной суммы check при замене 16-битного поля old_value на new_value */
+inline unsigned short Update16(unsigned short check, unsigned short old_value, unsigned short new_value) {
+    unsigned int sum = (unsigned short)~check + (unsigned int)(unsigned short)~old_value + new_value;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
+
+/* Обновление при замене 32-битного поля (IPv4 адрес) */
+inline unsigned short Update32(unsigned short check, unsigned int old_value, unsigned int new_value) {
+    check = Update16(check, old_value & 0xFFFF, new_value & 0xFFFF);
+    return Update16(check, old_value >> 16, new_value >> 16);
+}
+
+}
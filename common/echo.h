@@ -0,0 +1,49 @@
+#pragma once
+/*
+ * Общий интерфейс бэкендов ICMP echo: отправка echo request и приём echo reply
+ *
+ * Бэкенд - набор функций и контекст ctx, который передаётся каждой из них (как обработчики фреймов
+ * в ping_raw_eth), без виртуальных функций. Реализации:
+ * - IcmpSocket (common/icmp_socket.h) - датаграммный ICMP сокет (SOCK_DGRAM, IPPROTO_ICMP): работает без прав
+ *   суперпользователя в пределах net.ipv4.ping_group_range, ядро само подставляет идентификатор запроса
+ *   и отдаёт сокету только ответы с этим идентификатором; при запрете - запасной сырой ICMP сокет (SOCK_RAW)
+ * - Ping::GetBackend (ping_raw_eth/icmp.h) - сырые Ethernet фреймы через AF_PACKET (нужен CAP_NET_RAW),
+ *   ответы отбираются BPF фильтром, в ответе известен MAC адрес отправителя
+ *
+ * USAGE:
+ * IcmpSocket sock;  // если успешно создан, то IsCreated вернёт true
+ * EchoBackend backend = sock.GetBackend();
+ * backend.send(backend.ctx, inet_addr("192.168.1.1"), htons(1));
+ * EchoReply reply;
+ * int res = backend.receive(backend.ctx, &reply, true);
+ */
+#include <netinet/in.h>
+#include <net/ethernet.h>
+
+/* Принятый echo reply, адрес, идентификатор и sequence - в сетевом порядке байт */
+struct EchoReply {
+    in_addr_t src;
+    unsigned short id;
+    unsigned short sequence;
+    long long ts_ns;                        // метка приёма ядра (CLOCK_REALTIME), 0 - метки нет
+    bool has_mac;                           // MAC адрес отправителя известен (только сырой Ethernet)
+    unsigned char mac[ETH_ALEN];
+};
+
+struct EchoBackend {
+    void* ctx;
+
+    /* Идентификатор echo запросов бэкенда (в сетевом порядке байт) */
+    unsigned short (*get_id)(void* ctx);
+
+    /* Дескриптор для ожидания ответов (poll/epoll) */
+    int (*get_socket)(void* ctx);
+
+    /* Отправка echo request на dst (в сетевом порядке байт) с sequence, возвращает true при успехе */
+    bool (*send)(void* ctx, in_addr_t dst, unsigned short sequence);
+
+    /* Приём следующего echo reply с идентификатором бэкенда
+     * - wait - ждать ответа не дольше таймаута приёма бэкенда, иначе - только уже принятые ядром ответы
+     * возвращает 1 - ответ записан в reply, 0 - ответа нет, -1 - ошибка приёма */
+    int (*receive)(void* ctx, EchoReply* reply, bool wait);
+};
@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "echo_retry.h"
+
+namespace {
+    long long ClockNs(clockid_t clock) {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    /* Слот адреса ip в хэш-таблице индексов целей RunAll (индекс + 1, 0 - слот свободен):
+     * слот с этим адресом, либо свободный слот, куда его можно записать */
+    unsigned int FindSlot(const unsigned int* slots, unsigned int mask, const EchoRetry::Target* targets, in_addr_t ip) {
+        unsigned int h = ip * 2654435761u;
+        unsigned int slot = (h ^ (h >> 15)) & mask;
+        while ((slots[slot] != 0) && (targets[slots[slot] - 1].dst != ip)) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+}
+
+EchoRetry::EchoRetry(const EchoBackend& backend, unsigned int budget_ms) noexcept
+    : backend_(backend), budget_ns_((budget_ms == 0 ? DEFAULT_BUDGET_MS : budget_ms) * 1000000LL) {
+    seed_ = (unsigned int)ClockNs(CLOCK_MONOTONIC) ^ ((unsigned int)getpid() << 16);
+    if (seed_ == 0) {
+        seed_ = 1;
+    }
+}
+
+/* Время отправки попыток хранится в часах CLOCK_REALTIME - в тех же, что и метки приёма ядра,
+ * сроки повторов и бюджет - в монотонных часах */
+int EchoRetry::Run(in_addr_t dst, RttEstimator& rtt, Result* result) noexcept {
+    long long sent_ns[MAX_ATTEMPTS];
+    unsigned int attempts = 0;
+    const int fd = backend_.get_socket(backend_.ctx);
+    const long long start = ClockNs(CLOCK_MONOTONIC);
+    const long long end = start + budget_ns_;
+    long long next = start;
+    for (;;) {
+        long long now = ClockNs(CLOCK_MONOTONIC);
+        if ((now >= next) && (now < end) && (attempts < MAX_ATTEMPTS)) {
+            sent_ns[attempts] = ClockNs(CLOCK_REALTIME);
+            if (!backend_.send(backend_.ctx, dst, htons(attempts))) {
+                // errno отправки нужен вызывающей стороне: ошибка может относиться только к этому адресу
+                int err = errno;
+                printf("ICMP packet sending failed!\n");
+                errno = err;
+                return -1;
+            }
+            next = now + RttEstimator::Backoff(rtt.GetRto(), attempts, &seed_);
+            ++attempts;
+        }
+
+        EchoReply reply;
+        int res;
+        while ((res = backend_.receive(backend_.ctx, &reply, false)) > 0) {
+            unsigned int attempt = ntohs(reply.sequence);
+            if ((reply.src != dst) || (attempt >= attempts)) {
+                continue;
+            }
+            result->reply = reply;
+            result->rtt_ns = ((reply.ts_ns != 0) ? reply.ts_ns : ClockNs(CLOCK_REALTIME)) - sent_ns[attempt];
+            result->attempt = attempt;
+            result->attempts = attempts;
+            rtt.Sample(result->rtt_ns);
+            return 1;
+        }
+        if (res < 0) {
+            int err = errno;
+            printf("Problems with network\n");
+            errno = err;
+            return -1;
+        }
+
+        now = ClockNs(CLOCK_MONOTONIC);
+        if (now >= end) {
+            return 0;
+        }
+        long long wake = ((attempts < MAX_ATTEMPTS) && (next < end)) ? next : end;
+        struct pollfd pfd{fd, POLLIN, 0};
+        if ((poll(&pfd, 1, (int)((wake - now + 999999) / 1000000)) < 0) && (errno != EINTR)) {
+            int err = errno;
+            printf("Problems with network\n");
+            errno = err;
+            return -1;
+        }
+    }
+}
+
+bool EchoRetry::SendNext(Target& target, long long now, SubnetRtt& subnets) noexcept {
+    if (target.end == 0) {
+        target.end = now + budget_ns_;
+    }
+    target.sent_ns[target.attempts] = ClockNs(CLOCK_REALTIME);
+    if (!backend_.send(backend_.ctx, target.dst, htons(target.attempts))) {
+        return false;
+    }
+    // пока у подсети нет измерений, первый срок не съедает весь бюджет: остаются повторы
+    long long rto = subnets.GetRto(target.dst);
+    if (rto > budget_ns_ / 4) {
+        rto = budget_ns_ / 4;
+    }
+    target.next = now + RttEstimator::Backoff(rto, target.attempts, &seed_);
+    ++target.attempts;
+    return true;
+}
+
+/* Цели перебираются только когда наступил ближайший срок (wake), ответы обрабатываются по мере прихода:
+ * хэш-таблица индексов целей по адресу (открытая адресация, заполнение не более 1/2) находит цель за O(1) */
+int EchoRetry::RunAll(Target* targets, unsigned int count, SubnetRtt& subnets) noexcept {
+    unsigned int capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    unsigned int* slots = (unsigned int*)calloc(capacity, sizeof(unsigned int));
+    if (slots == nullptr) {
+        printf("Error. Not enough memory.\n");
+        errno = ENOMEM;
+        return -1;
+    }
+    const unsigned int mask = capacity - 1;
+    unsigned int pending = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        Target& target = targets[i];
+        target.status = 0;
+        target.error = 0;
+        target.end = 0;
+        target.attempts = 0;
+        target.done = false;
+        unsigned int slot = FindSlot(slots, mask, targets, target.dst);
+        if (slots[slot] != 0) {
+            // повтор адреса - итог возьмём у первой цели с ним
+            target.done = true;
+            continue;
+        }
+        slots[slot] = i + 1;
+        ++pending;
+    }
+
+    const int fd = backend_.get_socket(backend_.ctx);
+    int replies = 0;
+    long long wake = 0;
+    int res = 0;
+    while (pending > 0) {
+        long long now = ClockNs(CLOCK_MONOTONIC);
+        if (now >= wake) {
+            wake = now + budget_ns_;
+            for (unsigned int i = 0; i < count; ++i) {
+                Target& target = targets[i];
+                if (target.done) {
+                    continue;
+                }
+                if ((target.end != 0) && (now >= target.end)) {
+                    target.done = true;
+                    --pending;
+                    continue;
+                }
+                if ((target.end == 0) || ((now >= target.next) && (target.attempts < MAX_ATTEMPTS))) {
+                    if (!SendNext(target, now, subnets)) {
+                        target.status = -1;
+                        target.error = errno;
+                        target.done = true;
+                        --pending;
+                        continue;
+                    }
+                }
+                long long deadline = ((target.attempts < MAX_ATTEMPTS) && (target.next < target.end)) ? target.next
+                                                                                                       : target.end;
+                wake = (deadline < wake) ? deadline : wake;
+            }
+        }
+
+        EchoReply reply;
+        while ((pending > 0) && ((res = backend_.receive(backend_.ctx, &reply, false)) > 0)) {
+            unsigned int slot = FindSlot(slots, mask, targets, reply.src);
+            if (slots[slot] == 0) {
+                continue;
+            }
+            Target& target = targets[slots[slot] - 1];
+            unsigned int attempt = ntohs(reply.sequence);
+            if (target.done || (attempt >= target.attempts)) {
+                continue;
+            }
+            target.result.reply = reply;
+            target.result.rtt_ns = ((reply.ts_ns != 0) ? reply.ts_ns : ClockNs(CLOCK_REALTIME)) - target.sent_ns[attempt];
+            target.result.attempt = attempt;
+            target.result.attempts = target.attempts;
+            subnets.Get(target.dst).Sample(target.result.rtt_ns);
+            target.status = 1;
+            target.done = true;
+            --pending;
+            ++replies;
+        }
+        if ((res < 0) || (pending == 0)) {
+            break;
+        }
+
+        now = ClockNs(CLOCK_MONOTONIC);
+        if (now < wake) {
+            struct pollfd pfd{fd, POLLIN, 0};
+            if ((poll(&pfd, 1, (int)((wake - now + 999999) / 1000000)) < 0) && (errno != EINTR)) {
+                res = -1;
+                break;
+            }
+        }
+    }
+    if (res < 0) {
+        int err = errno;
+        printf("Problems with network\n");
+        free(slots);
+        errno = err;
+        return -1;
+    }
+
+    // итог повторяющихся адресов
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned int first = slots[FindSlot(slots, mask, targets, targets[i].dst)] - 1;
+        if (first != i) {
+            targets[i].status = targets[first].status;
+            targets[i].error = targets[first].error;
+            targets[i].result = targets[first].result;
+            replies += (targets[i].status == 1) ? 1 : 0;
+        }
+    }
+    free(slots);
+    return replies;
+}
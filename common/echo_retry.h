@@ -0,0 +1,83 @@
+#pragma once
+/*
+ * Запрос ICMP echo с повторами по оценке RTT вместо фиксированного ожидания, см. common/rtt.h
+ *
+ * Запросы и ожидание ответа - в одном цикле poll по дескриптору бэкенда (common/echo.h), без блокирующего
+ * приёма: срок очередного повтора - RttEstimator::Backoff от текущей оценки RTT цели (экспоненциальное
+ * увеличение с отклонением), общий бюджет времени ограничивает и повторы, и ожидание последнего ответа.
+ * У каждой попытки свой sequence (номер попытки), поэтому ответ на любую из отправленных попыток
+ * принимается, даже если он опоздал к моменту повтора, а RTT измеряется однозначно (алгоритм Карна
+ * не отбрасывает измерение) и пополняет оценку цели.
+ *
+ * Множество адресов (RunAll) опрашивается конвейером в одном цикле poll: первые запросы ко всем целям уходят
+ * сразу, повторы - по срокам целей, ответы сопоставляются с целями по адресу отправителя через хэш-таблицу.
+ * Оценка RTT общая на подсеть /24 (SubnetRtt): срок ожидания цели без своих измерений берётся по ответам
+ * соседей (не больше четверти бюджета), каждый ответ пополняет оценку своей подсети. Бюджет - у каждой цели свой,
+ * от её первого запроса, поэтому весь опрос занимает около одного бюджета, а не бюджет на адрес.
+ *
+ * USAGE:
+ * EchoRetry retry(backend, budget_ms);
+ * RttEstimator rtt;
+ * EchoRetry::Result result;
+ * int res = retry.Run(inet_addr("192.168.1.1"), rtt, &result);  // 1 - ответ, 0 - нет ответа за бюджет, -1 - ошибка
+ *
+ * SubnetRtt subnets;
+ * EchoRetry::Target targets[2]{};
+ * targets[0].dst = inet_addr("192.168.1.1");
+ * targets[1].dst = inet_addr("192.168.1.2");
+ * int replies = retry.RunAll(targets, 2, subnets);  // итог каждой цели - в targets[i].status
+ */
+#include "echo.h"
+#include "rtt.h"
+
+class EchoRetry {
+public:
+    static constexpr unsigned int DEFAULT_BUDGET_MS = 3000;    // общее время на адрес
+    static constexpr unsigned int MAX_ATTEMPTS = 32;           // предел запросов на адрес
+
+    struct Result {
+        EchoReply reply;
+        long long rtt_ns;                   // RTT ответившей попытки
+        unsigned int attempt;               // номер ответившей попытки (0 - первая)
+        unsigned int attempts;              // отправлено запросов
+    };
+
+    /* Цель RunAll: dst заполняет вызывающая сторона, остальное - RunAll */
+    struct Target {
+        in_addr_t dst;                      // адрес в сетевом порядке байт
+        int status;                         // 1 - ответ в result, 0 - нет ответа за бюджет, -1 - запрос не отправлен
+        int error;                          // errno отправки при status == -1
+        Result result;
+
+        // состояние опроса
+        long long end;                      // окончание бюджета цели (монотонные часы), 0 - запросов ещё не было
+        long long next;                     // срок следующего запроса
+        long long sent_ns[MAX_ATTEMPTS];    // время отправки попыток (CLOCK_REALTIME)
+        unsigned int attempts;
+        bool done;
+    };
+
+    /* - backend - бэкенд ICMP echo
+     * - budget_ms - общее время на адрес, от первого запроса до отказа, 0 - DEFAULT_BUDGET_MS */
+    EchoRetry(const EchoBackend& backend, unsigned int budget_ms) noexcept;
+
+    /* Запросы к dst (в сетевом порядке байт) до первого ответа либо до исчерпания бюджета
+     * - rtt - оценка RTT цели: задаёт сроки повторов и пополняется измерением ответа
+     * возвращает 1 - ответ записан в result, 0 - ответа нет, -1 - ошибка отправки или приёма (выведена, errno сохранён) */
+    int Run(in_addr_t dst, RttEstimator& rtt, Result* result) noexcept;
+
+    /* Конвейерный опрос count целей до ответа каждой либо до исчерпания её бюджета
+     * - subnets - оценки RTT подсетей: задают сроки запросов целей и пополняются их ответами
+     * Ошибка отправки завершает только свою цель (status -1, errno в error) и не выводится.
+     * Повторяющиеся адреса опрашиваются один раз, итог копируется во все их цели.
+     * возвращает количество ответивших целей, -1 - ошибка приёма или нехватка памяти (выведена, errno сохранён) */
+    int RunAll(Target* targets, unsigned int count, SubnetRtt& subnets) noexcept;
+
+private:
+    /* Отправка очередной попытки цели, срок следующей - по оценке подсети. false - ошибка отправки */
+    bool SendNext(Target& target, long long now, SubnetRtt& subnets) noexcept;
+
+    EchoBackend backend_;
+    long long budget_ns_;
+    unsigned int seed_;                     // генератор отклонений повторов
+};
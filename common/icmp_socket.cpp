@@ -0,0 +1,200 @@
+#include <errno.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "icmp_socket.h"
+
+/*
+ * При создании объекта:
+ * - создаём датаграммный ICMP сокет (EACCES - группа процесса не входит в net.ipv4.ping_group_range),
+ *   при запрете и raw_fallback - сырой ICMP сокет
+ * - датаграммный: bind без номера, ядро назначает свободный идентификатор, читаем его через getsockname;
+ *   сырой: идентификатор от pid процесса
+ * - включаем TTL и программные метки времени приёма (SO_TIMESTAMPNS)
+ */
+IcmpSocket::IcmpSocket(bool raw_fallback) noexcept {
+    sock_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_ICMP);
+    if ((sock_fd_ < 0) && raw_fallback && ((errno == EACCES) || (errno == EPERM))) {
+        sock_fd_ = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_ICMP);
+        if ((sock_fd_ < 0) && ((errno == EACCES) || (errno == EPERM))) {
+            printf("Icmp. Error. Neither datagram nor raw ICMP socket is permitted, see net.ipv4.ping_group_range.\n");
+            return;
+        }
+        raw_ = true;
+    }
+    if (sock_fd_ < 0) {
+        if ((errno == EACCES) || (errno == EPERM)) {
+            printf("Icmp. Error. Datagram ICMP socket is not permitted, see net.ipv4.ping_group_range.\n");
+        } else {
+            printf("Icmp. Error. Socket file descriptor not received! %s\n", strerror(errno));
+        }
+        return;
+    }
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    socklen_t addr_len = sizeof(addr);
+    int ttl = TTL;
+    int on = 1;
+    if (raw_) {
+        addr.sin_port = htons(getpid() & 0xFFFF);
+    } else if ((bind(sock_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+               (getsockname(sock_fd_, (struct sockaddr*)&addr, &addr_len) < 0)) {
+        printf("Icmp. Error. Can't get echo identifier. %s\n", strerror(errno));
+        close(sock_fd_);
+        sock_fd_ = -1;
+        return;
+    }
+    if ((setsockopt(sock_fd_, SOL_IP, IP_TTL, &ttl, sizeof(ttl)) != 0) ||
+        (setsockopt(sock_fd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0)) {
+        printf("Icmp. Error setting socket options. %s\n", strerror(errno));
+    } else {
+        id_ = addr.sin_port;
+        return;
+    }
+    close(sock_fd_);
+    sock_fd_ = -1;
+}
+
+IcmpSocket::~IcmpSocket() {
+    if (sock_fd_ >= 0) {
+        close(sock_fd_);
+        sock_fd_ = -1;
+    }
+}
+
+bool IcmpSocket::IsCreated() const noexcept {
+    return sock_fd_ >= 0;
+}
+
+bool IcmpSocket::IsRaw() const noexcept {
+    return raw_;
+}
+
+unsigned short IcmpSocket::GetId() const noexcept {
+    return id_;
+}
+
+int IcmpSocket::GetSocket() const noexcept {
+    return sock_fd_;
+}
+
+bool IcmpSocket::SetRcvBufSize(int size) noexcept {
+    if (setsockopt(sock_fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+        printf("Icmp. Error setting socket receive buffer size.\n");
+        return false;
+    }
+    return true;
+}
+
+/* Идентификатор и контрольную сумму датаграммного сокета заполняет ядро, для сырого - программа */
+bool IcmpSocket::Send(in_addr_t dst, unsigned short sequence) noexcept {
+    unsigned char pkt[PING_PKT_SIZE];
+    memset(pkt, 0, sizeof(pkt));
+    struct icmphdr* icmp_h = (struct icmphdr*)pkt;
+    icmp_h->type = ICMP_ECHO;
+    icmp_h->un.echo.sequence = sequence;
+    if (raw_) {
+        icmp_h->un.echo.id = id_;
+        icmp_h->checksum = checksum::Compute(pkt, sizeof(pkt));
+    }
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = dst;
+    for (;;) {
+        if (sendto(sock_fd_, pkt, sizeof(pkt), 0, (struct sockaddr*)&addr, sizeof(addr)) == (ssize_t)sizeof(pkt)) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/* Датаграммный сокет отдаёт ICMP сообщение без IP заголовка, сырой - с IP заголовком и весь ICMP трафик
+ * машины (ответы отбираются по идентификатору), адрес отправителя - в msg_name.
+ * Без ожидания читаются только ответы, уже лежащие в сокете; с ожиданием - один poll не дольше RECV_TIMEOUT_MS */
+int IcmpSocket::Receive(EchoReply* reply, bool wait) noexcept {
+    unsigned char buf[PING_PKT_SIZE * 3];
+    unsigned char control[CMSG_SPACE(sizeof(struct timespec))];
+    bool waited = false;
+    for (;;) {
+        struct sockaddr_in addr{};
+        struct iovec iov{buf, sizeof(buf)};
+        struct msghdr msg{};
+        msg.msg_name = &addr;
+        msg.msg_namelen = sizeof(addr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t len = recvmsg(sock_fd_, &msg, MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                return -1;
+            }
+            if (!wait || waited) {
+                return 0;
+            }
+            struct pollfd pfd{sock_fd_, POLLIN, 0};
+            int res = poll(&pfd, 1, RECV_TIMEOUT_MS);
+            if ((res < 0) && (errno != EINTR)) {
+                return -1;
+            }
+            waited = true;
+            continue;
+        }
+        const unsigned char* message = buf;
+        if (raw_) {
+            ssize_t ip_len = (len > 0) ? (buf[0] & 0x0F) * 4 : 0;
+            message += ip_len;
+            len -= ip_len;
+        }
+        const struct icmphdr* icmp_h = (const struct icmphdr*)message;
+        if ((len < (ssize_t)sizeof(struct icmphdr)) || (icmp_h->type != ICMP_ECHOREPLY) ||
+            (raw_ && (icmp_h->un.echo.id != id_))) {
+            continue;
+        }
+        reply->src = addr.sin_addr.s_addr;
+        reply->id = icmp_h->un.echo.id;
+        reply->sequence = icmp_h->un.echo.sequence;
+        reply->ts_ns = 0;
+        reply->has_mac = false;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                reply->ts_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+            }
+        }
+        return 1;
+    }
+}
+
+EchoBackend IcmpSocket::GetBackend() noexcept {
+    return EchoBackend{this, BackendGetId, BackendGetSocket, BackendSend, BackendReceive};
+}
+
+unsigned short IcmpSocket::BackendGetId(void* ctx) {
+    return ((IcmpSocket*)ctx)->GetId();
+}
+
+int IcmpSocket::BackendGetSocket(void* ctx) {
+    return ((IcmpSocket*)ctx)->GetSocket();
+}
+
+bool IcmpSocket::BackendSend(void* ctx, in_addr_t dst, unsigned short sequence) {
+    return ((IcmpSocket*)ctx)->Send(dst, sequence);
+}
+
+int IcmpSocket::BackendReceive(void* ctx, EchoReply* reply, bool wait) {
+    return ((IcmpSocket*)ctx)->Receive(reply, wait);
+}
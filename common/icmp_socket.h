@@ -0,0 +1,64 @@
+#pragma once
+/*
+ * Бэкенд ICMP echo на датаграммном ICMP сокете (SOCK_DGRAM, IPPROTO_ICMP), см. common/echo.h
+ *
+ * Сокет создаётся без прав суперпользователя, если группа процесса входит в net.ipv4.ping_group_range.
+ * Ядро назначает сокету свободный идентификатор (как номер порта при bind), подставляет его в каждый запрос
+ * и считает контрольную сумму. Принятые echo reply ядро раздаёт сокетам по идентификатору: процесс получает
+ * только свои ответы, сколько бы экземпляров ни работало параллельно, и не разбирает чужой ICMP трафик.
+ *
+ * Если датаграммный сокет запрещён (EACCES/EPERM - группа вне ping_group_range) и разрешён запасной вариант
+ * (raw_fallback), создаётся сырой ICMP сокет (SOCK_RAW, IPPROTO_ICMP, нужен CAP_NET_RAW): идентификатор
+ * берётся от pid процесса, контрольную сумму считает программа, ответы принимаются с IP заголовком
+ * и отбираются по идентификатору среди всего ICMP трафика машины.
+ *
+ * USAGE:
+ * IcmpSocket sock;  // если успешно создан, то IsCreated вернёт true (IcmpSocket sock(true) - с запасным сырым)
+ * sock.Send(inet_addr("192.168.1.1"), htons(1));
+ * EchoReply reply;
+ * int res = sock.Receive(&reply, true);  // 1 - ответ, 0 - нет ответа, -1 - ошибка
+ */
+#include "echo.h"
+
+class IcmpSocket {
+public:
+    static constexpr unsigned int PING_PKT_SIZE = 64;          // размер ICMP сообщения запроса
+    static constexpr unsigned int RECV_TIMEOUT_MS = 1000;      // ожидание ответа при Receive(..., true)
+    static constexpr int TTL = 64;
+
+    /* raw_fallback - при запрете датаграммного сокета использовать сырой */
+    explicit IcmpSocket(bool raw_fallback = false) noexcept;
+    ~IcmpSocket();
+
+    bool IsCreated() const noexcept;
+
+    /* Работает ли объект через сырой сокет (запасной вариант) */
+    bool IsRaw() const noexcept;
+
+    /* Идентификатор, назначенный ядром, либо от pid для сырого сокета (в сетевом порядке байт) */
+    unsigned short GetId() const noexcept;
+
+    int GetSocket() const noexcept;
+
+    /* Размер приёмного буфера сокета, возвращает true при успехе */
+    bool SetRcvBufSize(int size) noexcept;
+
+    /* Отправка echo request на dst с sequence (в сетевом порядке байт), возвращает true при успехе */
+    bool Send(in_addr_t dst, unsigned short sequence) noexcept;
+
+    /* Приём echo reply, возвращает 1 - ответ записан в reply, 0 - ответа нет, -1 - ошибка приёма */
+    int Receive(EchoReply* reply, bool wait) noexcept;
+
+    /* Набор функций общего интерфейса, ctx - этот объект */
+    EchoBackend GetBackend() noexcept;
+
+private:
+    static unsigned short BackendGetId(void* ctx);
+    static int BackendGetSocket(void* ctx);
+    static bool BackendSend(void* ctx, in_addr_t dst, unsigned short sequence);
+    static int BackendReceive(void* ctx, EchoReply* reply, bool wait);
+
+    int sock_fd_ = -1;
+    unsigned short id_ = 0;
+    bool raw_ = false;
+};
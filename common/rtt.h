@@ -0,0 +1,144 @@
+#pragma once
+/*
+ * Оценка RTT и срока ожидания ответа по Jacobson/Karels (RFC 6298)
+ *
+ * По каждому измерению R:
+ *   первое измерение:  SRTT = R, RTTVAR = R / 2
+ *   далее:             RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|,  SRTT = 7/8 SRTT + 1/8 R
+ *   срок ожидания:     RTO = SRTT + max(G, 4 RTTVAR), в пределах [MIN_RTO_NS, MAX_RTO_NS]
+ * Пока измерений нет, RTO = INITIAL_RTO_NS. Нижний предел ниже рекомендованной RFC секунды: цель - быстрый
+ * повтор запроса в локальной сети, а не защита канала от ложных повторов TCP.
+ * Измерение берётся только по ответу, однозначно сопоставленному с запросом (алгоритм Карна): если запросы
+ * повторов неразличимы (одинаковый sequence), RTT повторного запроса не измеряется.
+ *
+ * Повтор запроса ждёт RTO * 2^attempt (экспоненциальное увеличение) со случайным отклонением +-1/4 (jitter),
+ * чтобы повторы множества запросов, потерянных одновременно, не уходили одной пачкой.
+ *
+ * SubnetRtt - оценки по подсетям /24: цель без своих измерений получает срок ожидания по соседям
+ * из той же подсети. Таблица фиксированного размера с прямой адресацией по хэшу подсети, при совпадении
+ * слота старая подсеть вытесняется - память не выделяется, поиск O(1).
+ *
+ * Время - в наносекундах.
+ *
+ * USAGE:
+ * RttEstimator rtt;
+ * long long deadline = now + RttEstimator::Backoff(rtt.GetRto(), attempt, &seed);
+ * rtt.Sample(reply_ns - sent_ns);
+ *
+ * SubnetRtt subnets;
+ * subnets.Get(ip).Sample(rtt_ns);
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+class RttEstimator {
+public:
+    static constexpr long long INITIAL_RTO_NS = 1000000000LL;      // срок ожидания без измерений (1 с)
+    static constexpr long long MIN_RTO_NS = 10000000LL;            // нижний предел (10 мс)
+    static constexpr long long MAX_RTO_NS = 60000000000LL;         // верхний предел (60 с)
+    static constexpr long long GRANULARITY_NS = 1000000LL;         // G - точность часов ожидания (1 мс)
+
+    /* Учёт измерения rtt_ns, неположительные значения игнорируются */
+    void Sample(long long rtt_ns) noexcept {
+        if (rtt_ns <= 0) {
+            return;
+        }
+        if (samples_ == 0) {
+            srtt_ = rtt_ns;
+            rttvar_ = rtt_ns / 2;
+        } else {
+            long long delta = (srtt_ > rtt_ns) ? (srtt_ - rtt_ns) : (rtt_ns - srtt_);
+            rttvar_ = (3 * rttvar_ + delta) / 4;
+            srtt_ = (7 * srtt_ + rtt_ns) / 8;
+        }
+        ++samples_;
+    }
+
+    long long GetRto() const noexcept {
+        if (samples_ == 0) {
+            return INITIAL_RTO_NS;
+        }
+        long long rto = srtt_ + ((4 * rttvar_ > GRANULARITY_NS) ? 4 * rttvar_ : GRANULARITY_NS);
+        return (rto < MIN_RTO_NS) ? MIN_RTO_NS : ((rto > MAX_RTO_NS) ? MAX_RTO_NS : rto);
+    }
+
+    long long GetSrtt() const noexcept {
+        return srtt_;
+    }
+
+    long long GetRttvar() const noexcept {
+        return rttvar_;
+    }
+
+    unsigned int GetSamples() const noexcept {
+        return samples_;
+    }
+
+    /* Срок ожидания запроса номер attempt (0 - первый): rto * 2^attempt +-1/4, не более MAX_RTO_NS
+     * - seed - состояние генератора отклонений (xorshift32), не 0 */
+    static long long Backoff(long long rto, unsigned int attempt, unsigned int* seed) noexcept {
+        long long timeout = rto;
+        for (unsigned int i = 0; (i < attempt) && (timeout < MAX_RTO_NS); ++i) {
+            timeout *= 2;
+        }
+        if (timeout > MAX_RTO_NS) {
+            timeout = MAX_RTO_NS;
+        }
+        unsigned int x = *seed;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *seed = x;
+        // отклонение в [-timeout/4, timeout/4]
+        long long jitter = (long long)(x % 1025) - 512;
+        return timeout + timeout / 4 * jitter / 512;
+    }
+
+private:
+    long long srtt_ = 0;
+    long long rttvar_ = 0;
+    unsigned int samples_ = 0;
+};
+
+class SubnetRtt {
+public:
+    static constexpr unsigned int SLOT_BITS = 10;
+    static constexpr unsigned int SLOTS = 1 << SLOT_BITS;
+    static constexpr unsigned int PREFIX_LEN = 24;
+
+    /* Оценка подсети адреса ip (в сетевом порядке байт). Если слот занят другой подсетью,
+     * он отдаётся этой подсети с чистой оценкой */
+    RttEstimator& Get(in_addr_t ip) noexcept {
+        unsigned int subnet = Subnet(ip);
+        Slot& slot = slots_[Index(subnet)];
+        if (slot.subnet != subnet + 1) {
+            slot.subnet = subnet + 1;
+            slot.rtt = RttEstimator();
+        }
+        return slot.rtt;
+    }
+
+    /* Срок ожидания для ip: по оценке подсети, либо INITIAL_RTO_NS, если измерений по подсети нет */
+    long long GetRto(in_addr_t ip) const noexcept {
+        unsigned int subnet = Subnet(ip);
+        const Slot& slot = slots_[Index(subnet)];
+        return (slot.subnet == subnet + 1) ? slot.rtt.GetRto() : RttEstimator::INITIAL_RTO_NS;
+    }
+
+private:
+    struct Slot {
+        unsigned int subnet = 0;            // номер подсети + 1, 0 - слот свободен
+        RttEstimator rtt;
+    };
+
+    /* Номер подсети в порядке байт хоста: старшие PREFIX_LEN бит адреса */
+    static unsigned int Subnet(in_addr_t ip) noexcept {
+        return ntohl(ip) >> (32 - PREFIX_LEN);
+    }
+
+    static unsigned int Index(unsigned int subnet) noexcept {
+        return (subnet * 2654435761u) >> (32 - SLOT_BITS);
+    }
+
+    Slot slots_[SLOTS];
+};
@@ -0,0 +1,276 @@
+#include <errno.h>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "neighbor_table.h"
+
+namespace {
+constexpr int NL_BUF_SIZE = 32768;
+// состояния записи, в которых у неё есть MAC адрес
+constexpr unsigned short NUD_VALID_STATES = NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT | NUD_NOARP;
+
+struct DumpRequest {
+    struct nlmsghdr hdr;
+    struct ndmsg ndm;
+};
+}
+
+NeighborTable::NeighborTable() noexcept {
+    nl_fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl_fd_ < 0) {
+        printf("Neighbors. Error. Netlink socket not received!\n");
+        return;
+    }
+    unsigned int group = RTNLGRP_NEIGH;
+    if (setsockopt(nl_fd_, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+        printf("Neighbors. Error subscribing to netlink group %u.\n", group);
+        return;
+    }
+    if (Rehash(MIN_CAPACITY) && Dump()) {
+        created_ = true;
+    }
+}
+
+NeighborTable::~NeighborTable() {
+    if (nl_fd_ >= 0) {
+        close(nl_fd_);
+    }
+    free(entries_);
+}
+
+bool NeighborTable::IsCreated() const noexcept {
+    return created_;
+}
+
+int NeighborTable::GetSocket() const noexcept {
+    return nl_fd_;
+}
+
+unsigned int NeighborTable::Slot(in_addr_t ip) const noexcept {
+    unsigned int h = ip * 2654435761u;
+    h ^= h >> 15;
+    return h & (capacity_ - 1);
+}
+
+/* Полное перечитывание таблицы: записи, полученные до дампа, отбрасываются */
+bool NeighborTable::Dump() noexcept {
+    memset(entries_, 0, capacity_ * sizeof(Entry));
+    count_ = 0;
+
+    DumpRequest req{};
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    req.hdr.nlmsg_type = RTM_GETNEIGH;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.hdr.nlmsg_seq = ++seq_;
+    req.ndm.ndm_family = AF_INET;
+    if (send(nl_fd_, &req, req.hdr.nlmsg_len, 0) < 0) {
+        printf("Neighbors. Error sending netlink dump request. %s\n", strerror(errno));
+        return false;
+    }
+
+    char* buf = (char*)malloc(NL_BUF_SIZE);
+    if (buf == nullptr) {
+        printf("Neighbors. Error. Not enough memory.\n");
+        return false;
+    }
+    int done = 0;
+    while (done == 0) {
+        int len = recv(nl_fd_, buf, NL_BUF_SIZE, 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Neighbors. Error receiving netlink dump. %s\n", strerror(errno));
+            done = -1;
+            break;
+        }
+        done = ProcessMessages(buf, len);
+    }
+    free(buf);
+    return done > 0;
+}
+
+bool NeighborTable::Update() noexcept {
+    char buf[NL_BUF_SIZE];
+    for (;;) {
+        int len = recv(nl_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                // уведомления потеряны - состояние таблицы неизвестно, перечитываем
+                return Dump();
+            }
+            printf("Neighbors. Error receiving netlink notification. %s\n", strerror(errno));
+            return false;
+        }
+        if (ProcessMessages(buf, len) < 0) {
+            return false;
+        }
+    }
+}
+
+int NeighborTable::ProcessMessages(const char* buf, int len) noexcept {
+    for (const struct nlmsghdr* nh = (const struct nlmsghdr*)buf; NLMSG_OK(nh, (unsigned int)len); nh = NLMSG_NEXT(nh, len)) {
+        switch (nh->nlmsg_type) {
+        case NLMSG_DONE:
+            return 1;
+        case NLMSG_ERROR: {
+            const struct nlmsgerr* err = (const struct nlmsgerr*)NLMSG_DATA(nh);
+            if (err->error != 0) {
+                printf("Neighbors. Netlink error. %s\n", strerror(-err->error));
+                return -1;
+            }
+            break;
+        }
+        case RTM_NEWNEIGH:
+        case RTM_DELNEIGH:
+            OnNeigh(nh);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Запись без MAC адреса (INCOMPLETE, FAILED) и удалённая запись снимают адрес с того же интерфейса */
+void NeighborTable::OnNeigh(const struct nlmsghdr* nh) noexcept {
+    const struct ndmsg* ndm = (const struct ndmsg*)NLMSG_DATA(nh);
+    if (ndm->ndm_family != AF_INET) {
+        return;
+    }
+    in_addr_t ip = 0;
+    const unsigned char* mac = nullptr;
+    int attr_len = RTM_PAYLOAD(nh);
+    for (const struct rtattr* rta = RTM_RTA(ndm); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        if ((rta->rta_type == NDA_DST) && (RTA_PAYLOAD(rta) == sizeof(ip))) {
+            memcpy(&ip, RTA_DATA(rta), sizeof(ip));
+        } else if ((rta->rta_type == NDA_LLADDR) && (RTA_PAYLOAD(rta) == ETH_ALEN)) {
+            mac = (const unsigned char*)RTA_DATA(rta);
+        }
+    }
+    if (ip == 0) {
+        return;
+    }
+    if ((nh->nlmsg_type == RTM_NEWNEIGH) && (ndm->ndm_state & NUD_VALID_STATES) && (mac != nullptr)) {
+        Insert(ip, mac, ndm->ndm_ifindex);
+    } else {
+        Remove(ip, ndm->ndm_ifindex);
+    }
+}
+
+bool NeighborTable::Rehash(unsigned int capacity) noexcept {
+    unsigned int new_capacity = MIN_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    Entry* entries = (Entry*)calloc(new_capacity, sizeof(Entry));
+    if (entries == nullptr) {
+        printf("Neighbors. Error. Not enough memory.\n");
+        return false;
+    }
+    Entry* old_entries = entries_;
+    unsigned int old_capacity = capacity_;
+    entries_ = entries;
+    capacity_ = new_capacity;
+
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int j = 0; j < old_capacity; ++j) {
+        if (old_entries[j].ip == 0) {
+            continue;
+        }
+        unsigned int i = Slot(old_entries[j].ip);
+        while (entries_[i].ip != 0) {
+            i = (i + 1) & mask;
+        }
+        entries_[i] = old_entries[j];
+    }
+    free(old_entries);
+    return true;
+}
+
+bool NeighborTable::Insert(in_addr_t ip, const unsigned char* mac, int if_index) noexcept {
+    // заполнение не более 3/4, иначе цепочки пробирования становятся длинными
+    if (((count_ + 1) * 4 > capacity_ * 3) && !Rehash((count_ + 1) * 2)) {
+        return false;
+    }
+    unsigned int mask = capacity_ - 1;
+    unsigned int i = Slot(ip);
+    while ((entries_[i].ip != 0) && (entries_[i].ip != ip)) {
+        i = (i + 1) & mask;
+    }
+    if (entries_[i].ip == 0) {
+        entries_[i].ip = ip;
+        ++count_;
+    }
+    entries_[i].if_index = if_index;
+    memcpy(entries_[i].mac, mac, ETH_ALEN);
+    return true;
+}
+
+/* Снятие записи со сдвигом назад: следующие записи цепочки, которые могли бы стоять на месте снятой
+ * (их слот не лежит циклически между снятой записью и ими), переносятся на освободившееся место */
+void NeighborTable::Remove(in_addr_t ip, int if_index) noexcept {
+    unsigned int mask = capacity_ - 1;
+    unsigned int i = Slot(ip);
+    while ((entries_[i].ip != 0) && (entries_[i].ip != ip)) {
+        i = (i + 1) & mask;
+    }
+    if ((entries_[i].ip == 0) || (entries_[i].if_index != if_index)) {
+        return;
+    }
+    entries_[i].ip = 0;
+    --count_;
+    for (unsigned int j = (i + 1) & mask; entries_[j].ip != 0; j = (j + 1) & mask) {
+        unsigned int home = Slot(entries_[j].ip);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            entries_[i] = entries_[j];
+            entries_[j].ip = 0;
+            i = j;
+        }
+    }
+}
+
+bool NeighborTable::Find(in_addr_t ip, unsigned char* mac, int* if_index) const noexcept {
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int i = Slot(ip); entries_[i].ip != 0; i = (i + 1) & mask) {
+        if (entries_[i].ip == ip) {
+            memcpy(mac, entries_[i].mac, ETH_ALEN);
+            if (if_index != nullptr) {
+                *if_index = entries_[i].if_index;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int NeighborTable::FindAll(const in_addr_t* ips, unsigned int count, Result* results) const noexcept {
+    unsigned int found = 0;
+    for (unsigned int k = 0; k < count; ++k) {
+        Result& result = results[k];
+        result.ip = ips[k];
+        result.if_index = 0;
+        memset(result.mac, 0, ETH_ALEN);
+        result.found = Find(ips[k], result.mac, &result.if_index);
+        if (result.found) {
+            ++found;
+        }
+    }
+    return found;
+}
+
+unsigned int NeighborTable::GetCount() const noexcept {
+    return count_;
+}
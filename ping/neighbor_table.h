@@ -0,0 +1,84 @@
+#pragma once
+/*
+ * Таблица соседей ядра (ARP кэш) IPv4 -> MAC в памяти процесса
+ *
+ * Заполняется один раз дампом rtnetlink (RTM_GETNEIGH) и далее поддерживается в актуальном состоянии
+ * по уведомлениям группы RTNLGRP_NEIGH (RTM_NEWNEIGH / RTM_DELNEIGH): подписка - до дампа, чтобы не пропустить
+ * изменения, случившиеся во время дампа. При переполнении очереди уведомлений таблица перечитывается целиком.
+ * Вместо ioctl SIOCGARP на каждую пару (адрес, интерфейс) - один дамп на все адреса, поиск - обращение
+ * к таблице в памяти без системных вызовов.
+ *
+ * Хранятся только записи с MAC адресом (состояния REACHABLE, STALE, DELAY, PROBE, PERMANENT, NOARP):
+ * записи INCOMPLETE и FAILED адреса не дают. Открытая адресация с линейным пробированием, заполнение
+ * не более 3/4, удаление - со сдвигом следующих записей цепочки назад (без "надгробий").
+ * Если адрес известен на нескольких интерфейсах, хранится последняя изменившаяся запись.
+ *
+ * USAGE:
+ * NeighborTable table; // если успешно создана, то IsCreated вернёт true
+ * table.Update();      // уведомления, накопившиеся с момента дампа
+ * unsigned char mac[ETH_ALEN];
+ * if (table.Find(inet_addr("192.168.1.1"), mac)) { ... }
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+class NeighborTable {
+public:
+    static constexpr unsigned int MIN_CAPACITY = 256;
+
+    /* Результат пакетного поиска */
+    struct Result {
+        in_addr_t ip;                       // в сетевом порядке байт
+        bool found;
+        unsigned char mac[ETH_ALEN];
+        int if_index;                       // интерфейс записи, 0 если адрес не найден
+    };
+
+    NeighborTable() noexcept;
+    ~NeighborTable();
+
+    bool IsCreated() const noexcept;
+
+    /* Обработка накопившихся уведомлений без блокировки
+     * возвращает true при успехе */
+    bool Update() noexcept;
+
+    /* Сокет уведомлений - для добавления в цикл событий */
+    int GetSocket() const noexcept;
+
+    /* Поиск MAC адреса ip (в сетевом порядке байт)
+     * - if_index - интерфейс записи (если не nullptr)
+     * возвращает false, если записи с MAC адресом нет */
+    bool Find(in_addr_t ip, unsigned char* mac, int* if_index = nullptr) const noexcept;
+
+    /* Поиск count адресов ips (без системных вызовов), результаты - в results в порядке адресов
+     * возвращает количество найденных адресов */
+    unsigned int FindAll(const in_addr_t* ips, unsigned int count, Result* results) const noexcept;
+
+    /* Количество записей */
+    unsigned int GetCount() const noexcept;
+
+private:
+    struct Entry {
+        in_addr_t ip;                       // 0 - слот свободен
+        int if_index;
+        unsigned char mac[ETH_ALEN];
+        unsigned short reserved;
+    };
+
+    bool Dump() noexcept;
+    /* разбор сообщений в буфере, возвращает 1 если встретился конец дампа, -1 при ошибке */
+    int ProcessMessages(const char* buf, int len) noexcept;
+    void OnNeigh(const struct nlmsghdr* nh) noexcept;
+    bool Insert(in_addr_t ip, const unsigned char* mac, int if_index) noexcept;
+    void Remove(in_addr_t ip, int if_index) noexcept;
+    bool Rehash(unsigned int capacity) noexcept;
+    unsigned int Slot(in_addr_t ip) const noexcept;
+
+    bool created_ = false;
+    int nl_fd_ = -1;
+    unsigned int seq_ = 0;
+    Entry* entries_ = nullptr;
+    unsigned int capacity_ = 0;             // степень двойки
+    unsigned int count_ = 0;
+};
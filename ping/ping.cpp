@@ -13,15 +13,19 @@ bool CheckIPv4Valid(const char *ip) {
 }
 /*
  * Разбор опций командной строки
- * В опциях командной строки ожидается один IPv4 адрес, если есть другие опции, то они игнорируются
- * Возвращает IPv4 адрес в бинарном формате
+ * В опциях командной строки ожидается один или несколько IPv4 адресов
  */
 bool OptionsParsing(int argc, char **argv) {
     if (argc < 2) {
         printf("Command error. The required parameter is not set - IPv4 address\n");
         return false;
     }
-    return CheckIPv4Valid(argv[1]);
+    for (int i = 1; i < argc; ++i) {
+        if (!CheckIPv4Valid(argv[i])) {
+            return false;
+        }
+    }
+    return true;
 }
 
 int main(int argc, char *argv[]) {
@@ -30,7 +34,7 @@ int main(int argc, char *argv[]) {
     }
 
     Ping ping;
-    if (!ping.IsCreated() || !(ping.Do(argv[1]))) {
+    if (!ping.IsCreated() || !(ping.Do(argv + 1, argc - 1))) {
         return EXIT_FAILURE;
     }
 
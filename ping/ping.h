@@ -10,187 +10,125 @@
  * Программа должна быть написана под Linux.
  */
 #include <arpa/inet.h>
-#include <ifaddrs.h>
-#include <linux/if_arp.h>
+#include <errno.h>
 #include <netinet/in.h>
-#include <netinet/ip_icmp.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <unistd.h>
 
-constexpr unsigned int PING_PKT_SIZE = 64;  // ping packet size
-constexpr unsigned int PORT_NUMBER = 0;     // automatic port number
-constexpr unsigned int RECV_TIMEOUT = 1;    // timeout for receiving packets (in seconds)
+#include "../common/echo_retry.h"
+#include "../common/icmp_socket.h"
+#include "neighbor_table.h"
 
-namespace {
-    /* Вычисляем контрольную сумму (RFC 1071) */
-    unsigned short Checksum(void *b, int len) {
-        unsigned short *buf = (unsigned short*)b;
-        unsigned int sum = 0;
+/*
+ * Класс, реализующий выполнение ICMP запросов
+ * Запрос уходит через датаграммный ICMP сокет (common/icmp_socket.h): права суперпользователя не нужны,
+ * если группа процесса входит в net.ipv4.ping_group_range, ядро само назначает идентификатор запроса
+ * и отдаёт сокету только ответы с ним - параллельно работающие экземпляры не перехватывают чужие ответы.
+ * Если датаграммный сокет запрещён (EACCES/EPERM), запросы идут через сырой ICMP сокет (нужен CAP_NET_RAW).
+ * MAC адрес из ответа на этом уровне не виден: после ответов адреса ищутся в таблице соседей ядра, которая
+ * читается один раз дампом rtnetlink и обновляется по уведомлениям (NeighborTable) - без ioctl SIOCGARP
+ * на каждую пару адрес-интерфейс, поэтому адресов может быть много.
+ * Запросы ко всем адресам идут конвейером в одном цикле (EchoRetry::RunAll), сроки повторов - по общей оценке
+ * RTT подсети /24 (SubnetRtt): адреса одной сети получают срок по уже ответившим соседям.
+ * USAGE:
+ * Ping ping; // если успешно создан, то IsCreated вернёт true
+ * ping.Do(ips, count); // выведет MAC адреса и вернёт true при успешном получении всех MAC адресов
+ */
+class Ping {
+public:
+    bool IsCreated() const noexcept {
+        return sock_.IsCreated() && neighbors_.IsCreated();
+    }
 
-        for (; len > 1; len -= 2) {
-            sum += *buf++;
-        }
-        if (len == 1) {
-            sum += *(unsigned char *)buf;
+    /* Запросы ко всем count адресам ips (строки IPv4) конвейером, затем поиск всех ответивших в таблице соседей
+     * Для одного адреса выводится только MAC адрес, для нескольких - строки "IPv4 MAC" */
+    bool Do(char** ips, int count) noexcept {
+        if (!IsCreated()) {
+            return false;
         }
-        sum = (sum >> 16) + (sum & 0xFFFF);
-        sum += (sum >> 16);
-        return ~sum;
-    }
-    /* Получаем MAC адрес
-     * - Задаем IP для поиска в ARP-таблице
-     * - получаем список всех интерфейсов
-     * - Запрашиваем ARP-запись для каждого из интерфейсов
-     * Для правильной работы ioctl(..., SIOCGARP, ...) требуется указать корретное имя сетевого устройства.
-     * Но мы не можем получить ни MAC адрес ни имя сетевого интерфейса из ICMP ответа, поэтому
-     * перебираем все интерфейсы в поисках нужного.
-     * Нужным считаем первый интефейс, с положительным результатом выполнения ioctl */
-    bool GetMac(const struct in_addr &ping_ip, unsigned char* hw_addr) {
-        int arp_sock = socket(AF_INET, SOCK_DGRAM, 0);
-        if (arp_sock < 0) {
-            printf("Error. Socket file descriptor for ARP not received!\n");
+        EchoRetry::Target* targets = (EchoRetry::Target*)calloc(count, sizeof(EchoRetry::Target) +
+                                                                    sizeof(NeighborTable::Result) + sizeof(in_addr_t));
+        if (targets == nullptr) {
+            printf("Error. Not enough memory.\n");
             return false;
         }
-
-        struct ifaddrs *ifaddr;
-        if (getifaddrs(&ifaddr) < 0) {
-            printf("Error. Can't receive interfaces!\n");
+        NeighborTable::Result* results = (NeighborTable::Result*)(targets + count);
+        in_addr_t* addrs = (in_addr_t*)(results + count);
+        for (int i = 0; i < count; ++i) {
+            targets[i].dst = inet_addr(ips[i]);
+        }
+        // все адреса опрашиваются в одном цикле, запросы повторяются по оценке RTT подсети, пока у адреса
+        // не исчерпан бюджет времени (common/echo_retry.h)
+        EchoRetry retry(sock_.GetBackend(), EchoRetry::DEFAULT_BUDGET_MS);
+        if (retry.RunAll(targets, count, subnets_) < 0) {
+            free(targets);
             return false;
         }
-
-        struct arpreq req;
-        memset(&req, 0, sizeof(req));
-        ((struct sockaddr_in *)&req.arp_pa)->sin_family = AF_INET;
-        ((struct sockaddr_in *)&req.arp_pa)->sin_addr = ping_ip;
-        ((struct sockaddr_in *)&req.arp_ha)->sin_family = ARPHRD_ETHER;
-
-        bool found = false;
-        for (struct ifaddrs *ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-            if (ifa->ifa_addr == NULL) {
+        bool ok = true;
+        int replied = 0;
+        for (int i = 0; i < count; ++i) {
+            if ((targets[i].status < 0) && !IsAddressError(targets[i].error)) {
+                printf("ICMP packet sending failed! %s\n", strerror(targets[i].error));
+                free(targets);
+                return false;
+            }
+            if (targets[i].status < 0) {
+                char error[128];
+                snprintf(error, sizeof(error), "Error. Request not sent. %s", strerror(targets[i].error));
+                Report(ips[i], count, error);
+                ok = false;
                 continue;
             }
-            strncpy(req.arp_dev, ifa->ifa_name, 15);
-
-            if (ioctl(arp_sock, SIOCGARP, (caddr_t)&req) < 0) {
+            if (targets[i].status == 0) {
+                Report(ips[i], count, "Error. Host unreachable");
+                ok = false;
                 continue;
-            } else {
-                found = true;
-                break;
             }
+            addrs[replied++] = targets[i].dst;
         }
-        freeifaddrs(ifaddr);
 
-        if (!found) {
-            printf("Error. Failed to get MAC address from ARP table\n");
-            close(arp_sock);
+        // записи, появившиеся за время запросов, приходят уведомлениями - таблица не перечитывается
+        if (!neighbors_.Update()) {
+            free(targets);
             return false;
         }
-        close(arp_sock);
-        memcpy(hw_addr, (unsigned char *)req.arp_ha.sa_data, sizeof(req.arp_ha.sa_data));
-        return true;
-    }
-}
-/*
- * Класс, реализующий выполнение ICMP запроса
- * USAGE:
- * Ping ping; // если успешно создан, то IsCreated вернёт true
- * ping.Do(); // выведет MAC адрес и вернёт true при успешном получении MAC адреса
- */
-class Ping {
-public:
-    /* Настраиваем TTL = 64, таймаут ответа = 1 секунда */
-    Ping() {
-        sock_fd_ = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-        if (sock_fd_ < 0) {
-            printf("Error. Socket file descriptor not received!\n");
-        } else {
-            int ttl_val = 64;
-            if (setsockopt(sock_fd_, SOL_IP, IP_TTL, &ttl_val, sizeof(ttl_val)) != 0) {
-                printf("Error. Setting socket options to TTL failed!\n");
-                close(sock_fd_);
-            } else {
-                struct timeval tv_out{RECV_TIMEOUT, 0};
-                if (setsockopt(sock_fd_, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv_out, sizeof(tv_out)) != 0) {
-                    printf("Error. Setting socket options to receive timeout failed!\n");
-                    close(sock_fd_);
-                } else {
-                    created_ = true;
-                }
-            }
-        }
-    }
-    ~Ping() {
-        if (created_) {
-            created_= false;
-            close(sock_fd_);
-        }
-    }
-
-    bool IsCreated() const noexcept {
-        return created_;
-    }
-
-    bool Do(char* ip) noexcept {
-        if (created_) {
-            struct in_addr ping_ip;
-            inet_aton(ip, &ping_ip);
-            struct sockaddr_in ping_addr{AF_INET, htons(PORT_NUMBER), ping_ip};
-
-            auto id = getpid() & 0xFFFF;
-            if (!SendICMPRequest(id, &ping_addr)) {
-                return false;
-            }
-            if (!RcvICMPReply(id)) {
-                return false;
+        neighbors_.FindAll(addrs, replied, results);
+        for (int i = 0; i < replied; ++i) {
+            char addr[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &results[i].ip, addr, sizeof(addr));
+            if (!results[i].found) {
+                Report(addr, count, "Error. Failed to get MAC address from ARP table");
+                ok = false;
+                continue;
             }
-            unsigned char hw[sizeof(arpreq::arp_ha.sa_data)];
-            if (!GetMac(ping_ip, hw)) {
-                return false;
+            const unsigned char* hw = results[i].mac;
+            if (count > 1) {
+                printf("%s ", addr);
             }
             printf("%02x:%02x:%02x:%02x:%02x:%02x\n", hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
-            return true;
-        } else {
-            return false;
         }
+        free(targets);
+        return ok;
     }
 
 private:
-    struct PingPkt {
-        struct icmphdr hdr;
-        char msg[PING_PKT_SIZE - sizeof(struct icmphdr)];
-    };
-
-    bool SendICMPRequest(unsigned short id, const struct sockaddr_in* ping_addr) noexcept {
-        struct PingPkt pckt;
-        memset(&pckt, 0, sizeof(pckt));
-        pckt.hdr.type = ICMP_ECHO;
-        pckt.hdr.un.echo.id = id;
-        pckt.hdr.un.echo.sequence = 0;
-        pckt.hdr.checksum = Checksum(&pckt, sizeof(pckt));
-        if (sendto(sock_fd_, &pckt, sizeof(pckt), 0, (struct sockaddr *)ping_addr, sizeof(*ping_addr)) <= 0) {
-            printf("Error. Packet Sending Failed!\n");
-            close(sock_fd_);
-            return false;
-        }
-        return true;
+    /* Ошибка отправки, которая относится только к этому адресу (нет маршрута, широковещательный адрес,
+     * запрет правилами фильтрации) - остальные адреса опрашиваются дальше */
+    static bool IsAddressError(int err) noexcept {
+        return (err == ENETUNREACH) || (err == EHOSTUNREACH) || (err == EACCES) || (err == EPERM);
     }
 
-    bool RcvICMPReply(unsigned short id) noexcept {
-        struct sockaddr_in remote_addr{};
-        char rcv_buf[128];
-        socklen_t addr_len = sizeof(remote_addr);
-        if (recvfrom(sock_fd_, rcv_buf, sizeof(rcv_buf), 0, (struct sockaddr *)&remote_addr, &addr_len) <= 0) {
-            printf("Error. Packet receive failed!\n");
-            close(sock_fd_);
-            return false;
+    /* Ошибка по адресу: для нескольких адресов - с адресом в начале строки */
+    static void Report(const char* ip, int count, const char* error) noexcept {
+        if (count > 1) {
+            printf("%s %s\n", ip, error);
+        } else {
+            printf("%s\n", error);
         }
-        return true;
     }
 
-    bool created_ = false;
-    int sock_fd_;
+    IcmpSocket sock_{true};                 // с запасным сырым сокетом
+    NeighborTable neighbors_;
+    SubnetRtt subnets_;                     // оценки RTT подсетей /24, общие для всех адресов
 };
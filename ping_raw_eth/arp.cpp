@@ -0,0 +1,312 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/ether.h>
+#include <netinet/if_ether.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arp.h"
+#include "ethernet.h"
+#include "utils.h"
+
+namespace {
+constexpr unsigned int MIN_CAPACITY = 64;
+}
+
+NeighborCache::~NeighborCache() {
+    free(entries_);
+}
+
+unsigned int NeighborCache::Slot(in_addr_t ip) const noexcept {
+    unsigned int h = ip * 2654435761u;
+    h ^= h >> 15;
+    return h & (capacity_ - 1);
+}
+
+NeighborCache::State NeighborCache::Lookup(in_addr_t ip, unsigned char* mac, long long now) const noexcept {
+    if (capacity_ == 0) {
+        return State::NONE;
+    }
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int i = Slot(ip); entries_[i].ip != 0; i = (i + 1) & mask) {
+        if (entries_[i].ip != ip) {
+            continue;
+        }
+        if (entries_[i].expires <= now) {
+            return State::NONE;
+        }
+        if ((entries_[i].state == State::REACHABLE) && (mac != nullptr)) {
+            memcpy(mac, entries_[i].mac, ETH_ALEN);
+        }
+        return entries_[i].state;
+    }
+    return State::NONE;
+}
+
+/* Перенос действующих записей в новую таблицу, просроченные записи отбрасываются */
+bool NeighborCache::Rehash(unsigned int capacity, long long now) noexcept {
+    unsigned int new_capacity = MIN_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    Entry* entries = (Entry*)calloc(new_capacity, sizeof(Entry));
+    if (entries == nullptr) {
+        printf("ARP. Error. Not enough memory for neighbor cache.\n");
+        return false;
+    }
+    Entry* old_entries = entries_;
+    unsigned int old_capacity = capacity_;
+    entries_ = entries;
+    capacity_ = new_capacity;
+    count_ = 0;
+
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int j = 0; j < old_capacity; ++j) {
+        const Entry& entry = old_entries[j];
+        if ((entry.ip == 0) || (entry.expires <= now)) {
+            continue;
+        }
+        unsigned int i = Slot(entry.ip);
+        while (entries_[i].ip != 0) {
+            i = (i + 1) & mask;
+        }
+        entries_[i] = entry;
+        ++count_;
+    }
+    free(old_entries);
+    return true;
+}
+
+NeighborCache::Entry* NeighborCache::Insert(in_addr_t ip, long long now) noexcept {
+    // заполнение не более 3/4, иначе цепочки пробирования становятся длинными
+    if (((count_ + 1) * 4 > capacity_ * 3) && !Rehash((count_ + 1) * 2, now)) {
+        return nullptr;
+    }
+    unsigned int mask = capacity_ - 1;
+    unsigned int i = Slot(ip);
+    while ((entries_[i].ip != 0) && (entries_[i].ip != ip)) {
+        i = (i + 1) & mask;
+    }
+    if (entries_[i].ip == 0) {
+        entries_[i].ip = ip;
+        ++count_;
+    }
+    return &entries_[i];
+}
+
+bool NeighborCache::SetReachable(in_addr_t ip, const unsigned char* mac, long long now) noexcept {
+    Entry* entry = Insert(ip, now);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->state = State::REACHABLE;
+    entry->expires = now + REACHABLE_TTL_NS;
+    memcpy(entry->mac, mac, ETH_ALEN);
+    return true;
+}
+
+bool NeighborCache::Refresh(in_addr_t ip, const unsigned char* mac, long long now) noexcept {
+    if (capacity_ == 0) {
+        return false;
+    }
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int i = Slot(ip); entries_[i].ip != 0; i = (i + 1) & mask) {
+        if (entries_[i].ip != ip) {
+            continue;
+        }
+        if (entries_[i].expires <= now) {
+            return false;
+        }
+        entries_[i].state = State::REACHABLE;
+        entries_[i].expires = now + REACHABLE_TTL_NS;
+        memcpy(entries_[i].mac, mac, ETH_ALEN);
+        return true;
+    }
+    return false;
+}
+
+bool NeighborCache::SetFailed(in_addr_t ip, long long now) noexcept {
+    Entry* entry = Insert(ip, now);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->state = State::FAILED;
+    entry->expires = now + FAILED_TTL_NS;
+    memset(entry->mac, 0, ETH_ALEN);
+    return true;
+}
+
+bool NeighborCache::SetIncomplete(in_addr_t ip, long long now) noexcept {
+    Entry* entry = Insert(ip, now);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->state = State::INCOMPLETE;
+    entry->expires = now + INCOMPLETE_TTL_NS;
+    memset(entry->mac, 0, ETH_ALEN);
+    return true;
+}
+
+bool NeighborCache::Reserve(unsigned int count) noexcept {
+    if (count * 4 <= capacity_ * 3) {
+        return true;
+    }
+    return Rehash(count * 2, utils::MonotonicNs());
+}
+
+unsigned int NeighborCache::GetCount() const noexcept {
+    return count_;
+}
+
+ArpResolver::ArpResolver(EthernetProtocol& ether) noexcept : ether_(ether) {
+}
+
+/* ARP запрос: кто имеет ip? Сообщить MAC адресу интерфейса if_name */
+int ArpResolver::BuildRequest(unsigned char* buf, in_addr_t ip, const char* if_name) const noexcept {
+    const InterfaceTable::Interface* iface = ether_.GetInterfaces().FindByName(if_name);
+    if (iface == nullptr) {
+        printf("ARP. Error. Interface %s not found.\n", if_name);
+        return -1;
+    }
+    struct ether_arp* arp = (struct ether_arp*)buf;
+    arp->arp_hrd = htons(ARPHRD_ETHER);
+    arp->arp_pro = htons(ETH_P_IP);
+    arp->arp_hln = ETH_ALEN;
+    arp->arp_pln = sizeof(in_addr_t);
+    arp->arp_op = htons(ARPOP_REQUEST);
+    memcpy(arp->arp_sha, iface->mac, ETH_ALEN);
+    memcpy(arp->arp_spa, &iface->ip, sizeof(in_addr_t));
+    memset(arp->arp_tha, 0, ETH_ALEN);
+    memcpy(arp->arp_tpa, &ip, sizeof(in_addr_t));
+    return sizeof(*arp);
+}
+
+bool ArpResolver::SendRequest(in_addr_t ip, const char* if_name) noexcept {
+    unsigned char buf[sizeof(struct ether_arp)];
+    int len = BuildRequest(buf, ip, if_name);
+    return (len > 0) && ether_.SendRequest(buf, len, if_name, nullptr, ETH_P_ARP);
+}
+
+bool ArpResolver::QueueRequest(in_addr_t ip, const char* if_name) noexcept {
+    unsigned char buf[sizeof(struct ether_arp)];
+    int len = BuildRequest(buf, ip, if_name);
+    return (len > 0) && ether_.QueueRequest(buf, len, if_name, nullptr, ETH_P_ARP);
+}
+
+/* Адрес отправителя ответа запоминается как разрешённый. Запрос не подтверждает, что мы можем достучаться
+ * до отправителя, и его адреса могут быть подделаны, поэтому по запросу обновляется только уже известная запись */
+bool ArpResolver::HandlePacket(const unsigned char* data, int len, in_addr_t* sender_ip,
+                               const unsigned char** sender_mac) noexcept {
+    if (len < (int)sizeof(struct ether_arp)) {
+        return false;
+    }
+    const struct ether_arp* arp = (const struct ether_arp*)data;
+    if ((arp->arp_hrd != htons(ARPHRD_ETHER)) || (arp->arp_pro != htons(ETH_P_IP)) ||
+        (arp->arp_hln != ETH_ALEN) || (arp->arp_pln != sizeof(in_addr_t))) {
+        return false;
+    }
+    unsigned short op = ntohs(arp->arp_op);
+    if ((op != ARPOP_REQUEST) && (op != ARPOP_REPLY)) {
+        return false;
+    }
+    in_addr_t ip;
+    memcpy(&ip, arp->arp_spa, sizeof(ip));
+    if (ip == 0) {
+        // проверка адреса (RFC 5227) - у отправителя ещё нет адреса
+        return false;
+    }
+    if (op == ARPOP_REPLY) {
+        cache_.SetReachable(ip, arp->arp_sha, utils::MonotonicNs());
+    } else {
+        cache_.Refresh(ip, arp->arp_sha, utils::MonotonicNs());
+    }
+    if (sender_ip != nullptr) {
+        *sender_ip = ip;
+    }
+    if (sender_mac != nullptr) {
+        *sender_mac = arp->arp_sha;
+    }
+    return true;
+}
+
+int ArpResolver::Resolve(in_addr_t ip, const char* if_name, unsigned char* mac) noexcept {
+    switch (cache_.Lookup(ip, mac, utils::MonotonicNs())) {
+    case NeighborCache::State::REACHABLE:
+        return 0;
+    case NeighborCache::State::FAILED:
+        return 1;
+    default:
+        break;
+    }
+    if (!ether_.BindInterface(if_name)) {
+        return -1;
+    }
+
+    for (unsigned int attempt = 0; attempt < ATTEMPTS; ++attempt) {
+        if (!SendRequest(ip, if_name)) {
+            return -1;
+        }
+        long long deadline = utils::MonotonicNs() + TIMEOUT_MS * 1000000LL;
+        for (;;) {
+            long long now = utils::MonotonicNs();
+            if (now >= deadline) {
+                break;
+            }
+            const unsigned char* frame;
+            int frame_len = ether_.RcvFrameView(&frame, false);
+            if (frame_len < 0) {
+                printf("ARP. Packet receive failed!\n");
+                return -1;
+            }
+            if (frame_len == 0) {
+                struct pollfd pfd{ether_.GetSocket(), POLLIN, 0};
+                if ((poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000)) < 0) && (errno != EINTR)) {
+                    printf("ARP. Packet receive failed!\n");
+                    return -1;
+                }
+                continue;
+            }
+            const struct ether_header* eth_h = (const struct ether_header*)frame;
+            in_addr_t sender = 0;
+            const unsigned char* sender_mac = nullptr;
+            if ((frame_len > (int)sizeof(*eth_h)) && (eth_h->ether_type == htons(ETH_P_ARP)) &&
+                HandlePacket(frame + sizeof(*eth_h), frame_len - sizeof(*eth_h), &sender, &sender_mac) &&
+                (sender == ip)) {
+                memcpy(mac, sender_mac, ETH_ALEN);
+                return 0;
+            }
+        }
+    }
+    cache_.SetFailed(ip, utils::MonotonicNs());
+    return 1;
+}
+
+bool ArpResolver::Lookup(in_addr_t ip, unsigned char* mac) const noexcept {
+    return cache_.Lookup(ip, mac, utils::MonotonicNs()) == NeighborCache::State::REACHABLE;
+}
+
+bool ArpResolver::LookupOrQueue(in_addr_t ip, const char* if_name, unsigned char* mac) noexcept {
+    return LookupOrRequest(ip, if_name, mac, true);
+}
+
+bool ArpResolver::LookupOrSend(in_addr_t ip, const char* if_name, unsigned char* mac) noexcept {
+    return LookupOrRequest(ip, if_name, mac, false);
+}
+
+bool ArpResolver::LookupOrRequest(in_addr_t ip, const char* if_name, unsigned char* mac, bool queue) noexcept {
+    long long now = utils::MonotonicNs();
+    NeighborCache::State state = cache_.Lookup(ip, mac, now);
+    if (state == NeighborCache::State::REACHABLE) {
+        return true;
+    }
+    if ((state == NeighborCache::State::NONE) && (queue ? QueueRequest(ip, if_name) : SendRequest(ip, if_name))) {
+        cache_.SetIncomplete(ip, now);
+    }
+    return false;
+}
+
+NeighborCache& ArpResolver::GetCache() noexcept {
+    return cache_;
+}
@@ -0,0 +1,134 @@
+#pragma once
+/*
+ * ARP (RFC 826) и кэш соседей IP -> MAC
+ *
+ * ARP запросы формируются и разбираются самостоятельно и отправляются через тот же AF_PACKET сокет,
+ * что и IP пакеты. Результаты хранятся в кэше соседей:
+ * - успешное разрешение живёт REACHABLE_TTL_NS
+ * - неудачное (нет ответа на все попытки) запоминается на FAILED_TTL_NS, чтобы не повторять
+ *   ожидание для заведомо отсутствующих адресов (отрицательное кэширование)
+ * Кэш - открытая адресация с линейным пробированием, просроченные записи вычищаются при росте таблицы.
+ *
+ * Разрешение одного адреса (Resolve) - блокирующее, с повторами, только для явного запроса MAC адреса (--arp).
+ * Для разрешения множества адресов запросы ставятся в очередь пакетной отправки (QueueRequest),
+ * а ответы разбираются по мере прихода (HandlePacket) - см. Sweeper.
+ * Асинхронное разрешение (LookupOrQueue) не ждёт ответа: при промахе кэша запрос ставится в очередь, а запись
+ * помечается как ожидающая ответа (INCOMPLETE), чтобы не повторять запрос на каждый пакет - см. Monitor.
+ * LookupOrSend - то же для одиночной отправки: запрос уходит сразу, ответ приходит вместе с echo reply.
+ *
+ * USAGE:
+ * ArpResolver arp(ether);
+ * unsigned char mac[ETH_ALEN];
+ * if (arp.Resolve(inet_addr("192.168.1.1"), "eth0", mac) == 0) { ... }
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+class EthernetProtocol;
+
+class NeighborCache {
+public:
+    static constexpr long long REACHABLE_TTL_NS = 60 * 1000000000LL;   // время жизни разрешённого адреса
+    static constexpr long long FAILED_TTL_NS = 5 * 1000000000LL;       // время жизни отрицательной записи
+    static constexpr long long INCOMPLETE_TTL_NS = 1000000000LL;        // ожидание ответа на асинхронный запрос
+
+    enum class State : unsigned char {
+        NONE = 0,           // записи нет или она просрочена
+        REACHABLE,          // адрес разрешён
+        FAILED,             // адрес не ответил
+        INCOMPLETE          // запрос отправлен, ответа ещё нет
+    };
+
+    NeighborCache() noexcept = default;
+    ~NeighborCache();
+
+    /* Поиск записи для ip (в сетевом порядке байт) на момент now (utils::MonotonicNs)
+     * для REACHABLE MAC адрес копируется в mac (если не nullptr) */
+    State Lookup(in_addr_t ip, unsigned char* mac, long long now) const noexcept;
+
+    /* возвращают false, если не хватило памяти */
+    bool SetReachable(in_addr_t ip, const unsigned char* mac, long long now) noexcept;
+    bool SetFailed(in_addr_t ip, long long now) noexcept;
+    bool SetIncomplete(in_addr_t ip, long long now) noexcept;
+
+    /* Обновление MAC и срока жизни уже существующей (не просроченной) записи ip, новая запись не создаётся
+     * возвращает true, если запись найдена */
+    bool Refresh(in_addr_t ip, const unsigned char* mac, long long now) noexcept;
+
+    /* Резервирование места под count записей - перед массовым разрешением */
+    bool Reserve(unsigned int count) noexcept;
+
+    /* Количество занятых слотов (включая просроченные записи) */
+    unsigned int GetCount() const noexcept;
+
+private:
+    struct Entry {
+        long long expires;
+        in_addr_t ip;
+        State state;
+        unsigned char mac[ETH_ALEN];
+    };
+
+    Entry* Insert(in_addr_t ip, long long now) noexcept;
+    bool Rehash(unsigned int capacity, long long now) noexcept;
+    unsigned int Slot(in_addr_t ip) const noexcept;
+
+    Entry* entries_ = nullptr;
+    unsigned int capacity_ = 0;             // степень двойки
+    unsigned int count_ = 0;
+};
+
+class ArpResolver {
+public:
+    static constexpr unsigned int ATTEMPTS = 3;             // количество запросов при разрешении одного адреса
+    static constexpr unsigned int TIMEOUT_MS = 200;         // ожидание ответа на один запрос
+
+    explicit ArpResolver(EthernetProtocol& ether) noexcept;
+
+    /* Отправка ARP запроса для ip (в сетевом порядке байт) с интерфейса if_name
+     * возвращает true при успехе */
+    bool SendRequest(in_addr_t ip, const char* if_name) noexcept;
+
+    /* Постановка ARP запроса в очередь пакетной отправки Ethernet (отправка - EthernetProtocol::FlushRequests) */
+    bool QueueRequest(in_addr_t ip, const char* if_name) noexcept;
+
+    /* Разбор ARP пакета (payload Ethernet фрейма) и обновление кэша по адресам отправителя: ответ добавляет
+     * запись, запрос только обновляет существующую (ожидающую ответа или разрешённую)
+     * - sender_ip, sender_mac - адреса отправителя (если не nullptr), sender_mac указывает внутрь data
+     * возвращает true, если пакет корректный и содержит адрес отправителя */
+    bool HandlePacket(const unsigned char* data, int len, in_addr_t* sender_ip = nullptr,
+                      const unsigned char** sender_mac = nullptr) noexcept;
+
+    /* Разрешение адреса ip (в сетевом порядке байт) через интерфейс if_name
+     * Сначала проверяется кэш, затем отправляется до ATTEMPTS запросов.
+     * Фреймы, отличные от ARP, принятые во время ожидания, отбрасываются.
+     * возвращает:
+     * - 0 - адрес разрешён, MAC записан в mac
+     * - 1 - ответа нет (в том числе по отрицательной записи кэша)
+     * - -1 - ошибка отправки или приёма */
+    int Resolve(in_addr_t ip, const char* if_name, unsigned char* mac) noexcept;
+
+    /* Только поиск в кэше, возвращает true, если адрес разрешён */
+    bool Lookup(in_addr_t ip, unsigned char* mac) const noexcept;
+
+    /* Асинхронное разрешение: поиск в кэше, при промахе ARP запрос ставится в очередь пакетной отправки
+     * (не чаще раза в INCOMPLETE_TTL_NS для одного адреса), ответ пополнит кэш через HandlePacket
+     * возвращает true, если адрес разрешён (MAC записан в mac) */
+    bool LookupOrQueue(in_addr_t ip, const char* if_name, unsigned char* mac) noexcept;
+
+    /* То же, что LookupOrQueue, но ARP запрос отправляется сразу (SendRequest) - для одиночной отправки,
+     * где очередь не сбрасывается. Ответ разбирается вместе с остальными фреймами через HandlePacket */
+    bool LookupOrSend(in_addr_t ip, const char* if_name, unsigned char* mac) noexcept;
+
+    NeighborCache& GetCache() noexcept;
+
+private:
+    /* Формирование ARP запроса в buf, возвращает длину, либо -1 если интерфейс не найден */
+    int BuildRequest(unsigned char* buf, in_addr_t ip, const char* if_name) const noexcept;
+
+    /* Общая часть LookupOrQueue / LookupOrSend, queue - постановка запроса в очередь вместо отправки */
+    bool LookupOrRequest(in_addr_t ip, const char* if_name, unsigned char* mac, bool queue) noexcept;
+
+    EthernetProtocol& ether_;
+    NeighborCache cache_;
+};
@@ -0,0 +1,182 @@
+/*
+ * Измерение скорости вычисления контрольной суммы Internet для разных ядер common/checksum.h:
+ * - rfc1071 - исходный цикл по 16-битным словам (эталон)
+ * - scalar - 32-битные слова в 64-битный аккумулятор
+ * - sse2, avx2 - векторные ядра (если поддерживаются процессором)
+ * - dispatch - checksum::Compute с выбором ядра во время выполнения
+ * - update16 - инкрементальное обновление (RFC 1624) вместо полного пересчёта
+ *
+ * Запуск: ./checksum_bench [байт на измерение]
+ * Перед измерением результаты всех ядер сверяются с эталоном на длинах 0..9000 и невыровненных адресах.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../common/checksum.h"
+
+namespace {
+constexpr int MAX_LEN = 9000;
+constexpr long long DEFAULT_BYTES = 1LL << 30;
+constexpr int SIZES[] = {8, 20, 64, 128, 256, 576, 1500, 4096, 9000};
+
+unsigned short Rfc1071(const void* b, int len) {
+    const unsigned short* buf = (const unsigned short*)b;
+    unsigned int sum = 0;
+    for (; len > 1; len -= 2) {
+        sum += *buf++;
+    }
+    if (len == 1) {
+        sum += *(const unsigned char*)buf;
+    }
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum += (sum >> 16);
+    return ~sum;
+}
+
+unsigned long long SumRfc1071(const unsigned char* data, int len, unsigned long long sum) {
+    return sum + (unsigned short)~Rfc1071(data, len);
+}
+
+unsigned long long SumDispatch(const unsigned char* data, int len, unsigned long long sum) {
+    return sum + checksum::Sum(data, len);
+}
+
+struct KernelInfo {
+    const char* name;
+    checksum::Kernel kernel;
+};
+
+double MonotonicSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Сверка ядра с эталоном на всех длинах и смещениях 0..3 */
+bool Verify(const KernelInfo& info, const unsigned char* data) {
+    for (int offset = 0; offset < 4; ++offset) {
+        for (int len = 0; len <= MAX_LEN; ++len) {
+            unsigned short expected = Rfc1071(data + offset, len);
+            unsigned short actual = ~checksum::Fold(info.kernel(data + offset, len, 0));
+            // 0x0000 и 0xFFFF - два представления нуля в обратном коде
+            if ((expected != actual) && !((expected | actual) == 0xFFFF && (expected & actual) == 0)) {
+                printf("Error. %s: checksum mismatch at len=%d offset=%d (%04x != %04x)\n",
+                       info.name, len, offset, actual, expected);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Проверка инкрементального обновления: замена 16 и 32-битного поля в пакете */
+bool VerifyUpdate(unsigned char* data) {
+    for (int i = 0; i < 100000; ++i) {
+        int len = 8 + rand() % 1500;
+        int field = (rand() % ((len - 4) / 2)) * 2;
+        unsigned short check = checksum::Compute(data, len);
+        unsigned int old_value;
+        memcpy(&old_value, data + field, sizeof(old_value));
+        unsigned int new_value = rand();
+        if (i & 1) {
+            check = checksum::Update32(check, old_value, new_value);
+            memcpy(data + field, &new_value, sizeof(new_value));
+        } else {
+            check = checksum::Update16(check, old_value & 0xFFFF, new_value & 0xFFFF);
+            memcpy(data + field, &new_value, sizeof(unsigned short));
+        }
+        unsigned short expected = checksum::Compute(data, len);
+        if ((check != expected) && !((check | expected) == 0xFFFF && (check & expected) == 0)) {
+            printf("Error. Incremental update mismatch at len=%d field=%d (%04x != %04x)\n", len, field, check, expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+void Measure(const KernelInfo& info, const unsigned char* data, int size, long long total_bytes) {
+    long long iterations = total_bytes / size;
+    if (iterations < 100000) {
+        iterations = 100000;
+    }
+    unsigned long long sink = 0;
+    double start = MonotonicSec();
+    for (long long i = 0; i < iterations; ++i) {
+        // смещение на слово мешает компилятору вынести вычисление из цикла
+        sink += info.kernel(data + (i & 3) * 4, size, 0);
+    }
+    double seconds = MonotonicSec() - start;
+    printf("%-8s size=%d ns=%.2f gbps=%.2f sink=%u\n", info.name, size, seconds * 1e9 / iterations,
+           iterations * (double)size * 8 / seconds / 1e9, checksum::Fold(sink));
+}
+
+void MeasureUpdate(unsigned char* data, long long total_bytes) {
+    long long iterations = total_bytes / 64;
+    unsigned short check = checksum::Compute(data, 64);
+    unsigned short value = 0;
+    double start = MonotonicSec();
+    for (long long i = 0; i < iterations; ++i) {
+        unsigned short new_value = (unsigned short)i;
+        check = checksum::Update16(check, value, new_value);
+        value = new_value;
+    }
+    double seconds = MonotonicSec() - start;
+    printf("%-8s size=%d ns=%.2f gbps=%.2f sink=%u\n", "update16", 2, seconds * 1e9 / iterations,
+           iterations * 2.0 * 8 / seconds / 1e9, check);
+}
+}
+
+int main(int argc, char* argv[]) {
+    long long total_bytes = (argc > 1) ? atoll(argv[1]) : DEFAULT_BYTES;
+    if (total_bytes <= 0) {
+        printf("Command error. Usage: %s [bytes]\n", argv[0]);
+        return 1;
+    }
+
+    unsigned char* data = (unsigned char*)malloc(MAX_LEN + 64);
+    if (data == nullptr) {
+        printf("Error. Not enough memory.\n");
+        return 2;
+    }
+    srand(1);
+    for (int i = 0; i < MAX_LEN + 64; ++i) {
+        data[i] = rand();
+    }
+
+    KernelInfo kernels[5];
+    int count = 0;
+    kernels[count++] = {"rfc1071", SumRfc1071};
+    kernels[count++] = {"scalar", checksum::SumScalar};
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels[count++] = {"sse2", checksum::SumSse2};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[count++] = {"avx2", checksum::SumAvx2};
+    }
+#endif
+    kernels[count++] = {"dispatch", SumDispatch};
+
+    for (int k = 0; k < count; ++k) {
+        if (!Verify(kernels[k], data)) {
+            free(data);
+            return 2;
+        }
+    }
+    if (!VerifyUpdate(data)) {
+        free(data);
+        return 2;
+    }
+
+    for (int size : SIZES) {
+        for (int k = 0; k < count; ++k) {
+            Measure(kernels[k], data, size, total_bytes);
+        }
+    }
+    MeasureUpdate(data, total_bytes);
+    free(data);
+    return 0;
+}
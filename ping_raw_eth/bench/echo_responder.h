@@ -0,0 +1,129 @@
+#pragma once
+/*
+ * Ответчик на ICMP echo request для измерений
+ *
+ * Принимает фреймы интерфейса через кольцо приёма и на каждый echo request, адресованный его IPv4 адресу,
+ * отправляет echo reply: фрейм запроса копируется в слот очереди отправки, в нём меняются местами MAC и IP
+ * адреса, тип ICMP меняется на echo reply, контрольная сумма обновляется инкрементально (RFC 1624).
+ * Ответы одного пробуждения уходят одним системным вызовом.
+ *
+ * Ядро того же пространства имён на echo request отвечать не должно (net.ipv4.icmp_echo_ignore_all = 1),
+ * ARP запросы к адресу интерфейса обслуживает ядро.
+ *
+ * USAGE:
+ * EchoResponder responder("bench1"); // если успешно создан, то IsCreated вернёт true
+ * responder.Run(stop_fd);            // до закрытия (или готовности к чтению) stop_fd
+ */
+#include <errno.h>
+#include <linux/icmp.h>
+#include <linux/ip.h>
+#include <netinet/ether.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../common/checksum.h"
+#include "../ethernet.h"
+
+class EchoResponder {
+public:
+    static constexpr int RCV_BATCH = 256;                      // максимум фреймов за одно пробуждение
+    static constexpr int POLL_TIMEOUT_MS = 100;
+
+    explicit EchoResponder(const char* if_name) noexcept {
+        if (!ether_.IsCreated()) {
+            return;
+        }
+        const InterfaceTable::Interface* iface = ether_.GetInterfaces().FindByName(if_name);
+        if (iface == nullptr) {
+            printf("Responder. Error. Interface %s not found.\n", if_name);
+            return;
+        }
+        if_idx_ = iface->index;
+        ip_ = iface->ip;
+        memcpy(mac_, iface->mac, ETH_ALEN);
+        ether_.EnableRxRing();
+        ether_.EnableTxRing();
+        created_ = ether_.BindInterface(if_name);
+    }
+
+    bool IsCreated() const noexcept {
+        return created_;
+    }
+
+    /* Обслуживание запросов до закрытия stop_fd другой стороной (или появления в нём данных)
+     * возвращает количество отправленных ответов, либо -1 при ошибке */
+    long long Run(int stop_fd) noexcept {
+        if (!created_) {
+            return -1;
+        }
+        struct pollfd fds[2] = {{ether_.GetSocket(), POLLIN, 0}, {stop_fd, POLLIN, 0}};
+        for (;;) {
+            if ((poll(fds, 2, POLL_TIMEOUT_MS) < 0) && (errno != EINTR)) {
+                printf("Responder. Error. poll failed.\n");
+                return -1;
+            }
+            if (fds[1].revents != 0) {
+                return replies_;
+            }
+            queued_ = 0;
+            if (ether_.RcvFrames(HandleFrame, this, RCV_BATCH) < 0) {
+                return -1;
+            }
+            if ((queued_ > 0) && (ether_.FlushRequests() < 0) && (errno != ENOBUFS) && (errno != EAGAIN)) {
+                return -1;
+            }
+        }
+    }
+
+private:
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len) {
+        EchoResponder* self = (EchoResponder*)ctx;
+        const struct ether_header* eth_h = (const struct ether_header*)frame;
+        if ((eth_h->ether_type != htons(ETH_P_IP)) || (len < (int)(ETH_HLEN + sizeof(struct iphdr)))) {
+            return;
+        }
+        const struct iphdr* ip_h = (const struct iphdr*)(frame + ETH_HLEN);
+        int ip_hlen = ip_h->ihl * 4;
+        if ((ip_h->protocol != IPPROTO_ICMP) || (ip_h->daddr != self->ip_) ||
+            (len < (int)(ETH_HLEN + ip_hlen + sizeof(struct icmphdr)))) {
+            return;
+        }
+        const struct icmphdr* icmp_h = (const struct icmphdr*)(frame + ETH_HLEN + ip_hlen);
+        if (icmp_h->type != ICMP_ECHO) {
+            return;
+        }
+
+        unsigned char* reply = self->ether_.ReserveFrame(self->if_idx_);
+        if (reply == nullptr) {
+            // очередь переполнена - запрос остаётся без ответа, как при потере
+            return;
+        }
+        memcpy(reply, frame, len);
+        struct ether_header* reply_eth = (struct ether_header*)reply;
+        memcpy(reply_eth->ether_dhost, eth_h->ether_shost, ETH_ALEN);
+        memcpy(reply_eth->ether_shost, self->mac_, ETH_ALEN);
+        // перестановка адресов не меняет контрольную сумму IP
+        struct iphdr* reply_ip = (struct iphdr*)(reply + ETH_HLEN);
+        reply_ip->saddr = ip_h->daddr;
+        reply_ip->daddr = ip_h->saddr;
+        struct icmphdr* reply_icmp = (struct icmphdr*)(reply + ETH_HLEN + ip_hlen);
+        unsigned short old_word;
+        unsigned short new_word;
+        memcpy(&old_word, reply_icmp, sizeof(old_word));
+        reply_icmp->type = ICMP_ECHOREPLY;
+        memcpy(&new_word, reply_icmp, sizeof(new_word));
+        reply_icmp->checksum = checksum::Update16(reply_icmp->checksum, old_word, new_word);
+        self->ether_.CommitFrame(len);
+        ++self->queued_;
+        ++self->replies_;
+    }
+
+    EthernetProtocol ether_;
+    bool created_ = false;
+    int if_idx_ = -1;
+    in_addr_t ip_ = 0;
+    unsigned char mac_[ETH_ALEN] = {};
+    int queued_ = 0;                        // ответов в очереди текущего пробуждения
+    long long replies_ = 0;
+};
@@ -0,0 +1,411 @@
+/*
+ * Измерение пути запрос-ответ на паре veth в двух сетевых пространствах имён
+ *
+ * - клиент (этот процесс, своё пространство имён) отправляет ICMP echo request через IPProtocol из шаблона фрейма
+ *   с заданным бэкендом пакетной отправки и принимает ответы через кольцо приёма
+ * - ответчик (дочерний процесс в другом пространстве имён, второй конец пары) отвечает через EchoResponder,
+ *   либо (--kernel) отвечает ядро
+ * Бэкенды: sendmmsg и tx_ring (приём через кольцо PACKET_RX_RING), uring (приём и отправка через io_uring),
+ * dgram (датаграммный ICMP сокет через общий интерфейс common/echo.h, запрос на системный вызов).
+ * Для каждого бэкенда измеряются скорость отправки и приёма (пакетов в секунду), доля сопоставленных ответов
+ * (по id и sequence) и распределение RTT по меткам времени ядра (Histogram).
+ *
+ * Результаты - по строке JSON на бэкенд (JSON Lines) в stdout, для отслеживания регрессий:
+ * {"bench":"ping","backend":"tx_ring","responder":"raw","frames":200000,"rate":0,"sent":200000,"replies":200000,
+ *  "match_rate":1.0000,"send_pps":...,"recv_pps":...,"rtt_ns":{"min":...,"p50":...,"p99":...,"p999":...,"max":...},
+ *  "timestamps":"kernel"}
+ *
+ * Запуск: sudo ./ping_bench [--kernel] [количество запросов] [скорость, пакетов в секунду; 0 - без ограничения]
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../common/icmp_socket.h"
+#include "../histogram.h"
+#include "../icmp.h"
+#include "../utils.h"
+#include "echo_responder.h"
+#include "veth.h"
+
+namespace {
+constexpr int DEFAULT_FRAMES = 200000;
+constexpr int BATCH = EthernetProtocol::TX_BATCH_MAX;
+constexpr int RCV_BATCH = 1024;
+constexpr int RCV_BUF_SIZE = 8 * 1024 * 1024;       // приёмный буфер датаграммного ICMP сокета
+constexpr long long WAIT_NS = 1000000000LL;         // ожидание ответов после последней отправки
+constexpr unsigned int SEQUENCES = 1 << 16;
+constexpr const char* CLIENT_IF = "pb0";
+constexpr const char* RESPONDER_IF = "pb1";
+constexpr const char* CLIENT_ADDR = "10.98.0.1";
+constexpr const char* RESPONDER_ADDR = "10.98.0.2";
+constexpr int PREFIX_LEN = 24;
+
+enum class Backend { SENDMMSG, TX_RING, URING };
+
+/* Состояние прогона: запросы индексируются sequence */
+struct Run {
+    long long tx_user[SEQUENCES];           // время возврата из отправки (CLOCK_REALTIME)
+    long long tx_kernel[SEQUENCES];         // программная метка отправки ядра
+    bool pending[SEQUENCES];
+    Histogram rtt;
+    IPProtocol* ip_proto;
+    unsigned short id;
+    unsigned int replies;
+    unsigned int unmatched;                 // ответы без ожидающего запроса (повторные, чужие)
+    unsigned int kernel_samples;
+    long long last_reply_ns;                // время последнего ответа (monotonic)
+};
+
+void HandleTxTimestamp(void* ctx, const unsigned char* frame, int len, const EthernetProtocol::Timestamp& ts) {
+    Run* run = (Run*)ctx;
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + ETH_HLEN, len - ETH_HLEN, &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP) || (icmp_len < (int)sizeof(struct icmphdr))) {
+        return;
+    }
+    const struct icmphdr* icmp_h = (const struct icmphdr*)icmp_data;
+    if ((icmp_h->type == ICMP_ECHO) && (icmp_h->un.echo.id == run->id)) {
+        run->tx_kernel[ntohs(icmp_h->un.echo.sequence)] = ts.software;
+    }
+}
+
+/* Сопоставление ответа с запросом и RTT, rx_ns - метка приёма ядра (0 - нет метки) */
+void RecordReply(Run* run, unsigned short sequence, long long rx_ns) {
+    if (!run->pending[sequence]) {
+        ++run->unmatched;
+        return;
+    }
+    run->pending[sequence] = false;
+    ++run->replies;
+    run->last_reply_ns = utils::MonotonicNs();
+
+    long long rtt;
+    if ((run->tx_kernel[sequence] != 0) && (rx_ns != 0)) {
+        rtt = rx_ns - run->tx_kernel[sequence];
+        ++run->kernel_samples;
+    } else {
+        rtt = ((rx_ns != 0) ? rx_ns : utils::RealtimeNs()) - run->tx_user[sequence];
+    }
+    run->rtt.Record((rtt < 0) ? 0 : rtt);
+}
+
+void HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    Run* run = (Run*)ctx;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        return;
+    }
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + ETH_HLEN, len - ETH_HLEN, &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP)) {
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if ((icmp_h == nullptr) || (icmp_h->un.echo.id != run->id)) {
+        return;
+    }
+    RecordReply(run, ntohs(icmp_h->un.echo.sequence), run->ip_proto->GetEthernet().GetRxTimestamp().software);
+}
+
+/* Разбор накопленных меток отправки и ответов без блокировки */
+bool Drain(Run* run) {
+    EthernetProtocol& ether = run->ip_proto->GetEthernet();
+    return (ether.RcvTxTimestamps(HandleTxTimestamp, run, RCV_BATCH) >= 0) &&
+           (ether.RcvFrames(HandleFrame, run, RCV_BATCH) >= 0);
+}
+
+/* Отправка очереди, запасная метка отправки - время возврата из системного вызова */
+bool Flush(Run* run, int first, int count) {
+    if ((count > 0) && (run->ip_proto->FlushRequests() < 0) && (errno != ENOBUFS) && (errno != EAGAIN)) {
+        return false;
+    }
+    long long now = utils::RealtimeNs();
+    for (int i = first; i < first + count; ++i) {
+        run->tx_user[i % SEQUENCES] = now;
+    }
+    return true;
+}
+
+/* Строка JSON с результатами прогона */
+void PrintRun(const Run* run, const char* name, bool kernel, int frames, unsigned int rate, int sent,
+              long long start, long long send_end) {
+    double send_sec = (send_end - start) / 1e9;
+    double recv_sec = (run->last_reply_ns > start) ? (run->last_reply_ns - start) / 1e9 : 0.0;
+    const Histogram& rtt = run->rtt;
+    printf("{\"bench\":\"ping\",\"backend\":\"%s\",\"responder\":\"%s\",\"frames\":%d,\"rate\":%u,\"sent\":%d,"
+           "\"replies\":%u,\"unmatched\":%u,\"match_rate\":%.4f,\"send_pps\":%.0f,\"recv_pps\":%.0f,"
+           "\"rtt_ns\":{\"min\":%llu,\"mean\":%llu,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu},"
+           "\"timestamps\":\"%s\"}\n",
+           name, kernel ? "kernel" : "raw", frames, rate, sent, run->replies, run->unmatched,
+           (sent > 0) ? (double)run->replies / sent : 0.0, (send_sec > 0) ? sent / send_sec : 0.0,
+           (recv_sec > 0) ? run->replies / recv_sec : 0.0, rtt.GetMin(), rtt.GetMean(), rtt.GetPercentile(50.0),
+           rtt.GetPercentile(99.0), rtt.GetPercentile(99.9), rtt.GetMax(),
+           (run->kernel_samples == run->replies) ? "kernel" : ((run->kernel_samples > 0) ? "mixed" : "user"));
+    fflush(stdout);
+}
+
+bool RunBackend(Backend backend, const char* name, bool kernel, int frames, unsigned int rate) {
+    IPProtocol ip_proto;
+    if (!ip_proto.IsCreated()) {
+        return false;
+    }
+    EthernetProtocol& ether = ip_proto.GetEthernet();
+    ether.EnableTimestamps(false);
+    if (backend == Backend::URING) {
+        if (!ether.EnableUring()) {
+            return false;
+        }
+    } else {
+        ether.EnableRxRing();
+    }
+    if ((backend == Backend::TX_RING) && !ether.EnableTxRing()) {
+        return false;
+    }
+    in_addr_t dst = inet_addr(RESPONDER_ADDR);
+    in_addr_t next_hop;
+    const char* if_name = ip_proto.GetRouteInterface(dst, &next_hop);
+    const InterfaceTable::Interface* iface = (if_name != nullptr) ? ether.GetInterfaces().FindByName(if_name) : nullptr;
+    if (iface == nullptr) {
+        return false;
+    }
+    unsigned short id = getpid() & 0xFFFF;
+    unsigned char echo[Ping::PING_PKT_SIZE];
+    Ping::BuildEchoRequest(echo, sizeof(echo), id, 0);
+    FrameTemplate tmpl;
+    if (!tmpl.Init(*iface, IPPROTO_ICMP, echo, sizeof(echo))) {
+        printf("Bench. Error. Can't build frame template for interface %s.\n", iface->name);
+        return false;
+    }
+    ip_proto.SetReplyFilter(id);
+    unsigned char mac[ETH_ALEN];
+    if (!ether.BindInterface(iface->name) || (ip_proto.ResolveMac(dst, mac) != 0)) {
+        printf("Bench. Error. Responder %s is not reachable.\n", RESPONDER_ADDR);
+        return false;
+    }
+
+    void* mem = malloc(sizeof(Run));
+    if (mem == nullptr) {
+        printf("Bench. Error. Not enough memory.\n");
+        return false;
+    }
+    Run* run = new (mem) Run();
+    run->ip_proto = &ip_proto;
+    run->id = id;
+
+    bool ok = true;
+    int sent = 0;
+    int batch_first = 0;
+    const long long start = utils::MonotonicNs();
+    while (ok && (sent < frames)) {
+        // при ограничении скорости запрос ждёт своего времени, ответы тем временем разбираются
+        if ((rate > 0) && (utils::MonotonicNs() < start + sent * 1000000000LL / rate)) {
+            ok = Flush(run, batch_first, sent - batch_first) && Drain(run);
+            batch_first = sent;
+            continue;
+        }
+        unsigned short sequence = sent % SEQUENCES;
+        run->pending[sequence] = true;
+        run->tx_kernel[sequence] = 0;
+        if (!Ping::QueueEchoRequest(ip_proto, tmpl, echo, sizeof(echo), dst, htons(sequence))) {
+            run->pending[sequence] = false;
+            if ((errno != ENOBUFS) && (errno != EAGAIN)) {
+                ok = false;
+                break;
+            }
+            // очередь заполнена - отправляем и повторяем
+            ok = Flush(run, batch_first, sent - batch_first) && Drain(run);
+            batch_first = sent;
+            continue;
+        }
+        ++sent;
+        if (sent - batch_first == BATCH) {
+            ok = Flush(run, batch_first, BATCH) && Drain(run);
+            batch_first = sent;
+        }
+    }
+    ok = ok && Flush(run, batch_first, sent - batch_first);
+    const long long send_end = utils::MonotonicNs();
+
+    struct pollfd pfd{ether.GetSocket(), POLLIN, 0};
+    while (ok && (run->replies < (unsigned int)sent) && (utils::MonotonicNs() < send_end + WAIT_NS)) {
+        poll(&pfd, 1, 10);
+        ok = Drain(run);
+    }
+
+    if (ok) {
+        PrintRun(run, name, kernel, frames, rate, sent, start, send_end);
+    }
+    run->~Run();
+    free(run);
+    return ok;
+}
+
+/* Разбор ответов бэкенда общего интерфейса без ожидания */
+bool DrainEcho(Run* run, const EchoBackend& backend) {
+    EchoReply reply;
+    int res;
+    while ((res = backend.receive(backend.ctx, &reply, false)) > 0) {
+        RecordReply(run, ntohs(reply.sequence), reply.ts_ns);
+    }
+    return res == 0;
+}
+
+/* Прогон через общий интерфейс бэкендов ICMP echo (common/echo.h): системный вызов на запрос, без пакетной
+ * отправки; ответы разбираются без ожидания после каждого запроса */
+bool RunEcho(const char* name, const EchoBackend& backend, bool kernel, int frames, unsigned int rate) {
+    void* mem = malloc(sizeof(Run));
+    if (mem == nullptr) {
+        printf("Bench. Error. Not enough memory.\n");
+        return false;
+    }
+    Run* run = new (mem) Run();
+    in_addr_t dst = inet_addr(RESPONDER_ADDR);
+
+    bool ok = true;
+    int sent = 0;
+    const long long start = utils::MonotonicNs();
+    while (ok && (sent < frames)) {
+        if ((rate > 0) && (utils::MonotonicNs() < start + sent * 1000000000LL / rate)) {
+            ok = DrainEcho(run, backend);
+            continue;
+        }
+        unsigned short sequence = sent % SEQUENCES;
+        run->pending[sequence] = true;
+        run->tx_user[sequence] = utils::RealtimeNs();
+        if (!backend.send(backend.ctx, dst, htons(sequence))) {
+            run->pending[sequence] = false;
+            // очередь отправки сокета заполнена - разбираем ответы и повторяем
+            ok = ((errno == ENOBUFS) || (errno == EAGAIN)) && DrainEcho(run, backend);
+            continue;
+        }
+        ++sent;
+        ok = DrainEcho(run, backend);
+    }
+    const long long send_end = utils::MonotonicNs();
+
+    struct pollfd pfd{backend.get_socket(backend.ctx), POLLIN, 0};
+    while (ok && (run->replies < (unsigned int)sent) && (utils::MonotonicNs() < send_end + WAIT_NS)) {
+        poll(&pfd, 1, 10);
+        ok = DrainEcho(run, backend);
+    }
+    if (ok) {
+        PrintRun(run, name, kernel, frames, rate, sent, start, send_end);
+    }
+    run->~Run();
+    free(run);
+    return ok;
+}
+
+bool RunDgram(bool kernel, int frames, unsigned int rate) {
+    IcmpSocket sock;
+    // всплески ответов ждут в сокете, как в кольце приёма у остальных бэкендов
+    return sock.IsCreated() && sock.SetRcvBufSize(RCV_BUF_SIZE) &&
+           RunEcho("dgram", sock.GetBackend(), kernel, frames, rate);
+}
+
+bool WriteSysctl(const char* path, const char* value) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+    close(fd);
+    return ok;
+}
+
+/* Дочерний процесс: своё пространство имён, второй конец пары, ответы до закрытия stop_fd */
+int RunResponder(int ready_fd, int stop_fd, bool kernel) {
+    char byte = 0;
+    if (unshare(CLONE_NEWNET) < 0) {
+        printf("Error. Can't create network namespace (root required).\n");
+        return 2;
+    }
+    // пространство имён создано - клиент помещает в него второй конец пары
+    if ((write(ready_fd, &byte, 1) != 1) || (read(stop_fd, &byte, 1) != 1)) {
+        return 2;
+    }
+    VethPair peer(RESPONDER_IF, RESPONDER_ADDR, PREFIX_LEN);
+    if (!peer.IsCreated() || !WriteSysctl("/proc/sys/net/ipv4/icmp_echo_ignore_all", kernel ? "0" : "1")) {
+        printf("Responder. Error. Can't configure %s.\n", RESPONDER_IF);
+        return 2;
+    }
+    if (kernel) {
+        write(ready_fd, &byte, 1);
+        while (read(stop_fd, &byte, 1) > 0);
+        return 0;
+    }
+    EchoResponder responder(RESPONDER_IF);
+    if (!responder.IsCreated()) {
+        return 2;
+    }
+    write(ready_fd, &byte, 1);
+    return (responder.Run(stop_fd) < 0) ? 2 : 0;
+}
+}
+
+int main(int argc, char* argv[]) {
+    bool kernel = false;
+    int arg = 1;
+    if ((argc > arg) && (strcmp(argv[arg], "--kernel") == 0)) {
+        kernel = true;
+        ++arg;
+    }
+    int frames = (argc > arg) ? atoi(argv[arg]) : DEFAULT_FRAMES;
+    unsigned int rate = (argc > arg + 1) ? strtoul(argv[arg + 1], nullptr, 10) : 0;
+    if (frames <= 0) {
+        printf("Command error. Usage: %s [--kernel] [frames] [rate]\n", argv[0]);
+        return 1;
+    }
+    if (unshare(CLONE_NEWNET) < 0) {
+        printf("Error. Can't create network namespace (root required).\n");
+        return 2;
+    }
+
+    int ready_pipe[2];
+    int stop_pipe[2];
+    if ((pipe2(ready_pipe, O_CLOEXEC) < 0) || (pipe2(stop_pipe, O_CLOEXEC) < 0)) {
+        printf("Error. Can't create pipe.\n");
+        return 2;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("Error. Can't start responder process.\n");
+        return 2;
+    }
+    if (pid == 0) {
+        close(ready_pipe[0]);
+        close(stop_pipe[1]);
+        _exit(RunResponder(ready_pipe[1], stop_pipe[0], kernel));
+    }
+    close(ready_pipe[1]);
+    close(stop_pipe[0]);
+
+    bool ok = false;
+    char byte = 0;
+    if (read(ready_pipe[0], &byte, 1) == 1) {
+        VethPair veth(CLIENT_IF, RESPONDER_IF, CLIENT_ADDR, nullptr, PREFIX_LEN, pid);
+        ok = veth.IsCreated() && (write(stop_pipe[1], &byte, 1) == 1) && (read(ready_pipe[0], &byte, 1) == 1);
+        ok = ok && RunBackend(Backend::SENDMMSG, "sendmmsg", kernel, frames, rate) &&
+             RunBackend(Backend::TX_RING, "tx_ring", kernel, frames, rate) &&
+             RunBackend(Backend::URING, "uring", kernel, frames, rate);
+        // датаграммный ICMP сокет: в пространстве имён клиента разрешается всем группам
+        ok = ok && WriteSysctl("/proc/sys/net/ipv4/ping_group_range", "0 2147483647") && RunDgram(kernel, frames, rate);
+    }
+    close(stop_pipe[1]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    close(ready_pipe[0]);
+    return (ok && WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : 2;
+}
@@ -0,0 +1,251 @@
+/*
+ * Измерение скорости разбора принятых фреймов без сети: pcap файл воспроизводится из памяти (PcapReader)
+ * через EthernetProtocol без сокета и проходит тот же путь, что и ответы при опросе:
+ * Ethernet -> ARP (кэш соседей) / IP (IPProtocol::ParsePacket) -> ICMP (Ping::ParseEchoReply) -> сопоставление
+ * ответа по идентификатору и sequence (повторный ответ не считается).
+ *
+ * Права суперпользователя не нужны, результат детерминирован (зависит только от файла), поэтому программа
+ * годится для сравнения версий разбора и для воспроизведения реальной смеси трафика, записанной
+ * ping2 --capture или tcpdump.
+ * Без файла генерируется синтетическая смесь SYNTHETIC_FRAMES фреймов (PcapWriter, временный файл):
+ * ответы с нашим идентификатором, ответы с чужим идентификатором, ARP ответы, TCP сегменты и IPv6.
+ *
+ * Результат - строка JSON (как у ping_bench):
+ * {"bench":"replay","file":"...","passes":20,"frames":...,"bytes":...,"arp":...,"ip":...,"other":...,
+ *  "echo_replies":...,"matched":...,"seconds":...,"pps":...,"mbps":...}
+ *
+ * Запуск: ./replay_bench [--id N] [pcap файл] [количество проходов]
+ */
+#include <arpa/inet.h>
+#include <net/if_arp.h>
+#include <netinet/ether.h>
+#include <netinet/if_ether.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../icmp.h"
+#include "../pcap.h"
+#include "../utils.h"
+
+namespace {
+constexpr int DEFAULT_PASSES = 20;
+constexpr int SYNTHETIC_FRAMES = 80000;             // наших ответов меньше 65536 - sequence не повторяются
+constexpr int RCV_BATCH = 1024;
+constexpr unsigned short SYNTHETIC_ID = 0x5eed;
+constexpr unsigned int SEQUENCES = 1 << 16;
+
+/* Счётчики прохода и состояние сопоставления */
+struct Replay {
+    IPProtocol* ip_proto;
+    bool id_known;                          // идентификатор задан (--id) или взят из первого ответа
+    unsigned short id;                      // в сетевом порядке байт
+    unsigned long long frames;
+    unsigned long long bytes;
+    unsigned long long arp;
+    unsigned long long ip;
+    unsigned long long other;
+    unsigned long long echo_replies;
+    unsigned long long matched;
+    unsigned char seen[SEQUENCES / 8];      // sequence, на которые ответ уже был
+};
+
+void HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    Replay* replay = (Replay*)ctx;
+    ++replay->frames;
+    replay->bytes += len;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        ++replay->arp;
+        replay->ip_proto->GetArp().HandlePacket(frame + ETH_HLEN, len - ETH_HLEN);
+        return;
+    }
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        ++replay->other;
+        return;
+    }
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + ETH_HLEN, len - ETH_HLEN, &ip_h, &icmp_len);
+    if (icmp_data == nullptr) {
+        ++replay->other;
+        return;
+    }
+    ++replay->ip;
+    if (ip_h->protocol != IPPROTO_ICMP) {
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if (icmp_h == nullptr) {
+        return;
+    }
+    ++replay->echo_replies;
+    if (!replay->id_known) {
+        replay->id_known = true;
+        replay->id = icmp_h->un.echo.id;
+    }
+    unsigned short sequence = ntohs(icmp_h->un.echo.sequence);
+    unsigned char bit = 1 << (sequence & 7);
+    if ((icmp_h->un.echo.id == replay->id) && !(replay->seen[sequence >> 3] & bit)) {
+        replay->seen[sequence >> 3] |= bit;
+        ++replay->matched;
+    }
+}
+
+void BuildEthernet(unsigned char* frame, unsigned short ether_type) {
+    struct ether_header* eth_h = (struct ether_header*)frame;
+    static const unsigned char local_mac[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    static const unsigned char peer_mac[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    memcpy(eth_h->ether_dhost, local_mac, ETH_ALEN);
+    memcpy(eth_h->ether_shost, peer_mac, ETH_ALEN);
+    eth_h->ether_type = htons(ether_type);
+}
+
+/* IPv4 пакет от src к 10.0.0.1 с payload_len байт данных, возвращает длину фрейма */
+int BuildIp(unsigned char* frame, in_addr_t src, unsigned char protocol, int payload_len) {
+    BuildEthernet(frame, ETH_P_IP);
+    struct iphdr* ip_h = (struct iphdr*)(frame + ETH_HLEN);
+    memset(ip_h, 0, sizeof(*ip_h));
+    ip_h->version = 4;
+    ip_h->ihl = 5;
+    ip_h->ttl = 64;
+    ip_h->tot_len = htons(sizeof(struct iphdr) + payload_len);
+    ip_h->protocol = protocol;
+    ip_h->saddr = src;
+    ip_h->daddr = inet_addr("10.0.0.1");
+    ip_h->check = checksum::Compute(ip_h, sizeof(struct iphdr));
+    return ETH_HLEN + sizeof(struct iphdr) + payload_len;
+}
+
+/* Синтетическая смесь: из каждых 20 фреймов 14 - наши ответы, 2 - чужие ответы, 2 - ARP, 1 - TCP, 1 - IPv6 */
+bool WriteSynthetic(const char* path) {
+    PcapWriter writer(path);
+    if (!writer.IsCreated()) {
+        return false;
+    }
+    unsigned char frame[ETH_FRAME_LEN];
+    long long ts = 1700000000LL * 1000000000LL;
+    unsigned short sequence = 0;
+    for (int i = 0; i < SYNTHETIC_FRAMES; ++i) {
+        memset(frame, 0, sizeof(frame));
+        in_addr_t src = htonl(0x0A000000u | (2 + i % 250));
+        int len;
+        switch (i % 20) {
+        case 14:
+        case 15: {
+            unsigned char* echo = frame + ETH_HLEN + sizeof(struct iphdr);
+            Ping::BuildEchoRequest(echo, Ping::PING_PKT_SIZE, htons(0x1234), htons(i & 0xFFFF));
+            ((struct icmphdr*)echo)->type = ICMP_ECHOREPLY;
+            len = BuildIp(frame, src, IPPROTO_ICMP, Ping::PING_PKT_SIZE);
+            break;
+        }
+        case 16:
+        case 17: {
+            BuildEthernet(frame, ETH_P_ARP);
+            struct ether_arp* arp = (struct ether_arp*)(frame + ETH_HLEN);
+            arp->arp_hrd = htons(ARPHRD_ETHER);
+            arp->arp_pro = htons(ETH_P_IP);
+            arp->arp_hln = ETH_ALEN;
+            arp->arp_pln = sizeof(in_addr_t);
+            arp->arp_op = htons(ARPOP_REPLY);
+            memcpy(arp->arp_sha, frame + ETH_ALEN, ETH_ALEN);
+            memcpy(arp->arp_spa, &src, sizeof(src));
+            memcpy(arp->arp_tha, frame, ETH_ALEN);
+            len = ETH_HLEN + sizeof(struct ether_arp);
+            break;
+        }
+        case 18:
+            len = BuildIp(frame, src, IPPROTO_TCP, 20 + 512);
+            break;
+        case 19:
+            BuildEthernet(frame, ETH_P_IPV6);
+            len = ETH_HLEN + 40 + 64;
+            break;
+        default: {
+            unsigned char* echo = frame + ETH_HLEN + sizeof(struct iphdr);
+            Ping::BuildEchoRequest(echo, Ping::PING_PKT_SIZE, htons(SYNTHETIC_ID), htons(sequence++));
+            ((struct icmphdr*)echo)->type = ICMP_ECHOREPLY;
+            len = BuildIp(frame, src, IPPROTO_ICMP, Ping::PING_PKT_SIZE);
+            break;
+        }
+        }
+        ts += 1000;
+        if (!writer.Write(frame, len, ts)) {
+            return false;
+        }
+    }
+    return writer.Flush();
+}
+}
+
+int main(int argc, char* argv[]) {
+    int arg = 1;
+    bool id_known = false;
+    unsigned short id = 0;
+    if ((argc > arg + 1) && (strcmp(argv[arg], "--id") == 0)) {
+        id_known = true;
+        id = htons(strtoul(argv[arg + 1], nullptr, 0) & 0xFFFF);
+        arg += 2;
+    }
+    char path[] = "/tmp/replay_bench_XXXXXX";
+    const char* file = (argc > arg) ? argv[arg] : nullptr;
+    int passes = (argc > arg + 1) ? atoi(argv[arg + 1]) : DEFAULT_PASSES;
+    if (passes <= 0) {
+        printf("Command error. Usage: %s [--id N] [pcap file] [passes]\n", argv[0]);
+        return 1;
+    }
+    if (file == nullptr) {
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            printf("Error. Can't create temporary file.\n");
+            return 2;
+        }
+        close(fd);
+        if (!WriteSynthetic(path)) {
+            unlink(path);
+            return 2;
+        }
+        file = path;
+        id_known = true;
+        id = htons(SYNTHETIC_ID);
+    }
+
+    int res = 2;
+    PcapReader reader(file);
+    if (reader.IsCreated()) {
+        IPProtocol ip_proto(PcapReader::Source, &reader);
+        Replay* replay = (Replay*)calloc(1, sizeof(Replay));
+        if (ip_proto.IsCreated() && (replay != nullptr)) {
+            replay->ip_proto = &ip_proto;
+            replay->id_known = id_known;
+            replay->id = id;
+            EthernetProtocol& ether = ip_proto.GetEthernet();
+            res = 0;
+            long long start = utils::MonotonicNs();
+            for (int pass = 0; (pass < passes) && (res == 0); ++pass) {
+                // каждый проход сопоставляет ответы заново
+                memset(replay->seen, 0, sizeof(replay->seen));
+                reader.Rewind();
+                int count;
+                while ((count = ether.RcvFrames(HandleFrame, replay, RCV_BATCH)) > 0);
+                res = (count < 0) ? 2 : 0;
+            }
+            double seconds = (utils::MonotonicNs() - start) / 1e9;
+            if (res == 0) {
+                printf("{\"bench\":\"replay\",\"file\":\"%s\",\"passes\":%d,\"frames\":%llu,\"bytes\":%llu,"
+                       "\"arp\":%llu,\"ip\":%llu,\"other\":%llu,\"echo_replies\":%llu,\"matched\":%llu,"
+                       "\"seconds\":%.3f,\"pps\":%.0f,\"mbps\":%.1f}\n",
+                       (file == path) ? "synthetic" : file, passes, replay->frames, replay->bytes, replay->arp,
+                       replay->ip, replay->other, replay->echo_replies, replay->matched, seconds,
+                       (seconds > 0) ? replay->frames / seconds : 0.0,
+                       (seconds > 0) ? replay->bytes * 8 / seconds / 1e6 : 0.0);
+            }
+        }
+        free(replay);
+    }
+    if (file == path) {
+        unlink(path);
+    }
+    return res;
+}
@@ -0,0 +1,145 @@
+/*
+ * Измерение скорости отправки (пакетов в секунду) для разных путей отправки EthernetProtocol:
+ * - per_frame - SendRequest, один sendto (и два ioctl) на фрейм
+ * - sendmmsg - QueueRequest + FlushRequests, один sendmmsg на пачку
+ * - tx_ring - QueueRequest + FlushRequests через кольцо PACKET_TX_RING, один send на пачку
+ * - uring - QueueRequest + FlushRequests через io_uring, один io_uring_enter на пачку
+ *
+ * Запуск: sudo ./tx_bench [количество фреймов]
+ * Процесс переходит в собственное сетевое пространство имён и создаёт в нём пару veth.
+ * Фреймы отправляются с первого конца пары, на втором конце ядро считает принятые фреймы (PACKET_STATISTICS).
+ */
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../ethernet.h"
+#include "../icmp.h"
+#include "veth.h"
+
+namespace {
+constexpr int DEFAULT_FRAMES = 200000;
+constexpr int BATCH = EthernetProtocol::TX_BATCH_MAX;
+
+double MonotonicSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Сокет на принимающем конце пары - только для счётчиков ядра */
+int OpenCounter(const char* if_name) {
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_ll sll{};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = if_nametoindex(if_name);
+    if (bind(fd, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+unsigned int ReadCounter(int fd) {
+    struct tpacket_stats stats{};
+    socklen_t len = sizeof(stats);
+    getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len);
+    return stats.tp_packets;
+}
+
+/* IPv4 пакет с ICMP echo request на адрес, которого нет на втором конце - ядро его отбросит без ответа */
+int BuildPacket(unsigned char* buf) {
+    struct iphdr* ip_h = (struct iphdr*)buf;
+    memset(ip_h, 0, sizeof(*ip_h));
+    ip_h->version = 4;
+    ip_h->ihl = 5;
+    ip_h->ttl = 64;
+    ip_h->tot_len = htons(sizeof(struct iphdr) + Ping::PING_PKT_SIZE);
+    ip_h->protocol = IPPROTO_ICMP;
+    ip_h->saddr = inet_addr("10.99.0.1");
+    ip_h->daddr = inet_addr("10.99.0.200");
+    ip_h->check = checksum::Compute(ip_h, sizeof(*ip_h));
+    Ping::BuildEchoRequest(buf + sizeof(*ip_h), Ping::PING_PKT_SIZE, 1, 0);
+    return sizeof(*ip_h) + Ping::PING_PKT_SIZE;
+}
+
+enum class Method { PER_FRAME, SENDMMSG, TX_RING, URING };
+
+bool Run(Method method, const char* name, const char* if_name, int counter_fd, int frames) {
+    EthernetProtocol ether;
+    if (!ether.IsCreated() || ((method == Method::TX_RING) && !ether.EnableTxRing()) ||
+        ((method == Method::URING) && !ether.EnableUring())) {
+        return false;
+    }
+    unsigned char packet[ETH_DATA_LEN];
+    int packet_len = BuildPacket(packet);
+
+    ReadCounter(counter_fd);
+    double start = MonotonicSec();
+    int sent = 0;
+    for (int i = 0; i < frames; ++i) {
+        if (method == Method::PER_FRAME) {
+            sent += ether.SendRequest(packet, packet_len, if_name) ? 1 : 0;
+            continue;
+        }
+        if (!ether.QueueRequest(packet, packet_len, if_name)) {
+            return false;
+        }
+        if ((i + 1) % BATCH == 0) {
+            int res = ether.FlushRequests();
+            sent += (res > 0) ? res : 0;
+        }
+    }
+    if (method != Method::PER_FRAME) {
+        int res = ether.FlushRequests();
+        sent += (res > 0) ? res : 0;
+    }
+    double elapsed = MonotonicSec() - start;
+    usleep(100000);
+    unsigned int delivered = ReadCounter(counter_fd);
+
+    printf("%-10s frames=%d sent=%d delivered=%u seconds=%.3f pps=%.0f\n",
+           name, frames, sent, delivered, elapsed, sent / elapsed);
+    return true;
+}
+}
+
+int main(int argc, char* argv[]) {
+    int frames = (argc > 1) ? atoi(argv[1]) : DEFAULT_FRAMES;
+    if (frames <= 0) {
+        printf("Command error. Usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+    if (unshare(CLONE_NEWNET) < 0) {
+        printf("Error. Can't create network namespace (root required).\n");
+        return 2;
+    }
+    VethPair veth("ptx0", "ptx1", "10.99.0.1", "10.99.0.2", 24);
+    if (!veth.IsCreated()) {
+        return 2;
+    }
+    int counter_fd = OpenCounter(veth.GetName(1));
+    if (counter_fd < 0) {
+        printf("Error. Can't open counter socket on %s.\n", veth.GetName(1));
+        return 2;
+    }
+
+    bool ok = Run(Method::PER_FRAME, "per_frame", veth.GetName(0), counter_fd, frames) &&
+              Run(Method::SENDMMSG, "sendmmsg", veth.GetName(0), counter_fd, frames) &&
+              Run(Method::TX_RING, "tx_ring", veth.GetName(0), counter_fd, frames) &&
+              Run(Method::URING, "uring", veth.GetName(0), counter_fd, frames);
+    close(counter_fd);
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,198 @@
+#pragma once
+/*
+ * Пара veth интерфейсов для измерений
+ *
+ * Интерфейсы создаются через rtnetlink (RTM_NEWLINK с IFLA_INFO_KIND = "veth"), им назначаются
+ * IPv4 адреса и они поднимаются. Рассчитано на запуск в собственном сетевом пространстве имён
+ * (unshare(CLONE_NEWNET)): тогда интерфейсы исчезают вместе с процессом и не мешают системе.
+ *
+ * Второй конец пары можно сразу поместить в другое пространство имён (IFLA_NET_NS_PID) - например процесса,
+ * который отвечает на запросы. Тогда здесь настраивается только первый конец, а второй настраивается
+ * в своём пространстве имён конструктором для одного конца.
+ *
+ * USAGE:
+ * unshare(CLONE_NEWNET);
+ * VethPair veth("bench0", "bench1", "10.99.0.1", "10.99.0.2", 24); // IsCreated вернёт true при успехе
+ *
+ * VethPair veth("bench0", "bench1", "10.99.0.1", nullptr, 24, responder_pid);  // в пространстве имён клиента
+ * VethPair peer("bench1", "10.99.0.2", 24);                                    // в пространстве имён responder_pid
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+class VethPair {
+public:
+    /* - peer_ns_pid - процесс, в пространство имён которого помещается второй конец (addr1 не используется),
+     *   0 - оба конца в текущем пространстве имён */
+    VethPair(const char* name0, const char* name1, const char* addr0, const char* addr1, int prefix_len,
+             pid_t peer_ns_pid = 0) noexcept {
+        strncpy(names_[0], name0, IFNAMSIZ - 1);
+        strncpy(names_[1], name1, IFNAMSIZ - 1);
+
+        if (!OpenNetlink() || !CreateLink(peer_ns_pid) || !SetLinkUp("lo")) {
+            return;
+        }
+        const char* addrs[2] = {addr0, addr1};
+        for (int i = 0; i < ((peer_ns_pid != 0) ? 1 : 2); ++i) {
+            if (!AddAddress(names_[i], addrs[i], prefix_len) || !SetLinkUp(names_[i])) {
+                return;
+            }
+        }
+        created_ = true;
+    }
+
+    /* Настройка второго конца пары, помещённого в текущее пространство имён другим процессом */
+    VethPair(const char* name, const char* addr, int prefix_len) noexcept {
+        strncpy(names_[0], name, IFNAMSIZ - 1);
+        if (!OpenNetlink() || !SetLinkUp("lo") || !AddAddress(names_[0], addr, prefix_len) || !SetLinkUp(names_[0])) {
+            return;
+        }
+        created_ = true;
+    }
+    ~VethPair() {
+        if (nl_fd_ >= 0) {
+            close(nl_fd_);
+        }
+    }
+
+    bool IsCreated() const noexcept {
+        return created_;
+    }
+
+    const char* GetName(int idx) const noexcept {
+        return names_[idx ? 1 : 0];
+    }
+
+private:
+    static constexpr int BUF_SIZE = 1024;
+
+    struct Request {
+        struct nlmsghdr hdr;
+        union {
+            struct ifinfomsg ifi;
+            struct ifaddrmsg ifa;
+        };
+        char attrs[BUF_SIZE];
+    };
+
+    void Init(Request* req, unsigned short type, unsigned short flags) noexcept {
+        memset(req, 0, sizeof(*req));
+        req->hdr.nlmsg_type = type;
+        req->hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+        req->hdr.nlmsg_seq = ++seq_;
+        req->hdr.nlmsg_len = NLMSG_LENGTH((type == RTM_NEWADDR) ? sizeof(struct ifaddrmsg) : sizeof(struct ifinfomsg));
+        req->ifi.ifi_family = AF_UNSPEC;
+    }
+
+    static struct rtattr* AddAttr(struct nlmsghdr* hdr, unsigned short type, const void* data, int len) noexcept {
+        struct rtattr* rta = (struct rtattr*)((char*)hdr + NLMSG_ALIGN(hdr->nlmsg_len));
+        rta->rta_type = type;
+        rta->rta_len = RTA_LENGTH(len);
+        if (len > 0) {
+            memcpy(RTA_DATA(rta), data, len);
+        }
+        hdr->nlmsg_len = NLMSG_ALIGN(hdr->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+        return rta;
+    }
+
+    static void EndNest(struct nlmsghdr* hdr, struct rtattr* nest) noexcept {
+        nest->rta_len = (char*)hdr + hdr->nlmsg_len - (char*)nest;
+    }
+
+    /* Отправка запроса и ожидание подтверждения (NLMSG_ERROR с кодом 0) */
+    bool Transact(struct nlmsghdr* hdr, const char* what) noexcept {
+        if (send(nl_fd_, hdr, hdr->nlmsg_len, 0) < 0) {
+            printf("Veth. Error. Can't %s: %s\n", what, strerror(errno));
+            return false;
+        }
+        char buf[BUF_SIZE];
+        int len = recv(nl_fd_, buf, sizeof(buf), 0);
+        if (len < 0) {
+            printf("Veth. Error. Can't %s: %s\n", what, strerror(errno));
+            return false;
+        }
+        for (struct nlmsghdr* nh = (struct nlmsghdr*)buf; NLMSG_OK(nh, (unsigned int)len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr* err = (const struct nlmsgerr*)NLMSG_DATA(nh);
+                if (err->error != 0) {
+                    printf("Veth. Error. Can't %s: %s\n", what, strerror(-err->error));
+                    return false;
+                }
+                return true;
+            }
+        }
+        return true;
+    }
+
+    bool OpenNetlink() noexcept {
+        nl_fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (nl_fd_ < 0) {
+            printf("Veth. Error. Netlink socket not received!\n");
+            return false;
+        }
+        return true;
+    }
+
+    bool CreateLink(pid_t peer_ns_pid) noexcept {
+        Request req;
+        Init(&req, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL);
+        AddAttr(&req.hdr, IFLA_IFNAME, names_[0], strlen(names_[0]) + 1);
+        struct rtattr* link_info = AddAttr(&req.hdr, IFLA_LINKINFO, nullptr, 0);
+        AddAttr(&req.hdr, IFLA_INFO_KIND, "veth", 4);
+        struct rtattr* info_data = AddAttr(&req.hdr, IFLA_INFO_DATA, nullptr, 0);
+        struct rtattr* peer = AddAttr(&req.hdr, VETH_INFO_PEER, nullptr, 0);
+        struct ifinfomsg peer_ifi{};
+        peer_ifi.ifi_family = AF_UNSPEC;
+        memcpy((char*)&req.hdr + req.hdr.nlmsg_len, &peer_ifi, sizeof(peer_ifi));
+        req.hdr.nlmsg_len += NLMSG_ALIGN(sizeof(peer_ifi));
+        AddAttr(&req.hdr, IFLA_IFNAME, names_[1], strlen(names_[1]) + 1);
+        if (peer_ns_pid != 0) {
+            unsigned int pid = peer_ns_pid;
+            AddAttr(&req.hdr, IFLA_NET_NS_PID, &pid, sizeof(pid));
+        }
+        EndNest(&req.hdr, peer);
+        EndNest(&req.hdr, info_data);
+        EndNest(&req.hdr, link_info);
+        return Transact(&req.hdr, "create veth pair");
+    }
+
+    bool SetLinkUp(const char* name) noexcept {
+        Request req;
+        Init(&req, RTM_NEWLINK, 0);
+        req.ifi.ifi_index = if_nametoindex(name);
+        req.ifi.ifi_flags = IFF_UP;
+        req.ifi.ifi_change = IFF_UP;
+        return Transact(&req.hdr, "set link up");
+    }
+
+    bool AddAddress(const char* name, const char* addr, int prefix_len) noexcept {
+        struct in_addr in;
+        if (inet_pton(AF_INET, addr, &in) <= 0) {
+            printf("Error. IPv4 address is not correct\n");
+            return false;
+        }
+        Request req;
+        Init(&req, RTM_NEWADDR, NLM_F_CREATE | NLM_F_EXCL);
+        req.ifa.ifa_family = AF_INET;
+        req.ifa.ifa_prefixlen = prefix_len;
+        req.ifa.ifa_index = if_nametoindex(name);
+        AddAttr(&req.hdr, IFA_LOCAL, &in, sizeof(in));
+        AddAttr(&req.hdr, IFA_ADDRESS, &in, sizeof(in));
+        return Transact(&req.hdr, "add address");
+    }
+
+    bool created_ = false;
+    int nl_fd_ = -1;
+    unsigned int seq_ = 0;
+    char names_[2][IFNAMSIZ] = {};
+};
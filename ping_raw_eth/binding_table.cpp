@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binding_table.h"
+
+BindingTable::~BindingTable() {
+    free(bindings_);
+}
+
+unsigned int BindingTable::Slot(in_addr_t ip) const noexcept {
+    unsigned int h = ip * 2654435761u;
+    h ^= h >> 15;
+    return h & (capacity_ - 1);
+}
+
+/* Перенос записей в новую таблицу (записи не удаляются, поэтому переносятся все) */
+bool BindingTable::Rehash(unsigned int capacity) noexcept {
+    unsigned int new_capacity = MIN_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    Binding* bindings = (Binding*)aligned_alloc(CACHE_LINE, (size_t)new_capacity * sizeof(Binding));
+    if (bindings == nullptr) {
+        printf("Learn. Error. Not enough memory for bindings table.\n");
+        return false;
+    }
+    memset(bindings, 0, (size_t)new_capacity * sizeof(Binding));
+    Binding* old_bindings = bindings_;
+    unsigned int old_capacity = capacity_;
+    bindings_ = bindings;
+    capacity_ = new_capacity;
+
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int j = 0; j < old_capacity; ++j) {
+        if (old_bindings[j].ip == 0) {
+            continue;
+        }
+        unsigned int i = Slot(old_bindings[j].ip);
+        while (bindings_[i].ip != 0) {
+            i = (i + 1) & mask;
+        }
+        bindings_[i] = old_bindings[j];
+    }
+    free(old_bindings);
+    return true;
+}
+
+bool BindingTable::Reserve(unsigned int count) noexcept {
+    if (count * 4ULL <= capacity_ * 3ULL) {
+        return true;
+    }
+    return Rehash(count * 2);
+}
+
+/* В записи mac - MAC адрес последнего появления, other_mac - предыдущий отличный от него */
+const BindingTable::Binding* BindingTable::Update(in_addr_t ip, const unsigned char* mac, int if_index, Source source,
+                                                  long long now, Event* event) noexcept {
+    Binding* binding = (Binding*)Find(ip);
+    if (binding == nullptr) {
+        if (count_ >= MAX_BINDINGS) {
+            return nullptr;
+        }
+        // заполнение не более 3/4, иначе цепочки пробирования становятся длинными
+        if (((count_ + 1) * 4ULL > capacity_ * 3ULL) && !Rehash((count_ + 1) * 2)) {
+            return nullptr;
+        }
+        unsigned int mask = capacity_ - 1;
+        unsigned int i = Slot(ip);
+        while (bindings_[i].ip != 0) {
+            i = (i + 1) & mask;
+        }
+        binding = &bindings_[i];
+        binding->ip = ip;
+        memcpy(binding->mac, mac, ETH_ALEN);
+        ++count_;
+        *event = Event::NEW;
+    } else if (memcmp(binding->mac, mac, ETH_ALEN) == 0) {
+        *event = Event::NONE;
+    } else if ((binding->flags & CONFLICT) && (memcmp(binding->other_mac, mac, ETH_ALEN) == 0)) {
+        // чередование двух MAC адресов известного конфликта
+        memcpy(binding->other_mac, binding->mac, ETH_ALEN);
+        memcpy(binding->mac, mac, ETH_ALEN);
+        *event = Event::NONE;
+    } else if ((source == GRATUITOUS_ARP) || (binding->if_index != if_index) ||
+               (now - binding->last_seen >= CONFLICT_WINDOW_NS)) {
+        // новый владелец адреса: прежние источники и конфликт к нему не относятся
+        if (binding->flags & CONFLICT) {
+            --conflicts_;
+        }
+        memcpy(binding->other_mac, binding->mac, ETH_ALEN);
+        memcpy(binding->mac, mac, ETH_ALEN);
+        binding->flags &= ~CONFLICT;
+        binding->sources = 0;
+        *event = Event::MOVED;
+    } else {
+        if (!(binding->flags & CONFLICT)) {
+            ++conflicts_;
+        }
+        memcpy(binding->other_mac, binding->mac, ETH_ALEN);
+        memcpy(binding->mac, mac, ETH_ALEN);
+        binding->flags |= CONFLICT;
+        *event = Event::CONFLICT;
+    }
+    binding->last_seen = now;
+    binding->if_index = if_index;
+    binding->sources |= source;
+    return binding;
+}
+
+const BindingTable::Binding* BindingTable::Find(in_addr_t ip) const noexcept {
+    if (capacity_ == 0) {
+        return nullptr;
+    }
+    unsigned int mask = capacity_ - 1;
+    for (unsigned int i = Slot(ip); bindings_[i].ip != 0; i = (i + 1) & mask) {
+        if (bindings_[i].ip == ip) {
+            return &bindings_[i];
+        }
+    }
+    return nullptr;
+}
+
+void BindingTable::ForEach(BindingHandler handler, void* ctx) const noexcept {
+    for (unsigned int i = 0; i < capacity_; ++i) {
+        if (bindings_[i].ip != 0) {
+            handler(ctx, bindings_[i]);
+        }
+    }
+}
+
+unsigned int BindingTable::GetCount() const noexcept {
+    return count_;
+}
+
+unsigned int BindingTable::GetConflictCount() const noexcept {
+    return conflicts_;
+}
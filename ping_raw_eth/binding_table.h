@@ -0,0 +1,98 @@
+#pragma once
+/*
+ * Таблица привязок IPv4 -> MAC, выученных по чужому трафику (пассивное обучение, см. Learner)
+ *
+ * Открытая адресация с линейным пробированием, как в NeighborCache: массив - степень двойки с заполнением
+ * не более 3/4, при заполнении удваивается. Запись занимает 32 байта (две записи на строку кэша) и хранит
+ * MAC адрес, интерфейс, время последнего появления адреса в трафике и источники, по которым он выучен.
+ * Записи не удаляются: время последнего появления показывает, насколько привязка свежая.
+ *
+ * Конфликт - один адрес в трафике с двух MAC адресов в пределах CONFLICT_WINDOW_NS: дублирующийся адрес,
+ * подмена ARP, прокси ARP. Второй MAC адрес запоминается в записи, запись помечается CONFLICT; смена MAC после
+ * окна молчания старого адреса или по gratuitous ARP (объявление нового владельца) - переезд (MOVED).
+ * Событие сообщается один раз: дальнейшее чередование тех же двух MAC адресов событий не порождает.
+ *
+ * Время - в любых единицах вызывающей стороны, лишь бы now и CONFLICT_WINDOW_NS были в одних (наносекунды).
+ *
+ * USAGE:
+ * BindingTable table;
+ * table.Reserve(1024);                    // возвращает false, если не хватило памяти
+ * BindingTable::Event event;
+ * const BindingTable::Binding* binding = table.Update(ip, mac, if_index, BindingTable::ARP, now, &event);
+ * if (event == BindingTable::Event::CONFLICT) { ... binding->mac и binding->other_mac ... }
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+class BindingTable {
+public:
+    static constexpr unsigned int MIN_CAPACITY = 64;
+    static constexpr unsigned int MAX_BINDINGS = 1u << 22;              // предел записей (защита от потока адресов)
+    static constexpr unsigned int CACHE_LINE = 64;
+    static constexpr long long CONFLICT_WINDOW_NS = 10 * 1000000000LL;  // окно, в котором смена MAC - конфликт
+
+    /* Источник привязки (биты поля sources) */
+    enum Source : unsigned char {
+        ARP = 1,                            // адрес отправителя ARP запроса или ответа
+        GRATUITOUS_ARP = 2,                 // объявление: адрес отправителя равен искомому
+        IPV4 = 4                            // адрес отправителя IPv4 пакета из сети интерфейса
+    };
+
+    /* Флаги записи */
+    enum Flag : unsigned char {
+        CONFLICT = 1                        // адрес замечен с двух MAC адресов (второй - other_mac)
+    };
+
+    enum class Event : unsigned char {
+        NONE = 0,                           // привязка подтверждена
+        NEW,                                // новый адрес
+        MOVED,                              // адрес сменил MAC адрес (прежний - other_mac)
+        CONFLICT                            // адрес замечен с другого MAC адреса (other_mac) в окне конфликта
+    };
+
+    struct Binding {
+        long long last_seen;                // время последнего появления в трафике
+        in_addr_t ip;                       // в сетевом порядке байт, 0 - слот свободен
+        int if_index;                       // интерфейс, на котором адрес замечен последним
+        unsigned char mac[ETH_ALEN];
+        unsigned char other_mac[ETH_ALEN];  // второй MAC адрес конфликта, либо прежний после переезда
+        unsigned char sources;              // биты Source
+        unsigned char flags;                // биты Flag
+        unsigned short reserved;
+    };
+    static_assert(sizeof(Binding) == 32, "binding layout");
+
+    /* Обработчик записи при обходе таблицы */
+    using BindingHandler = void (*)(void* ctx, const Binding& binding);
+
+    BindingTable() noexcept = default;
+    ~BindingTable();
+
+    /* Резервирование места под count записей, возвращает false, если не хватило памяти */
+    bool Reserve(unsigned int count) noexcept;
+
+    /* Учёт появления ip (в сетевом порядке байт, не 0) с MAC адресом mac на интерфейсе if_index в момент now
+     * - event - что изменилось в привязке
+     * возвращает запись (действительна до следующего Update), либо nullptr, если новый адрес не поместился */
+    const Binding* Update(in_addr_t ip, const unsigned char* mac, int if_index, Source source, long long now,
+                          Event* event) noexcept;
+
+    /* Запись ip (в сетевом порядке байт), nullptr - адрес не встречался */
+    const Binding* Find(in_addr_t ip) const noexcept;
+
+    /* Вызов handler для каждой записи (в порядке слотов) */
+    void ForEach(BindingHandler handler, void* ctx) const noexcept;
+
+    /* Количество записей и записей с конфликтом */
+    unsigned int GetCount() const noexcept;
+    unsigned int GetConflictCount() const noexcept;
+
+private:
+    bool Rehash(unsigned int capacity) noexcept;
+    unsigned int Slot(in_addr_t ip) const noexcept;
+
+    Binding* bindings_ = nullptr;
+    unsigned int capacity_ = 0;             // степень двойки
+    unsigned int count_ = 0;
+    unsigned int conflicts_ = 0;
+};
@@ -0,0 +1,612 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/ether.h>
+#include <new>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "learner.h"
+#include "utils.h"
+
+/*
+ * При создании объекта:
+ * - выделяются пулы запросов клиентов, списков ожидания и разрешений адресов
+ * - резервируются кэш результатов и таблица запросов в полёте
+ */
+Daemon::Daemon(unsigned int budget_ms) noexcept
+    : budget_ns_((budget_ms == 0 ? DEFAULT_BUDGET_MS : budget_ms) * 1000000LL) {
+    id_ = getpid() & 0xFFFF;
+    seed_ = (unsigned int)utils::MonotonicNs() | 1;
+    if (!ip_proto_.IsCreated()) {
+        return;
+    }
+    queries_ = (PendingQuery*)malloc(sizeof(PendingQuery) * MAX_QUERIES);
+    waiters_ = (unsigned int*)malloc(sizeof(unsigned int) * MAX_QUERIES * MAX_BATCH);
+    lookups_ = (Lookup*)malloc(sizeof(Lookup) * MAX_LOOKUPS);
+    if ((queries_ == nullptr) || (waiters_ == nullptr) || (lookups_ == nullptr)) {
+        printf("Daemon. Error. Not enough memory.\n");
+        return;
+    }
+    for (unsigned int i = MAX_QUERIES; i-- > 0;) {
+        queries_[i].client_fd = -1;
+        queries_[i].next_free = free_query_;
+        free_query_ = i;
+    }
+    for (unsigned int i = MAX_LOOKUPS; i-- > 0;) {
+        // узел таймера после конструктора - не запланирован
+        new (&lookups_[i]) Lookup{};
+        lookups_[i].waiters = free_lookup_;
+        free_lookup_ = i;
+    }
+    // сроки ожидания ведёт колесо таймеров, истечение по таблице запросов не используется
+    if (!answers_.Reserve(CACHE_SIZE) || !probes_.Reserve(MAX_LOOKUPS, 0)) {
+        return;
+    }
+    created_ = true;
+}
+
+Daemon::~Daemon() {
+    if (learner_ != nullptr) {
+        learner_->~Learner();
+        free(learner_);
+    }
+    free(queries_);
+    free(waiters_);
+    free(lookups_);
+}
+
+bool Daemon::IsCreated() const noexcept {
+    return created_;
+}
+
+EthernetProtocol& Daemon::GetEthernet() noexcept {
+    return ip_proto_.GetEthernet();
+}
+
+bool Daemon::EnableLearning() noexcept {
+    if (learner_ != nullptr) {
+        return true;
+    }
+    void* mem = malloc(sizeof(Learner));
+    if (mem == nullptr) {
+        printf("Daemon. Error. Not enough memory.\n");
+        return false;
+    }
+    learner_ = new (mem) Learner();
+    if (!learner_->IsCreated()) {
+        learner_->~Learner();
+        free(learner_);
+        learner_ = nullptr;
+        return false;
+    }
+    learner_->SetHandler(OnBinding, this);
+    return true;
+}
+
+Learner* Daemon::GetLearner() noexcept {
+    return learner_;
+}
+
+/* Файл сокета, оставшийся от прошлого запуска, удаляется, только если к нему нельзя подключиться:
+ * работающий демон на том же пути не подменяется */
+bool Daemon::Listen(const char* path) noexcept {
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Daemon. Error. Socket path %s is too long.\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        printf("Daemon. Error. Can't create socket. %s\n", strerror(errno));
+        return false;
+    }
+    int res = bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr));
+    if ((res < 0) && (errno == EADDRINUSE)) {
+        int probe_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        bool alive = (probe_fd >= 0) && (connect(probe_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+        if (probe_fd >= 0) {
+            close(probe_fd);
+        }
+        if (alive) {
+            printf("Daemon. Error. Another daemon is listening on %s.\n", path);
+            return false;
+        }
+        unlink(path);
+        res = bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    if ((res < 0) || (listen(listen_fd_, MAX_CLIENTS) < 0)) {
+        printf("Daemon. Error. Can't listen on %s. %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void Daemon::Accept() noexcept {
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (clients_count_ == MAX_CLIENTS) {
+            // лишние соединения закрываются сразу - клиент увидит разрыв и может повторить позже
+            close(fd);
+            continue;
+        }
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        clients_[clients_count_++] = fd;
+    }
+}
+
+/* Запросы отключившегося клиента продолжают ждать разрешения адресов (результаты пополнят кэш),
+ * но ответ не отправляется: дескриптор может достаться новому клиенту */
+void Daemon::CloseClient(int fd) noexcept {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    for (unsigned int i = 0; i < clients_count_; ++i) {
+        if (clients_[i] == fd) {
+            clients_[i] = clients_[--clients_count_];
+            break;
+        }
+    }
+    for (unsigned int i = 0; i < MAX_QUERIES; ++i) {
+        if (queries_[i].client_fd == fd) {
+            queries_[i].client_fd = -1;
+        }
+    }
+}
+
+/* Вычитывание всех сообщений клиента. Пока заполняется ответ, счётчик адресов без ответа больше на единицу:
+ * разрешение, завершившееся синхронно (попадание, нет маршрута), не отправит неполный ответ
+ * возвращает false, если соединение нужно закрыть */
+bool Daemon::OnClient(int fd) noexcept {
+    struct {
+        QueryHeader header;
+        in_addr_t ips[MAX_BATCH];
+    } msg;
+    for (;;) {
+        ssize_t len = recv(fd, &msg, sizeof(msg), MSG_TRUNC);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+        }
+        if ((len < (ssize_t)sizeof(QueryHeader)) || (msg.header.count == 0) || (msg.header.count > MAX_BATCH) ||
+            (len != (ssize_t)(sizeof(QueryHeader) + msg.header.count * sizeof(in_addr_t)))) {
+            return false;
+        }
+        ++queries_count_;
+        addresses_ += msg.header.count;
+        unsigned int q = free_query_;
+        if (q == NIL) {
+            // все запросы заняты ожиданием - ответ "перегружен" целиком
+            ++busy_;
+            struct {
+                QueryHeader header;
+                Answer answers[MAX_BATCH];
+            } busy;
+            busy.header = msg.header;
+            for (unsigned int i = 0; i < msg.header.count; ++i) {
+                memset(&busy.answers[i], 0, sizeof(Answer));
+                busy.answers[i].ip = msg.ips[i];
+                busy.answers[i].status = Status::BUSY;
+            }
+            send(fd, &busy, sizeof(QueryHeader) + msg.header.count * sizeof(Answer), MSG_DONTWAIT | MSG_NOSIGNAL);
+            continue;
+        }
+        PendingQuery& query = queries_[q];
+        free_query_ = query.next_free;
+        query.client_fd = fd;
+        query.header = msg.header;
+        query.remaining = msg.header.count + 1;
+        const long long now = utils::MonotonicNs();
+        for (unsigned int i = 0; i < msg.header.count; ++i) {
+            memset(&query.answers[i], 0, sizeof(Answer));
+            query.answers[i].ip = msg.ips[i];
+            Resolve(q, i, now);
+        }
+        if (--query.remaining == 0) {
+            Reply(q);
+        }
+    }
+}
+
+/* Запись slot запроса query: кэш результатов, затем адрес в полёте, затем новое разрешение */
+void Daemon::Resolve(unsigned int q, unsigned int slot, long long now) noexcept {
+    PendingQuery& query = queries_[q];
+    Answer& answer = query.answers[slot];
+    NeighborCache::State state = answers_.Lookup(answer.ip, answer.mac, now);
+    if ((state == NeighborCache::State::REACHABLE) || (state == NeighborCache::State::FAILED) ||
+        (answer.ip == 0) || (answer.ip == INADDR_BROADCAST)) {
+        ++hits_;
+        answer.status = (state == NeighborCache::State::REACHABLE) ? Status::REACHABLE : Status::UNREACHABLE;
+        --query.remaining;
+        return;
+    }
+    const unsigned int waiter = q * MAX_BATCH + slot;
+    unsigned int l;
+    if (probes_.Lookup(answer.ip, id_, 0, &l)) {
+        ++coalesced_;
+        waiters_[waiter] = lookups_[l].waiters;
+        lookups_[l].waiters = waiter;
+        return;
+    }
+    l = free_lookup_;
+    if (l == NIL) {
+        ++busy_;
+        answer.status = Status::BUSY;
+        --query.remaining;
+        return;
+    }
+    Lookup& lookup = lookups_[l];
+    free_lookup_ = lookup.waiters;
+    lookup.ip = answer.ip;
+    lookup.attempts = 0;
+    lookup.started_ns = utils::MonotonicNs();
+    lookup.waiters = waiter;
+    waiters_[waiter] = NIL;
+    Probe(l);
+}
+
+/* Echo request ставится в очередь пакетной отправки (уходит в конце прохода цикла событий),
+ * MAC адрес следующего узла разрешается асинхронно. Запрос, не поставленный в очередь из-за её переполнения,
+ * считается потерянным и повторяется по истечении ожидания.
+ * Срок ожидания - по оценке RTT подсети (не больше четверти бюджета) с увеличением на каждый повтор,
+ * но не позже конца бюджета */
+void Daemon::Probe(unsigned int l) noexcept {
+    Lookup& lookup = lookups_[l];
+    const long long now = utils::MonotonicNs();
+    lookup.sent_ns = now;
+    if (ip_proto_.QueueRequest(echo_, sizeof(echo_), lookup.ip, IPPROTO_ICMP)) {
+        ++queued_;
+        ++sent_;
+    } else if (errno == ENETUNREACH) {
+        Complete(l, Status::NO_ROUTE, nullptr);
+        return;
+    }
+    if (!probes_.Insert(lookup.ip, id_, 0, l, now)) {
+        Complete(l, Status::UNREACHABLE, nullptr);
+        return;
+    }
+    // без измерений RTO подсети - секунда, и весь бюджет ушёл бы на один запрос: первый срок не больше
+    // четверти бюджета, чтобы в бюджет поместилось 2-3 запроса
+    long long rto = subnets_.GetRto(lookup.ip);
+    if (rto > budget_ns_ / 4) {
+        rto = budget_ns_ / 4;
+    }
+    long long deadline = now + RttEstimator::Backoff(rto, lookup.attempts, &seed_);
+    if (deadline > lookup.started_ns + budget_ns_) {
+        deadline = lookup.started_ns + budget_ns_;
+    }
+    ++lookup.attempts;
+    wheel_.Schedule(&lookup.timer, (deadline + TICK_NS - 1) / TICK_NS);
+}
+
+/* Ответ всем ожидающим адреса, разрешение возвращается в пул. Запись в таблице запросов в полёте
+ * к этому моменту уже снята */
+void Daemon::Complete(unsigned int l, Status status, const unsigned char* mac) noexcept {
+    Lookup& lookup = lookups_[l];
+    wheel_.Cancel(&lookup.timer);
+    for (unsigned int waiter = lookup.waiters; waiter != NIL;) {
+        unsigned int next = waiters_[waiter];
+        unsigned int q = waiter / MAX_BATCH;
+        Answer& answer = queries_[q].answers[waiter % MAX_BATCH];
+        answer.status = status;
+        if (mac != nullptr) {
+            memcpy(answer.mac, mac, ETH_ALEN);
+        }
+        if (--queries_[q].remaining == 0) {
+            Reply(q);
+        }
+        waiter = next;
+    }
+    lookup.waiters = free_lookup_;
+    free_lookup_ = l;
+}
+
+/* Ответ клиенту одним сообщением, запрос возвращается в пул */
+void Daemon::Reply(unsigned int q) noexcept {
+    PendingQuery& query = queries_[q];
+    if (query.client_fd >= 0) {
+        send(query.client_fd, &query.header, sizeof(QueryHeader) + query.header.count * sizeof(Answer),
+             MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    query.client_fd = -1;
+    query.next_free = free_query_;
+    free_query_ = q;
+}
+
+void Daemon::OnTick() noexcept {
+    wheel_.Advance(utils::MonotonicNs() / TICK_NS, OnTimer, this);
+}
+
+/* Запрос адреса остался без ответа: запись снимается с таблицы запросов в полёте, затем повтор,
+ * либо по исчерпании бюджета - "не отвечает" (в кэш на FAILED_TTL_NS) */
+void Daemon::OnTimer(void* ctx, TimerWheel::Timer* timer) {
+    Daemon* self = (Daemon*)ctx;
+    Lookup* lookup = (Lookup*)timer;
+    unsigned int l = (unsigned int)(lookup - self->lookups_);
+    self->probes_.Match(lookup->ip, self->id_, 0);
+    self->ip_proto_.GetEthernet().GetMetrics().Add(Metrics::TIMEOUTS);
+    const long long now = utils::MonotonicNs();
+    if ((now < lookup->started_ns + self->budget_ns_) && (lookup->attempts < MAX_ATTEMPTS)) {
+        self->Probe(l);
+        return;
+    }
+    self->answers_.SetFailed(lookup->ip, now);
+    self->Complete(l, Status::UNREACHABLE, nullptr);
+}
+
+void Daemon::HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    Daemon* self = (Daemon*)ctx;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        // ARP ответы пополняют кэш следующих узлов; ответ самого адреса в полёте завершает его разрешение
+        in_addr_t sender_ip;
+        const unsigned char* sender_mac;
+        if (self->ip_proto_.GetArp().HandlePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &sender_ip, &sender_mac)) {
+            self->OnResolved(sender_ip, sender_mac);
+        }
+        return;
+    }
+    Metrics& metrics = self->ip_proto_.GetEthernet().GetMetrics();
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if ((icmp_h == nullptr) || (icmp_h->un.echo.id != self->id_) || (icmp_h->un.echo.sequence != 0)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+    // ответ на уже разрешённый адрес (опоздавший после повтора) - несопоставленный
+    if (!self->OnResolved(ip_h->saddr, eth_h->ether_shost)) {
+        metrics.Add(Metrics::UNMATCHED);
+    }
+}
+
+/* Ответ от ip (в сетевом порядке байт): только для адреса в полёте - результат в кэш и ожидающим
+ * возвращает false, если адреса в полёте нет */
+bool Daemon::OnResolved(in_addr_t ip, const unsigned char* mac) noexcept {
+    unsigned int l;
+    if (!probes_.Match(ip, id_, 0, &l)) {
+        return false;
+    }
+    ip_proto_.GetEthernet().GetMetrics().Add(Metrics::REPLIES);
+    ++resolved_;
+    const long long now = utils::MonotonicNs();
+    // у всех запросов адреса один sequence: RTT однозначен только без повторов (алгоритм Карна)
+    if (lookups_[l].attempts == 1) {
+        subnets_.Get(ip).Sample(now - lookups_[l].sent_ns);
+    }
+    answers_.SetReachable(ip, mac, now);
+    Complete(l, Status::REACHABLE, mac);
+    return true;
+}
+
+/* Адрес замечен в трафике: запись кэша продлевается, адрес в полёте разрешается без ожидания ответа.
+ * Время последнего появления - по тем же монотонным часам, что и кэш */
+void Daemon::OnBinding(void* ctx, const BindingTable::Binding& binding, BindingTable::Event) {
+    Daemon* self = (Daemon*)ctx;
+    if (binding.flags & BindingTable::CONFLICT) {
+        return;
+    }
+    self->answers_.SetReachable(binding.ip, binding.mac, binding.last_seen);
+    unsigned int l;
+    if (self->probes_.Match(binding.ip, self->id_, 0, &l)) {
+        ++self->learned_;
+        self->Complete(l, Status::REACHABLE, binding.mac);
+    }
+}
+
+/* Фильтр ядра пропускает echo reply с нашим идентификатором и ARP ответы, адресованные нашим адресам,
+ * сокет принимает со всех интерфейсов. Все запросы прохода цикла событий уходят одним системным вызовом */
+int Daemon::Run(const char* path) noexcept {
+    if (!created_) {
+        return -1;
+    }
+    Ping::BuildEchoRequest(echo_, sizeof(echo_), id_, 0);
+    ip_proto_.SetAsyncResolve(true);
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    ether.EnableRxRing();
+    ether.EnableTxRing();
+    if (!ip_proto_.SetReplyFilter(id_) || !ether.BindAllInterfaces() ||
+        ((learner_ != nullptr) && !learner_->Start()) || !Listen(path)) {
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+            listen_fd_ = -1;
+        }
+        return -1;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    // SIGINT/SIGTERM принимаются через signalfd, чтобы завершиться штатно, удалить файл сокета и вывести итоги
+    sigset_t signals;
+    sigset_t saved_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &saved_signals);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    bool ok = (epoll_fd_ >= 0) && (timer_fd >= 0) && (signal_fd >= 0);
+    if (!ok) {
+        printf("Daemon. Error. Can't create event descriptors.\n");
+    }
+    struct itimerspec timer_spec{{0, TICK_NS}, {0, TICK_NS}};
+    ok = ok && (timerfd_settime(timer_fd, 0, &timer_spec, nullptr) == 0);
+
+    const int ether_fd = ether.GetSocket();
+    const int ifaces_fd = ether.GetInterfaces().GetSocket();
+    const int routes_fd = ip_proto_.GetRoutes().GetSocket();
+    const int learn_fd = (learner_ != nullptr) ? learner_->GetSocket() : -1;
+    const int learn_ifaces_fd = (learner_ != nullptr) ? learner_->GetEthernet().GetInterfaces().GetSocket() : -1;
+    const int fds[] = {listen_fd_, ether_fd, timer_fd, signal_fd, ifaces_fd, routes_fd, learn_fd, learn_ifaces_fd};
+    for (unsigned int i = 0; ok && (i < sizeof(fds) / sizeof(fds[0])); ++i) {
+        if (fds[i] < 0) {
+            continue;
+        }
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fds[i];
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+            printf("Daemon. Error. Can't configure epoll.\n");
+            ok = false;
+        }
+    }
+    if (ok) {
+        fprintf(stderr, "Daemon listening on %s\n", path);
+    }
+    wheel_.Advance(utils::MonotonicNs() / TICK_NS, OnTimer, this);
+
+    bool stop = false;
+    while (ok && !stop) {
+        struct epoll_event events[16];
+        int n = epoll_wait(epoll_fd_, events, 16, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Daemon. Error. epoll_wait failed.\n");
+            ok = false;
+            break;
+        }
+        for (int i = 0; (i < n) && ok; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == ether_fd) {
+                ok = (ether.RcvFrames(HandleFrame, this, RCV_BATCH) >= 0);
+            } else if (fd == timer_fd) {
+                unsigned long long expirations = 0;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    OnTick();
+                }
+            } else if (fd == listen_fd_) {
+                Accept();
+            } else if (fd == signal_fd) {
+                struct signalfd_siginfo info;
+                stop = (read(signal_fd, &info, sizeof(info)) == sizeof(info));
+            } else if (fd == ifaces_fd) {
+                // изменения интерфейсов, адресов и маршрутов применяются к следующим отправкам, смена адресов
+                // пересобирает фильтр ядра
+                ok = ip_proto_.UpdateInterfaces();
+            } else if (fd == routes_fd) {
+                ok = ip_proto_.GetRoutes().Update();
+            } else if (fd == learn_fd) {
+                ok = (learner_->Poll() >= 0);
+            } else if (fd == learn_ifaces_fd) {
+                ok = learner_->GetEthernet().GetInterfaces().Update();
+            } else if (!OnClient(fd)) {
+                CloseClient(fd);
+            }
+        }
+        // запросы всех событий прохода уходят одним системным вызовом
+        if (queued_ > 0) {
+            if ((ip_proto_.FlushRequests() < 0) && (errno != ENOBUFS) && (errno != EAGAIN)) {
+                ok = false;
+            }
+            queued_ = 0;
+        }
+    }
+
+    while (clients_count_ > 0) {
+        CloseClient(clients_[0]);
+    }
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(path);
+    if (signal_fd >= 0) {
+        close(signal_fd);
+    }
+    sigprocmask(SIG_SETMASK, &saved_signals, nullptr);
+    if (timer_fd >= 0) {
+        close(timer_fd);
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+
+    fprintf(stderr, "Daemon finished: %llu queries, %llu addresses, %llu cache hits, %llu coalesced, "
+            "%llu requests sent, %llu resolved, %llu learned from traffic, %llu busy\n",
+            queries_count_, addresses_, hits_, coalesced_, sent_, resolved_, learned_, busy_);
+    return ok ? 0 : -1;
+}
+
+bool Daemon::Query(const char* path, const in_addr_t* ips, unsigned int count, Answer* answers) noexcept {
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if ((count == 0) || (count > MAX_BATCH) || (strlen(path) >= sizeof(addr.sun_path))) {
+        printf("Daemon. Error. Incorrect query.\n");
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("Daemon. Error. Can't create socket. %s\n", strerror(errno));
+        return false;
+    }
+    struct timeval tv{QUERY_TIMEOUT_MS / 1000, (QUERY_TIMEOUT_MS % 1000) * 1000};
+    if ((setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) ||
+        (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)) {
+        printf("Daemon. Error. Can't connect to %s. %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    struct {
+        QueryHeader header;
+        in_addr_t ips[MAX_BATCH];
+    } request;
+    request.header.tag = getpid();
+    request.header.count = count;
+    memcpy(request.ips, ips, count * sizeof(in_addr_t));
+    struct {
+        QueryHeader header;
+        Answer answers[MAX_BATCH];
+    } response;
+    const ssize_t request_len = sizeof(QueryHeader) + count * sizeof(in_addr_t);
+    const ssize_t response_len = sizeof(QueryHeader) + count * sizeof(Answer);
+    bool ok = (send(fd, &request, request_len, MSG_NOSIGNAL) == request_len);
+    if (!ok) {
+        printf("Daemon. Error. Query not sent. %s\n", strerror(errno));
+    } else {
+        ssize_t len;
+        while (((len = recv(fd, &response, sizeof(response), 0)) < 0) && (errno == EINTR));
+        ok = (len == response_len) && (response.header.tag == request.header.tag) && (response.header.count == count);
+        if (!ok) {
+            printf("Daemon. Error. No answer from daemon. %s\n", (len < 0) ? strerror(errno) : "Incorrect answer");
+        }
+    }
+    close(fd);
+    if (ok) {
+        memcpy(answers, response.answers, count * sizeof(Answer));
+    }
+    return ok;
+}
@@ -0,0 +1,187 @@
+#pragma once
+/*
+ * Резидентный режим: разрешение IPv4 -> MAC по запросам локальных клиентов через Unix сокет
+ *
+ * Однократный запуск утилиты на каждый адрес каждый раз создаёт сокет, загружает таблицы интерфейсов
+ * и маршрутов и ждёт ответа. Демон делает это один раз и держит всё "тёплым":
+ * - сокет с кольцами приёма и передачи, таблицы интерфейсов и маршрутов (обновляются по уведомлениям netlink)
+ * - кэш результатов IPv4 -> MAC (NeighborCache: разрешённые адреса живут REACHABLE_TTL_NS,
+ *   не ответившие - FAILED_TTL_NS)
+ * Попадание в кэш отвечается сразу, в том же проходе цикла событий, без сетевых запросов.
+ *
+ * Промахи объединяются: на адрес в полёте не больше одного запроса, сколько бы клиентов его ни спросили.
+ * Ожидающие ответа записи запросов клиентов связываются в список разрешения адреса (Lookup), разрешение -
+ * в записи таблицы запросов в полёте (ProbeTable, cookie - индекс разрешения). Ответ приходит ICMP echo
+ * reply либо ARP ответом от самого адреса (для адресов из сети интерфейса). Срок ожидания ответа - по оценке
+ * RTT подсети /24 адреса (SubnetRtt, Jacobson/Karels), не больше четверти бюджета, без ответа запрос
+ * повторяется с экспоненциальным увеличением срока и отклонением, пока не исчерпан бюджет времени на адрес
+ * (не более MAX_ATTEMPTS запросов).
+ * Сроки ведёт колесо таймеров (TimerWheel): у каждого адреса свой срок, повторы планируются в цикле событий.
+ * Сокет принимает фреймы со всех интерфейсов, поэтому ответы не теряются при опросе адресов
+ * за разными интерфейсами. Как и в остальных режимах, для адресов за шлюзом возвращается MAC адрес шлюза.
+ *
+ * После EnableLearning кэш результатов пополняется и без запросов: второй сокет (Learner) учит привязки
+ * по чужому трафику сегмента, каждое появление адреса продлевает его запись в кэше на REACHABLE_TTL_NS,
+ * а адрес в полёте разрешается сразу. Запросы уходят только к адресам, которых в трафике не видно.
+ * Адреса с конфликтом (два MAC адреса) по трафику не отвечаются - их разрешает запрос.
+ *
+ * Протокол - Unix сокет SOCK_SEQPACKET, одно сообщение - один запрос или ответ, порядок байт хоста:
+ *   запрос: QueryHeader + count адресов in_addr_t (в сетевом порядке байт), count от 1 до MAX_BATCH
+ *   ответ:  QueryHeader (tag и count запроса) + count записей Answer в порядке адресов запроса
+ * Клиент может отправить несколько запросов подряд, не дожидаясь ответов: ответы различаются по tag,
+ * ответ на запрос из одних попаданий в кэш может прийти раньше ответа на предыдущий запрос.
+ * Некорректное сообщение закрывает соединение. Если клиент не вычитывает ответы и его буфер полон,
+ * ответ отбрасывается.
+ *
+ * USAGE:
+ * Daemon daemon(budget_ms);        // если успешно создан, то IsCreated вернёт true
+ * daemon.EnableLearning();         // необязательно
+ * daemon.Run("/run/ping2.sock");   // до SIGINT/SIGTERM
+ *
+ * Daemon::Answer answers[2];
+ * in_addr_t ips[2] = {inet_addr("10.0.0.1"), inet_addr("10.0.0.2")};
+ * Daemon::Query("/run/ping2.sock", ips, 2, answers);
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+#include "../common/rtt.h"
+#include "binding_table.h"
+#include "icmp.h"
+#include "probe_table.h"
+#include "timer_wheel.h"
+
+class Learner;
+
+class Daemon {
+public:
+    static constexpr const char* DEFAULT_SOCKET_PATH = "/run/ping2.sock";
+    static constexpr unsigned int DEFAULT_BUDGET_MS = 1000;     // общее время на разрешение адреса
+    static constexpr unsigned int MAX_ATTEMPTS = 5;             // предел запросов на адрес
+    static constexpr unsigned int MAX_BATCH = 256;              // адресов в одном запросе клиента
+    static constexpr unsigned int MAX_CLIENTS = 64;             // одновременных соединений
+    static constexpr unsigned int MAX_QUERIES = 256;            // запросов клиентов, ожидающих разрешения адресов
+    static constexpr unsigned int MAX_LOOKUPS = 4096;           // адресов в полёте
+    static constexpr unsigned int CACHE_SIZE = 65536;           // резерв кэша результатов
+    static constexpr long TICK_NS = 1000000;                    // тик колеса таймеров (1 мс)
+    static constexpr int RCV_BATCH = 256;                       // максимум фреймов за одно пробуждение
+    static constexpr int QUERY_TIMEOUT_MS = 5000;               // ожидание ответа демона клиентом
+
+    /* Заголовок сообщения протокола */
+    struct QueryHeader {
+        unsigned int tag;                   // значение клиента, возвращается в ответе
+        unsigned int count;                 // количество адресов (записей ответа)
+    };
+
+    enum class Status : unsigned char {
+        REACHABLE = 0,                      // адрес ответил, MAC адрес в записи
+        UNREACHABLE,                        // нет ответа за бюджет времени (или по отрицательной записи кэша)
+        NO_ROUTE,                           // нет маршрута к адресу
+        BUSY                                // демон перегружен, запрос можно повторить позже
+    };
+
+    /* Запись ответа */
+    struct Answer {
+        in_addr_t ip;                       // в сетевом порядке байт
+        Status status;
+        unsigned char mac[ETH_ALEN];
+        unsigned char reserved;
+    };
+    static_assert(sizeof(QueryHeader) == 8, "query header layout");
+    static_assert(sizeof(Answer) == 12, "answer layout");
+
+    /* - budget_ms - общее время на разрешение адреса, 0 - DEFAULT_BUDGET_MS */
+    explicit Daemon(unsigned int budget_ms) noexcept;
+    ~Daemon();
+
+    bool IsCreated() const noexcept;
+
+    /* Ethernet уровень - для подключения приёмника копий принятых фреймов (SetFrameSink) */
+    EthernetProtocol& GetEthernet() noexcept;
+
+    /* Пассивное обучение привязок по трафику сегмента, до вызова Run
+     * возвращает false, если не удалось создать сокет обучения */
+    bool EnableLearning() noexcept;
+
+    /* Объект пассивного обучения, nullptr - обучение не включено */
+    Learner* GetLearner() noexcept;
+
+    /* Обслуживание клиентов на Unix сокете path до SIGINT/SIGTERM
+     * Оставшийся от прошлого запуска файл сокета заменяется, если его никто не слушает
+     * возвращает 0 при штатном завершении, -1 при ошибке */
+    int Run(const char* path) noexcept;
+
+    /* Клиент: разрешение count (не более MAX_BATCH) адресов ips (в сетевом порядке байт) демоном на сокете path
+     * возвращает true, если ответ получен - записи в answers в порядке адресов */
+    static bool Query(const char* path, const in_addr_t* ips, unsigned int count, Answer* answers) noexcept;
+
+private:
+    static constexpr unsigned int NIL = 0xFFFFFFFF;
+
+    /* Запрос клиента, ожидающий разрешения части адресов */
+    struct PendingQuery {
+        int client_fd;                      // -1 - клиент отключился, ответ не отправляется
+        unsigned int remaining;             // адресов без ответа
+        unsigned int next_free;
+        QueryHeader header;                 // заголовок и записи ответа идут подряд - одно сообщение
+        Answer answers[MAX_BATCH];
+    };
+
+    /* Разрешение адреса в полёте */
+    struct Lookup {
+        TimerWheel::Timer timer;            // первое поле: узел таймера приводится к разрешению
+        long long started_ns;               // время первого запроса - от него отсчитывается бюджет
+        long long sent_ns;                  // время последнего запроса
+        in_addr_t ip;                       // в сетевом порядке байт
+        unsigned int attempts;              // отправлено запросов
+        unsigned int waiters;               // список ожидающих ответа записей, либо следующий свободный
+    };
+
+    bool Listen(const char* path) noexcept;
+    void Accept() noexcept;
+    void CloseClient(int fd) noexcept;
+    bool OnClient(int fd) noexcept;
+    void Resolve(unsigned int query, unsigned int slot, long long now) noexcept;
+    void Probe(unsigned int lookup) noexcept;
+    void Complete(unsigned int lookup, Status status, const unsigned char* mac) noexcept;
+    void Reply(unsigned int query) noexcept;
+    void OnTick() noexcept;
+    static void OnTimer(void* ctx, TimerWheel::Timer* timer);
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len);
+    bool OnResolved(in_addr_t ip, const unsigned char* mac) noexcept;
+    static void OnBinding(void* ctx, const BindingTable::Binding& binding, BindingTable::Event event);
+
+    IPProtocol ip_proto_;
+    NeighborCache answers_;                 // кэш результатов (не путать с кэшем следующих узлов ArpResolver)
+    ProbeTable probes_;                     // адреса в полёте: ключ (адрес, id_, 0), cookie - индекс Lookup
+    TimerWheel wheel_;                      // сроки ожидания ответов
+    SubnetRtt subnets_;                     // оценки RTT по подсетям
+    long long budget_ns_;
+    unsigned int seed_;                     // генератор отклонений повторов
+    unsigned short id_;
+    bool created_ = false;
+
+    unsigned char echo_[Ping::PING_PKT_SIZE];   // echo request, один на все адреса
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int clients_[MAX_CLIENTS];
+    Learner* learner_ = nullptr;            // пассивное обучение (EnableLearning)
+    unsigned int clients_count_ = 0;
+
+    PendingQuery* queries_ = nullptr;
+    unsigned int* waiters_ = nullptr;       // списки ожидающих: записи slot запроса query соответствует
+                                            // элемент query * MAX_BATCH + slot - индекс следующей записи
+    Lookup* lookups_ = nullptr;
+    unsigned int free_query_ = NIL;
+    unsigned int free_lookup_ = NIL;
+    unsigned int queued_ = 0;               // запросов в очереди отправки
+
+    unsigned long long queries_count_ = 0;
+    unsigned long long addresses_ = 0;
+    unsigned long long hits_ = 0;
+    unsigned long long coalesced_ = 0;      // промахов, присоединённых к адресу в полёте
+    unsigned long long sent_ = 0;
+    unsigned long long resolved_ = 0;
+    unsigned long long learned_ = 0;        // адресов в полёте, разрешённых по трафику
+    unsigned long long busy_ = 0;
+};
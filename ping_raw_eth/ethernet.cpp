@@ -1,51 +1,96 @@
 #include <arpa/inet.h>
 #include <errno.h>
-#include <ifaddrs.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
 #include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
 #include <netinet/ether.h>
 #include <netinet/in.h>
+#include <new>
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "ethernet.h"
+#include "frame.h"
+#include "uring.h"
+#include "utils.h"
+
+/* Очередь пакетной отправки через sendmmsg */
+struct TxBatch {
+    unsigned int count;
+    struct mmsghdr msgs[EthernetProtocol::TX_BATCH_MAX];
+    struct iovec iov[EthernetProtocol::TX_BATCH_MAX];
+    struct sockaddr_ll addr[EthernetProtocol::TX_BATCH_MAX];
+    unsigned char frames[EthernetProtocol::TX_BATCH_MAX][ETH_FRAME_LEN];
+};
+
+/* Кольца и буферы io_uring: отправка и приём идут через разные кольца, чтобы завершения отправки
+ * разбирались сразу при отправке, не дожидаясь разбора принятых фреймов */
+struct UringState {
+    Uring tx{EthernetProtocol::URING_ENTRIES, EthernetProtocol::URING_ENTRIES * 2};
+    Uring rx{EthernetProtocol::URING_ENTRIES, EthernetProtocol::URING_RX_BUFFERS * 2};
+    unsigned char* buffers = nullptr;       // слоты отправки (зарегистрированы), за ними буферы приёма
+    unsigned long buffers_size = 0;
+    struct msghdr rx_msg{};                 // разметка буфера приёма: место под адрес и управляющие сообщения
+    unsigned int tx_queued = 0;             // слотов в очереди, ещё не отданных ядру
+    unsigned int tx_inflight = 0;           // отдано ядру, завершения ещё нет
+    int tx_error = 0;                       // errno первой неудачной отправки
+    int rx_held = -1;                       // буфер приёма, отданный пользователю, -1 - нет
+    bool rx_armed = false;                  // многоразовый приём активен
+};
 
 namespace {
-/* Получаем MAC адрес по имени интерфейса:
- * - если запрашивается имя loopback интерфеса, то возвращаем нули
- * - посредством ioctl получаем MAC адрес интерфейса, по заданному имени
+constexpr unsigned short URING_RX_GROUP = 0;           // группа буферов приёма
+constexpr unsigned int URING_RX_CONTROL_LEN = 128;     // место под управляющие сообщения (метки времени)
+
+/* Получаем MAC адрес по имени интерфейса из таблицы интерфейсов:
+ * - у loopback интерфейса MAC адрес нулевой
  * входные параметры:
  * if_name - null-terminated string имя интерфейса
- * hw_addr - массив длиной HW_ADDR_LEN для записи результата
- * выходной параметр: ifr_ifindex. либо -1 при неудаче */
-int GetIfMacByName(const char* if_name, int len, unsigned char* hw_addr, int sck_fd) {
-    if (strcmp(if_name, "lo") == 0) {
-        memset(hw_addr, 0, ETH_ALEN);
-        return 1;
-    }
-
-    struct ifreq ifr;
-    if (sck_fd < 0) {
-        printf("Ethernet. Error. Socket file descriptor for getting my MAC address not received!\n");
-        return -1;
-    };
-
-    strncpy(ifr.ifr_name, if_name, len);
-    if (ioctl(sck_fd, SIOCGIFHWADDR, &ifr) < 0) {
-        printf("Ethernet. Error while reading interface %s HW address.\n", if_name);
+ * hw_addr - массив длиной ETH_ALEN для записи результата
+ * выходной параметр: индекс интерфейса, либо -1 при неудаче */
+int GetIfMacByName(const InterfaceTable& table, const char* if_name, unsigned char* hw_addr) {
+    const InterfaceTable::Interface* iface = table.FindByName(if_name);
+    if (iface == nullptr) {
+        printf("Ethernet. Error. Interface %s not found.\n", if_name);
         return -1;
     }
+    memcpy(hw_addr, iface->mac, ETH_ALEN);
+    return iface->index;
+}
 
-    memcpy(hw_addr, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+/* Метки времени из управляющего сообщения SCM_TIMESTAMPING: ts[0] - программная, ts[2] - аппаратная */
+void ReadTimestamps(struct msghdr* msg, EthernetProtocol::Timestamp* ts) {
+    ts->software = 0;
+    ts->hardware = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPING)) {
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            ts->software = stamps.ts[0].tv_sec * 1000000000LL + stamps.ts[0].tv_nsec;
+            ts->hardware = stamps.ts[2].tv_sec * 1000000000LL + stamps.ts[2].tv_nsec;
+        }
+    }
+}
 
-    if (ioctl(sck_fd, SIOCGIFINDEX, &ifr) < 0) {
-        printf("Ethernet. Error while reading interface %s index.\n", if_name);
-        return -1;
+/* Сообщение очереди ошибок - метка отправки фрейма драйверу (SCM_TSTAMP_SND), а не другая ошибка */
+bool IsSendTimestamp(struct msghdr* msg) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_PACKET) && (cmsg->cmsg_type == PACKET_TX_TIMESTAMP)) {
+            const struct sock_extended_err* err = (const struct sock_extended_err*)CMSG_DATA(cmsg);
+            return (err->ee_errno == ENOMSG) && (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) &&
+                   (err->ee_info == SCM_TSTAMP_SND);
+        }
     }
-    return ifr.ifr_ifindex;
+    return false;
 }
 }
 
@@ -53,11 +98,13 @@ int GetIfMacByName(const char* if_name, int len, unsigned char* hw_addr, int sck
  * При создании объекта:
  * - открываем сокет
  * - настраиваем сокет
- * - получаем список сетевых интерфейсов в системе (кроме loopback)
+ * - загружаем таблицу сетевых интерфейсов (rtnetlink), нужен хотя бы один рабочий интерфейс кроме loopback
  */
 EthernetProtocol::EthernetProtocol() noexcept {
     memset(rcvd_mac_addr_, 0, ETH_ALEN);
     memset(used_if_name_, 0, IFNAMSIZ);
+    memset(bound_if_name_, 0, IFNAMSIZ);
+    own_metrics_.Reset("");
 
     sock_fd_ = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
     if (sock_fd_ < 0) {
@@ -69,18 +116,61 @@ EthernetProtocol::EthernetProtocol() noexcept {
             close(sock_fd_);
             return;
         }
-        for (int i = 0; i < INTERFACE_MAX_COUNT; ++i) {
-            memset(if_list_[i], 0, IFNAMSIZ);
+        if (!ifaces_.IsCreated()) {
+            close(sock_fd_);
+            return;
         }
-        if (RetrieveInterfacesList()) {
-            created_ = true;
+        if (GetInterfaceName(0)[0] == 0) {
+            printf("Error. Can't get list of interfaces.\n");
+            close(sock_fd_);
+            return;
         }
+        created_ = true;
     }
 }
+
+/*
+ * Объект без сокета: загружается только таблица интерфейсов (для маршрутов и адресов вышестоящих уровней),
+ * рабочих интерфейсов может и не быть
+ */
+EthernetProtocol::EthernetProtocol(FrameSource source, void* ctx) noexcept
+    : sock_fd_(-1), source_(source), source_ctx_(ctx) {
+    memset(rcvd_mac_addr_, 0, ETH_ALEN);
+    memset(used_if_name_, 0, IFNAMSIZ);
+    memset(bound_if_name_, 0, IFNAMSIZ);
+    own_metrics_.Reset("");
+    created_ = (source != nullptr) && ifaces_.IsCreated();
+}
 EthernetProtocol::~EthernetProtocol() {
+    if (uring_ != nullptr) {
+        unsigned char* buffers = uring_->buffers;
+        unsigned long buffers_size = uring_->buffers_size;
+        uring_->~UringState();
+        free(uring_);
+        uring_ = nullptr;
+        if (buffers != nullptr) {
+            munmap(buffers, buffers_size);
+        }
+    }
+    if (rx_ring_ != nullptr) {
+        munmap(rx_ring_, rx_ring_size_);
+        rx_ring_ = nullptr;
+    }
+    if (tx_ring_ != nullptr) {
+        munmap(tx_ring_, (unsigned long)tx_ring_frames_ * TX_FRAME_SIZE);
+        tx_ring_ = nullptr;
+    }
+    if (tx_fd_ >= 0) {
+        close(tx_fd_);
+        tx_fd_ = -1;
+    }
+    free(tx_batch_);
+    tx_batch_ = nullptr;
     if (created_) {
         created_= false;
-        close(sock_fd_);
+        if (sock_fd_ >= 0) {
+            close(sock_fd_);
+        }
     }
 }
 
@@ -92,123 +182,1078 @@ bool EthernetProtocol::IsCreated() const noexcept {
  * входные параметры:
  * - data - данные, которые будут отправлены в пакете
  * - data_len - длина в байтах параметра data
- * - if_name - нуль терминированная строка - имя интерфейса */
-bool EthernetProtocol::SendRequest(const unsigned char* data, int data_len, const char* if_name) noexcept {
-    int tx_len = 0;
-    unsigned char send_buf[ETH_FRAME_LEN];
-    struct ether_header* eth_h = (struct ether_header*) send_buf;
-    struct sockaddr_ll socket_address{};
-
+ * - if_name - нуль терминированная строка - имя интерфейса
+ * - dst_mac - MAC адрес получателя, либо nullptr для широковещательной отправки
+ * - ether_type - EtherType фрейма */
+bool EthernetProtocol::SendRequest(const unsigned char* data, int data_len, const char* if_name,
+                                   const unsigned char* dst_mac, unsigned short ether_type) noexcept {
+    PacketBuffer pkt;
     data_len = (data_len > ETH_DATA_LEN) ? ETH_DATA_LEN : data_len;
+    memcpy(pkt.Put(data_len), data, data_len);
+    return SendPacket(pkt, if_name, dst_mac, ether_type);
+}
 
-    memset(send_buf, 0, sizeof(send_buf));
-
-    memset(eth_h->ether_dhost, 0xff, ETH_ALEN);
-    eth_h->ether_type = htons(ETH_P_IP);
-    tx_len += sizeof(*eth_h);
-
-    memcpy(&(send_buf[tx_len]), data, data_len);
-    tx_len += data_len;
-
-    socket_address.sll_halen = ETH_ALEN;
+/* Отправка пакета из буфера с запасом: Ethernet заголовок дописывается перед данными, данные не копируются */
+bool EthernetProtocol::SendPacket(PacketBuffer& pkt, const char* if_name, const unsigned char* dst_mac,
+                                  unsigned short ether_type) noexcept {
+    if (pkt.GetLength() > ETH_DATA_LEN) {
+        printf("Ethernet. Error. Too large packet (%d)!\n", pkt.GetLength());
+        return false;
+    }
     unsigned char my_mac_addr[ETH_ALEN];
-    int if_idx = GetIfMacByName(if_name, IFNAMSIZ, my_mac_addr, sock_fd_);
+    int if_idx = GetIfMacByName(ifaces_, if_name, my_mac_addr);
     if (if_idx < 0) {
         return false;
     }
+    struct ether_header* eth_h = (struct ether_header*)pkt.Push(sizeof(struct ether_header));
+    if (eth_h == nullptr) {
+        printf("Ethernet. Error. No headroom for ethernet header!\n");
+        return false;
+    }
+    if (dst_mac != nullptr) {
+        memcpy(eth_h->ether_dhost, dst_mac, ETH_ALEN);
+    } else {
+        memset(eth_h->ether_dhost, 0xff, ETH_ALEN);
+    }
     memcpy(eth_h->ether_shost, my_mac_addr, ETH_ALEN);
+    eth_h->ether_type = htons(ether_type);
+
+    struct sockaddr_ll socket_address{};
+    socket_address.sll_halen = ETH_ALEN;
     memcpy(socket_address.sll_addr, eth_h->ether_dhost, ETH_ALEN);
     socket_address.sll_ifindex = if_idx;
 
     strncpy(used_if_name_, if_name, IFNAMSIZ);
-    if (sendto(sock_fd_, send_buf, tx_len, 0, (struct sockaddr*)&socket_address, sizeof(struct sockaddr_ll)) < 0) {
+    long long start = utils::MonotonicNs();
+    int res = sendto(sock_fd_, pkt.GetData(), pkt.GetLength(), 0, (struct sockaddr*)&socket_address, sizeof(struct sockaddr_ll));
+    metrics_->Record(Metrics::TX_SEND, utils::MonotonicNs() - start);
+    metrics_->Add(Metrics::TX_SYSCALLS);
+    if (res < 0) {
+        metrics_->Add(Metrics::TX_ERRORS);
         printf("Ethernet. Send failed. %s\n", strerror(errno));
         return false;
     }
+    metrics_->Add(Metrics::TX_FRAMES);
+    return true;
+}
+
+/* Формирование фрейма в buf: заполняется только заголовок и данные, без обнуления всего буфера
+ * возвращает длину фрейма */
+int EthernetProtocol::BuildFrame(unsigned char* buf, const unsigned char* data, int data_len, const unsigned char* src_mac,
+                                 const unsigned char* dst_mac, unsigned short ether_type) const noexcept {
+    struct ether_header* eth_h = (struct ether_header*)buf;
+    data_len = (data_len > ETH_DATA_LEN) ? ETH_DATA_LEN : data_len;
+
+    if (dst_mac != nullptr) {
+        memcpy(eth_h->ether_dhost, dst_mac, ETH_ALEN);
+    } else {
+        memset(eth_h->ether_dhost, 0xff, ETH_ALEN);
+    }
+    memcpy(eth_h->ether_shost, src_mac, ETH_ALEN);
+    eth_h->ether_type = htons(ether_type);
+    memcpy(buf + sizeof(*eth_h), data, data_len);
+    return sizeof(*eth_h) + data_len;
+}
+
+bool EthernetProtocol::QueueRequest(const unsigned char* data, int data_len, const char* if_name,
+                                    const unsigned char* dst_mac, unsigned short ether_type) noexcept {
+    const InterfaceTable::Interface* iface = ifaces_.FindByName(if_name);
+    if (iface == nullptr) {
+        printf("Ethernet. Error. Interface %s not found.\n", if_name);
+        return false;
+    }
+    strncpy(used_if_name_, if_name, IFNAMSIZ);
+    unsigned char* buf = ReserveFrame(iface->index);
+    if (buf == nullptr) {
+        return false;
+    }
+    CommitFrame(BuildFrame(buf, data, data_len, iface->mac, dst_mac, ether_type));
+    return true;
+}
+
+/* Слот очереди: в кольце передачи - следующий свободный слот кольца (при смене интерфейса кольцо
+ * предварительно отправляется и перепривязывается), иначе - следующий элемент пачки sendmmsg */
+unsigned char* EthernetProtocol::ReserveFrame(int if_idx) noexcept {
+    if (uring_ != nullptr) {
+        if ((tx_ring_if_idx_ != if_idx) && ((FlushUring() < 0) || !BindTxRing(if_idx))) {
+            return nullptr;
+        }
+        if ((uring_->tx_queued == URING_ENTRIES) && (FlushUring() < 0)) {
+            return nullptr;
+        }
+        // слоты переиспользуются только после завершения всех отданных ядру отправок
+        if ((uring_->tx_inflight > 0) && !ReapUringSends()) {
+            errno = ENOBUFS;
+            return nullptr;
+        }
+        return uring_->buffers + (unsigned long)uring_->tx_queued * TX_FRAME_SIZE;
+    }
+    if (tx_ring_ != nullptr) {
+        if ((tx_ring_if_idx_ != if_idx) && ((FlushTxRing() < 0) || !BindTxRing(if_idx))) {
+            return nullptr;
+        }
+        struct tpacket2_hdr* hdr = (struct tpacket2_hdr*)(tx_ring_ + (unsigned long)tx_ring_head_ * TX_FRAME_SIZE);
+        if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            // кольцо заполнено - отправляем накопленное и ждём освобождения слотов
+            if (FlushTxRing() < 0) {
+                return nullptr;
+            }
+            if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+                errno = ENOBUFS;
+                return nullptr;
+            }
+        }
+        return (unsigned char*)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+    }
+
+    if (tx_batch_ == nullptr) {
+        tx_batch_ = (TxBatch*)malloc(sizeof(TxBatch));
+        if (tx_batch_ == nullptr) {
+            printf("Ethernet. Error. Not enough memory for send queue.\n");
+            return nullptr;
+        }
+        tx_batch_->count = 0;
+    }
+    if ((tx_batch_->count == TX_BATCH_MAX) && (FlushTxBatch() < 0)) {
+        return nullptr;
+    }
+    tx_batch_->addr[tx_batch_->count].sll_ifindex = if_idx;
+    return tx_batch_->frames[tx_batch_->count];
+}
+
+/* Адрес sockaddr_ll для sendmmsg берётся из заголовка готового фрейма */
+void EthernetProtocol::CommitFrame(int frame_len) noexcept {
+    if (uring_ != nullptr) {
+        // сокет отправки привязан к интерфейсу - адрес не нужен, фрейм пишется из зарегистрированного буфера
+        struct io_uring_sqe* sqe = uring_->tx.GetSqe();
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = tx_fd_;
+        sqe->addr = (unsigned long long)(uring_->buffers + (unsigned long)uring_->tx_queued * TX_FRAME_SIZE);
+        sqe->len = frame_len;
+        sqe->buf_index = 0;
+        ++uring_->tx_queued;
+        return;
+    }
+    if (tx_ring_ != nullptr) {
+        struct tpacket2_hdr* hdr = (struct tpacket2_hdr*)(tx_ring_ + (unsigned long)tx_ring_head_ * TX_FRAME_SIZE);
+        hdr->tp_len = frame_len;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        tx_ring_head_ = (tx_ring_head_ + 1) % tx_ring_frames_;
+        ++tx_ring_queued_;
+        return;
+    }
+
+    unsigned int i = tx_batch_->count++;
+    const struct ether_header* eth_h = (const struct ether_header*)tx_batch_->frames[i];
+    struct sockaddr_ll* addr = &tx_batch_->addr[i];
+    int if_idx = addr->sll_ifindex;
+    memset(addr, 0, sizeof(*addr));
+    addr->sll_family = AF_PACKET;
+    addr->sll_protocol = eth_h->ether_type;
+    addr->sll_ifindex = if_idx;
+    addr->sll_halen = ETH_ALEN;
+    memcpy(addr->sll_addr, eth_h->ether_dhost, ETH_ALEN);
+    tx_batch_->iov[i].iov_base = tx_batch_->frames[i];
+    tx_batch_->iov[i].iov_len = frame_len;
+    memset(&tx_batch_->msgs[i], 0, sizeof(tx_batch_->msgs[i]));
+    tx_batch_->msgs[i].msg_hdr.msg_name = addr;
+    tx_batch_->msgs[i].msg_hdr.msg_namelen = sizeof(*addr);
+    tx_batch_->msgs[i].msg_hdr.msg_iov = &tx_batch_->iov[i];
+    tx_batch_->msgs[i].msg_hdr.msg_iovlen = 1;
+}
+
+int EthernetProtocol::FlushRequests() noexcept {
+    if (uring_ != nullptr) {
+        return FlushUring();
+    }
+    if (tx_ring_ != nullptr) {
+        return FlushTxRing();
+    }
+    return FlushTxBatch();
+}
+
+/* Отправка очереди sendmmsg. Если ядро приняло не все сообщения, досылаем остаток */
+int EthernetProtocol::FlushTxBatch() noexcept {
+    if ((tx_batch_ == nullptr) || (tx_batch_->count == 0)) {
+        return 0;
+    }
+    unsigned int sent = 0;
+    while (sent < tx_batch_->count) {
+        long long start = utils::MonotonicNs();
+        int res = sendmmsg(sock_fd_, &tx_batch_->msgs[sent], tx_batch_->count - sent, 0);
+        metrics_->Record(Metrics::TX_SEND, utils::MonotonicNs() - start);
+        metrics_->Add(Metrics::TX_SYSCALLS);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            metrics_->Add(Metrics::TX_ERRORS);
+            printf("Ethernet. Send failed. %s\n", strerror(errno));
+            tx_batch_->count = 0;
+            metrics_->Add(Metrics::TX_FRAMES, sent);
+            return (sent > 0) ? (int)sent : -1;
+        }
+        sent += res;
+    }
+    tx_batch_->count = 0;
+    metrics_->Add(Metrics::TX_FRAMES, sent);
+    return sent;
+}
+
+/* Отправка кольца: один send без данных отдаёт ядру все слоты в состоянии TP_STATUS_SEND_REQUEST.
+ * Вызов блокирующий - возврат после того, как слоты освобождены.
+ * Фрейм, который ядро не смогло разобрать, останавливает отправку на себе (TP_STATUS_WRONG_FORMAT, send
+ * возвращает ошибку): его слот освобождается, фрейм считается потерянным (TX_DROPPED), остаток досылается */
+int EthernetProtocol::FlushTxRing() noexcept {
+    if (tx_ring_queued_ == 0) {
+        return 0;
+    }
+    int queued = tx_ring_queued_;
+    tx_ring_queued_ = 0;
+    for (;;) {
+        long long start = utils::MonotonicNs();
+        int res = send(tx_fd_, nullptr, 0, 0);
+        metrics_->Record(Metrics::TX_SEND, utils::MonotonicNs() - start);
+        metrics_->Add(Metrics::TX_SYSCALLS);
+        if (res >= 0) {
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        unsigned int dropped = DropWrongFormat(queued);
+        if (dropped > 0) {
+            printf("Ethernet. Send ring frame has wrong format, %u frame(s) dropped.\n", dropped);
+            metrics_->Add(Metrics::TX_DROPPED, dropped);
+            queued -= dropped;
+            continue;
+        }
+        metrics_->Add(Metrics::TX_ERRORS);
+        printf("Ethernet. Send failed. %s\n", strerror(errno));
+        return -1;
+    }
+    metrics_->Add(Metrics::TX_FRAMES, queued);
+    return queued;
+}
+
+/* Освобождение слотов с TP_STATUS_WRONG_FORMAT среди queued последних поставленных в кольцо
+ * возвращает количество освобождённых слотов */
+unsigned int EthernetProtocol::DropWrongFormat(unsigned int queued) noexcept {
+    unsigned int dropped = 0;
+    unsigned int slot = (tx_ring_head_ + tx_ring_frames_ - queued) % tx_ring_frames_;
+    for (unsigned int i = 0; i < queued; ++i) {
+        struct tpacket2_hdr* hdr = (struct tpacket2_hdr*)(tx_ring_ + (unsigned long)slot * TX_FRAME_SIZE);
+        if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_WRONG_FORMAT) {
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+            ++dropped;
+        }
+        slot = (slot + 1) % tx_ring_frames_;
+    }
+    return dropped;
+}
+
+/* Отправка очереди io_uring: все запросы отдаются ядру и дожидаются завершения одним io_uring_enter
+ * (повторные вызовы - только если ядро завершило не всё сразу) */
+int EthernetProtocol::FlushUring() noexcept {
+    if (uring_->tx_queued == 0) {
+        return 0;
+    }
+    int queued = uring_->tx_queued;
+    uring_->tx_queued = 0;
+    uring_->tx_inflight += queued;
+    uring_->tx_error = 0;
+    long long start = utils::MonotonicNs();
+    int res = uring_->tx.Submit(uring_->tx_inflight, URING_SEND_TIMEOUT_MS * 1000000LL);
+    metrics_->Record(Metrics::TX_SEND, utils::MonotonicNs() - start);
+    metrics_->Add(Metrics::TX_SYSCALLS);
+    if ((res < 0) && (errno != ETIME)) {
+        metrics_->Add(Metrics::TX_ERRORS);
+        printf("Ethernet. Send failed. %s\n", strerror(errno));
+        return -1;
+    }
+    if (!ReapUringSends()) {
+        metrics_->Add(Metrics::TX_ERRORS);
+        printf("Ethernet. Error. Send is not completed in %u ms.\n", URING_SEND_TIMEOUT_MS);
+        return -1;
+    }
+    if (uring_->tx_error != 0) {
+        metrics_->Add(Metrics::TX_ERRORS);
+        errno = uring_->tx_error;
+        printf("Ethernet. Send failed. %s\n", strerror(errno));
+        return -1;
+    }
+    metrics_->Add(Metrics::TX_FRAMES, queued);
+    return queued;
+}
+
+/* Разбор завершений отправки io_uring, при необходимости - с ожиданием не дольше URING_SEND_TIMEOUT_MS
+ * возвращает true, если все отданные ядру отправки завершены */
+bool EthernetProtocol::ReapUringSends() noexcept {
+    bool waited = false;
+    for (;;) {
+        const struct io_uring_cqe* cqe;
+        while ((cqe = uring_->tx.PeekCqe()) != nullptr) {
+            if ((cqe->res < 0) && (uring_->tx_error == 0)) {
+                uring_->tx_error = -cqe->res;
+            }
+            --uring_->tx_inflight;
+            uring_->tx.SeenCqe();
+        }
+        if ((uring_->tx_inflight == 0) || waited) {
+            return uring_->tx_inflight == 0;
+        }
+        metrics_->Add(Metrics::TX_SYSCALLS);
+        if ((uring_->tx.Submit(uring_->tx_inflight, URING_SEND_TIMEOUT_MS * 1000000LL) < 0) && (errno != ETIME)) {
+            return false;
+        }
+        waited = true;
+    }
+}
+
+bool EthernetProtocol::BindTxRing(int if_idx) noexcept {
+    struct sockaddr_ll sll{};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = 0;   // сокет кольца только передаёт
+    sll.sll_ifindex = if_idx;
+    if (bind(tx_fd_, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+        printf("Ethernet. Error binding send ring to device. %s\n", strerror(errno));
+        return false;
+    }
+    tx_ring_if_idx_ = if_idx;
+    return true;
+}
+
+bool EthernetProtocol::EnableTxRing(unsigned int frame_count) noexcept {
+    static constexpr unsigned int TX_BLOCK_SIZE = 1 << 16;
+    static constexpr unsigned int FRAMES_PER_BLOCK = TX_BLOCK_SIZE / TX_FRAME_SIZE;
+
+    if (tx_ring_ != nullptr) {
+        return true;
+    }
+    if (uring_ != nullptr) {
+        return false;
+    }
+    frame_count = ((frame_count + FRAMES_PER_BLOCK - 1) / FRAMES_PER_BLOCK) * FRAMES_PER_BLOCK;
+
+    tx_fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (tx_fd_ < 0) {
+        printf("Ethernet. Error. Socket file descriptor for send ring not received!\n");
+        return false;
+    }
+    if (timestamping_ != 0) {
+        // без меток на сокете кольца останутся только метки приёма
+        SetTimestamping(tx_fd_);
+    }
+    int version = TPACKET_V2;
+    struct tpacket_req req{};
+    req.tp_block_size = TX_BLOCK_SIZE;
+    req.tp_block_nr = frame_count / FRAMES_PER_BLOCK;
+    req.tp_frame_size = TX_FRAME_SIZE;
+    req.tp_frame_nr = frame_count;
+    void* ring = MAP_FAILED;
+    if ((setsockopt(tx_fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == 0) &&
+        (setsockopt(tx_fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) == 0)) {
+        ring = mmap(nullptr, (unsigned long)frame_count * TX_FRAME_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, tx_fd_, 0);
+    }
+    if (ring == MAP_FAILED) {
+        printf("Ethernet. Error setting PACKET_TX_RING. %s\n", strerror(errno));
+        close(tx_fd_);
+        tx_fd_ = -1;
+        return false;
+    }
+    tx_ring_ = (unsigned char*)ring;
+    tx_ring_frames_ = frame_count;
+    tx_ring_head_ = 0;
+    tx_ring_queued_ = 0;
+    tx_ring_if_idx_ = -1;
+    return true;
+}
+
+bool EthernetProtocol::IsTxRingEnabled() const noexcept {
+    return tx_ring_ != nullptr;
+}
+
+/*
+ * Включение io_uring:
+ * - два кольца (отправка и приём) и одна область буферов: TX слоты по TX_FRAME_SIZE регистрируются
+ *   в кольце отправки, буферы приёма по RX_FRAME_SIZE отдаются ядру кольцом предоставленных буферов
+ * - отдельный сокет отправки (как у кольца передачи), привязывается к интерфейсу при первой отправке
+ * - приёмный буфер сокета увеличивается до URING_RCV_BUF_SIZE
+ * - многоразовый приём ставится сразу
+ */
+bool EthernetProtocol::EnableUring() noexcept {
+    if (uring_ != nullptr) {
+        return true;
+    }
+    if ((source_ != nullptr) || (rx_ring_ != nullptr) || (tx_ring_ != nullptr)) {
+        printf("Ethernet. Error. io_uring can't be combined with PACKET_RX_RING/PACKET_TX_RING.\n");
+        return false;
+    }
+    void* mem = malloc(sizeof(UringState));
+    if (mem == nullptr) {
+        printf("Ethernet. Error. Not enough memory for io_uring.\n");
+        return false;
+    }
+    UringState* state = new (mem) UringState();
+    unsigned long tx_size = (unsigned long)URING_ENTRIES * TX_FRAME_SIZE;
+    state->buffers_size = tx_size + (unsigned long)URING_RX_BUFFERS * RX_FRAME_SIZE;
+    void* buffers = mmap(nullptr, state->buffers_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    state->buffers = (buffers == MAP_FAILED) ? nullptr : (unsigned char*)buffers;
+    int fd = socket(AF_PACKET, SOCK_RAW, 0);
+    bool ok = state->tx.IsCreated() && state->rx.IsCreated() && (state->buffers != nullptr) && (fd >= 0) &&
+              state->tx.RegisterBuffer(state->buffers, tx_size) &&
+              state->rx.SetupBufferRing(URING_RX_GROUP, state->buffers + tx_size, RX_FRAME_SIZE, URING_RX_BUFFERS);
+    if (!ok) {
+        if (fd < 0) {
+            printf("Ethernet. Error. Socket file descriptor for io_uring not received!\n");
+        } else {
+            close(fd);
+        }
+        if (state->buffers != nullptr) {
+            munmap(state->buffers, state->buffers_size);
+        }
+        state->~UringState();
+        free(state);
+        return false;
+    }
+    if (timestamping_ != 0) {
+        SetTimestamping(fd);
+    }
+    tx_fd_ = fd;
+    tx_ring_if_idx_ = -1;
+    // всплески ответов ждут в очереди сокета, пока приём не разобран: кольца приёма, которое бы их вместило, нет
+    SetRcvBufSize(URING_RCV_BUF_SIZE);
+    state->rx_msg.msg_namelen = sizeof(struct sockaddr_ll);
+    state->rx_msg.msg_controllen = URING_RX_CONTROL_LEN;
+    uring_ = state;
+    if (!ArmUringReceive() || (uring_->rx.Submit(0, 0) < 0)) {
+        printf("Ethernet. Error starting io_uring receive. %s\n", strerror(errno));
+    }
+    return true;
+}
+
+bool EthernetProtocol::IsUringEnabled() const noexcept {
+    return uring_ != nullptr;
+}
+
+/* Постановка многоразового приёма: ядро само выбирает буфер группы URING_RX_GROUP для каждого фрейма */
+bool EthernetProtocol::ArmUringReceive() noexcept {
+    struct io_uring_sqe* sqe = uring_->rx.GetSqe();
+    if (sqe == nullptr) {
+        errno = EBUSY;
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock_fd_;
+    sqe->addr = (unsigned long long)&uring_->rx_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RX_GROUP;
+    uring_->rx_armed = true;
     return true;
 }
 
 /* Настройка интерфейса на приём данных
- * - привязка сокета к интерфейсу */
+ * - привязка сокета к интерфейсу (SO_BINDTODEVICE и bind с индексом интерфейса,
+ *   чтобы в кольцо приёма попадали только фреймы этого интерфейса)
+ * - если сокет уже привязан к этому интерфейсу, то системный вызов не выполняется */
 int EthernetProtocol::RcvConfigure() noexcept {
+    if ((source_ != nullptr) || receive_all_ || (strncmp(bound_if_name_, used_if_name_, IFNAMSIZ) == 0)) {
+        return 0;
+    }
     if (setsockopt(sock_fd_, SOL_SOCKET, SO_BINDTODEVICE, used_if_name_, IFNAMSIZ) < 0) {
         printf("Ethernet. RcvReply. Error binding to device.\n");
         return -1;
     }
+    const InterfaceTable::Interface* iface = ifaces_.FindByName(used_if_name_);
+    if ((used_if_name_[0] != 0) && (iface != nullptr)) {
+        struct sockaddr_ll sll{};
+        sll.sll_family = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_ALL);
+        sll.sll_ifindex = iface->index;
+        if (bind(sock_fd_, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+            printf("Ethernet. RcvReply. Error binding to device.\n");
+            return -1;
+        }
+    }
+    strncpy(bound_if_name_, used_if_name_, IFNAMSIZ);
     return 0;
 }
 
+bool EthernetProtocol::BindInterface(const char* if_name) noexcept {
+    strncpy(used_if_name_, if_name, IFNAMSIZ);
+    return RcvConfigure() == 0;
+}
+
+/* Пустое имя устройства снимает SO_BINDTODEVICE, индекс 0 в bind - привязку к интерфейсу */
+bool EthernetProtocol::BindAllInterfaces() noexcept {
+    if ((source_ == nullptr) && (bound_if_name_[0] != 0)) {
+        struct sockaddr_ll sll{};
+        sll.sll_family = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_ALL);
+        sll.sll_ifindex = 0;
+        if ((setsockopt(sock_fd_, SOL_SOCKET, SO_BINDTODEVICE, "", 0) < 0) ||
+            (bind(sock_fd_, (struct sockaddr*)&sll, sizeof(sll)) < 0)) {
+            printf("Ethernet. Error unbinding from device. %s\n", strerror(errno));
+            return false;
+        }
+        memset(bound_if_name_, 0, IFNAMSIZ);
+    }
+    receive_all_ = true;
+    return true;
+}
+
+bool EthernetProtocol::JoinFanout(int* group_id, int type) noexcept {
+    if (RcvConfigure() < 0) {
+        return false;
+    }
+    int arg = (*group_id < 0) ? ((type | PACKET_FANOUT_FLAG_UNIQUEID) << 16) : ((type << 16) | (*group_id & 0xFFFF));
+    if (setsockopt(sock_fd_, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+        printf("Ethernet. Error joining fanout group. %s\n", strerror(errno));
+        return false;
+    }
+    if (*group_id < 0) {
+        socklen_t len = sizeof(arg);
+        if (getsockopt(sock_fd_, SOL_PACKET, PACKET_FANOUT, &arg, &len) < 0) {
+            printf("Ethernet. Error reading fanout group. %s\n", strerror(errno));
+            return false;
+        }
+        *group_id = arg & 0xFFFF;
+    }
+    return true;
+}
+
+bool EthernetProtocol::SetRcvBufSize(int size) noexcept {
+    if (setsockopt(sock_fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+        printf("Ethernet. Error setting socket receive buffer size.\n");
+        return false;
+    }
+    return true;
+}
+
+int EthernetProtocol::GetSocket() const noexcept {
+    return (uring_ != nullptr) ? uring_->rx.GetFd() : sock_fd_;
+}
+
+/* Вычитываем сокет (или кольцо) без блокировки, пока в нём есть фреймы.
+ * Фрейм передаётся обработчику целиком, вместе с Ethernet заголовком, без копирования
+ * Задержка от метки ядра до программы измеряется по первому фрейму пачки - одно чтение часов на пачку */
+int EthernetProtocol::RcvFrames(FrameHandler handler, void* ctx, int max_frames) noexcept {
+    if (RcvConfigure() < 0) {
+        return -1;
+    }
+
+    int count = 0;
+    while (count < max_frames) {
+        const unsigned char* frame;
+        int frame_len = RcvFrameView(&frame, false);
+        if (frame_len < 0) {
+            printf("Ethernet. Packet receive failed!\n");
+            return -1;
+        }
+        if (frame_len == 0) {
+            break;
+        }
+        if (frame_len < (int)sizeof(struct ether_header)) {
+            metrics_->Add(Metrics::RX_FILTERED);
+            continue;
+        }
+        if ((count == 0) && (source_ == nullptr)) {
+            long long now = utils::RealtimeNs();
+            if (rx_ts_.software != 0) {
+                metrics_->Record(Metrics::RX_DELAY, now - rx_ts_.software);
+            }
+            // счётчики ядра - только для блока в разделяемой памяти, свой блок никто не читает
+            if ((metrics_ != &own_metrics_) && (now - statistics_ns_ >= STATISTICS_PERIOD_NS)) {
+                statistics_ns_ = now;
+                RxStatistics stats;
+                GetStatistics(&stats);
+            }
+        }
+        handler(ctx, frame, frame_len);
+        ++count;
+    }
+    return count;
+}
+
 /* возвращает количество прочитанных байт в payload, либо -1 при неудаче */
 int EthernetProtocol::RcvReply(unsigned char* data, int max_data_len) noexcept {
-    unsigned char rcv_buf[ETH_FRAME_LEN];
+    const unsigned char* payload;
+    int payload_len = RcvReplyView(&payload);
+    if (payload_len < 0) {
+        return -1;
+    }
+    memcpy(data, payload, ((max_data_len > payload_len) ? payload_len : max_data_len));
+    return payload_len;
+}
 
+int EthernetProtocol::RcvReplyView(const unsigned char** payload) noexcept {
     if (RcvConfigure() < 0) {
         return -1;
     }
 
-    struct sockaddr_ll sll;
-    socklen_t sll_len = sizeof(sll);
-    int data_read = recvfrom(sock_fd_, rcv_buf, sizeof(rcv_buf), 0, (struct sockaddr*)&sll, &sll_len);
-
+    const unsigned char* frame;
+    int data_read;
+    const int header_len = sizeof(struct ether_header);
+    // фреймы короче заголовка пропускаются - учитываются только в счётчике
+    while ((data_read = RcvFrameView(&frame, true)) >= 0) {
+        if (data_read >= header_len) {
+            break;
+        }
+        metrics_->Add(Metrics::RX_FILTERED);
+    }
     if (data_read < 0) {
         printf("Ethernet. Packet receive failed!\n");
         return data_read;
     }
-    int header_len = sizeof(struct ether_header);
     int payload_len = data_read - header_len;
-    if (payload_len < 0) {
-        printf("Ethernet. Error. Too small ethernet packet received (%d)!\n", data_read);
+    memcpy(rcvd_mac_addr_, ((const struct ether_header*)frame)->ether_shost, ETH_ALEN);
+    rcvd_ether_type_ = ntohs(((const struct ether_header*)frame)->ether_type);
+    *payload = frame + header_len;
+    return payload_len;
+}
+
+int EthernetProtocol::RcvFrameView(const unsigned char** frame, bool wait) noexcept {
+    int frame_len;
+    if (source_ != nullptr) {
+        frame_len = NextSourceFrame(frame, wait);
+    } else if (uring_ != nullptr) {
+        frame_len = NextUringFrame(frame, wait);
+    } else if (rx_ring_ != nullptr) {
+        frame_len = NextRingFrame(frame, wait);
+    } else {
+        frame_len = NextSocketFrame(frame, wait);
+    }
+    if (frame_len > 0) {
+        metrics_->Add(Metrics::RX_FRAMES);
+    }
+    if ((frame_len > 0) && (sink_ != nullptr)) {
+        long long ts = (rx_ts_.software != 0) ? rx_ts_.software : rx_ts_.hardware;
+        if (ts == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            ts = now.tv_sec * 1000000000LL + now.tv_nsec;
+        }
+        sink_(sink_ctx_, *frame, frame_len, ts);
+    }
+    return frame_len;
+}
+
+/* Фрейм из источника вместо сокета
+ * ждать нечего: если источник исчерпан, ожидание завершается ошибкой (errno = ENODATA) */
+int EthernetProtocol::NextSourceFrame(const unsigned char** frame, bool wait) noexcept {
+    long long ts = 0;
+    int frame_len = source_(source_ctx_, frame, &ts);
+    if (frame_len < 0) {
+        errno = EIO;
         return -1;
     }
-    memcpy(data, &rcv_buf[header_len], ((max_data_len > payload_len) ? payload_len : max_data_len));
-    memcpy(rcvd_mac_addr_, sll.sll_addr, ETH_ALEN);
+    if (frame_len == 0) {
+        if (wait) {
+            errno = ENODATA;
+            return -1;
+        }
+        return 0;
+    }
+    rx_ts_.software = ts;
+    rx_ts_.hardware = 0;
+    rx_if_index_ = 0;
+    return frame_len;
+}
 
-    return payload_len;
+/* Приём фрейма через recvfrom в буфер объекта
+ * при ожидании время ограничено SO_RCVTIMEO */
+int EthernetProtocol::NextSocketFrame(const unsigned char** frame, bool wait) noexcept {
+    for (;;) {
+        struct sockaddr_ll sll;
+        unsigned char control[256];
+        struct iovec iov{rx_buf_, sizeof(rx_buf_)};
+        struct msghdr msg{};
+        msg.msg_name = &sll;
+        msg.msg_namelen = sizeof(sll);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        metrics_->Add(Metrics::RX_SYSCALLS);
+        int data_read = recvmsg(sock_fd_, &msg, wait ? 0 : MSG_DONTWAIT);
+        if (data_read < 0) {
+            if (!wait && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+                return 0;
+            }
+            return -1;
+        }
+        if (sll.sll_pkttype == PACKET_OUTGOING) {
+            metrics_->Add(Metrics::RX_FILTERED);
+            continue;
+        }
+        ReadTimestamps(&msg, &rx_ts_);
+        rx_if_index_ = sll.sll_ifindex;
+        *frame = rx_buf_;
+        return data_read;
+    }
 }
 
-const unsigned char* EthernetProtocol::GetDestinationMacAddr() const noexcept {
-    return rcvd_mac_addr_;
+/* Приём через io_uring: фреймы берутся из очереди завершений многоразового приёма
+ * - буфер предыдущего фрейма возвращается ядру при следующем вызове
+ * - если завершений нет, один io_uring_enter без ожидания (ядро доделывает отложенный приём),
+ *   при ожидании - io_uring_enter с пределом времени до RECV_TIMEOUT
+ * - многоразовый приём ставится заново, если ядро его завершило (например, кончились буферы) */
+int EthernetProtocol::NextUringFrame(const unsigned char** frame, bool wait) noexcept {
+    if (uring_->rx_held >= 0) {
+        uring_->rx.ReturnBuffer(uring_->rx_held);
+        uring_->rx_held = -1;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += RECV_TIMEOUT;
+    bool entered = false;
+
+    for (;;) {
+        const struct io_uring_cqe* cqe = uring_->rx.PeekCqe();
+        if (cqe == nullptr) {
+            if (!uring_->rx_armed && !ArmUringReceive()) {
+                return -1;
+            }
+            if (!wait) {
+                if (entered) {
+                    return 0;
+                }
+                entered = true;
+                metrics_->Add(Metrics::RX_SYSCALLS);
+                if (uring_->rx.Submit(0, 0) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long timeout_ns = (deadline.tv_sec - now.tv_sec) * 1000000000LL + (deadline.tv_nsec - now.tv_nsec);
+            if (timeout_ns <= 0) {
+                errno = EAGAIN;
+                return -1;
+            }
+            metrics_->Add(Metrics::RX_SYSCALLS);
+            if ((uring_->rx.Submit(1, timeout_ns) < 0) && (errno != ETIME)) {
+                return -1;
+            }
+            continue;
+        }
+        int res = cqe->res;
+        unsigned int flags = cqe->flags;
+        uring_->rx.SeenCqe();
+        if (!(flags & IORING_CQE_F_MORE)) {
+            uring_->rx_armed = false;
+        }
+        if (res < 0) {
+            if (res == -ENOBUFS) {
+                // все буферы заняты - фреймы остались в сокете, приём будет поставлен заново
+                continue;
+            }
+            errno = -res;
+            return -1;
+        }
+        if (!(flags & IORING_CQE_F_BUFFER)) {
+            continue;
+        }
+        unsigned short id = flags >> IORING_CQE_BUFFER_SHIFT;
+        unsigned char* buf = uring_->rx.GetBuffer(id);
+        const struct io_uring_recvmsg_out* out = (const struct io_uring_recvmsg_out*)buf;
+        unsigned char* name = buf + sizeof(*out);
+        unsigned char* control = name + uring_->rx_msg.msg_namelen;
+        const struct sockaddr_ll* sll = (const struct sockaddr_ll*)name;
+        if ((sll->sll_pkttype == PACKET_OUTGOING) || (out->flags & MSG_TRUNC)) {
+            metrics_->Add(Metrics::RX_FILTERED);
+            uring_->rx.ReturnBuffer(id);
+            continue;
+        }
+        struct msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = out->controllen;
+        ReadTimestamps(&msg, &rx_ts_);
+        rx_if_index_ = sll->sll_ifindex;
+        uring_->rx_held = id;
+        *frame = control + uring_->rx_msg.msg_controllen;
+        return out->payloadlen;
+    }
 }
 
-/* Получает список рабочих интерфейсов в системе.
- * Используется при создании объекта класса.
- * Количество интерфейсов ограничено INTERFACE_MAX_COUNT
- * LOOPBACK интерфейсы исключаются */
-bool EthernetProtocol::RetrieveInterfacesList() noexcept {
-    struct ifreq ifr;
-    struct ifconf ifc;
-    char buf[1024];
-    ifc.ifc_len = sizeof(buf);
-    ifc.ifc_buf = buf;
+/* Обход кольца TPACKET_V3
+ * - фреймы текущего блока отдаются по одному, указатель на фрейм указывает прямо в кольцо
+ * - когда фреймы блока закончились, блок возвращается ядру (TP_STATUS_KERNEL) и берётся следующий
+ * - если следующий блок ещё не отдан ядром, ждём его через poll не более RECV_TIMEOUT */
+int EthernetProtocol::NextRingFrame(const unsigned char** frame, bool wait) noexcept {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += RECV_TIMEOUT;
+
+    for (;;) {
+        if (rx_pkts_left_ == 0) {
+            struct tpacket_block_desc* desc;
+            if (rx_block_held_) {
+                desc = (struct tpacket_block_desc*)(rx_ring_ + (unsigned long)rx_block_idx_ * rx_block_size_);
+                __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+                rx_block_held_ = false;
+                rx_block_idx_ = (rx_block_idx_ + 1) % rx_block_count_;
+            }
+            desc = (struct tpacket_block_desc*)(rx_ring_ + (unsigned long)rx_block_idx_ * rx_block_size_);
+            if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+                if (!wait) {
+                    return 0;
+                }
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                long long timeout_ms = (deadline.tv_sec - now.tv_sec) * 1000LL + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+                if (timeout_ms <= 0) {
+                    errno = EAGAIN;
+                    return -1;
+                }
+                struct pollfd pfd{sock_fd_, POLLIN | POLLERR, 0};
+                metrics_->Add(Metrics::RX_SYSCALLS);
+                if ((poll(&pfd, 1, (int)timeout_ms) < 0) && (errno != EINTR)) {
+                    return -1;
+                }
+                continue;
+            }
+            rx_block_held_ = true;
+            rx_pkts_left_ = desc->hdr.bh1.num_pkts;
+            rx_pkt_ = (unsigned char*)desc + desc->hdr.bh1.offset_to_first_pkt;
+            continue;
+        }
+
+        const struct tpacket3_hdr* hdr = (const struct tpacket3_hdr*)rx_pkt_;
+        const struct sockaddr_ll* sll = (const struct sockaddr_ll*)(rx_pkt_ + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        --rx_pkts_left_;
+        unsigned char* pkt = rx_pkt_;
+        rx_pkt_ += hdr->tp_next_offset;
+        if (sll->sll_pkttype == PACKET_OUTGOING) {
+            metrics_->Add(Metrics::RX_FILTERED);
+            continue;
+        }
+        // метку кольца ядро ставит всегда: аппаратную, если она запрошена и есть, иначе программную
+        long long ts = hdr->tp_sec * 1000000000LL + hdr->tp_nsec;
+        rx_ts_.software = (hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE) ? 0 : ts;
+        rx_ts_.hardware = (hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE) ? ts : 0;
+        rx_if_index_ = sll->sll_ifindex;
+        *frame = pkt + hdr->tp_mac;
+        return hdr->tp_snaplen;
+    }
+}
+
+bool EthernetProtocol::EnableRxRing(unsigned int block_size, unsigned int block_count) noexcept {
+    if (rx_ring_ != nullptr) {
+        return true;
+    }
+    if ((source_ != nullptr) || (uring_ != nullptr)) {
+        return false;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(sock_fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        printf("Ethernet. Error setting TPACKET_V3 version. %s\n", strerror(errno));
+        return false;
+    }
 
-    bool success = false;
-    if (ioctl(sock_fd_, SIOCGIFCONF, &ifc) < 0) {
-        printf("Error. Can't get list of interfaces.\n");
+    struct tpacket_req3 req{};
+    req.tp_block_size = block_size;
+    req.tp_block_nr = block_count;
+    req.tp_frame_size = RX_FRAME_SIZE;
+    req.tp_frame_nr = (block_size * block_count) / RX_FRAME_SIZE;
+    req.tp_retire_blk_tov = RX_BLOCK_TIMEOUT_MS;
+    req.tp_feature_req_word = 0;
+    if (setsockopt(sock_fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        printf("Ethernet. Error setting PACKET_RX_RING. %s\n", strerror(errno));
         return false;
     }
 
-    struct ifreq* it = ifc.ifc_req;
-    const struct ifreq* const end = it + (ifc.ifc_len / sizeof(struct ifreq));
-    for (int i = 0; it != end; ++it) {
-        strncpy(ifr.ifr_name, it->ifr_name, IFNAMSIZ);
-        if (ioctl(sock_fd_, SIOCGIFFLAGS, &ifr) == 0) {
-            if (!(ifr.ifr_flags & IFF_LOOPBACK)) {
-                strncpy(&(if_list_[i++][0]), it->ifr_name, IFNAMSIZ);
-                success = true;
+    unsigned long size = (unsigned long)block_size * block_count;
+    void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sock_fd_, 0);
+    if (ring == MAP_FAILED) {
+        printf("Ethernet. Error mapping receive ring. %s\n", strerror(errno));
+        struct tpacket_req3 empty{};
+        setsockopt(sock_fd_, SOL_PACKET, PACKET_RX_RING, &empty, sizeof(empty));
+        return false;
+    }
+    rx_ring_ = (unsigned char*)ring;
+    rx_ring_size_ = size;
+    rx_block_size_ = block_size;
+    rx_block_count_ = block_count;
+    rx_block_idx_ = 0;
+    rx_block_held_ = false;
+    rx_pkts_left_ = 0;
+    return true;
+}
+
+bool EthernetProtocol::IsRxRingEnabled() const noexcept {
+    return rx_ring_ != nullptr;
+}
+
+bool EthernetProtocol::AttachFilter(const struct sock_fprog* prog, bool drain) noexcept {
+    if (source_ != nullptr) {
+        return true;
+    }
+    if (setsockopt(sock_fd_, SOL_SOCKET, SO_ATTACH_FILTER, prog, sizeof(*prog)) < 0) {
+        printf("Ethernet. Error attaching socket filter. %s\n", strerror(errno));
+        return false;
+    }
+    if (!drain) {
+        return true;
+    }
+    // всё, что попало в сокет до фильтра, фильтр уже не проверит - и в приёмник оно не попадает
+    FrameSink sink = sink_;
+    sink_ = nullptr;
+    const unsigned char* frame;
+    while (RcvFrameView(&frame, false) > 0);
+    sink_ = sink;
+    return true;
+}
+
+bool EthernetProtocol::SetTimestamping(int fd) noexcept {
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &timestamping_, sizeof(timestamping_)) < 0) {
+        printf("Ethernet. Error enabling timestamps. %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* Метки отправки включаются и на сокете приёма (SendRequest, sendmmsg), и на сокете кольца передачи */
+bool EthernetProtocol::EnableTimestamps(bool hardware) noexcept {
+    timestamping_ = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (hardware) {
+        timestamping_ |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+    if (!SetTimestamping(sock_fd_) || ((tx_fd_ >= 0) && !SetTimestamping(tx_fd_))) {
+        timestamping_ = 0;
+        return false;
+    }
+    if (hardware) {
+        int source = SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (setsockopt(sock_fd_, SOL_PACKET, PACKET_TIMESTAMP, &source, sizeof(source)) < 0) {
+            printf("Ethernet. Error selecting hardware timestamps for receive ring. %s\n", strerror(errno));
+        }
+    }
+    return true;
+}
+
+const EthernetProtocol::Timestamp& EthernetProtocol::GetRxTimestamp() const noexcept {
+    return rx_ts_;
+}
+
+int EthernetProtocol::GetRxInterface() const noexcept {
+    return rx_if_index_;
+}
+
+int EthernetProtocol::RcvTxTimestamps(TxTimestampHandler handler, void* ctx, int max_count) noexcept {
+    if (timestamping_ == 0) {
+        return 0;
+    }
+    int count = RcvTxTimestampsFrom(sock_fd_, handler, ctx, max_count);
+    if ((count < 0) || (tx_fd_ < 0)) {
+        return count;
+    }
+    int ring_count = RcvTxTimestampsFrom(tx_fd_, handler, ctx, max_count - count);
+    return (ring_count < 0) ? -1 : count + ring_count;
+}
+
+/* Очередь ошибок вычитывается без блокировки: в ней копии отправленных фреймов с метками времени */
+int EthernetProtocol::RcvTxTimestampsFrom(int fd, TxTimestampHandler handler, void* ctx, int max_count) noexcept {
+    int count = 0;
+    while (count < max_count) {
+        unsigned char frame[ETH_FRAME_LEN];
+        unsigned char control[256];
+        struct iovec iov{frame, sizeof(frame)};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int len = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-        } else {
-            printf("Error. Can't get SIOCGIFFLAGS of interface named %s.\n", ifr.ifr_name);
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            printf("Ethernet. Error reading send timestamps. %s\n", strerror(errno));
+            return -1;
+        }
+        if (!IsSendTimestamp(&msg) || (len < (int)sizeof(struct ether_header))) {
+            continue;
         }
+        Timestamp ts;
+        ReadTimestamps(&msg, &ts);
+        handler(ctx, frame, len, ts);
+        ++count;
+    }
+    return count;
+}
+void EthernetProtocol::SetFrameSink(FrameSink sink, void* ctx) noexcept {
+    sink_ = sink;
+    sink_ctx_ = ctx;
+}
+
+/* Ядро обнуляет счётчики при каждом чтении, поэтому накапливаем их в объекте.
+ * Формат ответа зависит от версии: tpacket_stats для режима recvfrom, tpacket_stats_v3 для кольца */
+bool EthernetProtocol::GetStatistics(RxStatistics* stats) noexcept {
+    struct tpacket_stats_v3 kstats{};
+    socklen_t len = (rx_ring_ != nullptr) ? sizeof(struct tpacket_stats_v3) : sizeof(struct tpacket_stats);
+    if (getsockopt(sock_fd_, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) < 0) {
+        printf("Ethernet. Error reading PACKET_STATISTICS. %s\n", strerror(errno));
+        return false;
     }
-    return success;
+    rx_stats_.packets += kstats.tp_packets;
+    rx_stats_.drops += kstats.tp_drops;
+    if (rx_ring_ != nullptr) {
+        rx_stats_.freeze_q_cnt += kstats.tp_freeze_q_cnt;
+    }
+    metrics_->Set(Metrics::KERNEL_PACKETS, rx_stats_.packets);
+    metrics_->Set(Metrics::KERNEL_DROPS, rx_stats_.drops);
+    metrics_->Set(Metrics::KERNEL_FREEZES, rx_stats_.freeze_q_cnt);
+    *stats = rx_stats_;
+    return true;
+}
+
+void EthernetProtocol::SetMetrics(Metrics* metrics) noexcept {
+    metrics_ = (metrics != nullptr) ? metrics : &own_metrics_;
+    statistics_ns_ = 0;
+}
+
+Metrics& EthernetProtocol::GetMetrics() noexcept {
+    return *metrics_;
+}
+
+const unsigned char* EthernetProtocol::GetDestinationMacAddr() const noexcept {
+    return rcvd_mac_addr_;
+}
+
+unsigned short EthernetProtocol::GetReceivedEtherType() const noexcept {
+    return rcvd_ether_type_;
 }
 
+/* Имя idx-го рабочего интерфейса: поднят, имеет IPv4 адрес, не loopback
+ * возвращает пустую строку, если такого интерфейса нет */
 const char* EthernetProtocol::GetInterfaceName(int idx = 0) const noexcept {
     if (idx < 0) {
         idx = 0;
     }
-    if (idx >= INTERFACE_MAX_COUNT) {
-        idx = INTERFACE_MAX_COUNT - 1;
+    for (int i = 0; i < ifaces_.GetCount(); ++i) {
+        const InterfaceTable::Interface* iface = ifaces_.Get(i);
+        if ((iface->flags & IFF_UP) && !(iface->flags & IFF_LOOPBACK) && (iface->ip != 0) && (idx-- == 0)) {
+            return iface->name;
+        }
     }
-    return if_list_[idx];
+    return "";
+}
+
+in_addr_t EthernetProtocol::GetInterfaceIp(const char* if_name) const noexcept {
+    const InterfaceTable::Interface* iface = ifaces_.FindByName(if_name);
+    return (iface != nullptr) ? iface->ip : 0;
+}
+
+InterfaceTable& EthernetProtocol::GetInterfaces() noexcept {
+    return ifaces_;
 }
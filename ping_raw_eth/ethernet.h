@@ -7,38 +7,310 @@
  *   Destination MAC Address (6 bytes)
  *   Source MAC Address (6 bytes)
  *   EtherType/Length (2 bytes)
+ *
+ * Приём возможен в двух режимах:
+ * - по умолчанию - recvfrom на каждый фрейм в буфер объекта
+ * - после EnableRxRing - кольцевой буфер PACKET_RX_RING (TPACKET_V3), отображённый в память процесса.
+ *   Ядро заполняет блоки фреймами, пользователь обходит их на месте и возвращает блок ядру,
+ *   когда все фреймы блока обработаны. Копирования и системного вызова на каждый фрейм нет.
+ * Исходящие фреймы (PACKET_OUTGOING) в обоих режимах пропускаются.
+ *
+ * Фреймы отправляются на заданный MAC адрес получателя, либо широковещательно, если адрес не известен.
+ *
+ * Отправка также возможна в двух режимах:
+ * - SendRequest / SendPacket - один sendto на каждый фрейм. SendPacket дописывает заголовок в запас буфера
+ *   PacketBuffer перед данными вышестоящих уровней, без промежуточных буферов и копирования
+ * - QueueRequest + FlushRequests - пакетная отправка: фреймы собираются в очередь и отправляются
+ *   одним системным вызовом - sendmmsg, либо (после EnableTxRing) одним send по кольцу PACKET_TX_RING.
+ *   Кольцо передачи живёт на отдельном сокете, чтобы не зависеть от версии и отображения кольца приёма.
+ *   Готовый фрейм (например из FrameTemplate) записывается прямо в слот очереди: ReserveFrame + CommitFrame.
+ *
+ * Третий вариант ввода-вывода - io_uring (EnableUring), вместо колец PACKET_*_RING:
+ * - пакетная отправка - запросы IORING_OP_WRITE_FIXED из зарегистрированных буферов, по одному на фрейм,
+ *   вся очередь отдаётся ядру и дожидается завершения одним io_uring_enter
+ * - приём - многоразовый IORING_OP_RECVMSG в буферы, предоставленные ядру: запрос остаётся активным,
+ *   фреймы (с адресом и метками времени) забираются из очереди завершений без системного вызова на фрейм
+ * Ожидание завершений ограничено по времени (RECV_TIMEOUT при приёме, URING_SEND_TIMEOUT_MS при отправке).
+ *
+ * После EnableTimestamps ядро ставит метки времени (SO_TIMESTAMPING) на принятые и отправленные фреймы:
+ * метка принятого фрейма доступна через GetRxTimestamp, метки отправленных фреймов приходят в очередь ошибок
+ * сокета вместе с копией фрейма и разбираются RcvTxTimestamps.
+ *
+ * Источник и приёмник фреймов подключаются без изменения вышестоящих уровней:
+ * - SetFrameSink - копия каждого принятого фрейма с меткой приёма передаётся приёмнику (например, запись pcap)
+ * - объект, созданный с FrameSource, не открывает сокет и принимает фреймы только из источника
+ *   (например, воспроизведение pcap): разбор IP/ICMP работает без прав суперпользователя и без сети
+ *
+ * Счётчики и задержки отправки и приёма пишутся в блок Metrics (metrics.h): по умолчанию в свой,
+ * после SetMetrics - в блок потока в разделяемой памяти, который читает "ping2 stats". Вышестоящие уровни
+ * пишут в тот же блок (GetMetrics) свои стадии: отброшенные фреймы, сопоставленные и потерянные ответы.
+ * Запись блока - без системных вызовов и без вывода в stdout.
  */
 
 #include <linux/if.h>
 #include <linux/if_ether.h>
 
+#include "iface_table.h"
+#include "metrics.h"
+
+class PacketBuffer;
+struct sock_fprog;
+
 class EthernetProtocol {
 public:
     static constexpr unsigned int RECV_TIMEOUT = 1;            // timeout for receiving packets (in seconds)
-    static constexpr unsigned int INTERFACE_MAX_COUNT = 10;    // максимальное количество сетевых интерфейсов
+    static constexpr unsigned int RX_BLOCK_SIZE = 1 << 18;     // размер блока кольца приёма (256 КиБ, кратен странице)
+    static constexpr unsigned int RX_BLOCK_COUNT = 64;         // количество блоков в кольце приёма
+    static constexpr unsigned int RX_FRAME_SIZE = 2048;        // номинальный размер слота фрейма в кольце
+    static constexpr unsigned int RX_BLOCK_TIMEOUT_MS = 2;     // неполный блок отдаётся пользователю через это время
+    static constexpr unsigned int TX_BATCH_MAX = 64;           // максимальный размер пачки sendmmsg
+    static constexpr unsigned int TX_FRAME_SIZE = 2048;        // размер слота фрейма в кольце передачи
+    static constexpr unsigned int TX_RING_FRAMES = 1024;       // количество слотов в кольце передачи
+    static constexpr unsigned int URING_ENTRIES = 256;         // запросов в очереди io_uring (и фреймов в пачке отправки)
+    static constexpr unsigned int URING_RX_BUFFERS = 512;      // буферов приёма io_uring (степень двойки)
+    static constexpr unsigned int URING_SEND_TIMEOUT_MS = 1000;        // ожидание завершения отправки io_uring
+    static constexpr int URING_RCV_BUF_SIZE = 8 * 1024 * 1024;         // приёмный буфер сокета при io_uring (кольца приёма нет)
+    static constexpr long long STATISTICS_PERIOD_NS = 1000000000LL;    // обновление счётчиков ядра в блоке Metrics
+
+    /* Статистика приёма ядра (PACKET_STATISTICS), накапливается с момента создания объекта */
+    struct RxStatistics {
+        unsigned long long packets;         // фреймов принято ядром для сокета
+        unsigned long long drops;           // фреймов отброшено из-за переполнения буфера/кольца
+        unsigned long long freeze_q_cnt;    // сколько раз очередь замораживалась из-за заполненного кольца
+    };
+
+    /* Метки времени ядра в наносекундах, 0 - метки нет */
+    struct Timestamp {
+        long long software;                 // программная метка ядра (CLOCK_REALTIME)
+        long long hardware;                 // аппаратная метка сетевой карты (часы PHC)
+    };
+
+    /* Обработчик принятого фрейма
+     * - ctx - контекст вызывающей стороны
+     * - frame - начало фрейма (с Ethernet заголовком)
+     * - len - длина фрейма в байтах */
+    using FrameHandler = void (*)(void* ctx, const unsigned char* frame, int len);
+
+    /* Обработчик метки времени отправленного фрейма
+     * - frame, len - копия отправленного фрейма (с Ethernet заголовком)
+     * - ts - метка момента передачи фрейма драйверу (или сетевой картой) */
+    using TxTimestampHandler = void (*)(void* ctx, const unsigned char* frame, int len, const Timestamp& ts);
+
+    /* Источник фреймов вместо сокета
+     * - frame - указатель на очередной фрейм (с Ethernet заголовком), действителен до следующего вызова
+     * - ts_ns - метка приёма фрейма (CLOCK_REALTIME) в наносекундах
+     * возвращает длину фрейма, 0 если фреймов больше нет, либо -1 при ошибке */
+    using FrameSource = int (*)(void* ctx, const unsigned char** frame, long long* ts_ns);
+
+    /* Приёмник копий принятых фреймов, ts_ns - метка приёма (CLOCK_REALTIME) в наносекундах */
+    using FrameSink = void (*)(void* ctx, const unsigned char* frame, int len, long long ts_ns);
 
     EthernetProtocol() noexcept;
+
+    /* Объект без сокета: фреймы принимаются только из source (ctx передаётся источнику)
+     * Права суперпользователя и рабочие интерфейсы не нужны, отправка невозможна,
+     * фильтр ядра (AttachFilter) не устанавливается - источник отдаёт все свои фреймы */
+    EthernetProtocol(FrameSource source, void* ctx) noexcept;
     ~EthernetProtocol();
 
     bool IsCreated() const noexcept;
 
-    /* возвращает true при успешной отправке */
-    bool SendRequest(const unsigned char* data, int data_len, const char* if_name) noexcept;
+    /* возвращает true при успешной отправке
+     * - dst_mac - MAC адрес получателя, nullptr - широковещательный фрейм
+     * - ether_type - EtherType фрейма (в порядке байт хоста) */
+    bool SendRequest(const unsigned char* data, int data_len, const char* if_name,
+                     const unsigned char* dst_mac = nullptr, unsigned short ether_type = ETH_P_IP) noexcept;
+
+    /* Отправка пакета из буфера pkt: Ethernet заголовок дописывается в запас буфера перед данными
+     * Остальные параметры как у SendRequest, возвращает true при успешной отправке */
+    bool SendPacket(PacketBuffer& pkt, const char* if_name,
+                    const unsigned char* dst_mac = nullptr, unsigned short ether_type = ETH_P_IP) noexcept;
+
+    /* Постановка фрейма в очередь пакетной отправки
+     * Параметры как у SendRequest. Если очередь заполнена, она предварительно отправляется.
+     * возвращает true при успехе */
+    bool QueueRequest(const unsigned char* data, int data_len, const char* if_name,
+                      const unsigned char* dst_mac = nullptr, unsigned short ether_type = ETH_P_IP) noexcept;
+
+    /* Слот очереди пакетной отправки для готового фрейма (с Ethernet заголовком) длиной до ETH_FRAME_LEN
+     * - if_idx - индекс интерфейса отправки
+     * возвращает указатель на слот, либо nullptr при неудаче (errno = ENOBUFS - очередь заполнена)
+     * Фрейм ставится в очередь вызовом CommitFrame, до него других вызовов отправки быть не должно */
+    unsigned char* ReserveFrame(int if_idx) noexcept;
+
+    /* Постановка в очередь фрейма, записанного в слот ReserveFrame
+     * - frame_len - длина фрейма в байтах */
+    void CommitFrame(int frame_len) noexcept;
+
+    /* Отправка очереди одним системным вызовом
+     * возвращает количество отправленных фреймов, либо -1 при неудаче */
+    int FlushRequests() noexcept;
+
+    /* Включение пакетной отправки через кольцо PACKET_TX_RING
+     * возвращает true при успехе, при неудаче пакетная отправка идёт через sendmmsg */
+    bool EnableTxRing(unsigned int frame_count = TX_RING_FRAMES) noexcept;
+
+    bool IsTxRingEnabled() const noexcept;
+
+    /* Включение приёма и пакетной отправки через io_uring
+     * Вызывается до начала приёма, не совместимо с EnableRxRing/EnableTxRing
+     * возвращает true при успехе, при неудаче остаются прежние режимы */
+    bool EnableUring() noexcept;
+
+    bool IsUringEnabled() const noexcept;
 
     /* возвращает количество прочитанных байт в payload, либо -1 при неудаче */
     int RcvReply(unsigned char* data, int max_data_len) noexcept;
 
+    /* Приём без копирования: payload указывает на данные фрейма в кольце (или в буфере объекта)
+     * и действителен до следующего вызова функций приёма
+     * возвращает длину payload, либо -1 при неудаче */
+    int RcvReplyView(const unsigned char** payload) noexcept;
+
+    /* Приём одного фрейма без копирования
+     * - frame - указатель на фрейм (с Ethernet заголовком), действителен до следующего вызова функций приёма
+     * - wait - ждать фрейм не более RECV_TIMEOUT, иначе вернуть 0, если фреймов нет
+     * возвращает длину фрейма, 0 если фреймов нет, либо -1 при неудаче (в том числе по таймауту ожидания) */
+    int RcvFrameView(const unsigned char** frame, bool wait) noexcept;
+
+    /* Неблокирующий приём фреймов, накопленных в сокете (не более max_frames)
+     * Для каждого фрейма вызывается handler
+     * возвращает количество обработанных фреймов, либо -1 при неудаче */
+    int RcvFrames(FrameHandler handler, void* ctx, int max_frames) noexcept;
+
+    /* Привязка сокета к интерфейсу для приёма (повторная привязка к тому же интерфейсу не выполняется) */
+    bool BindInterface(const char* if_name) noexcept;
+
+    /* Приём со всех интерфейсов: привязка сокета снимается, и отправка через другой интерфейс
+     * больше не перепривязывает приём к нему, возвращает true при успехе */
+    bool BindAllInterfaces() noexcept;
+
+    /* Вступление сокета в группу PACKET_FANOUT: ядро распределяет принятые фреймы между сокетами группы
+     * - group_id - идентификатор группы; -1 - ядро выделяет свободный идентификатор и он записывается в group_id,
+     *   остальные сокеты вступают в группу с этим идентификатором
+     * - type - способ распределения (PACKET_FANOUT_HASH, PACKET_FANOUT_CPU, ...)
+     * Сокеты группы должны быть привязаны к одному интерфейсу (BindInterface), либо все принимать со всех
+     * интерфейсов (BindAllInterfaces), возвращает true при успехе */
+    bool JoinFanout(int* group_id, int type) noexcept;
+
+    /* Размер приёмного буфера сокета, возвращает true при успехе */
+    bool SetRcvBufSize(int size) noexcept;
+
+    /* Дескриптор для ожидания приёма (poll/epoll): сокет, либо кольцо io_uring после EnableUring */
+    int GetSocket() const noexcept;
+
+    /* Включение приёма через кольцевой буфер PACKET_RX_RING (TPACKET_V3)
+     * Вызывается до начала приёма, возвращает true при успехе.
+     * При неудаче остаётся режим приёма через recvfrom */
+    bool EnableRxRing(unsigned int block_size = RX_BLOCK_SIZE, unsigned int block_count = RX_BLOCK_COUNT) noexcept;
+
+    bool IsRxRingEnabled() const noexcept;
+
+    /* Установка классического BPF фильтра (SO_ATTACH_FILTER), заменяет ранее установленный
+     * - drain - фреймы, принятые до установки фильтра, вычитываются и отбрасываются; при замене фильтра
+     *   в работе (false) очередь сохраняется - в ней только фреймы, прошедшие прежний фильтр
+     * возвращает true при успехе */
+    bool AttachFilter(const struct sock_fprog* prog, bool drain = true) noexcept;
+
+    /* Включение меток времени ядра (SO_TIMESTAMPING) на приём и передачу, в том числе для кольца передачи
+     * - hardware - запросить также аппаратные метки (должны быть включены на сетевой карте, например hwstamp_ctl),
+     *   кольцо приёма тогда отдаёт аппаратную метку, если она есть
+     * возвращает true при успехе */
+    bool EnableTimestamps(bool hardware) noexcept;
+
+    /* Метка времени последнего фрейма, принятого через RcvFrameView (или переданного обработчику RcvFrames) */
+    const Timestamp& GetRxTimestamp() const noexcept;
+
+    /* Индекс интерфейса, на котором принят последний фрейм (как у GetRxTimestamp), 0 - фрейм из источника */
+    int GetRxInterface() const noexcept;
+
+    /* Неблокирующий разбор меток времени отправленных фреймов из очереди ошибок сокетов (не более max_count)
+     * Для каждой метки вызывается handler, возвращает количество меток, либо -1 при неудаче */
+    int RcvTxTimestamps(TxTimestampHandler handler, void* ctx, int max_count) noexcept;
+
+    /* Передача копии каждого принятого фрейма (кроме исходящих) приёмнику sink, nullptr - выключить */
+    void SetFrameSink(FrameSink sink, void* ctx) noexcept;
+
+    /* Счётчики приёма и отброшенных ядром фреймов, возвращает true при успехе
+     * Счётчики попадают и в блок Metrics; при приёме через RcvFrames они обновляются сами
+     * не чаще раза в STATISTICS_PERIOD_NS, если блок подключён к разделяемой памяти */
+    bool GetStatistics(RxStatistics* stats) noexcept;
+
+    /* Блок счётчиков потока: metrics - блок в разделяемой памяти, nullptr - свой блок объекта */
+    void SetMetrics(Metrics* metrics) noexcept;
+
+    Metrics& GetMetrics() noexcept;
+
     const unsigned char* GetDestinationMacAddr() const noexcept;
 
+    /* EtherType (в порядке байт хоста) последнего фрейма, принятого через RcvReply/RcvReplyView */
+    unsigned short GetReceivedEtherType() const noexcept;
+
+    /* Имя idx-го рабочего интерфейса (поднят, есть IPv4 адрес, не loopback), либо пустая строка */
     const char* GetInterfaceName(int idx) const noexcept;
 
+    /* IPv4 адрес интерфейса в сетевом порядке байт, 0 если адреса нет */
+    in_addr_t GetInterfaceIp(const char* if_name) const noexcept;
+
+    /* Таблица интерфейсов - для обработки уведомлений об изменениях в цикле событий */
+    InterfaceTable& GetInterfaces() noexcept;
+
 private:
-    bool RetrieveInterfacesList() noexcept;
     int RcvConfigure() noexcept;
+    int NextRingFrame(const unsigned char** frame, bool wait) noexcept;
+    int NextSocketFrame(const unsigned char** frame, bool wait) noexcept;
+    int NextSourceFrame(const unsigned char** frame, bool wait) noexcept;
+    int NextUringFrame(const unsigned char** frame, bool wait) noexcept;
+    bool ArmUringReceive() noexcept;
+    int FlushUring() noexcept;
+    bool ReapUringSends() noexcept;
+    int BuildFrame(unsigned char* buf, const unsigned char* data, int data_len, const unsigned char* src_mac,
+                   const unsigned char* dst_mac, unsigned short ether_type) const noexcept;
+    bool BindTxRing(int if_idx) noexcept;
+    bool SetTimestamping(int fd) noexcept;
+    int RcvTxTimestampsFrom(int fd, TxTimestampHandler handler, void* ctx, int max_count) noexcept;
+    int FlushTxRing() noexcept;
+    unsigned int DropWrongFormat(unsigned int queued) noexcept;
+    int FlushTxBatch() noexcept;
 
     bool created_ = false;
     int sock_fd_;
-    char if_list_[INTERFACE_MAX_COUNT][IFNAMSIZ];
+    InterfaceTable ifaces_;
     unsigned char rcvd_mac_addr_[ETH_ALEN];
+    unsigned short rcvd_ether_type_ = 0;
     char used_if_name_[IFNAMSIZ];
+    char bound_if_name_[IFNAMSIZ];
+    bool receive_all_ = false;              // приём со всех интерфейсов (BindAllInterfaces)
+
+    unsigned char rx_buf_[ETH_FRAME_LEN];   // буфер приёма для режима recvfrom
+    unsigned char* rx_ring_ = nullptr;      // отображённое в память кольцо приёма
+    unsigned long rx_ring_size_ = 0;
+    unsigned int rx_block_size_ = 0;
+    unsigned int rx_block_count_ = 0;
+    unsigned int rx_block_idx_ = 0;         // текущий блок кольца
+    bool rx_block_held_ = false;            // текущий блок принадлежит пользователю
+    unsigned char* rx_pkt_ = nullptr;       // следующий фрейм в текущем блоке
+    unsigned int rx_pkts_left_ = 0;         // необработанных фреймов в текущем блоке
+    RxStatistics rx_stats_{};
+    int timestamping_ = 0;                  // флаги SO_TIMESTAMPING, 0 - метки выключены
+    Timestamp rx_ts_{};                     // метка последнего принятого фрейма
+    int rx_if_index_ = 0;                   // интерфейс последнего принятого фрейма
+    FrameSource source_ = nullptr;          // источник фреймов вместо сокета
+    void* source_ctx_ = nullptr;
+    FrameSink sink_ = nullptr;              // приёмник копий принятых фреймов
+    void* sink_ctx_ = nullptr;
+
+    struct TxBatch* tx_batch_ = nullptr;    // очередь sendmmsg
+    int tx_fd_ = -1;                        // сокет кольца передачи
+    unsigned char* tx_ring_ = nullptr;
+    unsigned int tx_ring_frames_ = 0;
+    unsigned int tx_ring_head_ = 0;         // следующий свободный слот кольца
+    unsigned int tx_ring_queued_ = 0;       // слотов, ожидающих отправки
+    int tx_ring_if_idx_ = -1;               // интерфейс, к которому привязан сокет кольца
+
+    struct UringState* uring_ = nullptr;    // кольца и буферы io_uring
+
+    Metrics own_metrics_;                   // блок счётчиков, пока не подключён блок в разделяемой памяти
+    Metrics* metrics_ = &own_metrics_;
+    long long statistics_ns_ = 0;           // время последнего обновления счётчиков ядра в блоке (CLOCK_REALTIME)
 };
@@ -0,0 +1,208 @@
+#pragma once
+/*
+ * Классический BPF фильтр (SO_ATTACH_FILTER) для AF_PACKET сокета
+ *
+ * Программа пропускает в пользовательское пространство только ICMP echo reply:
+ *   EtherType == IPv4
+ *   IP protocol == ICMP, пакет не является фрагментом
+ *   IP destination == один из адресов хоста (если набор адресов задан)
+ *   ICMP type == echo reply
+ *   ICMP id == идентификатор наших запросов (если задан)
+ * Остальные фреймы (ARP, IPv6, чужой трафик) отбрасываются ядром до копирования и пробуждения процесса.
+ * По флагу accept_arp дополнительно пропускаются ARP ответы, адресованные одному из адресов набора (если задан).
+ *
+ * LearnFilter - фильтр пассивного обучения (Learner): пропускаются все ARP и IPv4 фреймы, но в пользовательское
+ * пространство копируется только начало фрейма - ARP пакет, либо IPv4 заголовок без опций. Длинные фреймы
+ * не занимают место в кольце приёма, кольцо вмещает больше фреймов.
+ *
+ * USAGE:
+ * ReplyFilter filter(local_ip, id);
+ * ether.AttachFilter(filter.GetProgram());
+ *
+ * unsigned int count;
+ * const in_addr_t* ips = ifaces.GetLocalAddresses(&count);
+ * ReplyFilter filter(ips, count, id, true);       // любой адрес хоста
+ */
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/icmp.h>
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+
+class ReplyFilter {
+public:
+    static constexpr int ANY_ID = -1;               // не проверять ICMP id
+    static constexpr in_addr_t ANY_ADDR = 0;        // не проверять IP адрес назначения
+    static constexpr unsigned int MAX_ADDRS = 1024; // больше адресов - адрес назначения фильтр не проверяет
+
+    /* - local_ip - адрес интерфейса в сетевом порядке байт, либо ANY_ADDR
+     * - icmp_id - идентификатор ICMP в том виде, в котором он записан в запрос, либо ANY_ID
+     * - accept_arp - пропускать ARP ответы */
+    ReplyFilter(in_addr_t local_ip, int icmp_id, bool accept_arp = false) noexcept
+        : ReplyFilter(&local_ip, (local_ip != ANY_ADDR) ? 1 : 0, icmp_id, accept_arp) {}
+
+    /* Адрес назначения - любой из набора local_ips (count адресов в сетевом порядке байт, 0 - не проверять)
+     * Набор проверяется цепочкой сравнений в конце программы - её проходят только наши echo reply и ARP ответы.
+     * Если адресов больше MAX_ADDRS (программа не уместилась бы в предел BPF_MAXINSNS) или не хватило памяти,
+     * адрес назначения не проверяется */
+    ReplyFilter(const in_addr_t* local_ips, unsigned int count, int icmp_id, bool accept_arp = false) noexcept {
+        if (count > MAX_ADDRS) {
+            count = 0;
+        }
+        if (FIXED_LEN + 2 * count > sizeof(fixed_) / sizeof(fixed_[0])) {
+            code_ = (struct sock_filter*)malloc((FIXED_LEN + 2 * count) * sizeof(struct sock_filter));
+            if (code_ == nullptr) {
+                code_ = fixed_;
+                count = 0;
+            }
+        }
+        Build(local_ips, count, icmp_id, accept_arp);
+    }
+
+    ReplyFilter(const ReplyFilter&) = delete;
+    ReplyFilter& operator=(const ReplyFilter&) = delete;
+
+    ~ReplyFilter() {
+        if (code_ != fixed_) {
+            free(code_);
+        }
+    }
+
+    const struct sock_fprog* GetProgram() const noexcept {
+        return &prog_;
+    }
+
+private:
+    static constexpr unsigned int FIXED_LEN = 24;  // программа без цепочки адресов
+    // метки переходов до разрешения
+    static constexpr unsigned char NEXT = 0;
+    static constexpr unsigned char ACCEPT = 0xFE;
+    static constexpr unsigned char DROP = 0xFF;
+
+    /* Адрес назначения (или адрес получателя ARP ответа) загружается в аккумулятор, и переход BPF_JA
+     * (смещение 32-битное) ведёт в цепочку "JEQ адрес -> RET ACCEPT", заканчивающуюся RET DROP.
+     * Метки ACCEPT и DROP основной части стоят перед цепочкой: 8-битные смещения условных переходов
+     * до них не зависят от количества адресов */
+    void Build(const in_addr_t* local_ips, unsigned int count, int icmp_id, bool accept_arp) noexcept {
+        static constexpr unsigned int ETHERTYPE_OFF = 12;
+        static constexpr unsigned int IP_PROTO_OFF = ETH_HLEN + 9;
+        static constexpr unsigned int IP_FRAG_OFF = ETH_HLEN + 6;
+        static constexpr unsigned int IP_DST_OFF = ETH_HLEN + 16;
+        static constexpr unsigned int ICMP_TYPE_OFF = ETH_HLEN;        // относительно X = длина IP заголовка
+        static constexpr unsigned int ICMP_ID_OFF = ETH_HLEN + 4;
+        static constexpr unsigned int ARP_OP_OFF = ETH_HLEN + 6;
+        static constexpr unsigned int ARP_TPA_OFF = ETH_HLEN + 24;
+        static constexpr unsigned short ARP_OP_REPLY = 2;
+
+        unsigned int arp_to_chain = 0;
+        Stmt(BPF_LD | BPF_H | BPF_ABS, ETHERTYPE_OFF);
+        if (accept_arp) {
+            // не ARP -> обход блока проверки ARP (в аккумуляторе остаётся EtherType)
+            Jump(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_ARP, NEXT, (count > 0) ? 4 : 2);
+            Stmt(BPF_LD | BPF_H | BPF_ABS, ARP_OP_OFF);
+            if (count > 0) {
+                Jump(BPF_JMP | BPF_JEQ | BPF_K, ARP_OP_REPLY, NEXT, DROP);
+                Stmt(BPF_LD | BPF_W | BPF_ABS, ARP_TPA_OFF);
+                arp_to_chain = len_;
+                Stmt(BPF_JMP | BPF_JA, 0);
+            } else {
+                Jump(BPF_JMP | BPF_JEQ | BPF_K, ARP_OP_REPLY, ACCEPT, DROP);
+            }
+        }
+        Jump(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, NEXT, DROP);
+        Stmt(BPF_LD | BPF_B | BPF_ABS, IP_PROTO_OFF);
+        Jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, NEXT, DROP);
+        Stmt(BPF_LD | BPF_H | BPF_ABS, IP_FRAG_OFF);
+        Jump(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, DROP, NEXT);
+        Stmt(BPF_LDX | BPF_B | BPF_MSH, ETH_HLEN);
+        Stmt(BPF_LD | BPF_B | BPF_IND, ICMP_TYPE_OFF);
+        Jump(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, NEXT, DROP);
+        if (icmp_id != ANY_ID) {
+            // BPF читает полуслово в сетевом порядке байт
+            Stmt(BPF_LD | BPF_H | BPF_IND, ICMP_ID_OFF);
+            Jump(BPF_JMP | BPF_JEQ | BPF_K, ntohs((unsigned short)icmp_id), NEXT, DROP);
+        }
+        if (count > 0) {
+            Stmt(BPF_LD | BPF_W | BPF_ABS, IP_DST_OFF);
+            Stmt(BPF_JMP | BPF_JA, 2);
+        }
+        unsigned int accept = len_;
+        Stmt(BPF_RET | BPF_K, 0xFFFFFFFF);
+        unsigned int drop = len_;
+        Stmt(BPF_RET | BPF_K, 0);
+
+        // разрешение меток переходов: переходы BPF относительные и только вперёд
+        for (unsigned int i = 0; i < len_; ++i) {
+            if ((BPF_CLASS(code_[i].code) != BPF_JMP) || (BPF_OP(code_[i].code) == BPF_JA)) {
+                continue;
+            }
+            code_[i].jt = Resolve(i, code_[i].jt, accept, drop);
+            code_[i].jf = Resolve(i, code_[i].jf, accept, drop);
+        }
+        if (count > 0) {
+            if (accept_arp) {
+                code_[arp_to_chain].k = len_ - arp_to_chain - 1;
+            }
+            for (unsigned int i = 0; i < count; ++i) {
+                Jump(BPF_JMP | BPF_JEQ | BPF_K, ntohl(local_ips[i]), 0, 1);
+                Stmt(BPF_RET | BPF_K, 0xFFFFFFFF);
+            }
+            Stmt(BPF_RET | BPF_K, 0);
+        }
+        prog_.len = len_;
+        prog_.filter = code_;
+    }
+
+    void Stmt(unsigned short code, unsigned int k) noexcept {
+        code_[len_++] = BPF_STMT(code, k);
+    }
+
+    void Jump(unsigned short code, unsigned int k, unsigned char jt, unsigned char jf) noexcept {
+        code_[len_++] = BPF_JUMP(code, k, jt, jf);
+    }
+
+    static unsigned char Resolve(unsigned int pos, unsigned char label, unsigned int accept, unsigned int drop) noexcept {
+        if (label == ACCEPT) {
+            return accept - pos - 1;
+        }
+        if (label == DROP) {
+            return drop - pos - 1;
+        }
+        return label;
+    }
+
+    struct sock_filter fixed_[FIXED_LEN + 8];       // программа с несколькими адресами - без выделения памяти
+    struct sock_filter* code_ = fixed_;
+    unsigned int len_ = 0;
+    struct sock_fprog prog_;
+};
+
+class LearnFilter {
+public:
+    static constexpr unsigned int ARP_SNAP_LEN = ETH_HLEN + 28;     // Ethernet заголовок и ARP пакет для IPv4
+    static constexpr unsigned int IP_SNAP_LEN = ETH_HLEN + 20;      // Ethernet заголовок и IPv4 заголовок без опций
+
+    LearnFilter() noexcept {
+        static constexpr unsigned int ETHERTYPE_OFF = 12;
+
+        code_[0] = BPF_STMT(BPF_LD | BPF_H | BPF_ABS, ETHERTYPE_OFF);
+        code_[1] = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_ARP, 2, 0);
+        code_[2] = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 2, 0);
+        code_[3] = BPF_STMT(BPF_RET | BPF_K, 0);
+        code_[4] = BPF_STMT(BPF_RET | BPF_K, ARP_SNAP_LEN);
+        code_[5] = BPF_STMT(BPF_RET | BPF_K, IP_SNAP_LEN);
+        prog_.len = LEN;
+        prog_.filter = code_;
+    }
+
+    const struct sock_fprog* GetProgram() const noexcept {
+        return &prog_;
+    }
+
+private:
+    static constexpr unsigned int LEN = 6;
+
+    struct sock_filter code_[LEN];
+    struct sock_fprog prog_;
+};
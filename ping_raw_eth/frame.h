@@ -0,0 +1,135 @@
+#pragma once
+/*
+ * Формирование фреймов без промежуточных буферов
+ *
+ * PacketBuffer - один буфер с запасом места (headroom) перед данными: каждый уровень дописывает свой заголовок
+ * перед данными вышестоящего уровня (Push), данные между уровнями не копируются и буфер целиком не обнуляется.
+ *
+ * FrameTemplate - шаблон фрейма Ethernet + IPv4 + данные, размеченный один раз. Для очередного пакета шаблон
+ * копируется в слот отправки и в нём правятся только MAC и IP адреса получателя, а контрольная сумма IP
+ * обновляется инкрементально (RFC 1624). Поля данных (например sequence ICMP) правит вызывающая сторона.
+ *
+ * USAGE:
+ * PacketBuffer pkt;
+ * Ping::BuildEchoRequest(pkt.Put(len), len, id, 0);
+ * ip_proto.SendPacket(pkt, dst_ip);     // допишет IP и Ethernet заголовки и отправит
+ *
+ * FrameTemplate tmpl;
+ * tmpl.Init(*iface, IPPROTO_ICMP, echo, sizeof(echo));
+ * unsigned char* payload = tmpl.Write(slot, dst_ip, dst_mac);
+ */
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <netinet/in.h>
+#include <string.h>
+
+#include "../common/checksum.h"
+#include "iface_table.h"
+
+class PacketBuffer {
+public:
+    static constexpr int HEADROOM = 64;    // не меньше Ethernet заголовка + IPv4 заголовка с опциями
+
+    /* Добавление len байт данных в конец, возвращает указатель на них, либо nullptr если места нет */
+    unsigned char* Put(int len) noexcept {
+        if (tail_ + len > (int)sizeof(buf_)) {
+            return nullptr;
+        }
+        unsigned char* data = buf_ + tail_;
+        tail_ += len;
+        return data;
+    }
+
+    /* Резервирование len байт перед данными под заголовок, возвращает указатель на заголовок,
+     * либо nullptr если запаса не хватает */
+    unsigned char* Push(int len) noexcept {
+        if (head_ < len) {
+            return nullptr;
+        }
+        head_ -= len;
+        return buf_ + head_;
+    }
+
+    unsigned char* GetData() noexcept {
+        return buf_ + head_;
+    }
+
+    int GetLength() const noexcept {
+        return tail_ - head_;
+    }
+
+private:
+    unsigned char buf_[HEADROOM + ETH_DATA_LEN];
+    int head_ = HEADROOM;
+    int tail_ = HEADROOM;
+};
+
+class FrameTemplate {
+public:
+    static constexpr int HEADERS_LEN = ETH_HLEN + sizeof(struct iphdr);
+
+    /* Разметка шаблона
+     * - iface - интерфейс отправки (MAC, IPv4 адрес и индекс источника)
+     * - protocol - протокол вышестоящего уровня
+     * - payload, payload_len - данные пакета (заголовок вышестоящего уровня с данными)
+     * возвращает false, если данные не умещаются во фрейм или у интерфейса нет адреса */
+    bool Init(const InterfaceTable::Interface& iface, unsigned char protocol, const unsigned char* payload, int payload_len) noexcept {
+        if ((payload_len < 0) || (payload_len > (int)(ETH_DATA_LEN - sizeof(struct iphdr))) || (iface.ip == 0)) {
+            return false;
+        }
+        struct ethhdr* eth_h = (struct ethhdr*)frame_;
+        memset(eth_h->h_dest, 0xff, ETH_ALEN);
+        memcpy(eth_h->h_source, iface.mac, ETH_ALEN);
+        eth_h->h_proto = htons(ETH_P_IP);
+
+        struct iphdr* ip_h = (struct iphdr*)(frame_ + ETH_HLEN);
+        memset(ip_h, 0, sizeof(*ip_h));
+        ip_h->version = 4;
+        ip_h->ihl = 5;
+        ip_h->ttl = 64;
+        ip_h->tot_len = htons(sizeof(struct iphdr) + payload_len);
+        ip_h->protocol = protocol;
+        ip_h->saddr = iface.ip;
+        ip_h->daddr = 0;        // адрес получателя подставляется в Write
+        ip_h->check = checksum::Compute(ip_h, sizeof(*ip_h));
+
+        memcpy(frame_ + HEADERS_LEN, payload, payload_len);
+        len_ = HEADERS_LEN + payload_len;
+        if_index_ = iface.index;
+        src_ip_ = iface.ip;
+        return true;
+    }
+
+    /* Запись фрейма в buf (не менее GetLength байт)
+     * - dst_ip - адрес получателя в сетевом порядке байт
+     * - dst_mac - MAC адрес следующего узла, nullptr - широковещательный фрейм
+     * возвращает указатель на данные пакета внутри buf - для правки полей вышестоящего уровня */
+    unsigned char* Write(unsigned char* buf, in_addr_t dst_ip, const unsigned char* dst_mac) const noexcept {
+        memcpy(buf, frame_, len_);
+        if (dst_mac != nullptr) {
+            memcpy(((struct ethhdr*)buf)->h_dest, dst_mac, ETH_ALEN);
+        }
+        struct iphdr* ip_h = (struct iphdr*)(buf + ETH_HLEN);
+        ip_h->daddr = dst_ip;
+        ip_h->check = checksum::Update32(ip_h->check, 0, dst_ip);
+        return buf + HEADERS_LEN;
+    }
+
+    int GetLength() const noexcept {
+        return len_;
+    }
+
+    int GetIfIndex() const noexcept {
+        return if_index_;
+    }
+
+    in_addr_t GetSrcIp() const noexcept {
+        return src_ip_;
+    }
+
+private:
+    unsigned char frame_[ETH_FRAME_LEN];
+    int len_ = 0;
+    int if_index_ = 0;
+    in_addr_t src_ip_ = 0;
+};
@@ -0,0 +1,114 @@
+#pragma once
+/*
+ * Гистограмма задержек в духе HDR Histogram: лог-линейные корзины фиксированного размера
+ *
+ * Диапазон значений делится на степени двойки, каждая степень - на SUB_BUCKETS / 2 линейных корзин.
+ * Относительная погрешность значения не превышает 1 / (SUB_BUCKETS / 2) (< 0.8% при SUB_BITS = 8),
+ * значения меньше SUB_BUCKETS хранятся точно. Память фиксирована (BUCKETS счётчиков), запись - O(1)
+ * без ветвлений по диапазону и без выделения памяти. Значения больше MAX_VALUE учитываются в последней корзине,
+ * минимум, максимум и среднее считаются точно.
+ *
+ * USAGE:
+ * Histogram hist;
+ * hist.Record(rtt_ns);
+ * long long p99 = hist.GetPercentile(99.0);
+ */
+#include <string.h>
+
+class Histogram {
+public:
+    static constexpr unsigned int SUB_BITS = 8;
+    static constexpr unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr unsigned int HALF_BUCKETS = SUB_BUCKETS / 2;
+    static constexpr unsigned int VALUE_BITS = 36;                      // до 2^36 нс (~68 секунд)
+    static constexpr unsigned long long MAX_VALUE = (1ULL << VALUE_BITS) - 1;
+    static constexpr unsigned int BUCKETS = (VALUE_BITS - SUB_BITS + 2) * HALF_BUCKETS;
+
+    Histogram() noexcept {
+        Reset();
+    }
+
+    void Reset() noexcept {
+        memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        sum_ = 0;
+        min_ = 0;
+        max_ = 0;
+    }
+
+    /* Учёт значения value (неотрицательного) */
+    void Record(unsigned long long value) noexcept {
+        if (count_ == 0 || value < min_) {
+            min_ = value;
+        }
+        if (value > max_) {
+            max_ = value;
+        }
+        ++count_;
+        sum_ += value;
+        ++counts_[Index(value > MAX_VALUE ? MAX_VALUE : value)];
+    }
+
+    unsigned long long GetCount() const noexcept {
+        return count_;
+    }
+
+    unsigned long long GetMin() const noexcept {
+        return min_;
+    }
+
+    unsigned long long GetMax() const noexcept {
+        return max_;
+    }
+
+    unsigned long long GetMean() const noexcept {
+        return (count_ == 0) ? 0 : sum_ / count_;
+    }
+
+    /* Значение, не меньше которого percentile процентов учтённых значений (середина корзины,
+     * но не больше максимума), 0 если значений нет */
+    unsigned long long GetPercentile(double percentile) const noexcept {
+        if (count_ == 0) {
+            return 0;
+        }
+        unsigned long long rank = (unsigned long long)(percentile / 100.0 * count_ + 0.999999);
+        if (rank == 0) {
+            rank = 1;
+        } else if (rank > count_) {
+            rank = count_;
+        }
+        unsigned long long seen = 0;
+        for (unsigned int i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                unsigned long long value = Middle(i);
+                return (value > max_) ? max_ : ((value < min_) ? min_ : value);
+            }
+        }
+        return max_;
+    }
+
+private:
+    /* Корзина: сдвиг shift - сколько младших бит значения отбрасывается, старшие SUB_BITS бит - номер в степени */
+    static unsigned int Index(unsigned long long value) noexcept {
+        int msb = 63 - __builtin_clzll(value | 1);
+        unsigned int shift = (msb < (int)SUB_BITS) ? 0 : msb - SUB_BITS + 1;
+        return shift * HALF_BUCKETS + (unsigned int)(value >> shift);
+    }
+
+    /* Середина диапазона значений корзины index */
+    static unsigned long long Middle(unsigned int index) noexcept {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        unsigned int shift = index / HALF_BUCKETS - 1;
+        unsigned long long low = (unsigned long long)(index - shift * HALF_BUCKETS) << shift;
+        return low + ((1ULL << shift) >> 1);
+    }
+
+    unsigned int counts_[BUCKETS];
+    unsigned long long count_;
+    unsigned long long sum_;
+    unsigned long long min_;
+    unsigned long long max_;
+};
@@ -1,77 +1,176 @@
 #pragma once
 /*
  * Класс для работы с ICMP пакетами
+ * Через GetBackend доступен как бэкенд общего интерфейса ICMP echo (common/echo.h) - наравне
+ * с датаграммным ICMP сокетом (common/icmp_socket.h). Одиночный запрос с повторами - EchoRetry (common/echo_retry.h)
  */
+#include "../common/checksum.h"
+#include "../common/echo.h"
 #include "ip.h"
-#include "utils.h"
 
 #include <linux/icmp.h>
 
 class Ping {
 public:
     static constexpr unsigned int PING_PKT_SIZE = 64;
+    static constexpr unsigned int ECHO_STAMP_END = sizeof(struct icmphdr) + sizeof(unsigned int);
 
     bool IsCreated() const noexcept {
         return ip_proto_.IsCreated();
     }
 
-    bool Do(const char* ip) noexcept {
-        if (IsCreated()) {
-            auto id = getpid() & 0xFFFF;
-            if (!SendRequest(id, ip)) {
-                return false;
-            }
-            int res = RcvReply(id);
-            if (res != 0) {
-                printf("%s\n", ((res == -1) ? "Problems with network" : "Host unreachable"));
-                return false;
-            }
-            auto* hw = ip_proto_.GetDestinationMacAddr();
-            printf("%02x:%02x:%02x:%02x:%02x:%02x\n", hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
-            return true;
-        } else {
-            return false;
-        }
+    /* Ethernet уровень - для подключения приёмника копий принятых фреймов (SetFrameSink) */
+    EthernetProtocol& GetEthernet() noexcept {
+        return ip_proto_.GetEthernet();
     }
 
-private:
-    bool SendRequest(unsigned short id, const char* ping_addr) noexcept {
-        unsigned char send_buf[PING_PKT_SIZE];
-        memset(send_buf, 0, sizeof(send_buf));
-        struct icmphdr* icmp_header = (struct icmphdr*)send_buf;
+    /* Формирование ICMP echo request в буфере buf длиной len (не менее заголовка ICMP) */
+    static void BuildEchoRequest(unsigned char* buf, int len, unsigned short id, unsigned short sequence) noexcept {
+        memset(buf, 0, len);
+        struct icmphdr* icmp_header = (struct icmphdr*)buf;
 
         icmp_header->type = ICMP_ECHO;
         icmp_header->un.echo.id = id;
-        icmp_header->un.echo.sequence = 0;
-        icmp_header->checksum = utils::Checksum(send_buf, sizeof(send_buf));
-        if (!ip_proto_.SendRequest(send_buf, sizeof(send_buf), ping_addr, IPPROTO_ICMP)) {
-            printf("ICMP packet sending failed!\n");
+        icmp_header->un.echo.sequence = sequence;
+        icmp_header->checksum = checksum::Compute(buf, len);
+    }
+
+    /* Замена sequence в готовом echo request с инкрементальным пересчётом контрольной суммы (RFC 1624) */
+    static void SetEchoSequence(unsigned char* buf, unsigned short sequence) noexcept {
+        struct icmphdr* icmp_header = (struct icmphdr*)buf;
+        icmp_header->checksum = checksum::Update16(icmp_header->checksum, icmp_header->un.echo.sequence, sequence);
+        icmp_header->un.echo.sequence = sequence;
+    }
+
+    /* Метка в данных echo request (первые 4 байта после заголовка ICMP) с инкрементальным пересчётом
+     * контрольной суммы. Получатель возвращает данные в ответе как есть - по метке отправитель узнаёт
+     * время отправки, не храня его для каждого запроса. Буфер - не короче ECHO_STAMP_END */
+    static void SetEchoStamp(unsigned char* buf, unsigned int stamp) noexcept {
+        struct icmphdr* icmp_header = (struct icmphdr*)buf;
+        unsigned int old_stamp;
+        memcpy(&old_stamp, buf + sizeof(*icmp_header), sizeof(old_stamp));
+        icmp_header->checksum = checksum::Update32(icmp_header->checksum, old_stamp, stamp);
+        memcpy(buf + sizeof(*icmp_header), &stamp, sizeof(stamp));
+    }
+
+    /* Метка из echo reply длиной len, возвращает false, если ответ короче метки */
+    static bool GetEchoStamp(const unsigned char* data, int len, unsigned int* stamp) noexcept {
+        if (len < (int)ECHO_STAMP_END) {
             return false;
         }
+        memcpy(stamp, data + sizeof(struct icmphdr), sizeof(*stamp));
         return true;
     }
 
-    /* Получение ответа
-     * Возвращает результата:
-     * - -1 - ошибка получения ответа (IP протокол)
-     * - 0 - пришёл нормальный ответ
-     * - 1 - пришёл кривой ответ */
-    int RcvReply([[maybe_unused]]unsigned short id) noexcept {
-        static constexpr int BUF_LEN = 128;
-        unsigned char rcv_buf[BUF_LEN];
-        int icmp_len = ip_proto_.RcvReply(rcv_buf, sizeof(rcv_buf));
-        if (icmp_len <= 0) {
-            printf("ICMP packet receive failed!\n");
-            return -1;
+    /* Постановка echo request для dst_ip (в сетевом порядке байт) в очередь пакетной отправки ip_proto
+     * - tmpl - шаблон фрейма с echo request: копируется прямо в слот очереди, контрольные суммы не пересчитываются
+     *   целиком - меняются только адрес и sequence
+     * - echo, echo_len - тот же echo request без заголовков: для целей за другим интерфейсом (шаблон не подходит)
+     *   пакет собирается полностью
+     * - stamp - метка в данных (SetEchoStamp), 0 - данные шаблона не меняются (echo_len не короче ECHO_STAMP_END)
+     * возвращает true при успехе, при неудаче errno как у IPProtocol::QueueRequest */
+    static bool QueueEchoRequest(IPProtocol& ip_proto, const FrameTemplate& tmpl, const unsigned char* echo, int echo_len,
+                                 in_addr_t dst_ip, unsigned short sequence, unsigned int stamp = 0) noexcept {
+        unsigned char* icmp = ip_proto.ReserveFrame(tmpl, dst_ip);
+        if (icmp != nullptr) {
+            SetEchoSequence(icmp, sequence);
+            if (stamp != 0) {
+                SetEchoStamp(icmp, stamp);
+            }
+            ip_proto.CommitFrame(tmpl);
+            return true;
+        }
+        if (errno != EXDEV) {
+            return false;
+        }
+        unsigned char send_buf[PING_PKT_SIZE];
+        echo_len = (echo_len > (int)sizeof(send_buf)) ? (int)sizeof(send_buf) : echo_len;
+        memcpy(send_buf, echo, echo_len);
+        SetEchoSequence(send_buf, sequence);
+        if (stamp != 0) {
+            SetEchoStamp(send_buf, stamp);
+        }
+        return ip_proto.QueueRequest(send_buf, echo_len, dst_ip, IPPROTO_ICMP);
+    }
+
+    /* Разбор ICMP echo reply без копирования
+     * возвращает указатель на заголовок ICMP, либо nullptr, если это не echo reply */
+    static const struct icmphdr* ParseEchoReply(const unsigned char* data, int len) noexcept {
+        if (len < (int)sizeof(struct icmphdr)) {
+            return nullptr;
         }
-        const struct icmphdr* icmp_header = (struct icmphdr*)rcv_buf;
+        const struct icmphdr* icmp_header = (const struct icmphdr*)data;
+        if (icmp_header->type != ICMP_ECHOREPLY) {
+            return nullptr;
+        }
+        return icmp_header;
+    }
+
+    /* Набор функций общего интерфейса бэкендов ICMP echo, ctx - этот объект
+     * Запросы уходят фреймами по одному (SendPacket), идентификатор - от pid процесса, ответы с ним
+     * отбираются фильтром ядра, в ответе известен MAC адрес отправителя */
+    EchoBackend GetBackend() noexcept {
+        backend_id_ = getpid() & 0xFFFF;
+        ip_proto_.SetReplyFilter(backend_id_);
+        return EchoBackend{this, BackendGetId, BackendGetSocket, BackendSend, BackendReceive};
+    }
+
+private:
+    static unsigned short BackendGetId(void* ctx) {
+        return ((Ping*)ctx)->backend_id_;
+    }
 
-        // можно добавить проверку id: icmp_header->un.echo.id == id
-        if (icmp_header->type != 0) {
+    static int BackendGetSocket(void* ctx) {
+        return ((Ping*)ctx)->ip_proto_.GetEthernet().GetSocket();
+    }
+
+    static bool BackendSend(void* ctx, in_addr_t dst, unsigned short sequence) {
+        Ping* self = (Ping*)ctx;
+        PacketBuffer pkt;
+        BuildEchoRequest(pkt.Put(PING_PKT_SIZE), PING_PKT_SIZE, self->backend_id_, sequence);
+        return self->ip_proto_.SendPacket(pkt, dst, IPPROTO_ICMP);
+    }
+
+    /* Фреймы разбираются до первого echo reply с нашим идентификатором, ARP ответы пополняют кэш соседей */
+    static int BackendReceive(void* ctx, EchoReply* reply, bool wait) {
+        Ping* self = (Ping*)ctx;
+        EthernetProtocol& ether = self->ip_proto_.GetEthernet();
+        for (;;) {
+            const unsigned char* frame;
+            int len = ether.RcvFrameView(&frame, wait);
+            if (len <= 0) {
+                return ((len < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) ? -1 : 0;
+            }
+            if (len < (int)sizeof(struct ether_header)) {
+                // фрейм короче заголовка (усечённая запись pcap) пропускается, как в RcvFrames
+                ether.GetMetrics().Add(Metrics::RX_FILTERED);
+                continue;
+            }
+            const struct ether_header* eth_h = (const struct ether_header*)frame;
+            if (eth_h->ether_type == htons(ETH_P_ARP)) {
+                self->ip_proto_.GetArp().HandlePacket(frame + ETH_HLEN, len - ETH_HLEN);
+                continue;
+            }
+            const struct iphdr* ip_h;
+            int icmp_len;
+            const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + ETH_HLEN, len - ETH_HLEN, &ip_h, &icmp_len);
+            if ((eth_h->ether_type != htons(ETH_P_IP)) || (icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP)) {
+                continue;
+            }
+            const struct icmphdr* icmp_h = ParseEchoReply(icmp_data, icmp_len);
+            if ((icmp_h == nullptr) || (icmp_h->un.echo.id != self->backend_id_)) {
+                continue;
+            }
+            reply->src = ip_h->saddr;
+            reply->id = icmp_h->un.echo.id;
+            reply->sequence = icmp_h->un.echo.sequence;
+            reply->ts_ns = ether.GetRxTimestamp().software;
+            reply->has_mac = true;
+            memcpy(reply->mac, eth_h->ether_shost, ETH_ALEN);
             return 1;
         }
-        return 0;
     }
 
     IPProtocol ip_proto_;
+    unsigned short backend_id_ = 0;
 };
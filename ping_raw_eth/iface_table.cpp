@@ -0,0 +1,357 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iface_table.h"
+
+namespace {
+constexpr int NL_BUF_SIZE = 32768;
+
+struct DumpRequest {
+    struct nlmsghdr hdr;
+    struct rtgenmsg gen;
+};
+}
+
+/*
+ * При создании объекта:
+ * - открываем netlink сокет и подписываемся на изменения интерфейсов и IPv4 адресов
+ *   (подписка до дампа, чтобы не пропустить изменения, случившиеся во время дампа)
+ * - читаем текущее состояние дампом
+ */
+InterfaceTable::InterfaceTable() noexcept {
+    nl_fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl_fd_ < 0) {
+        printf("Interfaces. Error. Netlink socket not received!\n");
+        return;
+    }
+    unsigned int groups[] = {RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR};
+    for (unsigned int group : groups) {
+        if (setsockopt(nl_fd_, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+            printf("Interfaces. Error subscribing to netlink group %u.\n", group);
+            return;
+        }
+    }
+    if (Dump() && RebuildAddresses()) {
+        created_ = true;
+    }
+}
+
+InterfaceTable::~InterfaceTable() {
+    if (nl_fd_ >= 0) {
+        close(nl_fd_);
+    }
+    free(entries_);
+    free(addrs_);
+}
+
+bool InterfaceTable::IsCreated() const noexcept {
+    return created_;
+}
+
+int InterfaceTable::GetSocket() const noexcept {
+    return nl_fd_;
+}
+
+bool InterfaceTable::SendDumpRequest(unsigned short type, unsigned char family) noexcept {
+    DumpRequest req{};
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    req.hdr.nlmsg_type = type;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.hdr.nlmsg_seq = ++seq_;
+    req.gen.rtgen_family = family;
+    if (send(nl_fd_, &req, req.hdr.nlmsg_len, 0) < 0) {
+        printf("Interfaces. Error sending netlink dump request. %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* Полное перечитывание таблицы: сначала интерфейсы, затем их IPv4 адреса */
+bool InterfaceTable::Dump() noexcept {
+    static const unsigned short requests[][2] = {{RTM_GETLINK, AF_PACKET}, {RTM_GETADDR, AF_INET}};
+
+    count_ = 0;
+    ++generation_;
+    char* buf = (char*)malloc(NL_BUF_SIZE);
+    if (buf == nullptr) {
+        printf("Interfaces. Error. Not enough memory.\n");
+        return false;
+    }
+    bool ok = true;
+    for (const auto& request : requests) {
+        if (!SendDumpRequest(request[0], request[1])) {
+            ok = false;
+            break;
+        }
+        int done = 0;
+        while (done == 0) {
+            int len = recv(nl_fd_, buf, NL_BUF_SIZE, 0);
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                printf("Interfaces. Error receiving netlink dump. %s\n", strerror(errno));
+                done = -1;
+                break;
+            }
+            done = ProcessMessages(buf, len);
+        }
+        if (done < 0) {
+            ok = false;
+            break;
+        }
+    }
+    free(buf);
+    return ok;
+}
+
+bool InterfaceTable::Update() noexcept {
+    bool ok = ReceiveNotifications();
+    if (generation_ != addrs_generation_) {
+        ok = RebuildAddresses() && ok;
+    }
+    return ok;
+}
+
+bool InterfaceTable::ReceiveNotifications() noexcept {
+    char buf[NL_BUF_SIZE];
+    for (;;) {
+        int len = recv(nl_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                // уведомления потеряны - состояние таблицы неизвестно, перечитываем
+                return Dump();
+            }
+            printf("Interfaces. Error receiving netlink notification. %s\n", strerror(errno));
+            return false;
+        }
+        if (ProcessMessages(buf, len) < 0) {
+            return false;
+        }
+    }
+}
+
+int InterfaceTable::ProcessMessages(const char* buf, int len) noexcept {
+    for (const struct nlmsghdr* nh = (const struct nlmsghdr*)buf; NLMSG_OK(nh, (unsigned int)len); nh = NLMSG_NEXT(nh, len)) {
+        switch (nh->nlmsg_type) {
+        case NLMSG_DONE:
+            return 1;
+        case NLMSG_ERROR: {
+            const struct nlmsgerr* err = (const struct nlmsgerr*)NLMSG_DATA(nh);
+            if (err->error != 0) {
+                printf("Interfaces. Netlink error. %s\n", strerror(-err->error));
+                return -1;
+            }
+            break;
+        }
+        case RTM_NEWLINK:
+            OnLink(nh);
+            break;
+        case RTM_DELLINK:
+            Remove(((const struct ifinfomsg*)NLMSG_DATA(nh))->ifi_index);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            OnAddr(nh);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+void InterfaceTable::OnLink(const struct nlmsghdr* nh) noexcept {
+    const struct ifinfomsg* ifi = (const struct ifinfomsg*)NLMSG_DATA(nh);
+    Interface* iface = FindOrAdd(ifi->ifi_index);
+    if (iface == nullptr) {
+        return;
+    }
+    iface->flags = ifi->ifi_flags;
+
+    int attr_len = IFLA_PAYLOAD(nh);
+    for (const struct rtattr* rta = IFLA_RTA(ifi); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+            strncpy(iface->name, (const char*)RTA_DATA(rta), IFNAMSIZ - 1);
+        } else if ((rta->rta_type == IFLA_ADDRESS) && (RTA_PAYLOAD(rta) == ETH_ALEN)) {
+            memcpy(iface->mac, RTA_DATA(rta), ETH_ALEN);
+        }
+    }
+}
+
+/* Хранится только основной (не secondary) адрес интерфейса */
+void InterfaceTable::OnAddr(const struct nlmsghdr* nh) noexcept {
+    const struct ifaddrmsg* ifa = (const struct ifaddrmsg*)NLMSG_DATA(nh);
+    if ((ifa->ifa_family != AF_INET) || (ifa->ifa_flags & IFA_F_SECONDARY)) {
+        return;
+    }
+    in_addr_t ip = 0;
+    int attr_len = IFA_PAYLOAD(nh);
+    for (const struct rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        if ((rta->rta_type == IFA_LOCAL) || ((rta->rta_type == IFA_ADDRESS) && (ip == 0))) {
+            memcpy(&ip, RTA_DATA(rta), sizeof(ip));
+        }
+    }
+
+    Interface* iface = nullptr;
+    for (int i = 0; i < count_; ++i) {
+        if (entries_[i].index == (int)ifa->ifa_index) {
+            iface = &entries_[i];
+            break;
+        }
+    }
+    if (iface == nullptr) {
+        return;
+    }
+    if (nh->nlmsg_type == RTM_NEWADDR) {
+        if (iface->ip != ip) {
+            ++generation_;
+        }
+        iface->ip = ip;
+        iface->prefix_len = ifa->ifa_prefixlen;
+    } else if (iface->ip == ip) {
+        iface->ip = 0;
+        iface->prefix_len = 0;
+        ++generation_;
+    }
+}
+
+InterfaceTable::Interface* InterfaceTable::FindOrAdd(int index) noexcept {
+    for (int i = 0; i < count_; ++i) {
+        if (entries_[i].index == index) {
+            return &entries_[i];
+        }
+    }
+    if (count_ == capacity_) {
+        int capacity = (capacity_ == 0) ? 16 : capacity_ * 2;
+        Interface* entries = (Interface*)realloc(entries_, capacity * sizeof(Interface));
+        if (entries == nullptr) {
+            printf("Interfaces. Error. Not enough memory.\n");
+            return nullptr;
+        }
+        entries_ = entries;
+        capacity_ = capacity;
+    }
+    Interface* iface = &entries_[count_++];
+    memset(iface, 0, sizeof(*iface));
+    iface->index = index;
+    return iface;
+}
+
+/* Удаление с сохранением порядка - порядок определяет нумерацию в GetInterfaceName */
+void InterfaceTable::Remove(int index) noexcept {
+    for (int i = 0; i < count_; ++i) {
+        if (entries_[i].index == index) {
+            if (entries_[i].ip != 0) {
+                ++generation_;
+            }
+            memmove(&entries_[i], &entries_[i + 1], (count_ - i - 1) * sizeof(Interface));
+            --count_;
+            return;
+        }
+    }
+}
+
+const InterfaceTable::Interface* InterfaceTable::FindByName(const char* name) const noexcept {
+    for (int i = 0; i < count_; ++i) {
+        if (strncmp(entries_[i].name, name, IFNAMSIZ) == 0) {
+            return &entries_[i];
+        }
+    }
+    return nullptr;
+}
+
+const InterfaceTable::Interface* InterfaceTable::FindByIndex(int index) const noexcept {
+    for (int i = 0; i < count_; ++i) {
+        if (entries_[i].index == index) {
+            return &entries_[i];
+        }
+    }
+    return nullptr;
+}
+
+int InterfaceTable::GetCount() const noexcept {
+    return count_;
+}
+
+const InterfaceTable::Interface* InterfaceTable::Get(int idx) const noexcept {
+    return ((idx >= 0) && (idx < count_)) ? &entries_[idx] : nullptr;
+}
+
+/* Список и хеш-таблица адресов - одним блоком, заполнение хеш-таблицы не более 1/2 */
+bool InterfaceTable::RebuildAddresses() noexcept {
+    unsigned int count = 0;
+    for (int i = 0; i < count_; ++i) {
+        if (entries_[i].ip != 0) {
+            ++count;
+        }
+    }
+    unsigned int slots = 16;
+    while (slots < count * 2) {
+        slots *= 2;
+    }
+    in_addr_t* addrs = (in_addr_t*)calloc(count + slots, sizeof(in_addr_t));
+    if (addrs == nullptr) {
+        printf("Interfaces. Error. Not enough memory.\n");
+        return false;
+    }
+    free(addrs_);
+    addrs_ = addrs;
+    addr_slots_ = addrs + count;
+    addr_mask_ = slots - 1;
+    addr_count_ = 0;
+    for (int i = 0; i < count_; ++i) {
+        in_addr_t ip = entries_[i].ip;
+        if ((ip == 0) || IsLocalAddress(ip)) {
+            continue;
+        }
+        addrs_[addr_count_++] = ip;
+        unsigned int j = AddressSlot(ip);
+        while (addr_slots_[j] != 0) {
+            j = (j + 1) & addr_mask_;
+        }
+        addr_slots_[j] = ip;
+    }
+    addrs_generation_ = generation_;
+    return true;
+}
+
+unsigned int InterfaceTable::AddressSlot(in_addr_t ip) const noexcept {
+    unsigned int h = ip * 2654435761u;
+    h ^= h >> 15;
+    return h & addr_mask_;
+}
+
+bool InterfaceTable::IsLocalAddress(in_addr_t ip) const noexcept {
+    if ((ip == 0) || (addr_slots_ == nullptr)) {
+        return false;
+    }
+    for (unsigned int j = AddressSlot(ip); addr_slots_[j] != 0; j = (j + 1) & addr_mask_) {
+        if (addr_slots_[j] == ip) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const in_addr_t* InterfaceTable::GetLocalAddresses(unsigned int* count) const noexcept {
+    *count = addr_count_;
+    return addrs_;
+}
+
+unsigned int InterfaceTable::GetAddressGeneration() const noexcept {
+    return addrs_generation_;
+}
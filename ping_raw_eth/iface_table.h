@@ -0,0 +1,91 @@
+#pragma once
+/*
+ * Таблица сетевых интерфейсов системы
+ *
+ * Заполняется один раз дампом rtnetlink (RTM_GETLINK + RTM_GETADDR) и далее поддерживается в актуальном
+ * состоянии по уведомлениям групп RTNLGRP_LINK и RTNLGRP_IPV4_IFADDR. Количество интерфейсов не ограничено.
+ * Поиск интерфейса - обращение к таблице в памяти, без системных вызовов.
+ *
+ * Уведомления обрабатываются в Update(): сокет таблицы можно добавить в цикл событий (GetSocket)
+ * и вызывать Update() по готовности сокета.
+ *
+ * Адреса интерфейсов дополнительно собираются в набор локальных адресов: список - для фильтра ядра
+ * (ReplyFilter), хеш-таблица - для проверки адреса за O(1). Набор пересобирается в конце Update(),
+ * если адреса изменились; по номеру версии (GetAddressGeneration) видно, что его пора перечитать.
+ *
+ * USAGE:
+ * InterfaceTable table; // если успешно создана, то IsCreated вернёт true
+ * auto* iface = table.FindByName("eth0");
+ */
+#include <linux/if.h>
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+class InterfaceTable {
+public:
+    struct Interface {
+        int index;                          // индекс интерфейса в системе
+        char name[IFNAMSIZ];
+        unsigned char mac[ETH_ALEN];        // нули, если у интерфейса нет MAC адреса (loopback)
+        unsigned int flags;                 // IFF_*
+        in_addr_t ip;                       // основной IPv4 адрес в сетевом порядке байт, 0 если адреса нет
+        unsigned char prefix_len;           // длина префикса сети основного адреса
+    };
+
+    InterfaceTable() noexcept;
+    ~InterfaceTable();
+
+    bool IsCreated() const noexcept;
+
+    /* Обработка накопившихся уведомлений без блокировки
+     * При переполнении очереди уведомлений таблица перечитывается целиком
+     * возвращает true при успехе */
+    bool Update() noexcept;
+
+    /* Сокет уведомлений - для добавления в цикл событий */
+    int GetSocket() const noexcept;
+
+    /* Указатели действительны до следующего вызова Update() */
+    const Interface* FindByName(const char* name) const noexcept;
+    const Interface* FindByIndex(int index) const noexcept;
+
+    int GetCount() const noexcept;
+    const Interface* Get(int idx) const noexcept;
+
+    /* Принадлежит ли адрес (в сетевом порядке байт) одному из интерфейсов, O(1) */
+    bool IsLocalAddress(in_addr_t ip) const noexcept;
+
+    /* Адреса интерфейсов (в сетевом порядке байт, без нулевых), count - их количество
+     * Массив действителен до следующего вызова Update() */
+    const in_addr_t* GetLocalAddresses(unsigned int* count) const noexcept;
+
+    /* Версия набора адресов: меняется при каждом изменении адресов интерфейсов */
+    unsigned int GetAddressGeneration() const noexcept;
+
+private:
+    bool Dump() noexcept;
+    bool SendDumpRequest(unsigned short type, unsigned char family) noexcept;
+    /* разбор сообщений в буфере, возвращает 1 если встретился конец дампа, -1 при ошибке */
+    int ProcessMessages(const char* buf, int len) noexcept;
+    void OnLink(const struct nlmsghdr* nh) noexcept;
+    void OnAddr(const struct nlmsghdr* nh) noexcept;
+    Interface* FindOrAdd(int index) noexcept;
+    void Remove(int index) noexcept;
+    bool ReceiveNotifications() noexcept;
+    bool RebuildAddresses() noexcept;
+    unsigned int AddressSlot(in_addr_t ip) const noexcept;
+
+    bool created_ = false;
+    int nl_fd_ = -1;
+    unsigned int seq_ = 0;
+    Interface* entries_ = nullptr;
+    int count_ = 0;
+    int capacity_ = 0;
+
+    in_addr_t* addrs_ = nullptr;            // список адресов, за ним - хеш-таблица addr_slots_
+    unsigned int addr_count_ = 0;
+    in_addr_t* addr_slots_ = nullptr;       // открытая адресация, 0 - слот свободен
+    unsigned int addr_mask_ = 0;            // размер хеш-таблицы - 1 (степень двойки)
+    unsigned int generation_ = 0;           // версия адресов интерфейсов
+    unsigned int addrs_generation_ = 0;     // версия, по которой собран набор адресов
+};
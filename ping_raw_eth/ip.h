@@ -2,9 +2,16 @@
 /*
  * Класс работы с пакетами IP
  * Упрощённый вариант - длина пакета должна уместиться в 1500 байт
+ *
+ * Интерфейс отправки и следующий узел (шлюз, либо сам адресат) выбираются по таблице маршрутов ядра.
+ * Пакеты отправляются на MAC адрес следующего узла, если он известен (кэш соседей ARP), иначе - широковещательно.
+ *
+ * Заголовки пишутся сразу на место во фрейме: в запас буфера PacketBuffer (SendPacket), в слот очереди
+ * отправки (QueueRequest), либо копируются из шаблона FrameTemplate с правкой адреса (ReserveFrame).
  */
 #include <arpa/inet.h>
 #include <cstring>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <linux/if_ether.h>
@@ -12,95 +19,363 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
-#include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "../common/checksum.h"
+#include "arp.h"
 #include "ethernet.h"
-#include "utils.h"
-
-namespace {
-struct in_addr GetIfaceIp(const char* if_name) noexcept {
-    struct ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
-    strncpy(ifr.ifr_name, if_name, sizeof(ifr.ifr_name));
-
-    int s = socket(AF_INET, SOCK_DGRAM, 0);
-    ioctl(s, SIOCGIFADDR, &ifr);
-    close(s);
-
-    const struct sockaddr_in *sa = (struct sockaddr_in*)&ifr.ifr_addr;
-    if(sa == NULL) {
-        printf("Error getting IP of interface %s\n", if_name);
-        struct in_addr myip;
-        inet_aton("127.0.0.1", &myip);
-        return myip;
-    }
-    return sa->sin_addr;
-}
-}
+#include "filter.h"
+#include "frame.h"
+#include "route.h"
 
 class IPProtocol {
 public:
+    IPProtocol() noexcept = default;
+
+    /* Разбор без сети: фреймы принимаются из source (см. EthernetProtocol(FrameSource, void*)) */
+    IPProtocol(EthernetProtocol::FrameSource source, void* ctx) noexcept : ether_(source, ctx) {}
+
     bool IsCreated() const noexcept {
-        return ether_.IsCreated();
+        return ether_.IsCreated() && routes_.IsCreated();
     }
 
     /* Отправка IP пакета
      * - data - данные, которые будут отправлены в пакете
      * - data_len - длина в байтах параметра data
-     * - dst_ip_addr - нуль терминированная строка IP адрес назначения
+     * - dst_ip_addr - IP адрес назначения в сетевом порядке байт (строка разбирается один раз вызывающей стороной)
      * - protocol - протокол передачи вышестоящего уровня
      * возвращает true при успешной отправке
-     * ! отправляем на первый интерфейс в списке интерфейсов */
-    bool SendRequest(const unsigned char* data, int data_len, const char* dst_ip_addr, short protocol = IPPROTO_ICMP) noexcept {
-        unsigned char send_buf[ETH_DATA_LEN];
-        memset(send_buf, 0, sizeof(send_buf));
-
-        data_len = (data_len > (ETH_DATA_LEN - sizeof(struct iphdr))) ? (ETH_DATA_LEN - sizeof(struct iphdr)) : data_len;
+     * Интерфейс отправки и следующий узел выбираются по таблице маршрутов,
+     * MAC адрес следующего узла берётся из кэша соседей; при промахе ARP запрос отправляется без ожидания ответа,
+     * а пакет уходит широковещательно (ответ ARP разбирается приёмом вместе с остальными фреймами) */
+    bool SendRequest(const unsigned char* data, int data_len, in_addr_t dst_ip_addr, short protocol = IPPROTO_ICMP) noexcept {
+        PacketBuffer pkt;
+        data_len = (data_len > (int)(ETH_DATA_LEN - sizeof(struct iphdr))) ? (ETH_DATA_LEN - sizeof(struct iphdr)) : data_len;
+        memcpy(pkt.Put(data_len), data, data_len);
+        return SendPacket(pkt, dst_ip_addr, protocol);
+    }
 
-        struct iphdr *ip_h = (struct iphdr*)send_buf;
-        ip_h->version   = 4;    // версия протокола IPv4
-        ip_h->ihl       = 5;    // длина заголовка IP-пакета в 32-битных словах (dword), параметры не используем
-        ip_h->ttl       = 64;   // время жизни (TTL) — число маршрутизаторов, которые может пройти этот пакет
-        ip_h->tot_len   = htons((unsigned short)sizeof(struct iphdr) + (unsigned short)data_len);
-        ip_h->protocol  = protocol;
-        ip_h->daddr     = inet_addr(dst_ip_addr);
-        memcpy(&send_buf[sizeof(struct iphdr)], data, data_len);
+    /* Отправка IP пакета из буфера pkt: заголовок IP дописывается в запас буфера перед данными,
+     * Ethernet заголовок - следующим уровнем, данные между уровнями не копируются
+     * Остальные параметры как у SendRequest */
+    bool SendPacket(PacketBuffer& pkt, in_addr_t dst_ip_addr, short protocol = IPPROTO_ICMP) noexcept {
+        in_addr_t next_hop;
+        auto* if_name = GetRouteInterface(dst_ip_addr, &next_hop);
+        if (if_name == nullptr) {
+            return false;
+        }
+        int data_len = pkt.GetLength();
+        if (data_len > (int)(ETH_DATA_LEN - sizeof(struct iphdr))) {
+            printf("Error. Too large IP packet (%d)\n", data_len);
+            return false;
+        }
+        struct iphdr* ip_h = (struct iphdr*)pkt.Push(sizeof(struct iphdr));
+        if ((ip_h == nullptr) || !BuildHeader(ip_h, data_len, dst_ip_addr, protocol, if_name)) {
+            return false;
+        }
+        return ether_.SendPacket(pkt, if_name, NextHopMac(next_hop, if_name, true));
+    }
 
-        auto* if_name = ether_.GetInterfaceName(0);
-        if (if_name[0] == 0) {
+    /* Постановка IP пакета в очередь пакетной отправки, параметры как у SendRequest
+     * Пакеты уходят при FlushRequests (или при заполнении очереди)
+     * MAC адрес следующего узла берётся только из кэша соседей, без ожидания ARP
+     * Если маршрута нет, возвращает false с errno = ENETUNREACH без вывода ошибки */
+    bool QueueRequest(const unsigned char* data, int data_len, in_addr_t dst_ip_addr, short protocol = IPPROTO_ICMP) noexcept {
+        in_addr_t next_hop;
+        const InterfaceTable::Interface* iface = FindRoute(dst_ip_addr, &next_hop);
+        if (iface == nullptr) {
+            errno = ENETUNREACH;
+            return false;
+        }
+        data_len = (data_len > (int)(ETH_DATA_LEN - sizeof(struct iphdr))) ? (ETH_DATA_LEN - sizeof(struct iphdr)) : data_len;
+        const unsigned char* dst_mac = NextHopMac(next_hop, iface->name, false);
+        unsigned char* frame = ether_.ReserveFrame(iface->index);
+        if (frame == nullptr) {
+            return false;
+        }
+        // фрейм собирается прямо в слоте очереди
+        struct ethhdr* eth_h = (struct ethhdr*)frame;
+        struct iphdr* ip_h = (struct iphdr*)(frame + ETH_HLEN);
+        if (!BuildHeader(ip_h, data_len, dst_ip_addr, protocol, iface->name)) {
             return false;
         }
-        ip_h->saddr = GetIfaceIp(if_name).s_addr;
-        ip_h->check = utils::Checksum((unsigned short *)ip_h, sizeof(struct iphdr));
+        if (dst_mac != nullptr) {
+            memcpy(eth_h->h_dest, dst_mac, ETH_ALEN);
+        } else {
+            memset(eth_h->h_dest, 0xff, ETH_ALEN);
+        }
+        memcpy(eth_h->h_source, iface->mac, ETH_ALEN);
+        eth_h->h_proto = htons(ETH_P_IP);
+        memcpy(frame + FrameTemplate::HEADERS_LEN, data, data_len);
+        ether_.CommitFrame(FrameTemplate::HEADERS_LEN + data_len);
+        return true;
+    }
 
-        if (ether_.SendRequest(send_buf, data_len + sizeof(struct iphdr), if_name)) {
-            return true;
+    /* Слот очереди пакетной отправки с фреймом из шаблона tmpl для dst_ip_addr (в сетевом порядке байт)
+     * В слоте уже подставлены адреса получателя и контрольная сумма IP, вызывающая сторона правит
+     * данные пакета (по возвращённому указателю) и ставит фрейм в очередь вызовом CommitFrame
+     * MAC адрес следующего узла берётся только из кэша соседей, без ожидания ARP
+     * возвращает указатель на данные пакета в слоте, либо nullptr:
+     * - errno = ENETUNREACH - маршрута нет
+     * - errno = EXDEV - маршрут идёт через другой интерфейс, шаблон не подходит
+     * - иначе - ошибка очереди (errno = ENOBUFS - очередь заполнена) */
+    unsigned char* ReserveFrame(const FrameTemplate& tmpl, in_addr_t dst_ip_addr) noexcept {
+        in_addr_t next_hop;
+        const InterfaceTable::Interface* iface = FindRoute(dst_ip_addr, &next_hop);
+        if (iface == nullptr) {
+            errno = ENETUNREACH;
+            return nullptr;
+        }
+        if ((iface->index != tmpl.GetIfIndex()) || (iface->ip != tmpl.GetSrcIp())) {
+            errno = EXDEV;
+            return nullptr;
+        }
+        const unsigned char* dst_mac = NextHopMac(next_hop, iface->name, false);
+        unsigned char* frame = ether_.ReserveFrame(tmpl.GetIfIndex());
+        if (frame == nullptr) {
+            return nullptr;
         }
+        return tmpl.Write(frame, dst_ip_addr, dst_mac);
+    }
 
-        return true;
+    /* Постановка в очередь фрейма, полученного через ReserveFrame */
+    void CommitFrame(const FrameTemplate& tmpl) noexcept {
+        ether_.CommitFrame(tmpl.GetLength());
+    }
+
+    /* Разрешение MAC адреса соседа через ARP, без ICMP
+     * - dst_ip_addr - адрес в сетевом порядке байт, маршрут к нему должен быть без шлюза
+     * возвращает 0 при успехе, 1 если ответа нет, -1 при ошибке */
+    int ResolveMac(in_addr_t dst_ip_addr, unsigned char* mac) noexcept {
+        in_addr_t next_hop;
+        auto* if_name = GetRouteInterface(dst_ip_addr, &next_hop);
+        if (if_name == nullptr) {
+            return -1;
+        }
+        if (next_hop != dst_ip_addr) {
+            printf("Error. Address is not in the network of interface %s\n", if_name);
+            return -1;
+        }
+        return arp_.Resolve(dst_ip_addr, if_name, mac);
+    }
+
+    /* Интерфейс отправки для dst_ip_addr (в сетевом порядке байт) по таблице маршрутов
+     * - next_hop - адрес следующего узла: шлюз, либо сам адресат, если он в сети интерфейса
+     * возвращает имя интерфейса, либо nullptr (с выводом ошибки), если маршрута нет */
+    const char* GetRouteInterface(in_addr_t dst_ip_addr, in_addr_t* next_hop) noexcept {
+        const InterfaceTable::Interface* iface = FindRoute(dst_ip_addr, next_hop);
+        if (iface == nullptr) {
+            struct in_addr addr{dst_ip_addr};
+            printf("Error. No route to host %s\n", inet_ntoa(addr));
+            return nullptr;
+        }
+        return iface->name;
+    }
+
+    /* возвращает количество отправленных пакетов, либо -1 при неудаче */
+    int FlushRequests() noexcept {
+        return ether_.FlushRequests();
     }
 
     /* возвращает количество прочитанных байт и записывает payload в массив data, либо -1 при неудаче */
     int RcvReply(unsigned char* data, int max_data_len) noexcept {
-        unsigned char rcv_buf[ETH_DATA_LEN];
-        memset(rcv_buf, 0, sizeof(rcv_buf));
-        int data_read = ether_.RcvReply(rcv_buf, max_data_len + sizeof(struct iphdr));
-
-        int header_len = sizeof(struct iphdr);
-        int payload_len = data_read - header_len;
+        const unsigned char* payload;
+        int payload_len = RcvReplyView(&payload);
         if (payload_len < 0) {
-            printf("Too small IP packet received (%d)!\n", data_read);
             return -1;
         }
-        memcpy(data, &rcv_buf[header_len], ((max_data_len > payload_len) ? payload_len : max_data_len));
-        return data_read;
+        memcpy(data, payload, ((max_data_len > payload_len) ? payload_len : max_data_len));
+        return payload_len + sizeof(struct iphdr);
+    }
+
+    /* Приём без копирования: data указывает на payload IP пакета внутри принятого фрейма
+     * и действителен до следующего вызова функций приёма
+     * - ip_header - заголовок принятого IP пакета (если не nullptr), действителен так же, как data
+     * возвращает длину payload, либо -1 при неудаче */
+    int RcvReplyView(const unsigned char** data, const struct iphdr** ip_header = nullptr) noexcept {
+        const unsigned char* packet;
+        const struct iphdr* ip_h;
+        int payload_len;
+        for (;;) {
+            int data_read = ether_.RcvReplyView(&packet);
+            if (data_read < 0) {
+                return -1;
+            }
+            if (ether_.GetReceivedEtherType() == ETH_P_ARP) {
+                // ARP ответы пропускаются фильтром ядра - пополняем ими кэш соседей
+                arp_.HandlePacket(packet, data_read);
+                continue;
+            }
+            *data = ParsePacket(packet, data_read, &ip_h, &payload_len);
+            if (*data != nullptr) {
+                break;
+            }
+            // некорректный пакет пропускается - учитывается только в счётчике
+            ether_.GetMetrics().Add(Metrics::RX_FILTERED);
+        }
+        if (ip_header != nullptr) {
+            *ip_header = ip_h;
+        }
+        return payload_len;
     }
 
     const unsigned char* GetDestinationMacAddr() const noexcept {
         return ether_.GetDestinationMacAddr();
     }
 
+    /* Включение фильтра ядра: в сокет попадают только ICMP echo reply с идентификатором id и ARP ответы,
+     * адресованные одному из адресов хоста. Фильтр один на все интерфейсы отправки и при отправке
+     * не пересобирается; при изменении адресов интерфейсов его пересобирает UpdateInterfaces
+     * возвращает true при успехе */
+    bool SetReplyFilter(int id) noexcept {
+        filter_enabled_ = true;
+        filter_id_ = id;
+        return AttachReplyFilter(true);
+    }
+
+    /* Обработка уведомлений таблицы интерфейсов (по готовности её сокета в цикле событий):
+     * если изменились адреса хоста, фильтр ядра пересобирается
+     * возвращает true при успехе */
+    bool UpdateInterfaces() noexcept {
+        InterfaceTable& ifaces = ether_.GetInterfaces();
+        bool ok = ifaces.Update();
+        if (filter_enabled_ && (ifaces.GetAddressGeneration() != filter_generation_)) {
+            ok = AttachReplyFilter(false) && ok;
+        }
+        return ok;
+    }
+
+    /* Принадлежит ли адрес (в сетевом порядке байт) одному из интерфейсов хоста - проверка за O(1)
+     * для ответов, которые фильтр ядра не проверил (слишком много адресов, либо адреса сменились
+     * до пересборки фильтра) */
+    bool IsLocalAddress(in_addr_t ip) noexcept {
+        return ether_.GetInterfaces().IsLocalAddress(ip);
+    }
+
+    /* Асинхронное разрешение MAC адресов при пакетной отправке: если следующий узел не найден в кэше соседей,
+     * перед пакетом в очередь ставится ARP запрос (не чаще раза в NeighborCache::INCOMPLETE_TTL_NS),
+     * а пакет уходит широковещательно. Следующие пакеты после ответа идут адресно */
+    void SetAsyncResolve(bool enable) noexcept {
+        async_resolve_ = enable;
+    }
+
+    EthernetProtocol& GetEthernet() noexcept {
+        return ether_;
+    }
+
+    ArpResolver& GetArp() noexcept {
+        return arp_;
+    }
+
+    /* Таблица маршрутов - для обработки уведомлений об изменениях в цикле событий */
+    RouteTable& GetRoutes() noexcept {
+        return routes_;
+    }
+
+    /* Является ли адрес (в сетевом порядке байт) широковещательным для сети интерфейса */
+    static bool IsBroadcast(const InterfaceTable::Interface* iface, in_addr_t ip) noexcept {
+        if (ip == INADDR_BROADCAST) {
+            return true;
+        }
+        if ((iface->ip == 0) || (iface->prefix_len == 0) || (iface->prefix_len >= 31)) {
+            return false;
+        }
+        in_addr_t mask = ~(0xFFFFFFFFu >> iface->prefix_len);
+        return (ntohl(ip) | mask) == (ntohl(iface->ip) | ~mask);
+    }
+
+    /* Разбор IP пакета без копирования
+     * - pkt, len - IP пакет (payload Ethernet фрейма)
+     * - ip_h - указатель на заголовок IP пакета
+     * - payload_len - длина данных IP пакета
+     * возвращает указатель на данные IP пакета, либо nullptr, если пакет некорректный */
+    static const unsigned char* ParsePacket(const unsigned char* pkt, int len,
+                                            const struct iphdr** ip_h, int* payload_len) noexcept {
+        if (len < (int)sizeof(struct iphdr)) {
+            return nullptr;
+        }
+        const struct iphdr* h = (const struct iphdr*)pkt;
+        int header_len = h->ihl * 4;
+        int total_len = ntohs(h->tot_len);
+        if ((h->version != 4) || (header_len < (int)sizeof(struct iphdr)) ||
+            (total_len < header_len) || (total_len > len)) {
+            return nullptr;
+        }
+        *ip_h = h;
+        *payload_len = total_len - header_len;
+        return pkt + header_len;
+    }
+
 private:
+    /* Заполнение заголовка IP пакета
+     * - data_len - длина данных, следующих за заголовком
+     * возвращает false, если у интерфейса нет адреса */
+    bool BuildHeader(struct iphdr* ip_h, int data_len, in_addr_t dst_ip_addr, short protocol, const char* if_name) noexcept {
+        memset(ip_h, 0, sizeof(struct iphdr));
+        ip_h->version   = 4;    // версия протокола IPv4
+        ip_h->ihl       = 5;    // длина заголовка IP-пакета в 32-битных словах (dword), параметры не используем
+        ip_h->ttl       = 64;   // время жизни (TTL) — число маршрутизаторов, которые может пройти этот пакет
+        ip_h->tot_len   = htons((unsigned short)sizeof(struct iphdr) + (unsigned short)data_len);
+        ip_h->protocol  = protocol;
+        ip_h->daddr     = dst_ip_addr;
+        ip_h->saddr     = ether_.GetInterfaceIp(if_name);
+        if (ip_h->saddr == 0) {
+            printf("Error getting IP of interface %s\n", if_name);
+            return false;
+        }
+        ip_h->check     = checksum::Compute(ip_h, sizeof(struct iphdr));
+        return true;
+    }
+
+    /* - drain - как у EthernetProtocol::AttachFilter: при пересборке в работе очередь сокета сохраняется */
+    bool AttachReplyFilter(bool drain) noexcept {
+        InterfaceTable& ifaces = ether_.GetInterfaces();
+        unsigned int count;
+        const in_addr_t* ips = ifaces.GetLocalAddresses(&count);
+        filter_generation_ = ifaces.GetAddressGeneration();
+        ReplyFilter filter(ips, count, filter_id_, true);
+        return ether_.AttachFilter(filter.GetProgram(), drain);
+    }
+
+    /* Поиск маршрута без вывода ошибок: интерфейс должен существовать и иметь IPv4 адрес */
+    const InterfaceTable::Interface* FindRoute(in_addr_t dst_ip_addr, in_addr_t* next_hop) noexcept {
+        const RouteTable::NextHop* hop = routes_.Lookup(dst_ip_addr);
+        if (hop == nullptr) {
+            return nullptr;
+        }
+        const InterfaceTable::Interface* iface = ether_.GetInterfaces().FindByIndex(hop->oif);
+        if ((iface == nullptr) || (iface->ip == 0) || (iface->flags & IFF_LOOPBACK)) {
+            return nullptr;
+        }
+        *next_hop = (hop->gateway != 0) ? hop->gateway : dst_ip_addr;
+        return iface;
+    }
+
+    /* MAC адрес следующего узла (шлюза или самого адресата): из кэша соседей, при промахе ARP запрос
+     * отправляется сразу (send - одиночная отправка), либо ставится в очередь (SetAsyncResolve), ответ не ждётся
+     * возвращает nullptr, если адрес не известен - тогда фрейм отправляется широковещательно */
+    const unsigned char* NextHopMac(in_addr_t next_hop, const char* if_name, bool send) noexcept {
+        const InterfaceTable::Interface* iface = ether_.GetInterfaces().FindByName(if_name);
+        if ((iface == nullptr) || IsBroadcast(iface, next_hop)) {
+            return nullptr;
+        }
+        bool known;
+        if (send) {
+            known = arp_.LookupOrSend(next_hop, if_name, next_hop_mac_);
+        } else if (async_resolve_) {
+            known = arp_.LookupOrQueue(next_hop, if_name, next_hop_mac_);
+        } else {
+            known = arp_.Lookup(next_hop, next_hop_mac_);
+        }
+        return known ? next_hop_mac_ : nullptr;
+    }
+
     EthernetProtocol ether_;
+    RouteTable routes_;
+    ArpResolver arp_{ether_};
+    unsigned char next_hop_mac_[ETH_ALEN];
+    bool async_resolve_ = false;
+    bool filter_enabled_ = false;
+    int filter_id_ = ReplyFilter::ANY_ID;
+    unsigned int filter_generation_ = 0;    // версия адресов интерфейсов, по которой собран фильтр
 };
@@ -0,0 +1,269 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if_arp.h>
+#include <netinet/ether.h>
+#include <netinet/ip.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "learner.h"
+#include "utils.h"
+
+/* Источники привязки строкой: "arp,garp,ip" */
+static void FormatSources(unsigned char sources, char* buf, unsigned int size) {
+    snprintf(buf, size, "%s%s%s%s%s",
+             (sources & BindingTable::ARP) ? "arp" : "",
+             ((sources & BindingTable::ARP) && (sources & (BindingTable::GRATUITOUS_ARP | BindingTable::IPV4))) ? "," : "",
+             (sources & BindingTable::GRATUITOUS_ARP) ? "garp" : "",
+             ((sources & BindingTable::GRATUITOUS_ARP) && (sources & BindingTable::IPV4)) ? "," : "",
+             (sources & BindingTable::IPV4) ? "ip" : "");
+}
+
+Learner::Learner() noexcept {
+    if (!ether_.IsCreated() || !table_.Reserve(TABLE_SIZE)) {
+        return;
+    }
+    created_ = true;
+}
+
+bool Learner::IsCreated() const noexcept {
+    return created_;
+}
+
+EthernetProtocol& Learner::GetEthernet() noexcept {
+    return ether_;
+}
+
+const BindingTable& Learner::GetTable() const noexcept {
+    return table_;
+}
+
+void Learner::SetHandler(BindingHandler handler, void* ctx) noexcept {
+    handler_ = handler;
+    handler_ctx_ = ctx;
+}
+
+/* Кольцо приёма - по возможности: без него фреймы принимаются recvmsg, как в остальных режимах */
+bool Learner::Start() noexcept {
+    if (!created_) {
+        return false;
+    }
+    if (!ether_.IsUringEnabled()) {
+        ether_.EnableRxRing();
+    }
+    LearnFilter filter;
+    return ether_.AttachFilter(filter.GetProgram()) && ether_.BindAllInterfaces();
+}
+
+int Learner::GetSocket() const noexcept {
+    return ether_.GetSocket();
+}
+
+/* Время одно на пачку фреймов: точность последнего появления - время одного пробуждения */
+int Learner::Poll() noexcept {
+    now_ = utils::MonotonicNs();
+    return ether_.RcvFrames(HandleFrame, this, RCV_BATCH);
+}
+
+void Learner::HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    Learner* self = (Learner*)ctx;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    const int if_index = self->ether_.GetRxInterface();
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        self->HandleArp(frame + sizeof(*eth_h), len - sizeof(*eth_h), if_index);
+    } else if (eth_h->ether_type == htons(ETH_P_IP)) {
+        self->HandleIp(frame + sizeof(*eth_h), len - sizeof(*eth_h), eth_h->ether_shost, if_index);
+    } else {
+        self->ether_.GetMetrics().Add(Metrics::RX_FILTERED);
+    }
+}
+
+/* Адрес отправителя ARP пакета: ARP probe (RFC 5227, отправитель 0.0.0.0) привязки не несёт,
+ * MAC адрес отправителя групповой или нулевой - некорректный пакет */
+void Learner::HandleArp(const unsigned char* data, int len, int if_index) noexcept {
+    const struct ether_arp* arp = (const struct ether_arp*)data;
+    if ((len < (int)sizeof(*arp)) || (arp->arp_hrd != htons(ARPHRD_ETHER)) || (arp->arp_pro != htons(ETH_P_IP)) ||
+        (arp->arp_hln != ETH_ALEN) || (arp->arp_pln != sizeof(in_addr_t)) || (arp->arp_sha[0] & 1)) {
+        ether_.GetMetrics().Add(Metrics::RX_FILTERED);
+        return;
+    }
+    static const unsigned char zero_mac[ETH_ALEN] = {};
+    in_addr_t sender_ip;
+    in_addr_t target_ip;
+    memcpy(&sender_ip, arp->arp_spa, sizeof(sender_ip));
+    memcpy(&target_ip, arp->arp_tpa, sizeof(target_ip));
+    if ((sender_ip == 0) || (sender_ip == INADDR_BROADCAST) || (memcmp(arp->arp_sha, zero_mac, ETH_ALEN) == 0)) {
+        ether_.GetMetrics().Add(Metrics::RX_FILTERED);
+        return;
+    }
+    Learn(sender_ip, arp->arp_sha, if_index,
+          (sender_ip == target_ip) ? BindingTable::GRATUITOUS_ARP : BindingTable::ARP);
+}
+
+/* Адрес отправителя IPv4 пакета - только из сети интерфейса приёма и не сам адрес сети или broadcast:
+ * остальные пакеты приходят через маршрутизатор (с его MAC адресом) либо не принадлежат одному узлу */
+void Learner::HandleIp(const unsigned char* data, int len, const unsigned char* mac, int if_index) noexcept {
+    const struct iphdr* ip_h = (const struct iphdr*)data;
+    const InterfaceTable::Interface* iface = ether_.GetInterfaces().FindByIndex(if_index);
+    if ((len < (int)sizeof(*ip_h)) || (ip_h->version != 4) || (mac[0] & 1) || (iface == nullptr) || (iface->ip == 0)) {
+        ether_.GetMetrics().Add(Metrics::RX_FILTERED);
+        return;
+    }
+    const in_addr_t mask = (iface->prefix_len == 0) ? 0 : htonl(0xFFFFFFFFu << (32 - iface->prefix_len));
+    const in_addr_t ip = ip_h->saddr;
+    if (((ip ^ iface->ip) & mask) || (ip == iface->ip) ||
+        ((iface->prefix_len < 31) && (((ip & ~mask) == 0) || ((ip & ~mask) == ~mask)))) {
+        ether_.GetMetrics().Add(Metrics::RX_FILTERED);
+        return;
+    }
+    Learn(ip, mac, if_index, BindingTable::IPV4);
+}
+
+void Learner::Learn(in_addr_t ip, const unsigned char* mac, int if_index, BindingTable::Source source) noexcept {
+    BindingTable::Event event;
+    const BindingTable::Binding* binding = table_.Update(ip, mac, if_index, source, now_, &event);
+    if (binding == nullptr) {
+        ++overflows_;
+        return;
+    }
+    ++learned_;
+    if (event == BindingTable::Event::MOVED) {
+        ++moved_;
+    }
+    if (handler_ != nullptr) {
+        handler_(handler_ctx_, *binding, event);
+    }
+}
+
+const char* Learner::GetInterfaceName(int if_index) noexcept {
+    const InterfaceTable::Interface* iface = ether_.GetInterfaces().FindByIndex(if_index);
+    return (iface != nullptr) ? iface->name : "?";
+}
+
+void Learner::PrintEvent(void* ctx, const BindingTable::Binding& binding, BindingTable::Event event) {
+    if (event == BindingTable::Event::NONE) {
+        return;
+    }
+    Learner* self = (Learner*)ctx;
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &binding.ip, addr, sizeof(addr));
+    const unsigned char* hw = binding.mac;
+    const unsigned char* other = binding.other_mac;
+    const char* if_name = self->GetInterfaceName(binding.if_index);
+    if (event == BindingTable::Event::NEW) {
+        char sources[16];
+        FormatSources(binding.sources, sources, sizeof(sources));
+        printf("%s new %02x:%02x:%02x:%02x:%02x:%02x dev %s %s\n", addr, hw[0], hw[1], hw[2], hw[3], hw[4], hw[5],
+               if_name, sources);
+    } else {
+        printf("%s %s %02x:%02x:%02x:%02x:%02x:%02x dev %s %s %02x:%02x:%02x:%02x:%02x:%02x\n", addr,
+               (event == BindingTable::Event::MOVED) ? "moved" : "conflict",
+               hw[0], hw[1], hw[2], hw[3], hw[4], hw[5], if_name,
+               (event == BindingTable::Event::MOVED) ? "was" : "also",
+               other[0], other[1], other[2], other[3], other[4], other[5]);
+    }
+    fflush(stdout);
+}
+
+/* Строка таблицы: <IPv4> <MAC> dev <интерфейс> age=<с> <источники> [conflict <MAC>] */
+void Learner::PrintBinding(void* ctx, const BindingTable::Binding& binding) {
+    Learner* self = (Learner*)ctx;
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &binding.ip, addr, sizeof(addr));
+    char sources[16];
+    FormatSources(binding.sources, sources, sizeof(sources));
+    const unsigned char* hw = binding.mac;
+    printf("%s %02x:%02x:%02x:%02x:%02x:%02x dev %s age=%.1f %s", addr, hw[0], hw[1], hw[2], hw[3], hw[4], hw[5],
+           self->GetInterfaceName(binding.if_index), (utils::MonotonicNs() - binding.last_seen) / 1e9, sources);
+    if (binding.flags & BindingTable::CONFLICT) {
+        const unsigned char* other = binding.other_mac;
+        printf(" conflict %02x:%02x:%02x:%02x:%02x:%02x", other[0], other[1], other[2], other[3], other[4], other[5]);
+    }
+    printf("\n");
+}
+
+int Learner::Run() noexcept {
+    SetHandler(PrintEvent, this);
+    if (!Start()) {
+        return -1;
+    }
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        printf("Learn. Error. Can't create epoll.\n");
+        return -1;
+    }
+    // SIGINT/SIGTERM принимаются через signalfd, чтобы завершиться штатно и вывести таблицу
+    sigset_t signals;
+    sigset_t saved_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &saved_signals);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        printf("Learn. Error. Can't create signal descriptor.\n");
+        sigprocmask(SIG_SETMASK, &saved_signals, nullptr);
+        close(epoll_fd);
+        return -1;
+    }
+
+    const int ether_fd = GetSocket();
+    const int ifaces_fd = ether_.GetInterfaces().GetSocket();
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = ether_fd;
+    bool ok = (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ether_fd, &ev) == 0);
+    ev.data.fd = signal_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) == 0);
+    ev.data.fd = ifaces_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ifaces_fd, &ev) == 0);
+    if (!ok) {
+        printf("Learn. Error. Can't configure epoll.\n");
+    }
+
+    bool stop = false;
+    while (ok && !stop) {
+        struct epoll_event events[3];
+        int n = epoll_wait(epoll_fd, events, 3, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Learn. Error. epoll_wait failed.\n");
+            ok = false;
+            break;
+        }
+        for (int i = 0; (i < n) && ok; ++i) {
+            if (events[i].data.fd == signal_fd) {
+                struct signalfd_siginfo info;
+                stop = (read(signal_fd, &info, sizeof(info)) == sizeof(info));
+            } else if (events[i].data.fd == ifaces_fd) {
+                // сети интерфейсов нужны для проверки адресов отправителей IPv4 пакетов
+                ok = ether_.GetInterfaces().Update();
+            } else if (Poll() < 0) {
+                ok = false;
+            }
+        }
+    }
+
+    close(signal_fd);
+    sigprocmask(SIG_SETMASK, &saved_signals, nullptr);
+    close(epoll_fd);
+
+    table_.ForEach(PrintBinding, this);
+    fflush(stdout);
+    fprintf(stderr, "Learn finished: %u bindings (%u in conflict), %llu moved, %llu frames learned from, "
+            "%llu addresses not stored\n", table_.GetCount(), table_.GetConflictCount(), moved_, learned_, overflows_);
+    EthernetProtocol::RxStatistics stats{};
+    if (ether_.GetStatistics(&stats)) {
+        fprintf(stderr, "Receive (%s): %llu frames, %llu dropped by kernel, %llu queue freezes\n",
+                ether_.IsRxRingEnabled() ? "rx ring" : (ether_.IsUringEnabled() ? "io_uring" : "recvfrom"),
+                stats.packets, stats.drops, stats.freeze_q_cnt);
+    }
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,89 @@
+#pragma once
+/*
+ * Пассивное обучение: привязки IPv4 -> MAC по чужому трафику, без единого запроса в сеть
+ *
+ * Сокет ETH_P_ALL видит все фреймы сегмента, которые доходят до интерфейса. Из них берутся:
+ * - ARP запросы и ответы - адреса отправителя (кроме ARP probe с адресом отправителя 0.0.0.0)
+ * - gratuitous ARP (адрес отправителя равен искомому) - объявление владельца адреса, в том числе после переезда
+ * - IPv4 пакеты - адрес и MAC отправителя, только если адрес из сети интерфейса приёма: пакеты из других сетей
+ *   приходят с MAC адресом маршрутизатора
+ * Приём - кольцо PACKET_RX_RING со всех интерфейсов, фильтр ядра (LearnFilter) пропускает только ARP и IPv4
+ * и копирует в кольцо только их заголовки. Привязки хранятся в BindingTable: время последнего появления,
+ * интерфейс, источники, конфликты (один адрес с двух MAC адресов).
+ *
+ * Без зеркалирования порта или неразборчивого режима интерфейса коммутатор приносит только широковещательный
+ * и адресованный хосту трафик - в основном ARP запросы соседей. Этого обычно хватает для большей части сегмента:
+ * активный опрос нужен только для "молчащих" адресов (см. Daemon, режим --daemon --learn).
+ *
+ * В режиме ping2 --learn в stdout выводятся изменения привязок:
+ *   <IPv4> new <MAC> dev <интерфейс> <источник>       - адрес замечен впервые
+ *   <IPv4> moved <MAC> dev <интерфейс> was <MAC>       - адрес сменил MAC адрес
+ *   <IPv4> conflict <MAC> dev <интерфейс> also <MAC>   - адрес замечен с двух MAC адресов
+ * По SIGINT/SIGTERM в stdout выводится вся таблица, итоги - в stderr.
+ *
+ * USAGE:
+ * Learner learner;                        // если успешно создан, то IsCreated вернёт true
+ * learner.Run();                          // до SIGINT/SIGTERM
+ *
+ * learner.SetHandler(OnBinding, ctx);     // либо в чужом цикле событий
+ * learner.Start();
+ * ... learner.GetSocket() готов -> learner.Poll() ...
+ */
+#include "binding_table.h"
+#include "ethernet.h"
+
+class Learner {
+public:
+    static constexpr unsigned int TABLE_SIZE = 4096;            // резерв таблицы привязок
+    static constexpr int RCV_BATCH = 1024;                      // максимум фреймов за одно пробуждение
+
+    /* Обработчик появления адреса в трафике: binding - запись после обновления, event - что изменилось */
+    using BindingHandler = void (*)(void* ctx, const BindingTable::Binding& binding, BindingTable::Event event);
+
+    Learner() noexcept;
+
+    bool IsCreated() const noexcept;
+
+    /* Ethernet уровень - для подключения приёмника копий фреймов и блока счётчиков */
+    EthernetProtocol& GetEthernet() noexcept;
+
+    const BindingTable& GetTable() const noexcept;
+
+    /* Обработчик вызывается на каждый фрейм, из которого выучен адрес (nullptr - выключить) */
+    void SetHandler(BindingHandler handler, void* ctx) noexcept;
+
+    /* Кольцо приёма, фильтр ядра и приём со всех интерфейсов, до первого Poll
+     * возвращает true при успехе */
+    bool Start() noexcept;
+
+    /* Дескриптор для ожидания фреймов (poll/epoll) */
+    int GetSocket() const noexcept;
+
+    /* Разбор накопленных фреймов без блокировки
+     * возвращает количество фреймов, либо -1 при ошибке приёма */
+    int Poll() noexcept;
+
+    /* Обучение до SIGINT/SIGTERM с выводом изменений привязок, затем вывод таблицы
+     * возвращает 0 при штатном завершении, -1 при ошибке */
+    int Run() noexcept;
+
+private:
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len);
+    static void PrintEvent(void* ctx, const BindingTable::Binding& binding, BindingTable::Event event);
+    static void PrintBinding(void* ctx, const BindingTable::Binding& binding);
+    void HandleArp(const unsigned char* data, int len, int if_index) noexcept;
+    void HandleIp(const unsigned char* data, int len, const unsigned char* mac, int if_index) noexcept;
+    void Learn(in_addr_t ip, const unsigned char* mac, int if_index, BindingTable::Source source) noexcept;
+    const char* GetInterfaceName(int if_index) noexcept;
+
+    EthernetProtocol ether_;
+    BindingTable table_;
+    BindingHandler handler_ = nullptr;
+    void* handler_ctx_ = nullptr;
+    long long now_ = 0;                     // время текущей пачки фреймов (utils::MonotonicNs)
+    bool created_ = false;
+
+    unsigned long long learned_ = 0;        // фреймов, из которых выучен адрес
+    unsigned long long moved_ = 0;
+    unsigned long long overflows_ = 0;      // новых адресов, не поместившихся в таблицу
+};
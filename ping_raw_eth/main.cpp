@@ -9,7 +9,58 @@
  * - сторонние библиотеки.
  * Программа должна быть написана под Linux.
  */
+#include "../common/echo_retry.h"
+#include "../common/icmp_socket.h"
+#include "daemon.h"
 #include "icmp.h"
+#include "learner.h"
+#include "metrics.h"
+#include "monitor.h"
+#include "pcap.h"
+#include "prober.h"
+#include "race.h"
+#include "sweep.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/if_packet.h>
+#include <new>
+#include <signal.h>
+
+/* Параметры запуска */
+struct Options {
+    static constexpr unsigned int MAX_EXCLUDES = 64;
+    bool sweep = false;                             // режим массового опроса
+    bool monitor = false;                           // режим непрерывного мониторинга
+    bool arp = false;                               // опрос ARP запросами вместо ICMP
+    unsigned int rate = Sweeper::DEFAULT_RATE;      // скорость отправки в режиме опроса (пакетов в секунду)
+    unsigned int wait = Sweeper::DEFAULT_WAIT;      // ожидание ответов после последней отправки (в секундах)
+    unsigned int workers = 1;                       // потоков опроса, 0 - по количеству процессоров
+    int fanout = PACKET_FANOUT_HASH;                // распределение ответов между потоками
+    bool pin = false;                               // закрепить потоки за процессорами
+    const char* exclude[MAX_EXCLUDES] = {};         // исключения из целей опроса
+    unsigned int exclude_count = 0;
+    const char* resume = nullptr;                   // файл состояния обхода в режиме опроса
+    unsigned int interval = Monitor::DEFAULT_INTERVAL;      // интервал опроса цели в режиме мониторинга (в секундах)
+    unsigned int timeout = 0;                       // ожидание ответа в режимах мониторинга и измерения RTT (в миллисекундах), 0 - по умолчанию режима
+    unsigned int budget = 0;                        // время на адрес для одиночного запроса и демона (в миллисекундах), 0 - по умолчанию режима
+    unsigned int count = 0;                         // запросов на цель в режиме измерения RTT, 0 - режим выключен
+    unsigned int period = Prober::DEFAULT_PERIOD_MS;        // период отправки запросов в режиме измерения RTT (в миллисекундах)
+    bool hwts = false;                              // аппаратные метки времени в режиме измерения RTT
+    const char* capture = nullptr;                  // pcap файл для записи принятых фреймов
+    bool uring = false;                             // отправка и приём через io_uring
+    bool dgram = false;                             // одиночный запрос через датаграммный ICMP сокет
+    bool race = false;                              // одиночный запрос сразу через все рабочие интерфейсы
+    ResultSink::Format format = ResultSink::Format::TEXT;   // формат результатов в режиме опроса
+    const char* output = nullptr;                   // файл результатов в режиме опроса, nullptr - stdout
+    bool daemon = false;                            // резидентный режим с запросами через Unix сокет
+    bool query = false;                             // запрос к демону
+    const char* socket_path = nullptr;              // Unix сокет демона, nullptr - Daemon::DEFAULT_SOCKET_PATH
+    bool learn = false;                             // пассивное обучение привязок по трафику (отдельно или в демоне)
+    int first_target = 1;                           // индекс первой цели в argv
+};
 
 /* Проверка валидности IPv4 адреса */
 bool CheckIPv4Valid(const char *ip) {
@@ -22,30 +73,698 @@ bool CheckIPv4Valid(const char *ip) {
 }
 /*
  * Разбор опций командной строки
- * В опциях командной строки ожидается один IPv4 адрес, если есть другие опции, то они игнорируются
- * Возвращает IPv4 адрес в бинарном формате
+ * Без опций ожидается один IPv4 адрес, остальные позиционные параметры игнорируются
+ *   --budget MS - время на адрес (в миллисекундах): запрос повторяется со сроком по оценке RTT, пока не истечёт
+ * В режиме --sweep ожидается список IPv4 адресов, сетей (a.b.c.d/n) и диапазонов (a.b.c.d-e.f.g.h),
+ * цели опрашиваются в псевдослучайном порядке
+ *   --exclude SPEC - исключение адреса, сети или диапазона из целей (можно повторять)
+ *   --resume FILE - состояние обхода сохраняется в файл, прерванный опрос продолжается с сохранённого места
+ *   --rate N - скорость отправки запросов (пакетов в секунду)
+ *   --wait S - время ожидания ответов после отправки последнего запроса (в секундах)
+ *   --workers N - количество потоков опроса (0 - по количеству процессоров)
+ *   --fanout hash|cpu - распределение ответов между потоками: по хэшу потока или по процессору приёма
+ *   --pin - закрепить потоки за процессорами
+ *   --format text|json|binary - формат результатов: строки "IPv4 MAC", JSON Lines или двоичные записи
+ *   --output FILE - результаты записываются в файл, сообщения и итоги остаются в stdout/stderr
+ * В режиме --monitor цели (адреса и сети) опрашиваются непрерывно, до SIGINT/SIGTERM
+ *   --interval S - интервал опроса каждой цели (в секундах)
+ *   --timeout MS - ожидание ответа (в миллисекундах)
+ *   --rate N - предел скорости отправки запросов (пакетов в секунду)
+ * С --count N каждой цели (адресу или сети не шире /26) отправляется N запросов, выводятся RTT, потери и джиттер
+ *   --period MS - период отправки запросов (в миллисекундах), ответы не дожидаются
+ *   --timeout MS - ожидание ответа (в миллисекундах)
+ *   --hwts - аппаратные метки времени сетевой карты
+ * --arp - MAC адрес получается ARP запросом, без ICMP (только для адресов из сети интерфейса)
+ * --capture FILE - принятые фреймы (после фильтра ядра) записываются в pcap файл, кроме режима --sweep
+ * --uring - отправка и приём через io_uring вместо колец PACKET_RX_RING/PACKET_TX_RING
+ * --dgram - одиночный запрос через датаграммный ICMP сокет без прав суперпользователя (net.ipv4.ping_group_range),
+ *   выводится RTT (MAC адрес на этом уровне не виден)
+ * --race - одиночный запрос отправляется сразу со всех рабочих интерфейсов (ICMP, а для адресов из сети
+ *   интерфейса ещё и ARP), выводятся MAC адрес и интерфейс первого ответа
+ * --daemon - резидентный режим без целей: MAC адреса разрешаются по запросам клиентов через Unix сокет, с кэшем
+ *   --socket PATH - путь Unix сокета
+ *   --budget MS - время на разрешение адреса (в миллисекундах)
+ *   --learn - кэш пополняется привязками, выученными по трафику сегмента: запросы только к "молчащим" адресам
+ * --learn - режим без целей: привязки IPv4 -> MAC учатся по ARP и IPv4 трафику сегмента без отправки запросов,
+ *   выводятся изменения привязок, по SIGINT/SIGTERM - вся таблица
+ * --query - адреса (до Daemon::MAX_BATCH) разрешаются одним запросом к демону, выводятся строки "IPv4 MAC"
+ *   --socket PATH - путь Unix сокета демона
  */
-bool OptionsParsing(int argc, char **argv) {
-    if (argc < 2) {
+bool OptionsParsing(int argc, char **argv, Options& options) {
+    static const struct option long_options[] = {
+        {"sweep", no_argument, nullptr, 's'},
+        {"rate", required_argument, nullptr, 'r'},
+        {"wait", required_argument, nullptr, 'w'},
+        {"arp", no_argument, nullptr, 'a'},
+        {"workers", required_argument, nullptr, 'j'},
+        {"fanout", required_argument, nullptr, 'f'},
+        {"pin", no_argument, nullptr, 'p'},
+        {"exclude", required_argument, nullptr, 'x'},
+        {"resume", required_argument, nullptr, 'e'},
+        {"monitor", no_argument, nullptr, 'm'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"timeout", required_argument, nullptr, 't'},
+        {"count", required_argument, nullptr, 'c'},
+        {"period", required_argument, nullptr, 'P'},
+        {"hwts", no_argument, nullptr, 'H'},
+        {"capture", required_argument, nullptr, 'C'},
+        {"uring", no_argument, nullptr, 'U'},
+        {"dgram", no_argument, nullptr, 'D'},
+        {"race", no_argument, nullptr, 'R'},
+        {"format", required_argument, nullptr, 'F'},
+        {"output", required_argument, nullptr, 'o'},
+        {"daemon", no_argument, nullptr, 'd'},
+        {"query", no_argument, nullptr, 'q'},
+        {"socket", required_argument, nullptr, 'S'},
+        {"budget", required_argument, nullptr, 'b'},
+        {"learn", no_argument, nullptr, 'L'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "sr:w:aj:f:px:e:mi:t:c:P:HC:UDRF:o:dqS:b:L", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 's':
+            options.sweep = true;
+            break;
+        case 'r':
+            options.rate = strtoul(optarg, nullptr, 10);
+            break;
+        case 'w':
+            options.wait = strtoul(optarg, nullptr, 10);
+            break;
+        case 'a':
+            options.arp = true;
+            break;
+        case 'j':
+            options.workers = strtoul(optarg, nullptr, 10);
+            break;
+        case 'f':
+            if (strcmp(optarg, "hash") == 0) {
+                options.fanout = PACKET_FANOUT_HASH;
+            } else if (strcmp(optarg, "cpu") == 0) {
+                options.fanout = PACKET_FANOUT_CPU;
+            } else {
+                printf("Command error. Fanout mode must be hash or cpu\n");
+                return false;
+            }
+            break;
+        case 'p':
+            options.pin = true;
+            break;
+        case 'x':
+            if (options.exclude_count == Options::MAX_EXCLUDES) {
+                printf("Command error. Too many excludes (maximum %u)\n", Options::MAX_EXCLUDES);
+                return false;
+            }
+            options.exclude[options.exclude_count++] = optarg;
+            break;
+        case 'e':
+            options.resume = optarg;
+            break;
+        case 'm':
+            options.monitor = true;
+            break;
+        case 'i':
+            options.interval = strtoul(optarg, nullptr, 10);
+            break;
+        case 't':
+            options.timeout = strtoul(optarg, nullptr, 10);
+            break;
+        case 'c':
+            options.count = strtoul(optarg, nullptr, 10);
+            break;
+        case 'P':
+            options.period = strtoul(optarg, nullptr, 10);
+            break;
+        case 'H':
+            options.hwts = true;
+            break;
+        case 'C':
+            options.capture = optarg;
+            break;
+        case 'U':
+            options.uring = true;
+            break;
+        case 'D':
+            options.dgram = true;
+            break;
+        case 'R':
+            options.race = true;
+            break;
+        case 'F':
+            if (!ResultSink::ParseFormat(optarg, &options.format)) {
+                printf("Command error. Output format must be text, json or binary\n");
+                return false;
+            }
+            break;
+        case 'o':
+            options.output = optarg;
+            break;
+        case 'd':
+            options.daemon = true;
+            break;
+        case 'q':
+            options.query = true;
+            break;
+        case 'S':
+            options.socket_path = optarg;
+            break;
+        case 'b':
+            options.budget = strtoul(optarg, nullptr, 10);
+            break;
+        case 'L':
+            options.learn = true;
+            break;
+        default:
+            printf("Command error. Usage: %s [--arp] [--sweep [--rate PPS] [--wait SEC] [--workers N] [--fanout hash|cpu] [--pin] [--exclude SPEC]... [--resume FILE] [--format text|json|binary] [--output FILE]] [--monitor [--interval SEC] [--timeout MS] [--rate PPS]] [--count N [--period MS] [--timeout MS] [--hwts]] [--budget MS] [--capture FILE] [--uring] [--dgram] [--race] [--daemon [--socket PATH] [--budget MS] [--learn]] [--query [--socket PATH]] [--learn] TARGET...\n", argv[0]);
+            return false;
+        }
+    }
+    options.first_target = optind;
+
+    if ((options.daemon || options.query) &&
+        ((options.daemon && options.query) || options.sweep || options.monitor || (options.count > 0) ||
+         options.arp || options.dgram || options.race)) {
+        printf("Command error. Daemon and query modes can't be combined with other modes\n");
+        return false;
+    }
+    if (options.learn && (options.query || options.sweep || options.monitor || (options.count > 0) ||
+                          options.arp || options.dgram || options.race)) {
+        printf("Command error. Learn mode can be combined only with daemon mode\n");
+        return false;
+    }
+    if (!options.daemon && !options.query && (options.socket_path != nullptr)) {
+        printf("Command error. Socket path is supported only in daemon and query modes\n");
+        return false;
+    }
+    if (options.query && (options.uring || (options.capture != nullptr))) {
+        printf("Command error. io_uring and capture are not supported in query mode\n");
+        return false;
+    }
+    if ((options.budget > 0) && (options.query || options.sweep || options.monitor || (options.count > 0) || options.arp ||
+                                 (options.learn && !options.daemon))) {
+        printf("Command error. Time budget is supported only for a single request and in daemon mode\n");
+        return false;
+    }
+    if (options.daemon) {
+        if (options.timeout > 0) {
+            printf("Command error. Timeout is not supported in daemon mode, use time budget\n");
+            return false;
+        }
+        return true;
+    }
+    if (options.learn) {
+        if (options.timeout > 0) {
+            printf("Command error. Timeout is not supported in learn mode\n");
+            return false;
+        }
+        return true;
+    }
+    if (optind >= argc) {
         printf("Command error. The required parameter is not set - IPv4 address\n");
         return false;
     }
-    return CheckIPv4Valid(argv[1]);
+    if (options.sweep && (options.capture != nullptr)) {
+        printf("Command error. Capture is not supported in sweep mode\n");
+        return false;
+    }
+    if (options.dgram && (options.sweep || options.monitor || (options.count > 0) || options.arp ||
+                          options.uring || (options.capture != nullptr))) {
+        printf("Command error. Datagram ICMP socket is supported only for a single request\n");
+        return false;
+    }
+    if (options.race && (options.sweep || options.monitor || (options.count > 0) || options.arp || options.dgram)) {
+        printf("Command error. Race over interfaces is supported only for a single request\n");
+        return false;
+    }
+    if (!options.sweep && ((options.format != ResultSink::Format::TEXT) || (options.output != nullptr))) {
+        printf("Command error. Output format and file are supported only in sweep mode\n");
+        return false;
+    }
+    if (!options.sweep && ((options.exclude_count > 0) || (options.resume != nullptr))) {
+        printf("Command error. Exclude and resume are supported only in sweep mode\n");
+        return false;
+    }
+    if (options.sweep || options.monitor || (options.count > 0)) {
+        return true;
+    }
+    if (options.query) {
+        if (argc - optind > (int)Daemon::MAX_BATCH) {
+            printf("Command error. Too many addresses for one query (maximum %u)\n", Daemon::MAX_BATCH);
+            return false;
+        }
+        for (int i = optind; i < argc; ++i) {
+            if (!CheckIPv4Valid(argv[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return CheckIPv4Valid(argv[optind]);
 }
 
-int main(int argc, char *argv[]) {
-    static constexpr int ATTEMPTS = 5;
+/* Массовый опрос всех заданных адресов и сетей */
+int RunSweep(int argc, char **argv, const Options& options) {
+    MetricsRegion metrics("sweep");
+    Sweeper sweeper(options.rate, options.wait, options.arp);
+    if (!sweeper.IsCreated()) {
+        return 2;
+    }
+    sweeper.SetMetrics(&metrics);
+    sweeper.SetUring(options.uring);
+    if ((options.workers != 1) && !sweeper.SetWorkers(options.workers, options.fanout, options.pin)) {
+        return 2;
+    }
+    for (int i = options.first_target; i < argc; ++i) {
+        if (!sweeper.AddTarget(argv[i])) {
+            return 1;
+        }
+    }
+    for (unsigned int i = 0; i < options.exclude_count; ++i) {
+        if (!sweeper.ExcludeTarget(options.exclude[i])) {
+            return 1;
+        }
+    }
+    if (options.resume != nullptr) {
+        sweeper.SetCursor(options.resume);
+    }
+    if (options.output == nullptr) {
+        sweeper.SetOutput(options.format, STDOUT_FILENO);
+        return (sweeper.Run() < 0) ? 2 : 0;
+    }
+    int fd = open(options.output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        printf("Error. Can't create file %s. %s\n", options.output, strerror(errno));
+        return 2;
+    }
+    sweeper.SetOutput(options.format, fd);
+    int res = (sweeper.Run() < 0) ? 2 : 0;
+    close(fd);
+    return res;
+}
 
-    if (!OptionsParsing(argc, argv)) {
-        return 1;
+/* Настройка канального уровня по опциям: io_uring (--uring) и запись принятых фреймов (--capture),
+ * capture == nullptr - запись выключена */
+bool AttachEthernet(EthernetProtocol& ether, const Options& options, PcapWriter* capture) {
+    if (options.uring && !ether.EnableUring()) {
+        return false;
+    }
+    if (capture != nullptr) {
+        ether.SetFrameSink(PcapWriter::Sink, capture);
+    }
+    return true;
+}
+
+/* Непрерывный мониторинг всех заданных адресов и сетей */
+int RunMonitor(int argc, char **argv, const Options& options, PcapWriter* capture) {
+    MetricsRegion metrics("monitor");
+    Monitor monitor(options.interval, options.timeout, options.rate);
+    if (!monitor.IsCreated()) {
+        return 2;
+    }
+    monitor.GetEthernet().SetMetrics(metrics.Acquire("monitor"));
+    if (!AttachEthernet(monitor.GetEthernet(), options, capture)) {
+        return 2;
+    }
+    for (int i = options.first_target; i < argc; ++i) {
+        if (!monitor.AddTarget(argv[i])) {
+            return 1;
+        }
+    }
+    return (monitor.Run() < 0) ? 2 : 0;
+}
+
+/* Измерение RTT, потерь и джиттера серией запросов к каждой цели */
+int RunProbe(int argc, char **argv, const Options& options, PcapWriter* capture) {
+    MetricsRegion metrics("count");
+    Prober prober(options.count, options.period, options.timeout, options.hwts);
+    if (!prober.IsCreated()) {
+        return 2;
+    }
+    prober.GetEthernet().SetMetrics(metrics.Acquire("count"));
+    if (!AttachEthernet(prober.GetEthernet(), options, capture)) {
+        return 2;
+    }
+    for (int i = options.first_target; i < argc; ++i) {
+        if (!prober.AddTarget(argv[i])) {
+            return 1;
+        }
+    }
+    return (prober.Run() < 0) ? 2 : 0;
+}
+
+/* Разрешение MAC адреса одного соседа через ARP */
+int RunArp(const char* ip, const Options& options, PcapWriter* capture) {
+    IPProtocol ip_proto;
+    if (!ip_proto.IsCreated()) {
+        return 2;
+    }
+    if (!AttachEthernet(ip_proto.GetEthernet(), options, capture)) {
+        return 2;
+    }
+    ip_proto.SetReplyFilter(ReplyFilter::ANY_ID);
+    unsigned char hw[ETH_ALEN];
+    int res = ip_proto.ResolveMac(inet_addr(ip), hw);
+    if (res != 0) {
+        printf("%s\n", ((res == -1) ? "Problems with network" : "Host unreachable"));
+        return 0;
+    }
+    printf("%02x:%02x:%02x:%02x:%02x:%02x\n", hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
+    return 0;
+}
+
+/* Одиночный запрос через бэкенд общего интерфейса ICMP echo (common/echo.h)
+ * повторяется со сроком по оценке RTT, пока нет ответа и не исчерпан бюджет budget_ms (0 - по умолчанию),
+ * выводятся RTT и MAC адрес, если бэкенд его знает */
+int RunEcho(const EchoBackend& backend, const char* ip, unsigned int budget_ms) {
+    EchoRetry retry(backend, budget_ms);
+    RttEstimator rtt;
+    EchoRetry::Result result;
+    int res = retry.Run(inet_addr(ip), rtt, &result);
+    if (res == 0) {
+        printf("Host unreachable\n");
+    }
+    if (res <= 0) {
+        return 0;
+    }
+    const EchoReply& reply = result.reply;
+    if (reply.has_mac) {
+        printf("%02x:%02x:%02x:%02x:%02x:%02x\n",
+               reply.mac[0], reply.mac[1], reply.mac[2], reply.mac[3], reply.mac[4], reply.mac[5]);
+    } else {
+        printf("%s seq=%u rtt=%.3f us\n", ip, result.attempt, result.rtt_ns / 1e3);
+    }
+    return 0;
+}
+
+/* Одиночный запрос сразу через все рабочие интерфейсы, раунды повторяются только при отсутствии ответа,
+ * пока не исчерпан бюджет budget_ms (0 - EchoRetry::DEFAULT_BUDGET_MS)
+ * выводятся MAC адрес, интерфейс и вид первого ответа */
+int RunRace(const char* ip, unsigned int budget_ms, const Options& options, PcapWriter* capture) {
+    InterfaceRace race;
+    if (!race.IsCreated()) {
+        return 2;
+    }
+    for (int i = 0; i < race.GetLaneCount(); ++i) {
+        if (!AttachEthernet(race.GetEthernet(i), options, capture)) {
+            return 2;
+        }
+    }
+    in_addr_t dst = inet_addr(ip);
+    const long long end = utils::MonotonicNs() + (long long)(budget_ms == 0 ? EchoRetry::DEFAULT_BUDGET_MS : budget_ms) * 1000000;
+    for (int i = 0; ; ++i) {
+        InterfaceRace::Result result;
+        int res = race.Run(dst, htons(i), &result);
+        if (res < 0) {
+            printf("Problems with network\n");
+            return 0;
+        }
+        if (res > 0) {
+            if (utils::MonotonicNs() >= end) {
+                printf("Host unreachable\n");
+                return 0;
+            }
+            continue;
+        }
+        const unsigned char* hw = result.mac;
+        printf("%02x:%02x:%02x:%02x:%02x:%02x dev %s %s rtt=%.3f us\n", hw[0], hw[1], hw[2], hw[3], hw[4], hw[5],
+               result.if_name, (result.arp ? "arp" : "icmp"), result.rtt_ns / 1e3);
+        return 0;
+    }
+}
+
+/* Резидентный режим: разрешение MAC адресов по запросам клиентов через Unix сокет */
+int RunDaemon(const Options& options, PcapWriter* capture) {
+    MetricsRegion metrics("daemon");
+    Daemon daemon(options.budget);
+    if (!daemon.IsCreated()) {
+        return 2;
+    }
+    daemon.GetEthernet().SetMetrics(metrics.Acquire("daemon"));
+    if (!AttachEthernet(daemon.GetEthernet(), options, capture)) {
+        return 2;
+    }
+    if (options.learn) {
+        if (!daemon.EnableLearning()) {
+            return 2;
+        }
+        daemon.GetLearner()->GetEthernet().SetMetrics(metrics.Acquire("learn"));
+    }
+    const char* path = (options.socket_path != nullptr) ? options.socket_path : Daemon::DEFAULT_SOCKET_PATH;
+    return (daemon.Run(path) < 0) ? 2 : 0;
+}
+
+/* Пассивное обучение привязок IPv4 -> MAC по трафику сегмента до SIGINT/SIGTERM */
+int RunLearn(const Options& options, PcapWriter* capture) {
+    MetricsRegion metrics("learn");
+    Learner learner;
+    if (!learner.IsCreated()) {
+        return 2;
+    }
+    learner.GetEthernet().SetMetrics(metrics.Acquire("learn"));
+    if (!AttachEthernet(learner.GetEthernet(), options, capture)) {
+        return 2;
+    }
+    return (learner.Run() < 0) ? 2 : 0;
+}
+
+/* Разрешение всех заданных адресов одним запросом к демону */
+int RunQuery(int argc, char **argv, const Options& options) {
+    in_addr_t ips[Daemon::MAX_BATCH];
+    Daemon::Answer answers[Daemon::MAX_BATCH];
+    unsigned int count = 0;
+    for (int i = options.first_target; i < argc; ++i) {
+        ips[count++] = inet_addr(argv[i]);
+    }
+    const char* path = (options.socket_path != nullptr) ? options.socket_path : Daemon::DEFAULT_SOCKET_PATH;
+    if (!Daemon::Query(path, ips, count, answers)) {
+        return 2;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+        const unsigned char* hw = answers[i].mac;
+        switch (answers[i].status) {
+        case Daemon::Status::REACHABLE:
+            printf("%s %02x:%02x:%02x:%02x:%02x:%02x\n", argv[options.first_target + i],
+                   hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
+            break;
+        case Daemon::Status::UNREACHABLE:
+            printf("%s unreachable\n", argv[options.first_target + i]);
+            break;
+        case Daemon::Status::NO_ROUTE:
+            printf("%s no route\n", argv[options.first_target + i]);
+            break;
+        default:
+            printf("%s busy\n", argv[options.first_target + i]);
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Выбор режима по опциям */
+int Run(int argc, char **argv, const Options& options, PcapWriter* capture) {
+    if (options.daemon) {
+        return RunDaemon(options, capture);
+    }
+    if (options.query) {
+        return RunQuery(argc, argv, options);
+    }
+    if (options.learn) {
+        return RunLearn(options, capture);
+    }
+    if (options.monitor) {
+        return RunMonitor(argc, argv, options, capture);
+    }
+    if (options.sweep) {
+        return RunSweep(argc, argv, options);
+    }
+    if (options.count > 0) {
+        return RunProbe(argc, argv, options, capture);
+    }
+    if (options.arp) {
+        return RunArp(argv[options.first_target], options, capture);
+    }
+    if (options.dgram) {
+        IcmpSocket sock;
+        if (!sock.IsCreated()) {
+            return 2;
+        }
+        return RunEcho(sock.GetBackend(), argv[options.first_target], options.budget);
+    }
+    if (options.race) {
+        return RunRace(argv[options.first_target], options.budget, options, capture);
     }
 
     Ping ping;
     if (!ping.IsCreated()) {
         return 2;
     }
+    if (!AttachEthernet(ping.GetEthernet(), options, capture)) {
+        return 2;
+    }
+    return RunEcho(ping.GetBackend(), argv[options.first_target], options.budget);
+}
 
-    for (int i = 1; !ping.Do(argv[1]) && (i <= ATTEMPTS); ++i);
+/* Строка таблицы счётчиков: значения блока m, задержки - в микросекундах (верхние границы корзин)
+ * Фреймов на системный вызов нет ("-"), если фреймы шли без системных вызовов (кольцо приёма в цикле epoll) */
+void PrintMetricsRow(const char* name, const Metrics& m) {
+    char tx_ratio[16] = "-";
+    char rx_ratio[16] = "-";
+    if (m.Get(Metrics::TX_SYSCALLS) > 0) {
+        snprintf(tx_ratio, sizeof(tx_ratio), "%.1f", (double)m.Get(Metrics::TX_FRAMES) / m.Get(Metrics::TX_SYSCALLS));
+    }
+    if (m.Get(Metrics::RX_SYSCALLS) > 0) {
+        snprintf(rx_ratio, sizeof(rx_ratio), "%.1f", (double)m.Get(Metrics::RX_FRAMES) / m.Get(Metrics::RX_SYSCALLS));
+    }
+    printf("%-12s %12llu %8s %7llu %7llu %12llu %8s %10llu %10llu %10llu %10llu %9llu %9.1f %9.1f %9.1f %9.1f\n", name,
+           m.Get(Metrics::TX_FRAMES), tx_ratio, m.Get(Metrics::TX_ERRORS), m.Get(Metrics::TX_DROPPED),
+           m.Get(Metrics::RX_FRAMES), rx_ratio,
+           m.Get(Metrics::RX_FILTERED), m.Get(Metrics::REPLIES), m.Get(Metrics::UNMATCHED), m.Get(Metrics::TIMEOUTS),
+           m.Get(Metrics::KERNEL_DROPS),
+           m.GetPercentile(Metrics::TX_SEND, 50.0) / 1e3, m.GetPercentile(Metrics::TX_SEND, 99.0) / 1e3,
+           m.GetPercentile(Metrics::RX_DELAY, 50.0) / 1e3, m.GetPercentile(Metrics::RX_DELAY, 99.0) / 1e3);
+}
 
-    return 0;
+/* Таблица счётчиков процесса: строка на поток и сумма, если потоков несколько
+ * - prev - копии блоков на начало интервала (изменения за интервал), nullptr - значения с запуска
+ * - current - место для копий текущих блоков (MetricsRegion::MAX_SLOTS) */
+void PrintMetrics(const MetricsRegion& region, const Metrics* prev, Metrics* current, bool running) {
+    const MetricsRegion::Header& header = region.GetHeader();
+    unsigned int count = region.GetCount();
+    double uptime = (utils::RealtimeNs() - header.started_ns) / 1e9;
+    printf("pid %d %.*s, up %.1f s%s\n", header.pid, (int)MetricsRegion::MODE_SIZE, header.mode, uptime,
+           running ? "" : " (not running)");
+    printf("%-12s %12s %8s %7s %7s %12s %8s %10s %10s %10s %10s %9s %9s %9s %9s %9s\n", "thread",
+           "tx", "tx/call", "tx err", "tx drop", "rx", "rx/call", "filtered", "replies", "unmatched", "timeouts", "k.drops",
+           "send p50", "send p99", "rx p50", "rx p99");
+    Metrics total;
+    total.Reset("total");
+    for (unsigned int i = 0; i < count; ++i) {
+        current[i].CopyFrom(region.Get(i));
+        Metrics row;
+        row.CopyFrom(current[i]);
+        if (prev != nullptr) {
+            row.Subtract(prev[i]);
+        }
+        total.Merge(row);
+        PrintMetricsRow(row.GetName(), row);
+    }
+    if (count > 1) {
+        PrintMetricsRow("total", total);
+    }
+    fflush(stdout);
+}
+
+/*
+ * Просмотр счётчиков работающих процессов: ping2 stats [--interval SEC] [PID]
+ * Без PID выводятся все сегменты ping2 в /dev/shm. С --interval таблица процесса PID повторяется
+ * каждые SEC секунд с изменениями за интервал, пока процесс работает
+ */
+int RunStats(int argc, char **argv) {
+    static const struct option long_options[] = {
+        {"interval", required_argument, nullptr, 'i'},
+        {nullptr, 0, nullptr, 0}
+    };
+    unsigned int interval = 0;
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "i:", long_options, nullptr)) != -1) {
+        if (opt != 'i') {
+            printf("Command error. Usage: %s stats [--interval SEC] [PID]\n", argv[0]);
+            return 1;
+        }
+        interval = strtoul(optarg, nullptr, 10);
+    }
+    if ((interval > 0) && (optind >= argc)) {
+        printf("Command error. Interval is supported only with PID\n");
+        return 1;
+    }
+
+    Metrics* current = (Metrics*)malloc(2 * sizeof(Metrics) * MetricsRegion::MAX_SLOTS);
+    if (current == nullptr) {
+        printf("Metrics. Error. Not enough memory.\n");
+        return 2;
+    }
+    Metrics* prev = current + MetricsRegion::MAX_SLOTS;
+    int res = 0;
+    if (optind < argc) {
+        int pid = atoi(argv[optind]);
+        MetricsRegion region(pid);
+        if (!region.IsCreated()) {
+            free(current);
+            return 2;
+        }
+        bool running = (kill(pid, 0) == 0) || (errno != ESRCH);
+        PrintMetrics(region, nullptr, current, running);
+        while ((interval > 0) && running) {
+            memcpy(prev, current, sizeof(Metrics) * MetricsRegion::MAX_SLOTS);
+            sleep(interval);
+            running = (kill(pid, 0) == 0) || (errno != ESRCH);
+            printf("\n");
+            PrintMetrics(region, prev, current, running);
+        }
+        free(current);
+        return res;
+    }
+
+    // сегменты POSIX разделяемой памяти видны как файлы /dev/shm/ping2.<pid>
+    DIR* dir = opendir("/dev/shm");
+    if (dir == nullptr) {
+        printf("Metrics. Error opening /dev/shm. %s\n", strerror(errno));
+        free(current);
+        return 2;
+    }
+    const char* prefix = MetricsRegion::NAME_PREFIX + 1;
+    unsigned int found = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {
+            continue;
+        }
+        char* end;
+        long pid = strtol(entry->d_name + strlen(prefix), &end, 10);
+        if ((*end != 0) || (pid <= 0)) {
+            continue;
+        }
+        MetricsRegion region((int)pid);
+        if (!region.IsCreated()) {
+            res = 2;
+            continue;
+        }
+        printf("%s", (found++ > 0) ? "\n" : "");
+        PrintMetrics(region, nullptr, current, (kill((int)pid, 0) == 0) || (errno != ESRCH));
+    }
+    closedir(dir);
+    free(current);
+    if (found == 0) {
+        printf("Metrics. No ping2 processes found.\n");
+        return 1;
+    }
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    if ((argc > 1) && (strcmp(argv[1], "stats") == 0)) {
+        return RunStats(argc, argv);
+    }
+    Options options;
+    if (!OptionsParsing(argc, argv, options)) {
+        return 1;
+    }
+    if (options.capture == nullptr) {
+        return Run(argc, argv, options, nullptr);
+    }
+
+    // файл записи живёт до завершения режима: остаток буфера дописывается при разрушении
+    void* mem = malloc(sizeof(PcapWriter));
+    if (mem == nullptr) {
+        printf("Pcap. Error. Not enough memory.\n");
+        return 2;
+    }
+    PcapWriter* capture = new (mem) PcapWriter(options.capture);
+    int res = capture->IsCreated() ? Run(argc, argv, options, capture) : 2;
+    capture->~PcapWriter();
+    free(mem);
+    return res;
 }
@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "utils.h"
+
+void Metrics::Reset(const char* name) noexcept {
+    memset(this, 0, sizeof(*this));
+    strncpy(name_, name, NAME_SIZE - 1);
+}
+
+void Metrics::CopyFrom(const Metrics& other) noexcept {
+    memcpy(name_, other.name_, NAME_SIZE);
+    name_[NAME_SIZE - 1] = 0;
+    for (unsigned int i = 0; i < COUNTERS; ++i) {
+        counters_[i] = other.Get((Counter)i);
+    }
+    for (unsigned int l = 0; l < LATENCIES; ++l) {
+        for (unsigned int b = 0; b < BUCKETS; ++b) {
+            buckets_[l][b] = other.GetBucket((Latency)l, b);
+        }
+    }
+}
+
+void Metrics::Merge(const Metrics& other) noexcept {
+    for (unsigned int i = 0; i < COUNTERS; ++i) {
+        counters_[i] += other.counters_[i];
+    }
+    for (unsigned int l = 0; l < LATENCIES; ++l) {
+        for (unsigned int b = 0; b < BUCKETS; ++b) {
+            buckets_[l][b] += other.buckets_[l][b];
+        }
+    }
+}
+
+void Metrics::Subtract(const Metrics& base) noexcept {
+    for (unsigned int i = 0; i < COUNTERS; ++i) {
+        counters_[i] -= base.counters_[i];
+    }
+    for (unsigned int l = 0; l < LATENCIES; ++l) {
+        for (unsigned int b = 0; b < BUCKETS; ++b) {
+            buckets_[l][b] -= base.buckets_[l][b];
+        }
+    }
+}
+
+unsigned long long Metrics::GetPercentile(Latency latency, double percentile) const noexcept {
+    unsigned long long count = 0;
+    for (unsigned int b = 0; b < BUCKETS; ++b) {
+        count += buckets_[latency][b];
+    }
+    if (count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    unsigned long long seen = 0;
+    for (unsigned int b = 0; b < BUCKETS; ++b) {
+        seen += buckets_[latency][b];
+        if (seen >= rank) {
+            return GetBucketLimit(b);
+        }
+    }
+    return GetBucketLimit(BUCKETS - 1);
+}
+
+/* Сегмент создаётся заново (O_TRUNC): сегмент с тем же pid может остаться от аварийно завершённого процесса.
+ * Память сегмента обнулена ftruncate - блоки готовы к записи без инициализации */
+MetricsRegion::MetricsRegion(const char* mode) noexcept {
+    snprintf(name_, sizeof(name_), "%s%d", NAME_PREFIX, (int)getpid());
+    int fd = shm_open(name_, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        printf("Metrics. Error creating shared memory %s. %s\n", name_, strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, SIZE) < 0) {
+        printf("Metrics. Error sizing shared memory %s. %s\n", name_, strerror(errno));
+        close(fd);
+        shm_unlink(name_);
+        return;
+    }
+    void* mem = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        printf("Metrics. Error mapping shared memory %s. %s\n", name_, strerror(errno));
+        shm_unlink(name_);
+        return;
+    }
+    base_ = (unsigned char*)mem;
+    owner_ = true;
+
+    Header* header = (Header*)base_;
+    header->version = VERSION;
+    header->slot_size = sizeof(Metrics);
+    header->slot_stride = SLOT_STRIDE;
+    header->slots = MAX_SLOTS;
+    header->pid = getpid();
+    header->started_ns = utils::RealtimeNs();
+    strncpy(header->mode, mode, MODE_SIZE - 1);
+    // признак готовности заголовка - последним
+    __atomic_store_n(&header->magic, MAGIC, __ATOMIC_RELEASE);
+    created_ = true;
+}
+
+/* Сегмент чужого процесса проверяется по заголовку: читатель другой версии не разбирает блоки */
+MetricsRegion::MetricsRegion(int pid) noexcept {
+    snprintf(name_, sizeof(name_), "%s%d", NAME_PREFIX, pid);
+    int fd = shm_open(name_, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("Metrics. Error opening shared memory %s. %s\n", name_, strerror(errno));
+        return;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < SIZE)) {
+        printf("Metrics. Error. Shared memory %s has wrong size.\n", name_);
+        close(fd);
+        return;
+    }
+    void* mem = mmap(nullptr, SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        printf("Metrics. Error mapping shared memory %s. %s\n", name_, strerror(errno));
+        return;
+    }
+    base_ = (unsigned char*)mem;
+
+    const Header* header = (const Header*)base_;
+    if ((__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != MAGIC) || (header->version != VERSION) ||
+        (header->slot_size != sizeof(Metrics)) || (header->slot_stride != SLOT_STRIDE) || (header->slots != MAX_SLOTS)) {
+        printf("Metrics. Error. Shared memory %s has unknown format.\n", name_);
+        return;
+    }
+    created_ = true;
+}
+
+MetricsRegion::~MetricsRegion() {
+    if (base_ != nullptr) {
+        munmap(base_, SIZE);
+        base_ = nullptr;
+    }
+    if (owner_) {
+        shm_unlink(name_);
+        owner_ = false;
+    }
+    created_ = false;
+}
+
+bool MetricsRegion::IsCreated() const noexcept {
+    return created_;
+}
+
+Metrics* MetricsRegion::Acquire(const char* name) noexcept {
+    if (!created_ || !owner_) {
+        return nullptr;
+    }
+    Header* header = (Header*)base_;
+    unsigned int index = __atomic_fetch_add(&header->used, 1, __ATOMIC_ACQ_REL);
+    if (index >= MAX_SLOTS) {
+        return nullptr;
+    }
+    Metrics* metrics = (Metrics*)(base_ + HEADER_STRIDE + (size_t)index * SLOT_STRIDE);
+    metrics->Reset(name);
+    return metrics;
+}
+
+const MetricsRegion::Header& MetricsRegion::GetHeader() const noexcept {
+    return *(const Header*)base_;
+}
+
+unsigned int MetricsRegion::GetCount() const noexcept {
+    unsigned int used = __atomic_load_n(&GetHeader().used, __ATOMIC_ACQUIRE);
+    return (used < MAX_SLOTS) ? used : MAX_SLOTS;
+}
+
+const Metrics& MetricsRegion::Get(unsigned int index) const noexcept {
+    return *(const Metrics*)(base_ + HEADER_STRIDE + (size_t)index * SLOT_STRIDE);
+}
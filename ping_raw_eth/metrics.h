@@ -0,0 +1,172 @@
+#pragma once
+/*
+ * Живые счётчики и гистограммы задержек пути отправки и приёма в разделяемой памяти
+ *
+ * Metrics - блок одного потока: счётчики стадий (фреймы, системные вызовы, отброшенные и несопоставленные
+ * фреймы, потери ответов, счётчики ядра PACKET_STATISTICS) и гистограммы задержек по степеням двойки
+ * (длительность системного вызова отправки, задержка принятого фрейма от метки ядра до программы).
+ * Пишет блок только поток-владелец: обновление - обычные load/store (атомарные relaxed, без lock префикса
+ * и барьеров), поэтому запись стоит как инкремент поля. Читатель в другом процессе видит каждое значение
+ * целиком, но снимок разных полей не согласован - для счётчиков это допустимо.
+ *
+ * MetricsRegion - сегмент POSIX разделяемой памяти процесса (/dev/shm/ping2.<pid>): заголовок и MAX_SLOTS
+ * блоков, каждый с шагом, кратным кэш-линии, - потоки не делят кэш-линии и не мешают друг другу.
+ * Блок выдаётся потоку один раз (Acquire, атомарный счётчик занятых блоков), блокировок нет ни у писателя,
+ * ни у читателя. Сегмент удаляется при разрушении объекта-владельца; сегмент аварийно завершённого
+ * процесса остаётся, читатель отличает его по pid.
+ *
+ * Просмотр - "ping2 stats": сегмент открывается только для чтения (MetricsRegion(pid)).
+ *
+ * USAGE:
+ * MetricsRegion region("sweep");         // если успешно создан, то IsCreated вернёт true
+ * ether.SetMetrics(region.Acquire("sweep.0"));
+ * metrics.Add(Metrics::TX_FRAMES, sent);
+ * metrics.Record(Metrics::TX_SEND, elapsed_ns);
+ *
+ * MetricsRegion view(pid);               // чтение сегмента процесса pid
+ * view.Get(0).Get(Metrics::TX_FRAMES);
+ */
+#include <stddef.h>
+
+class Metrics {
+public:
+    enum Counter : unsigned int {
+        TX_FRAMES = 0,                      // фреймов отдано ядру
+        TX_SYSCALLS,                        // системных вызовов отправки
+        TX_ERRORS,                          // неудачных системных вызовов отправки
+        TX_DROPPED,                         // фреймов, отвергнутых ядром при отправке (неверный формат слота кольца)
+        RX_FRAMES,                          // фреймов получено программой (кроме исходящих копий)
+        RX_SYSCALLS,                        // системных вызовов приёма и ожидания (recvmsg, poll, io_uring_enter)
+        RX_FILTERED,                        // фреймов отброшено программой: исходящие копии, некорректные, не ответы
+        REPLIES,                            // ответов, сопоставленных с запросами
+        UNMATCHED,                          // ответов без запроса: чужие, опоздавшие, повторные
+        TIMEOUTS,                           // запросов без ответа в срок
+        KERNEL_PACKETS,                     // PACKET_STATISTICS: фреймов принято ядром для сокета
+        KERNEL_DROPS,                       // PACKET_STATISTICS: отброшено ядром из-за переполнения буфера/кольца
+        KERNEL_FREEZES,                     // PACKET_STATISTICS: заморозок очереди кольца приёма
+        COUNTERS
+    };
+
+    enum Latency : unsigned int {
+        TX_SEND = 0,                        // длительность системного вызова отправки
+        RX_DELAY,                           // от метки приёма ядра до программы (первый фрейм пачки)
+        LATENCIES
+    };
+
+    static constexpr unsigned int BUCKETS = 40;         // корзина i > 0 - значения [2^(i-1), 2^i) нс
+    static constexpr unsigned int NAME_SIZE = 16;
+
+    /* Очистка блока, name - имя потока (обрезается до NAME_SIZE - 1 символов) */
+    void Reset(const char* name) noexcept;
+
+    void Add(Counter counter, unsigned long long value = 1) noexcept {
+        __atomic_store_n(&counters_[counter], __atomic_load_n(&counters_[counter], __ATOMIC_RELAXED) + value,
+                         __ATOMIC_RELAXED);
+    }
+
+    /* Замена значения - для счётчиков, которые накапливаются в другом месте (PACKET_STATISTICS) */
+    void Set(Counter counter, unsigned long long value) noexcept {
+        __atomic_store_n(&counters_[counter], value, __ATOMIC_RELAXED);
+    }
+
+    /* Учёт задержки value_ns (неотрицательной) */
+    void Record(Latency latency, long long value_ns) noexcept {
+        unsigned long long* bucket = &buckets_[latency][Bucket(value_ns)];
+        __atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    }
+
+    unsigned long long Get(Counter counter) const noexcept {
+        return __atomic_load_n(&counters_[counter], __ATOMIC_RELAXED);
+    }
+
+    unsigned long long GetBucket(Latency latency, unsigned int bucket) const noexcept {
+        return __atomic_load_n(&buckets_[latency][bucket], __ATOMIC_RELAXED);
+    }
+
+    const char* GetName() const noexcept {
+        return name_;
+    }
+
+    /* Операции просмотра над копиями блоков: копия блока другого потока (по полям, атомарными чтениями),
+     * сумма блоков, разность с предыдущей копией (изменения за интервал) */
+    void CopyFrom(const Metrics& other) noexcept;
+    void Merge(const Metrics& other) noexcept;
+    void Subtract(const Metrics& base) noexcept;
+
+    /* Верхняя граница корзины, в которую попадает percentile процентов учтённых задержек (в наносекундах),
+     * 0 если задержек нет */
+    unsigned long long GetPercentile(Latency latency, double percentile) const noexcept;
+
+    /* Верхняя граница значений корзины bucket (в наносекундах) */
+    static unsigned long long GetBucketLimit(unsigned int bucket) noexcept {
+        return 1ULL << bucket;
+    }
+
+    /* Номер корзины значения: число значащих бит, не больше последней корзины */
+    static unsigned int Bucket(long long value_ns) noexcept {
+        if (value_ns <= 0) {
+            return 0;
+        }
+        unsigned int bits = 64 - __builtin_clzll((unsigned long long)value_ns);
+        return (bits < BUCKETS) ? bits : BUCKETS - 1;
+    }
+
+private:
+    char name_[NAME_SIZE];
+    unsigned long long counters_[COUNTERS];
+    unsigned long long buckets_[LATENCIES][BUCKETS];
+};
+
+class MetricsRegion {
+public:
+    static constexpr unsigned int MAX_SLOTS = 64;       // блоков потоков в сегменте
+    static constexpr unsigned int CACHE_LINE = 64;
+    static constexpr unsigned int MAGIC = 0x4D32474E;   // "NG2M"
+    static constexpr unsigned int VERSION = 2;
+    static constexpr const char* NAME_PREFIX = "/ping2.";       // имя сегмента - префикс и pid процесса
+    static constexpr unsigned int MODE_SIZE = 16;
+
+    /* Заголовок сегмента */
+    struct Header {
+        unsigned int magic;
+        unsigned int version;
+        unsigned int slot_size;             // sizeof(Metrics) писателя - читатель сверяет со своим
+        unsigned int slot_stride;           // шаг блоков, кратен CACHE_LINE
+        unsigned int slots;                 // блоков в сегменте
+        unsigned int used;                  // выдано блоков (меняется только атомарно)
+        int pid;
+        unsigned int reserved;
+        long long started_ns;               // время создания (CLOCK_REALTIME)
+        char mode[MODE_SIZE];               // режим работы процесса
+    };
+
+    /* Создание сегмента текущего процесса (прежний сегмент с тем же именем заменяется)
+     * - mode - режим работы, виден в просмотре */
+    explicit MetricsRegion(const char* mode) noexcept;
+
+    /* Чтение сегмента процесса pid */
+    explicit MetricsRegion(int pid) noexcept;
+    ~MetricsRegion();
+
+    bool IsCreated() const noexcept;
+
+    /* Блок для потока name, nullptr - блоки кончились или сегмент открыт только для чтения */
+    Metrics* Acquire(const char* name) noexcept;
+
+    const Header& GetHeader() const noexcept;
+
+    /* Количество выданных блоков и блок index из них */
+    unsigned int GetCount() const noexcept;
+    const Metrics& Get(unsigned int index) const noexcept;
+
+    /* Размер сегмента: заголовок и блоки, каждый с шагом, кратным кэш-линии */
+    static constexpr unsigned int HEADER_STRIDE = (sizeof(Header) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    static constexpr unsigned int SLOT_STRIDE = (sizeof(Metrics) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    static constexpr size_t SIZE = HEADER_STRIDE + (size_t)SLOT_STRIDE * MAX_SLOTS;
+
+private:
+    unsigned char* base_ = nullptr;
+    bool owner_ = false;                    // сегмент создан этим объектом и удаляется при разрушении
+    bool created_ = false;
+    char name_[32];
+};
@@ -0,0 +1,398 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/ether.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "monitor.h"
+#include "utils.h"
+
+Monitor::Monitor(unsigned int interval_sec, unsigned int timeout_ms, unsigned int rate) noexcept
+    : rate_(rate == 0 ? DEFAULT_RATE : rate) {
+    id_ = getpid() & 0xFFFF;
+    interval_ticks_ = (interval_sec == 0 ? DEFAULT_INTERVAL : interval_sec) * 1000000000ULL / TICK_NS;
+    timeout_ticks_ = (timeout_ms == 0 ? DEFAULT_TIMEOUT_MS : timeout_ms) * 1000000ULL / TICK_NS;
+    // ответ ждём не дольше интервала - к следующему запросу предыдущий уже просрочен
+    if (timeout_ticks_ == 0) {
+        timeout_ticks_ = 1;
+    } else if (timeout_ticks_ > interval_ticks_) {
+        timeout_ticks_ = interval_ticks_;
+    }
+}
+
+Monitor::~Monitor() {
+    free(targets_);
+}
+
+bool Monitor::IsCreated() const noexcept {
+    return ip_proto_.IsCreated();
+}
+
+EthernetProtocol& Monitor::GetEthernet() noexcept {
+    return ip_proto_.GetEthernet();
+}
+
+int Monitor::CompareTargets(const void* a, const void* b) {
+    in_addr_t lhs = ((const Target*)a)->ip;
+    in_addr_t rhs = ((const Target*)b)->ip;
+    return (lhs < rhs) ? -1 : ((lhs > rhs) ? 1 : 0);
+}
+
+bool Monitor::AppendTarget(in_addr_t ip) noexcept {
+    if (targets_count_ == targets_capacity_) {
+        unsigned int capacity = (targets_capacity_ == 0) ? 256 : targets_capacity_ * 2;
+        Target* targets = (Target*)realloc(targets_, capacity * sizeof(Target));
+        if (targets == nullptr) {
+            printf("Monitor. Error. Not enough memory for targets.\n");
+            return false;
+        }
+        targets_ = targets;
+        targets_capacity_ = capacity;
+    }
+    Target& target = targets_[targets_count_++];
+    target = Target{};
+    target.ip = ip;
+    return true;
+}
+
+bool Monitor::AddTarget(const char* spec) noexcept {
+    in_addr_t first;
+    in_addr_t last;
+    if (!utils::ParseNetwork(spec, MIN_PREFIX_LEN, &first, &last)) {
+        return false;
+    }
+    for (in_addr_t ip = first; ; ++ip) {
+        if (!AppendTarget(ip)) {
+            return false;
+        }
+        if (ip == last) {
+            break;
+        }
+    }
+    return true;
+}
+
+/* Сортировка целей и удаление повторов - для поиска цели по адресу отправителя ответа */
+void Monitor::PrepareTargets() noexcept {
+    if (targets_count_ == 0) {
+        return;
+    }
+    qsort(targets_, targets_count_, sizeof(Target), CompareTargets);
+    unsigned int unique = 1;
+    for (unsigned int i = 1; i < targets_count_; ++i) {
+        if (targets_[i].ip != targets_[unique - 1].ip) {
+            targets_[unique++] = targets_[i];
+        }
+    }
+    targets_count_ = unique;
+}
+
+/* Приём идёт со всех интерфейсов, шаблон фрейма - для интерфейса маршрута к первой цели, как в Sweeper */
+bool Monitor::Prepare() noexcept {
+    Ping::BuildEchoRequest(echo_template_, sizeof(echo_template_), id_, 0);
+    ip_proto_.SetAsyncResolve(true);
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    if (!ip_proto_.GetArp().GetCache().Reserve(targets_count_ + 1) || !probes_.Reserve(targets_count_, timeout_ticks_)) {
+        return false;
+    }
+    if (!ether.EnableRxRing()) {
+        ether.SetRcvBufSize(RCV_BUF_SIZE);
+    }
+    ether.EnableTxRing();
+    in_addr_t next_hop;
+    const char* if_name = ip_proto_.GetRouteInterface(htonl(targets_[0].ip), &next_hop);
+    if (if_name == nullptr) {
+        return false;
+    }
+    strncpy(if_name_, if_name, IFNAMSIZ - 1);
+    const InterfaceTable::Interface* iface = ether.GetInterfaces().FindByName(if_name_);
+    if ((iface == nullptr) || !frame_template_.Init(*iface, IPPROTO_ICMP, echo_template_, sizeof(echo_template_))) {
+        printf("Monitor. Error. Can't build frame template for interface %s.\n", if_name_);
+        return false;
+    }
+    return ip_proto_.SetReplyFilter(id_) && ether.BindAllInterfaces();
+}
+
+/* Продвижение до текущего тика: истёкшие ожидания ответа фиксируют потери, истёкшие таймеры колеса
+ * отправляют запросы. Кредит копится пропорционально прошедшим тикам, но не более MAX_BURST пакетов */
+bool Monitor::OnTick(unsigned long long expirations) noexcept {
+    credit_ += expirations * rate_ * TICK_NS / 1000000;
+    if (credit_ > MAX_BURST * 1000ULL) {
+        credit_ = MAX_BURST * 1000ULL;
+    }
+    queued_ = 0;
+    backlog_ = 0;
+    const unsigned long long now = utils::MonotonicNs() / TICK_NS;
+    probes_.Expire(now, OnExpired, this);
+    wheel_.Advance(now, OnTimer, this);
+    // все запросы тика уходят одним системным вызовом
+    if ((queued_ > 0) && (ip_proto_.FlushRequests() < 0) && (errno != ENOBUFS) && (errno != EAGAIN)) {
+        return false;
+    }
+    return !send_failed_;
+}
+
+/* Таймер цели: срок очередного запроса */
+void Monitor::OnTimer(void* ctx, TimerWheel::Timer* timer) {
+    ((Monitor*)ctx)->Probe((Target*)timer);
+}
+
+/* Запрос цели index остался без ответа */
+void Monitor::OnExpired(void* ctx, unsigned int index) {
+    Monitor* self = (Monitor*)ctx;
+    self->ip_proto_.GetEthernet().GetMetrics().Add(Metrics::TIMEOUTS);
+    self->OnTimeout(&self->targets_[index]);
+}
+
+void Monitor::Probe(Target* target) noexcept {
+    const unsigned long long now = wheel_.GetNow();
+    if (send_failed_ || (credit_ < 1000)) {
+        // предел скорости - запросы, на которые не хватило кредита, раскладываются по следующим тикам
+        // согласно скорости, чтобы не переставлять всю очередь на каждом тике
+        ++deferred_;
+        const unsigned long long tick_credit = rate_ * TICK_NS / 1000000;
+        wheel_.Schedule(&target->timer, now + 1 + backlog_++ * 1000ULL / (tick_credit == 0 ? 1 : tick_credit));
+        return;
+    }
+    unsigned short sequence = htons(ntohs(target->sequence) + 1);
+    if (!Ping::QueueEchoRequest(ip_proto_, frame_template_, echo_template_, sizeof(echo_template_), htonl(target->ip),
+                                sequence)) {
+        if ((errno == ENOBUFS) || (errno == EAGAIN)) {
+            // очередь передачи переполнена - повторим на следующем тике
+            ++deferred_;
+            wheel_.Schedule(&target->timer, now + 1);
+            return;
+        }
+        if (errno != ENETUNREACH) {
+            send_failed_ = true;
+            wheel_.Schedule(&target->timer, now + 1);
+            return;
+        }
+        // маршрута нет - запрос считается потерянным
+        target->sent_tick = now;
+        OnTimeout(target);
+        return;
+    }
+    credit_ -= 1000;
+    ++queued_;
+    ++sent_;
+    target->sequence = sequence;
+    target->sent_tick = now;
+    target->sent_ns = utils::MonotonicNs();
+    // до ответа или истечения ожидания таймер цели не запланирован: срок ожидания ведёт таблица запросов
+    if (!probes_.Insert(htonl(target->ip), id_, sequence, (unsigned int)(target - targets_), now)) {
+        OnTimeout(target);
+    }
+}
+
+void Monitor::OnTimeout(Target* target) noexcept {
+    if (target->misses < 255) {
+        ++target->misses;
+    }
+    if ((target->state == State::UNKNOWN) ||
+        ((target->state == State::UP) && (target->misses >= DOWN_AFTER))) {
+        if (target->state == State::UP) {
+            --up_count_;
+        }
+        target->state = State::DOWN;
+        ++down_count_;
+        char addr[INET_ADDRSTRLEN];
+        in_addr_t ip = htonl(target->ip);
+        inet_ntop(AF_INET, &ip, addr, sizeof(addr));
+        printf("%s down\n", addr);
+        fflush(stdout);
+    }
+    wheel_.Schedule(&target->timer, target->sent_tick + interval_ticks_);
+}
+
+void Monitor::HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    Monitor* self = (Monitor*)ctx;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        // ARP ответы на асинхронные запросы пополняют кэш соседей
+        in_addr_t sender_ip;
+        const unsigned char* sender_mac;
+        self->ip_proto_.GetArp().HandlePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &sender_ip, &sender_mac);
+        return;
+    }
+    Metrics& metrics = self->ip_proto_.GetEthernet().GetMetrics();
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP) || !self->ip_proto_.IsLocalAddress(ip_h->daddr)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if (icmp_h == nullptr) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+
+    self->OnReply(ip_h->saddr, icmp_h->un.echo.id, icmp_h->un.echo.sequence, eth_h->ether_shost);
+}
+
+/* Ответ от ip (в сетевом порядке байт): запрос ищется в таблице запросов в полёте по адресу, идентификатору
+ * и sequence и снимается с ожидания, следующий запрос цели - через интервал от предыдущего.
+ * Чужие ответы, ответы на просроченные запросы и повторы в таблице не находятся и отбрасываются */
+void Monitor::OnReply(in_addr_t ip, unsigned short id, unsigned short sequence, const unsigned char* mac) noexcept {
+    unsigned int index;
+    Metrics& metrics = ip_proto_.GetEthernet().GetMetrics();
+    if (!probes_.Match(ip, id, sequence, &index)) {
+        metrics.Add(Metrics::UNMATCHED);
+        return;
+    }
+    metrics.Add(Metrics::REPLIES);
+    Target* target = &targets_[index];
+    target->misses = 0;
+    ++replies_;
+    if ((target->state != State::UP) || (memcmp(target->mac, mac, ETH_ALEN) != 0)) {
+        if (target->state != State::UP) {
+            if (target->state == State::DOWN) {
+                --down_count_;
+            }
+            ++up_count_;
+        }
+        target->state = State::UP;
+        memcpy(target->mac, mac, ETH_ALEN);
+        const unsigned char* hw = target->mac;
+        char addr[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &ip, addr, sizeof(addr));
+        printf("%s up %02x:%02x:%02x:%02x:%02x:%02x rtt=%.3f ms\n", addr, hw[0], hw[1], hw[2], hw[3], hw[4], hw[5],
+               (utils::MonotonicNs() - target->sent_ns) / 1000000.0);
+        fflush(stdout);
+    }
+    wheel_.Schedule(&target->timer, target->sent_tick + interval_ticks_);
+}
+
+/* Первые запросы целей равномерно разносятся по интервалу опроса, дальше каждая цель
+ * опрашивается через интервал от своего предыдущего запроса - нагрузка остаётся равномерной */
+int Monitor::Run() noexcept {
+    if (!IsCreated()) {
+        return -1;
+    }
+    PrepareTargets();
+    if (targets_count_ == 0) {
+        printf("Monitor. Error. No targets.\n");
+        return -1;
+    }
+    if (!Prepare()) {
+        return -1;
+    }
+
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        printf("Monitor. Error. Can't create epoll.\n");
+        return -1;
+    }
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        printf("Monitor. Error. Can't create timer.\n");
+        close(epoll_fd);
+        return -1;
+    }
+    // SIGINT/SIGTERM принимаются через signalfd, чтобы завершиться штатно и вывести итоги
+    sigset_t signals;
+    sigset_t saved_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &saved_signals);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        printf("Monitor. Error. Can't create signal descriptor.\n");
+        sigprocmask(SIG_SETMASK, &saved_signals, nullptr);
+        close(timer_fd);
+        close(epoll_fd);
+        return -1;
+    }
+    struct itimerspec timer_spec{{0, TICK_NS}, {0, TICK_NS}};
+    timerfd_settime(timer_fd, 0, &timer_spec, nullptr);
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = ether.GetSocket();
+    bool ok = (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ether.GetSocket(), &ev) == 0);
+    ev.data.fd = timer_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == 0);
+    ev.data.fd = signal_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) == 0);
+    int ifaces_fd = ether.GetInterfaces().GetSocket();
+    ev.data.fd = ifaces_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ifaces_fd, &ev) == 0);
+    int routes_fd = ip_proto_.GetRoutes().GetSocket();
+    ev.data.fd = routes_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, routes_fd, &ev) == 0);
+    if (!ok) {
+        printf("Monitor. Error. Can't configure epoll.\n");
+    }
+
+    wheel_.Advance(utils::MonotonicNs() / TICK_NS, OnTimer, this);
+    const unsigned long long start = wheel_.GetNow() + 1;
+    for (unsigned int i = 0; i < targets_count_; ++i) {
+        wheel_.Schedule(&targets_[i].timer, start + i * interval_ticks_ / targets_count_);
+    }
+
+    bool stop = false;
+    while (ok && !stop) {
+        struct epoll_event events[5];
+        int n = epoll_wait(epoll_fd, events, 5, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Monitor. Error. epoll_wait failed.\n");
+            ok = false;
+            break;
+        }
+        for (int i = 0; (i < n) && ok; ++i) {
+            if (events[i].data.fd == timer_fd) {
+                unsigned long long expirations = 0;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    ok = OnTick(expirations);
+                }
+            } else if (events[i].data.fd == signal_fd) {
+                struct signalfd_siginfo info;
+                stop = (read(signal_fd, &info, sizeof(info)) == sizeof(info));
+            } else if (events[i].data.fd == ifaces_fd) {
+                // изменения интерфейсов и адресов применяются к следующим отправкам, смена адресов
+                // пересобирает фильтр ядра
+                ok = ip_proto_.UpdateInterfaces();
+            } else if (events[i].data.fd == routes_fd) {
+                ok = ip_proto_.GetRoutes().Update();
+            } else if (ether.RcvFrames(HandleFrame, this, RCV_BATCH) < 0) {
+                ok = false;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < targets_count_; ++i) {
+        wheel_.Cancel(&targets_[i].timer);
+    }
+    close(signal_fd);
+    sigprocmask(SIG_SETMASK, &saved_signals, nullptr);
+    close(timer_fd);
+    close(epoll_fd);
+
+    fprintf(stderr, "Monitor finished: %u targets (%u up, %u down), %llu requests sent, %llu replies, "
+            "%llu deferred by rate limit\n", targets_count_, up_count_, down_count_, sent_, replies_, deferred_);
+    EthernetProtocol::RxStatistics stats{};
+    if (ether.GetStatistics(&stats)) {
+        fprintf(stderr, "Receive (%s): %llu frames, %llu dropped by kernel, %llu queue freezes\n",
+                ether.IsRxRingEnabled() ? "rx ring" : (ether.IsUringEnabled() ? "io_uring" : "recvfrom"), stats.packets, stats.drops, stats.freeze_q_cnt);
+    }
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,119 @@
+#pragma once
+/*
+ * Класс непрерывного мониторинга множества IPv4 адресов
+ *
+ * Долгоживущий режим вместо запуска утилиты по расписанию: сокет, кольца, таблицы интерфейсов и маршрутов
+ * создаются один раз, каждая цель опрашивается ICMP echo request с заданным интервалом.
+ * Сроки очередных запросов целей хранятся в иерархическом колесе таймеров (TimerWheel), запросы в полёте -
+ * в таблице ProbeTable: ответ сопоставляется с запросом по адресу, идентификатору и sequence, а истёкшие
+ * ожидания снимаются с головы списка таблицы. Постановка, сопоставление и срабатывание - O(1), поэтому
+ * число целей (сотни тысяч) не влияет на стоимость тика и приёма.
+ *
+ * Цикл событий - epoll + timerfd с тиком TICK_NS:
+ * - первые запросы целей равномерно разнесены по интервалу опроса, поэтому запросы не идут пачками
+ * - дополнительно скорость ограничена кредитом (пакетов в секунду, как в Sweeper): цели, на которые
+ *   не хватило кредита, переносятся на следующие тики
+ * - запросы одного тика уходят одним системным вызовом, фрейм берётся из шаблона (FrameTemplate)
+ * MAC адреса следующих узлов разрешаются асинхронно (IPProtocol::SetAsyncResolve).
+ *
+ * В stdout выводятся только изменения состояния цели:
+ *   <IPv4> up <MAC> rtt=<мс>    - цель ответила (впервые, после недоступности или с другого MAC адреса)
+ *   <IPv4> down                  - нет ответа на DOWN_AFTER запросов подряд (либо на первый запрос)
+ * Работа завершается по SIGINT/SIGTERM, итоговая статистика выводится в stderr.
+ *
+ * USAGE:
+ * Monitor monitor(interval_sec, timeout_ms, rate); // если успешно создан, то IsCreated вернёт true
+ * monitor.AddTarget("192.168.1.0/24");
+ * monitor.Run();
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+#include "icmp.h"
+#include "probe_table.h"
+#include "timer_wheel.h"
+
+class Monitor {
+public:
+    static constexpr unsigned int DEFAULT_INTERVAL = 60;        // интервал опроса цели (в секундах)
+    static constexpr unsigned int DEFAULT_TIMEOUT_MS = 1000;    // ожидание ответа на запрос
+    static constexpr unsigned int DEFAULT_RATE = 10000;         // предел скорости отправки (пакетов в секунду)
+    static constexpr long TICK_NS = 1000000;                    // тик колеса и таймера (1 мс)
+    static constexpr unsigned int MAX_BURST = 256;              // максимум пакетов за один тик
+    static constexpr unsigned int DOWN_AFTER = 3;               // потерянных подряд запросов до состояния down
+    static constexpr int RCV_BATCH = 1024;                      // максимум фреймов за одно пробуждение
+    static constexpr int RCV_BUF_SIZE = 8 * 1024 * 1024;        // размер приёмного буфера сокета
+    static constexpr int MIN_PREFIX_LEN = 8;                    // самая большая допустимая сеть /8
+
+    Monitor(unsigned int interval_sec, unsigned int timeout_ms, unsigned int rate) noexcept;
+    ~Monitor();
+
+    bool IsCreated() const noexcept;
+
+    /* Ethernet уровень - для подключения приёмника копий принятых фреймов (SetFrameSink) */
+    EthernetProtocol& GetEthernet() noexcept;
+
+    /* Добавление цели: IPv4 адрес (a.b.c.d) либо сеть (a.b.c.d/n), до вызова Run
+     * возвращает false при некорректной записи */
+    bool AddTarget(const char* spec) noexcept;
+
+    /* Мониторинг до SIGINT/SIGTERM
+     * возвращает 0 при штатном завершении, -1 при ошибке */
+    int Run() noexcept;
+
+private:
+    enum class State : unsigned char {
+        UNKNOWN = 0,        // ещё не опрашивалась
+        UP,
+        DOWN
+    };
+
+    struct Target {
+        TimerWheel::Timer timer;            // первое поле: узел таймера приводится к цели
+        long long sent_ns;                  // время отправки последнего запроса
+        unsigned long long sent_tick;       // тик отправки последнего запроса (от него отсчитывается интервал)
+        in_addr_t ip;                       // в порядке байт хоста
+        unsigned short sequence;            // sequence последнего запроса (в сетевом порядке байт)
+        unsigned char misses;               // потерянных запросов подряд
+        State state;
+        unsigned char mac[ETH_ALEN];
+    };
+
+    static int CompareTargets(const void* a, const void* b);
+    bool AppendTarget(in_addr_t ip) noexcept;
+    void PrepareTargets() noexcept;
+    bool Prepare() noexcept;
+    bool OnTick(unsigned long long expirations) noexcept;
+    static void OnTimer(void* ctx, TimerWheel::Timer* timer);
+    static void OnExpired(void* ctx, unsigned int index);
+    void Probe(Target* target) noexcept;
+    void OnTimeout(Target* target) noexcept;
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len);
+    void OnReply(in_addr_t ip, unsigned short id, unsigned short sequence, const unsigned char* mac) noexcept;
+
+    IPProtocol ip_proto_;
+    TimerWheel wheel_;
+    ProbeTable probes_;                     // запросы в полёте, не более одного на цель, cookie - индекс цели
+    unsigned long long interval_ticks_;
+    unsigned long long timeout_ticks_;
+    unsigned int rate_;
+    unsigned short id_;
+
+    Target* targets_ = nullptr;             // адреса не меняются после начала Run - на узлы ссылается колесо
+    unsigned int targets_count_ = 0;
+    unsigned int targets_capacity_ = 0;
+
+    unsigned char echo_template_[Ping::PING_PKT_SIZE];  // echo request, в котором меняется только sequence
+    FrameTemplate frame_template_;          // фрейм echo request для интерфейса if_name_
+    char if_name_[IFNAMSIZ] = {};           // интерфейс шаблона фрейма (по маршруту к первой цели)
+    unsigned long long credit_ = 0;         // накопленный кредит отправки (в тысячных долях пакета)
+    unsigned int queued_ = 0;               // запросов в очереди текущего тика
+    unsigned int backlog_ = 0;              // запросов текущего тика, перенесённых из-за предела скорости
+    bool send_failed_ = false;              // ошибка отправки в обработчике таймера
+
+    unsigned long long sent_ = 0;
+    unsigned long long replies_ = 0;
+    unsigned long long deferred_ = 0;       // переносов запросов из-за ограничения скорости
+    unsigned int up_count_ = 0;
+    unsigned int down_count_ = 0;
+};
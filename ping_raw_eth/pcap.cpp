@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pcap.h"
+
+namespace {
+constexpr unsigned int MAGIC_USEC = 0xa1b2c3d4;
+constexpr unsigned int MAGIC_NSEC = 0xa1b23c4d;
+constexpr unsigned int LINKTYPE_ETHERNET = 1;
+
+/* Заголовок файла pcap */
+struct FileHeader {
+    unsigned int magic;
+    unsigned short version_major;
+    unsigned short version_minor;
+    int thiszone;
+    unsigned int sigfigs;
+    unsigned int snaplen;
+    unsigned int network;
+};
+
+/* Заголовок записи (фрейма) */
+struct RecordHeader {
+    unsigned int ts_sec;
+    unsigned int ts_frac;                   // микро- или наносекунды
+    unsigned int incl_len;                  // сохранено байт
+    unsigned int orig_len;                  // длина фрейма
+};
+}
+
+/*
+ * При создании объекта:
+ * - создаём (или обрезаем) файл
+ * - выделяем буфер записи и кладём в него заголовок файла
+ */
+PcapWriter::PcapWriter(const char* path) noexcept {
+    fd_ = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        printf("Pcap. Error. Can't create file %s. %s\n", path, strerror(errno));
+        return;
+    }
+    buf_ = (unsigned char*)malloc(BUFFER_SIZE);
+    if (buf_ == nullptr) {
+        printf("Pcap. Error. Not enough memory.\n");
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    FileHeader header{MAGIC_NSEC, 2, 4, 0, 0, SNAPLEN, LINKTYPE_ETHERNET};
+    memcpy(buf_, &header, sizeof(header));
+    buf_len_ = sizeof(header);
+}
+
+PcapWriter::~PcapWriter() {
+    if (fd_ >= 0) {
+        Flush();
+        close(fd_);
+        fd_ = -1;
+    }
+    free(buf_);
+    buf_ = nullptr;
+}
+
+bool PcapWriter::IsCreated() const noexcept {
+    return fd_ >= 0;
+}
+
+bool PcapWriter::Write(const unsigned char* frame, int len, long long ts_ns) noexcept {
+    if ((fd_ < 0) || (len < 0)) {
+        return false;
+    }
+    unsigned int incl_len = ((unsigned int)len > SNAPLEN) ? SNAPLEN : (unsigned int)len;
+    if ((buf_len_ + sizeof(RecordHeader) + incl_len > BUFFER_SIZE) && !Flush()) {
+        return false;
+    }
+    RecordHeader record{(unsigned int)(ts_ns / 1000000000LL), (unsigned int)(ts_ns % 1000000000LL),
+                        incl_len, (unsigned int)len};
+    memcpy(buf_ + buf_len_, &record, sizeof(record));
+    memcpy(buf_ + buf_len_ + sizeof(record), frame, incl_len);
+    buf_len_ += sizeof(record) + incl_len;
+    ++count_;
+    return true;
+}
+
+/* Буфер пишется целиком, с повтором при частичной записи */
+bool PcapWriter::Flush() noexcept {
+    if (fd_ < 0) {
+        return false;
+    }
+    unsigned int done = 0;
+    while (done < buf_len_) {
+        ssize_t res = write(fd_, buf_ + done, buf_len_ - done);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!failed_) {
+                printf("Pcap. Error writing file. %s\n", strerror(errno));
+                failed_ = true;
+            }
+            return false;
+        }
+        done += res;
+    }
+    buf_len_ = 0;
+    return true;
+}
+
+unsigned long long PcapWriter::GetCount() const noexcept {
+    return count_;
+}
+
+void PcapWriter::Sink(void* ctx, const unsigned char* frame, int len, long long ts_ns) {
+    ((PcapWriter*)ctx)->Write(frame, len, ts_ns);
+}
+
+/*
+ * При создании объекта:
+ * - отображаем файл в память целиком (только чтение, последовательный доступ)
+ * - проверяем заголовок: magic (точность меток и порядок байт) и тип канального уровня Ethernet
+ */
+PcapReader::PcapReader(const char* path) noexcept {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Pcap. Error. Can't open file %s. %s\n", path, strerror(errno));
+        return;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(FileHeader))) {
+        printf("Pcap. Error. File %s is not a pcap file.\n", path);
+        close(fd);
+        return;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Pcap. Error mapping file %s. %s\n", path, strerror(errno));
+        return;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    data_ = (const unsigned char*)data;
+    size_ = st.st_size;
+
+    unsigned int magic;
+    memcpy(&magic, data_, sizeof(magic));
+    if ((magic == MAGIC_USEC) || (magic == MAGIC_NSEC)) {
+        swapped_ = false;
+    } else if ((magic == __builtin_bswap32(MAGIC_USEC)) || (magic == __builtin_bswap32(MAGIC_NSEC))) {
+        swapped_ = true;
+    } else {
+        printf("Pcap. Error. File %s is not a pcap file.\n", path);
+        return;
+    }
+    nanosec_ = (Read32(data_) == MAGIC_NSEC);
+    unsigned int network = Read32(data_ + offsetof(FileHeader, network));
+    if (network != LINKTYPE_ETHERNET) {
+        printf("Pcap. Error. Unsupported link type %u in file %s.\n", network, path);
+        return;
+    }
+    offset_ = sizeof(FileHeader);
+    created_ = true;
+}
+
+PcapReader::~PcapReader() {
+    if (data_ != nullptr) {
+        munmap((void*)data_, size_);
+        data_ = nullptr;
+    }
+}
+
+bool PcapReader::IsCreated() const noexcept {
+    return created_;
+}
+
+int PcapReader::Next(const unsigned char** frame, long long* ts_ns) noexcept {
+    if (!created_ || (offset_ == size_)) {
+        return 0;
+    }
+    if (size_ - offset_ < sizeof(RecordHeader)) {
+        return -1;
+    }
+    const unsigned char* record = data_ + offset_;
+    unsigned int incl_len = Read32(record + offsetof(RecordHeader, incl_len));
+    if (size_ - offset_ - sizeof(RecordHeader) < incl_len) {
+        return -1;
+    }
+    long long frac = Read32(record + offsetof(RecordHeader, ts_frac));
+    *ts_ns = Read32(record) * 1000000000LL + (nanosec_ ? frac : frac * 1000);
+    *frame = record + sizeof(RecordHeader);
+    offset_ += sizeof(RecordHeader) + incl_len;
+    return (int)incl_len;
+}
+
+void PcapReader::Rewind() noexcept {
+    offset_ = sizeof(FileHeader);
+}
+
+unsigned long PcapReader::GetSize() const noexcept {
+    return size_;
+}
+
+int PcapReader::Source(void* ctx, const unsigned char** frame, long long* ts_ns) {
+    return ((PcapReader*)ctx)->Next(frame, ts_ns);
+}
+
+unsigned int PcapReader::Read32(const unsigned char* p) const noexcept {
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return swapped_ ? __builtin_bswap32(value) : value;
+}
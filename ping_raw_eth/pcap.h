@@ -0,0 +1,86 @@
+#pragma once
+/*
+ * Запись и воспроизведение фреймов в формате pcap (LINKTYPE_ETHERNET)
+ *
+ * PcapWriter - потоковая запись: заголовки записей и фреймы копируются в буфер BUFFER_SIZE байт,
+ * который уходит в файл одним write при заполнении, при Flush и при разрушении объекта.
+ * Метки времени пишутся с наносекундной точностью (magic 0xa1b23c4d).
+ *
+ * PcapReader - воспроизведение: файл целиком отображается в память, фреймы отдаются указателями
+ * прямо в отображение, без копирования и системных вызовов на фрейм. Читаются файлы с микро- и
+ * наносекундными метками в любом порядке байт.
+ *
+ * Оба класса подключаются к EthernetProtocol как приёмник (SetFrameSink) и источник фреймов
+ * (конструктор EthernetProtocol(FrameSource, void*)) через статические функции Sink и Source.
+ *
+ * USAGE:
+ * PcapWriter writer("capture.pcap");  // если успешно создан, то IsCreated вернёт true
+ * ether.SetFrameSink(PcapWriter::Sink, &writer);
+ *
+ * PcapReader reader("capture.pcap");  // если успешно открыт, то IsCreated вернёт true
+ * IPProtocol ip_proto(PcapReader::Source, &reader);
+ */
+
+class PcapWriter {
+public:
+    static constexpr unsigned int BUFFER_SIZE = 1 << 20;       // буфер записи (1 МиБ)
+    static constexpr unsigned int SNAPLEN = 65535;             // максимальная длина сохраняемого фрейма
+
+    explicit PcapWriter(const char* path) noexcept;
+    ~PcapWriter();
+
+    bool IsCreated() const noexcept;
+
+    /* Запись фрейма (с Ethernet заголовком) длиной len, ts_ns - метка приёма (CLOCK_REALTIME) в наносекундах
+     * Фрейм длиннее SNAPLEN обрезается, возвращает false при ошибке записи в файл */
+    bool Write(const unsigned char* frame, int len, long long ts_ns) noexcept;
+
+    /* Запись накопленного буфера в файл, возвращает false при ошибке */
+    bool Flush() noexcept;
+
+    /* Количество записанных фреймов */
+    unsigned long long GetCount() const noexcept;
+
+    /* Приёмник фреймов для EthernetProtocol::SetFrameSink, ctx - PcapWriter */
+    static void Sink(void* ctx, const unsigned char* frame, int len, long long ts_ns);
+
+private:
+    int fd_ = -1;
+    unsigned char* buf_ = nullptr;
+    unsigned int buf_len_ = 0;
+    unsigned long long count_ = 0;
+    bool failed_ = false;                   // ошибка записи уже выведена
+};
+
+class PcapReader {
+public:
+    explicit PcapReader(const char* path) noexcept;
+    ~PcapReader();
+
+    bool IsCreated() const noexcept;
+
+    /* Следующий фрейм файла
+     * - frame - указатель на фрейм в отображении файла, действителен до разрушения объекта
+     * - ts_ns - метка записи (CLOCK_REALTIME) в наносекундах
+     * возвращает длину фрейма, 0 если фреймы закончились, либо -1 если запись обрезана */
+    int Next(const unsigned char** frame, long long* ts_ns) noexcept;
+
+    /* Возврат к первому фрейму файла (повторное воспроизведение) */
+    void Rewind() noexcept;
+
+    /* Размер файла в байтах */
+    unsigned long GetSize() const noexcept;
+
+    /* Источник фреймов для конструктора EthernetProtocol(FrameSource, void*), ctx - PcapReader */
+    static int Source(void* ctx, const unsigned char** frame, long long* ts_ns);
+
+private:
+    unsigned int Read32(const unsigned char* p) const noexcept;
+
+    bool created_ = false;
+    const unsigned char* data_ = nullptr;   // отображённый в память файл
+    unsigned long size_ = 0;
+    unsigned long offset_ = 0;              // начало следующей записи
+    bool swapped_ = false;                  // файл записан в другом порядке байт
+    bool nanosec_ = false;                  // метки с наносекундной точностью
+};
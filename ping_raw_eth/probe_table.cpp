@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "probe_table.h"
+
+ProbeTable::~ProbeTable() {
+    free(entries_);
+}
+
+/* Массив выделяется целиком и сразу заполняется нулями - страницы отображаются до начала отправки,
+ * объём памяти определяется только max_probes */
+bool ProbeTable::Reserve(unsigned int max_probes, long long timeout) noexcept {
+    if (max_probes > MAX_PROBES) {
+        max_probes = MAX_PROBES;
+    }
+    unsigned long long capacity = MIN_CAPACITY;
+    while (capacity * 3 < (unsigned long long)max_probes * 4) {
+        capacity *= 2;
+    }
+    Entry* entries = (Entry*)aligned_alloc(CACHE_LINE, capacity * sizeof(Entry));
+    if (entries == nullptr) {
+        printf("Probes. Error. Not enough memory for %u probes in flight.\n", max_probes);
+        return false;
+    }
+    memset(entries, 0, capacity * sizeof(Entry));
+    free(entries_);
+    entries_ = entries;
+    mask_ = (unsigned int)(capacity - 1);
+    max_count_ = max_probes;
+    count_ = 0;
+    timeout_ = timeout;
+    head_ = NIL;
+    tail_ = NIL;
+    return true;
+}
+
+unsigned int ProbeTable::Slot(in_addr_t ip, unsigned short id, unsigned short sequence) const noexcept {
+    unsigned int h = ip * 2654435761u;
+    h ^= (((unsigned int)id << 16) | sequence) * 2246822519u;
+    h ^= h >> 15;
+    return h & mask_;
+}
+
+unsigned int ProbeTable::Find(in_addr_t ip, unsigned short id, unsigned short sequence) const noexcept {
+    if (entries_ == nullptr) {
+        return NIL;
+    }
+    for (unsigned int i = Slot(ip, id, sequence); entries_[i].ip != 0; i = (i + 1) & mask_) {
+        const Entry& entry = entries_[i];
+        if ((entry.ip == ip) && (entry.id == id) && (entry.sequence == sequence)) {
+            return i;
+        }
+    }
+    return NIL;
+}
+
+bool ProbeTable::Insert(in_addr_t ip, unsigned short id, unsigned short sequence, unsigned int cookie,
+                        long long now) noexcept {
+    if ((ip == 0) || (count_ >= max_count_)) {
+        return false;
+    }
+    unsigned int i = Slot(ip, id, sequence);
+    for (; entries_[i].ip != 0; i = (i + 1) & mask_) {
+        const Entry& entry = entries_[i];
+        if ((entry.ip == ip) && (entry.id == id) && (entry.sequence == sequence)) {
+            return false;
+        }
+    }
+    Entry& entry = entries_[i];
+    entry.sent = now;
+    entry.ip = ip;
+    entry.id = id;
+    entry.sequence = sequence;
+    entry.cookie = cookie;
+    entry.prev = tail_;
+    entry.next = NIL;
+    if (tail_ != NIL) {
+        entries_[tail_].next = i;
+    } else {
+        head_ = i;
+    }
+    tail_ = i;
+    ++count_;
+    return true;
+}
+
+bool ProbeTable::Match(in_addr_t ip, unsigned short id, unsigned short sequence, unsigned int* cookie,
+                       long long* sent) noexcept {
+    unsigned int i = Find(ip, id, sequence);
+    if (i == NIL) {
+        return false;
+    }
+    if (cookie != nullptr) {
+        *cookie = entries_[i].cookie;
+    }
+    if (sent != nullptr) {
+        *sent = entries_[i].sent;
+    }
+    Remove(i);
+    return true;
+}
+
+bool ProbeTable::Lookup(in_addr_t ip, unsigned short id, unsigned short sequence, unsigned int* cookie) const noexcept {
+    unsigned int i = Find(ip, id, sequence);
+    if (i == NIL) {
+        return false;
+    }
+    if (cookie != nullptr) {
+        *cookie = entries_[i].cookie;
+    }
+    return true;
+}
+
+unsigned int ProbeTable::Expire(long long now, ExpireHandler handler, void* ctx) noexcept {
+    unsigned int expired = 0;
+    while ((head_ != NIL) && (entries_[head_].sent + timeout_ <= now)) {
+        unsigned int cookie = entries_[head_].cookie;
+        Remove(head_);
+        handler(ctx, cookie);
+        ++expired;
+    }
+    return expired;
+}
+
+unsigned int ProbeTable::GetCount() const noexcept {
+    return count_;
+}
+
+/* Перенос записи в другой слот: соседи по списку вставки переуказываются на новый слот */
+void ProbeTable::Move(unsigned int from, unsigned int to) noexcept {
+    Entry& entry = entries_[to];
+    entry = entries_[from];
+    if (entry.prev != NIL) {
+        entries_[entry.prev].next = to;
+    } else {
+        head_ = to;
+    }
+    if (entry.next != NIL) {
+        entries_[entry.next].prev = to;
+    } else {
+        tail_ = to;
+    }
+}
+
+/* Снятие записи из списка вставки и из таблицы. Освободившийся слот занимают следующие записи цепочки,
+ * для которых он лежит между их исходным слотом и текущим - так поиск не упирается в пустой слот раньше времени */
+void ProbeTable::Remove(unsigned int i) noexcept {
+    Entry& entry = entries_[i];
+    if (entry.prev != NIL) {
+        entries_[entry.prev].next = entry.next;
+    } else {
+        head_ = entry.next;
+    }
+    if (entry.next != NIL) {
+        entries_[entry.next].prev = entry.prev;
+    } else {
+        tail_ = entry.prev;
+    }
+    for (unsigned int j = (i + 1) & mask_; entries_[j].ip != 0; j = (j + 1) & mask_) {
+        const Entry& next = entries_[j];
+        unsigned int home = Slot(next.ip, next.id, next.sequence);
+        if (((j - home) & mask_) >= ((j - i) & mask_)) {
+            Move(j, i);
+            i = j;
+        }
+    }
+    entries_[i].ip = 0;
+    --count_;
+}
@@ -0,0 +1,96 @@
+#pragma once
+/*
+ * Таблица запросов в полёте: сопоставление ответа с запросом по адресу, идентификатору и sequence
+ *
+ * Открытая адресация с линейным пробированием в массиве, выделенном один раз под заданное количество запросов
+ * в полёте: вставка, поиск и снятие - O(1) в среднем, на горячем пути память не выделяется и не освобождается.
+ * Массив - степень двойки с заполнением не более 3/4, выровнен по строке кэша; запись занимает 32 байта,
+ * две записи на строку, поэтому цепочка пробирования обычно укладывается в одну-две строки кэша.
+ * Снятие записи - со сдвигом следующих записей цепочки назад (backward shift), без "надгробий":
+ * при долгой работе цепочки не удлиняются.
+ *
+ * Срок ожидания ответа у всех запросов таблицы одинаковый, поэтому порядок истечения совпадает с порядком
+ * вставки: записи связаны в список по времени вставки (индексами слотов), Expire снимает истёкшие записи
+ * с головы списка - O(1) на запись, без просмотра таблицы.
+ *
+ * Время - в любых единицах вызывающей стороны (наносекунды, тики), лишь бы timeout и now были в одних.
+ *
+ * USAGE:
+ * ProbeTable table;
+ * table.Reserve(targets_count, timeout);  // возвращает false, если не хватило памяти
+ * table.Insert(dst_ip, id, sequence, target_index, now);
+ * unsigned int cookie;
+ * if (table.Match(src_ip, id, sequence, &cookie)) { ... ответ на запрос к цели cookie ... }
+ * table.Expire(now, OnExpired, ctx);      // OnExpired вызывается для каждого запроса без ответа
+ */
+#include <netinet/in.h>
+
+class ProbeTable {
+public:
+    static constexpr unsigned int MIN_CAPACITY = 64;
+    static constexpr unsigned int MAX_PROBES = 1u << 30;       // предел запросов в полёте
+    static constexpr unsigned int CACHE_LINE = 64;
+
+    /* Обработчик запроса без ответа, cookie - значение, переданное в Insert */
+    using ExpireHandler = void (*)(void* ctx, unsigned int cookie);
+
+    ProbeTable() noexcept = default;
+    ~ProbeTable();
+
+    /* Выделение таблицы под max_probes запросов в полёте со сроком ожидания ответа timeout
+     * Запросы, которые были в таблице, снимаются без вызова обработчика
+     * возвращает false, если не хватило памяти */
+    bool Reserve(unsigned int max_probes, long long timeout) noexcept;
+
+    /* Добавление запроса к ip (в сетевом порядке байт, не 0) с id и sequence (в том виде, как записаны в запрос)
+     * - cookie - значение вызывающей стороны (например индекс цели), возвращается при ответе и истечении
+     * - now - время отправки
+     * возвращает false, если в полёте уже max_probes запросов либо такой же запрос */
+    bool Insert(in_addr_t ip, unsigned short id, unsigned short sequence, unsigned int cookie, long long now) noexcept;
+
+    /* Поиск и снятие запроса, на который пришёл ответ от ip с id и sequence
+     * - cookie, sent - значение вызывающей стороны и время отправки (если не nullptr)
+     * возвращает false, если такого запроса нет: чужой, повторный или опоздавший ответ */
+    bool Match(in_addr_t ip, unsigned short id, unsigned short sequence,
+               unsigned int* cookie = nullptr, long long* sent = nullptr) noexcept;
+
+    /* Поиск запроса без снятия - проверка, что такой запрос уже в полёте
+     * - cookie - значение вызывающей стороны (если не nullptr) */
+    bool Lookup(in_addr_t ip, unsigned short id, unsigned short sequence, unsigned int* cookie = nullptr) const noexcept;
+
+    /* Снятие запросов, срок ожидания которых истёк к now, с вызовом handler для каждого
+     * Запрос снимается до вызова handler - обработчик может добавлять новые запросы
+     * возвращает количество снятых запросов */
+    unsigned int Expire(long long now, ExpireHandler handler, void* ctx) noexcept;
+
+    /* Количество запросов в полёте */
+    unsigned int GetCount() const noexcept;
+
+private:
+    static constexpr unsigned int NIL = 0xFFFFFFFF;
+
+    struct Entry {
+        long long sent;                     // время отправки
+        in_addr_t ip;                       // 0 - слот свободен
+        unsigned short id;
+        unsigned short sequence;
+        unsigned int cookie;
+        unsigned int prev;                  // соседи в списке по времени вставки (индексы слотов)
+        unsigned int next;
+        unsigned int reserved;
+    };
+    static_assert(sizeof(Entry) * 2 == CACHE_LINE, "two entries per cache line");
+
+    unsigned int Slot(in_addr_t ip, unsigned short id, unsigned short sequence) const noexcept;
+    unsigned int Find(in_addr_t ip, unsigned short id, unsigned short sequence) const noexcept;
+    void Remove(unsigned int i) noexcept;
+    void Move(unsigned int from, unsigned int to) noexcept;
+
+    Entry* entries_ = nullptr;
+    unsigned int mask_ = 0;                 // количество слотов - 1
+    unsigned int max_count_ = 0;
+    unsigned int count_ = 0;
+    long long timeout_ = 0;
+    unsigned int head_ = NIL;               // самый старый запрос
+    unsigned int tail_ = NIL;               // самый новый запрос
+};
@@ -0,0 +1,391 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/ether.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "prober.h"
+#include "utils.h"
+
+Prober::Prober(unsigned int count, unsigned int period_ms, unsigned int timeout_ms, bool hardware) noexcept
+    : count_(count), hardware_(hardware) {
+    id_ = getpid() & 0xFFFF;
+    period_ns_ = (period_ms == 0 ? DEFAULT_PERIOD_MS : period_ms) * 1000000LL;
+    timeout_ns_ = (timeout_ms == 0 ? DEFAULT_TIMEOUT_MS : timeout_ms) * 1000000LL;
+    // слот запроса переиспользуется через WINDOW периодов - ждать ответ дольше нельзя
+    if (timeout_ns_ > period_ns_ * WINDOW) {
+        timeout_ns_ = period_ns_ * WINDOW;
+    }
+}
+
+Prober::~Prober() {
+    for (unsigned int i = 0; i < targets_count_; ++i) {
+        targets_[i]->~Target();
+        free(targets_[i]);
+    }
+}
+
+bool Prober::IsCreated() const noexcept {
+    return ip_proto_.IsCreated();
+}
+
+EthernetProtocol& Prober::GetEthernet() noexcept {
+    return ip_proto_.GetEthernet();
+}
+
+int Prober::CompareTargets(const void* a, const void* b) {
+    in_addr_t lhs = (*(const Target* const*)a)->ip;
+    in_addr_t rhs = (*(const Target* const*)b)->ip;
+    return (lhs < rhs) ? -1 : ((lhs > rhs) ? 1 : 0);
+}
+
+bool Prober::AddTarget(const char* spec) noexcept {
+    in_addr_t first;
+    in_addr_t last;
+    if (!utils::ParseNetwork(spec, MIN_PREFIX_LEN, &first, &last)) {
+        return false;
+    }
+    for (in_addr_t ip = first; ; ++ip) {
+        if (FindTarget(ip) == nullptr) {
+            if (targets_count_ == MAX_TARGETS) {
+                printf("Probe. Error. Too many targets (%u allowed).\n", MAX_TARGETS);
+                return false;
+            }
+            void* mem = malloc(sizeof(Target));
+            if (mem == nullptr) {
+                printf("Probe. Error. Not enough memory for targets.\n");
+                return false;
+            }
+            Target* target = new (mem) Target();
+            target->ip = ip;
+            target->last_rtt = -1;
+            targets_[targets_count_++] = target;
+            // цели хранятся отсортированными - для поиска цели по адресу отправителя ответа
+            qsort(targets_, targets_count_, sizeof(Target*), CompareTargets);
+        }
+        if (ip == last) {
+            break;
+        }
+    }
+    return true;
+}
+
+int Prober::CompareKey(const void* key, const void* target) {
+    in_addr_t lhs = *(const in_addr_t*)key;
+    in_addr_t rhs = (*(const Target* const*)target)->ip;
+    return (lhs < rhs) ? -1 : ((lhs > rhs) ? 1 : 0);
+}
+
+Prober::Target* Prober::FindTarget(in_addr_t ip) noexcept {
+    Target** found = (Target**)bsearch(&ip, targets_, targets_count_, sizeof(Target*), CompareKey);
+    return (found != nullptr) ? *found : nullptr;
+}
+
+/* Приём идёт со всех интерфейсов, шаблон фрейма - для интерфейса маршрута к первой цели, как в Sweeper */
+bool Prober::Prepare() noexcept {
+    Ping::BuildEchoRequest(echo_template_, sizeof(echo_template_), id_, 0);
+    ip_proto_.SetAsyncResolve(true);
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    // без меток ядра RTT считается по часам процесса
+    ether.EnableTimestamps(hardware_);
+    ether.EnableRxRing();
+    ether.EnableTxRing();
+    in_addr_t next_hop;
+    const char* if_name = ip_proto_.GetRouteInterface(htonl(targets_[0]->ip), &next_hop);
+    if (if_name == nullptr) {
+        return false;
+    }
+    strncpy(if_name_, if_name, IFNAMSIZ - 1);
+    const InterfaceTable::Interface* iface = ether.GetInterfaces().FindByName(if_name_);
+    if ((iface == nullptr) || !frame_template_.Init(*iface, IPPROTO_ICMP, echo_template_, sizeof(echo_template_))) {
+        printf("Probe. Error. Can't build frame template for interface %s.\n", if_name_);
+        return false;
+    }
+    return ip_proto_.SetReplyFilter(id_) && ether.BindAllInterfaces();
+}
+
+/* Очередной запрос всем целям: все запросы периода уходят одним системным вызовом,
+ * время возврата из него - запасная метка отправки */
+bool Prober::OnTick() noexcept {
+    if (next_sequence_ >= count_) {
+        return true;
+    }
+    const unsigned short sequence = next_sequence_ & 0xFFFF;
+    Probe* queued[MAX_TARGETS];
+    unsigned int queued_count = 0;
+    for (unsigned int i = 0; i < targets_count_; ++i) {
+        Target* target = targets_[i];
+        if (!Ping::QueueEchoRequest(ip_proto_, frame_template_, echo_template_, sizeof(echo_template_),
+                                    htonl(target->ip), htons(sequence))) {
+            if (errno == ENETUNREACH) {
+                // маршрута нет - запрос считается потерянным
+                ++target->sent;
+                continue;
+            }
+            return false;
+        }
+        Probe& probe = target->probes[sequence % WINDOW];
+        if (probe.pending) {
+            // ответа на запрос, занимавший место в окне, уже не будет
+            ip_proto_.GetEthernet().GetMetrics().Add(Metrics::TIMEOUTS);
+            --pending_;
+        }
+        memset(&probe, 0, sizeof(probe));
+        probe.sequence = sequence;
+        probe.pending = true;
+        ++pending_;
+        ++target->sent;
+        queued[queued_count++] = &probe;
+    }
+    if ((queued_count > 0) && (ip_proto_.FlushRequests() < 0)) {
+        return false;
+    }
+    long long now = utils::RealtimeNs();
+    for (unsigned int i = 0; i < queued_count; ++i) {
+        queued[i]->tx_user = now;
+    }
+    if (++next_sequence_ == count_) {
+        deadline_ = utils::MonotonicNs() + timeout_ns_;
+    }
+    return ip_proto_.GetEthernet().RcvTxTimestamps(HandleTxTimestamp, this, RCV_BATCH) >= 0;
+}
+
+/* Всё отправлено и либо ответы получены, либо истекло ожидание после последней отправки */
+bool Prober::IsFinished() const noexcept {
+    return (next_sequence_ >= count_) && ((pending_ == 0) || (utils::MonotonicNs() >= deadline_));
+}
+
+/* Метка отправки: копия фрейма разбирается, метка записывается в запрос цели */
+void Prober::HandleTxTimestamp(void* ctx, const unsigned char* frame, int len, const EthernetProtocol::Timestamp& ts) {
+    Prober* self = (Prober*)ctx;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        return;
+    }
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP) || (icmp_len < (int)sizeof(struct icmphdr))) {
+        return;
+    }
+    const struct icmphdr* icmp_h = (const struct icmphdr*)icmp_data;
+    if ((icmp_h->type != ICMP_ECHO) || (icmp_h->un.echo.id != self->id_)) {
+        return;
+    }
+    Target* target = self->FindTarget(ntohl(ip_h->daddr));
+    if (target == nullptr) {
+        return;
+    }
+    unsigned short sequence = ntohs(icmp_h->un.echo.sequence);
+    Probe& probe = target->probes[sequence % WINDOW];
+    if (probe.pending && (probe.sequence == sequence)) {
+        probe.tx = ts;
+    }
+}
+
+void Prober::HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    Prober* self = (Prober*)ctx;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        // ARP ответы на асинхронные запросы пополняют кэш соседей
+        in_addr_t sender_ip;
+        const unsigned char* sender_mac;
+        self->ip_proto_.GetArp().HandlePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &sender_ip, &sender_mac);
+        return;
+    }
+    Metrics& metrics = self->ip_proto_.GetEthernet().GetMetrics();
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP) || !self->ip_proto_.IsLocalAddress(ip_h->daddr)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if ((icmp_h == nullptr) || (icmp_h->un.echo.id != self->id_)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+
+    self->OnReply(ip_h->saddr, ntohs(icmp_h->un.echo.sequence), eth_h->ether_shost);
+}
+
+/* Ответ цели ip (в сетевом порядке байт) на запрос sequence
+ * RTT - по аппаратным меткам, если они есть с обеих сторон, иначе по программным меткам ядра,
+ * иначе по часам процесса. Метки разных часов не смешиваются */
+void Prober::OnReply(in_addr_t ip, unsigned short sequence, const unsigned char* mac) noexcept {
+    Metrics& metrics = ip_proto_.GetEthernet().GetMetrics();
+    Target* target = FindTarget(ntohl(ip));
+    if (target == nullptr) {
+        metrics.Add(Metrics::UNMATCHED);
+        return;
+    }
+    Probe& probe = target->probes[sequence % WINDOW];
+    if (!probe.pending || (probe.sequence != sequence)) {
+        metrics.Add(Metrics::UNMATCHED);
+        ++target->late;
+        return;
+    }
+    probe.pending = false;
+    --pending_;
+
+    const EthernetProtocol::Timestamp& rx = ip_proto_.GetEthernet().GetRxTimestamp();
+    long long rtt;
+    if ((probe.tx.hardware != 0) && (rx.hardware != 0)) {
+        rtt = rx.hardware - probe.tx.hardware;
+        ++target->hardware_samples;
+    } else if ((probe.tx.software != 0) && (rx.software != 0)) {
+        rtt = rx.software - probe.tx.software;
+        ++target->kernel_samples;
+    } else {
+        rtt = ((rx.software != 0) ? rx.software : utils::RealtimeNs()) - probe.tx_user;
+    }
+    if (rtt < 0) {
+        rtt = 0;
+    }
+    if (rtt > timeout_ns_) {
+        metrics.Add(Metrics::TIMEOUTS);
+        ++target->late;
+        return;
+    }
+    metrics.Add(Metrics::REPLIES);
+
+    ++target->received;
+    target->rtt.Record(rtt);
+    if (target->last_rtt >= 0) {
+        long long delta = (rtt > target->last_rtt) ? rtt - target->last_rtt : target->last_rtt - rtt;
+        target->jitter += (delta - target->jitter) / 16;
+    }
+    target->last_rtt = rtt;
+    memcpy(target->mac, mac, ETH_ALEN);
+
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip, addr, sizeof(addr));
+    printf("%s seq=%u rtt=%.3f us\n", addr, sequence, rtt / 1000.0);
+}
+
+/* Итоги цели одной строкой: потери, RTT по гистограмме, джиттер и источник меток времени */
+void Prober::PrintSummary(const Target& target) const noexcept {
+    char addr[INET_ADDRSTRLEN];
+    in_addr_t ip = htonl(target.ip);
+    inet_ntop(AF_INET, &ip, addr, sizeof(addr));
+    double loss = (target.sent == 0) ? 0.0 : 100.0 * (target.sent - target.received) / target.sent;
+    if (target.received == 0) {
+        printf("%s sent=%u received=0 loss=%.1f%%\n", addr, target.sent, loss);
+        return;
+    }
+    const unsigned char* hw = target.mac;
+    const char* source = "user";
+    if (target.hardware_samples == target.received) {
+        source = "hardware";
+    } else if (target.kernel_samples == target.received) {
+        source = "kernel";
+    } else if (target.hardware_samples + target.kernel_samples > 0) {
+        source = "mixed";
+    }
+    const Histogram& rtt = target.rtt;
+    printf("%s %02x:%02x:%02x:%02x:%02x:%02x sent=%u received=%u loss=%.1f%% late=%u "
+           "min=%.3f avg=%.3f max=%.3f p50=%.3f p99=%.3f p999=%.3f jitter=%.3f us timestamps=%s\n",
+           addr, hw[0], hw[1], hw[2], hw[3], hw[4], hw[5], target.sent, target.received, loss, target.late,
+           rtt.GetMin() / 1000.0, rtt.GetMean() / 1000.0, rtt.GetMax() / 1000.0,
+           rtt.GetPercentile(50.0) / 1000.0, rtt.GetPercentile(99.0) / 1000.0,
+           rtt.GetPercentile(99.9) / 1000.0, target.jitter / 1000.0, source);
+}
+
+int Prober::Run() noexcept {
+    if (!IsCreated()) {
+        return -1;
+    }
+    if (targets_count_ == 0) {
+        printf("Probe. Error. No targets.\n");
+        return -1;
+    }
+    if (!Prepare()) {
+        return -1;
+    }
+
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        printf("Probe. Error. Can't create epoll.\n");
+        return -1;
+    }
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        printf("Probe. Error. Can't create timer.\n");
+        close(epoll_fd);
+        return -1;
+    }
+    // первый запрос - сразу, ожидание после последнего ограничивает тот же таймер
+    struct itimerspec timer_spec{};
+    timer_spec.it_interval.tv_sec = period_ns_ / 1000000000LL;
+    timer_spec.it_interval.tv_nsec = period_ns_ % 1000000000LL;
+    timer_spec.it_value.tv_nsec = 1;
+    timerfd_settime(timer_fd, 0, &timer_spec, nullptr);
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = ether.GetSocket();
+    bool ok = (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ether.GetSocket(), &ev) == 0);
+    ev.data.fd = timer_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == 0);
+    if (!ok) {
+        printf("Probe. Error. Can't configure epoll.\n");
+    }
+
+    while (ok && !IsFinished()) {
+        struct epoll_event events[2];
+        int timeout_ms = -1;
+        if (next_sequence_ >= count_) {
+            long long left = deadline_ - utils::MonotonicNs();
+            timeout_ms = (left > 0) ? (int)((left + 999999) / 1000000) : 0;
+        }
+        int n = epoll_wait(epoll_fd, events, 2, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Probe. Error. epoll_wait failed.\n");
+            ok = false;
+            break;
+        }
+        for (int i = 0; (i < n) && ok; ++i) {
+            if (events[i].data.fd == timer_fd) {
+                unsigned long long expirations = 0;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    ok = OnTick();
+                }
+            } else {
+                // метки отправки разбираются раньше ответов - к ответу метка запроса уже известна
+                ok = (ether.RcvTxTimestamps(HandleTxTimestamp, this, RCV_BATCH) >= 0) &&
+                     (ether.RcvFrames(HandleFrame, this, RCV_BATCH) >= 0);
+            }
+        }
+    }
+    close(timer_fd);
+    close(epoll_fd);
+    if (!ok) {
+        return -1;
+    }
+    ether.GetMetrics().Add(Metrics::TIMEOUTS, pending_);
+
+    int replied = 0;
+    for (unsigned int i = 0; i < targets_count_; ++i) {
+        PrintSummary(*targets_[i]);
+        if (targets_[i]->received > 0) {
+            ++replied;
+        }
+    }
+    return replied;
+}
@@ -0,0 +1,104 @@
+#pragma once
+/*
+ * Класс измерения задержки (RTT), потерь и джиттера для нескольких IPv4 адресов
+ *
+ * Каждой цели отправляется count ICMP echo request с растущим sequence, по одному раз в период, не дожидаясь
+ * ответов на предыдущие (конвейер): в полёте одновременно до WINDOW запросов на цель. Ответ сопоставляется
+ * с запросом по адресу отправителя и sequence, ответ позже timeout (или повторный) считается опоздавшим.
+ *
+ * Задержка считается по меткам времени ядра (SO_TIMESTAMPING), а не по чтению часов вокруг системных вызовов:
+ * - метка отправки - момент передачи фрейма драйверу (приходит в очередь ошибок сокета с копией фрейма)
+ * - метка приёма - момент приёма фрейма ядром (из кольца приёма)
+ * Если обе стороны имеют аппаратную метку (--hwts и поддержка сетевой картой), используются аппаратные метки.
+ * Если метки отправки нет, используется время возврата из системного вызова отправки.
+ *
+ * Результаты цели копятся в гистограмме фиксированного размера (Histogram): минимум, среднее, максимум,
+ * p50/p99/p99.9, джиттер - сглаженное изменение RTT между соседними ответами (RFC 3550).
+ *
+ * USAGE:
+ * Prober prober(count, period_ms, timeout_ms, hardware); // если успешно создан, то IsCreated вернёт true
+ * prober.AddTarget("192.168.1.1");
+ * prober.Run(); // выведет RTT каждого ответа и итоги по каждой цели
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+#include "histogram.h"
+#include "icmp.h"
+
+class Prober {
+public:
+    static constexpr unsigned int DEFAULT_PERIOD_MS = 1000;     // период отправки запросов
+    static constexpr unsigned int DEFAULT_TIMEOUT_MS = 1000;    // ожидание ответа на запрос
+    static constexpr unsigned int MAX_TARGETS = 64;
+    static constexpr unsigned int WINDOW = 1024;                // максимум запросов в полёте на цель
+    static constexpr int RCV_BATCH = 1024;                      // максимум фреймов за одно пробуждение
+    static constexpr int MIN_PREFIX_LEN = 26;                   // самая большая допустимая сеть /26
+
+    Prober(unsigned int count, unsigned int period_ms, unsigned int timeout_ms, bool hardware) noexcept;
+    ~Prober();
+
+    bool IsCreated() const noexcept;
+
+    /* Ethernet уровень - для подключения приёмника копий принятых фреймов (SetFrameSink) */
+    EthernetProtocol& GetEthernet() noexcept;
+
+    /* Добавление цели: IPv4 адрес (a.b.c.d) либо небольшая сеть (a.b.c.d/n), не более MAX_TARGETS целей
+     * возвращает false при некорректной записи */
+    bool AddTarget(const char* spec) noexcept;
+
+    /* Выполнение измерения
+     * возвращает количество ответивших целей, либо -1 при неудаче */
+    int Run() noexcept;
+
+private:
+    /* Запрос в полёте */
+    struct Probe {
+        long long tx_user;                  // время возврата из отправки (CLOCK_REALTIME)
+        EthernetProtocol::Timestamp tx;     // метка отправки ядра
+        unsigned short sequence;            // в порядке байт хоста
+        bool pending;                       // ответа ещё не было
+    };
+
+    struct Target {
+        in_addr_t ip;                       // в порядке байт хоста
+        unsigned int sent;
+        unsigned int received;
+        unsigned int late;                  // ответы после timeout и повторные ответы
+        unsigned int hardware_samples;      // RTT по аппаратным меткам
+        unsigned int kernel_samples;        // RTT по программным меткам ядра
+        long long last_rtt;                 // предыдущий RTT (для джиттера), -1 - ещё не было
+        long long jitter;                   // сглаженный джиттер (нс)
+        unsigned char mac[ETH_ALEN];
+        Probe probes[WINDOW];               // индекс - sequence % WINDOW
+        Histogram rtt;
+    };
+
+    static int CompareTargets(const void* a, const void* b);
+    static int CompareKey(const void* key, const void* target);
+    Target* FindTarget(in_addr_t ip) noexcept;
+    bool Prepare() noexcept;
+    bool OnTick() noexcept;
+    bool IsFinished() const noexcept;
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len);
+    static void HandleTxTimestamp(void* ctx, const unsigned char* frame, int len, const EthernetProtocol::Timestamp& ts);
+    void OnReply(in_addr_t ip, unsigned short sequence, const unsigned char* mac) noexcept;
+    void PrintSummary(const Target& target) const noexcept;
+
+    IPProtocol ip_proto_;
+    unsigned int count_;
+    long long period_ns_;
+    long long timeout_ns_;
+    bool hardware_;
+    unsigned short id_;
+
+    Target* targets_[MAX_TARGETS] = {};
+    unsigned int targets_count_ = 0;
+
+    unsigned char echo_template_[Ping::PING_PKT_SIZE];  // echo request, в котором меняется только sequence
+    FrameTemplate frame_template_;          // фрейм echo request для интерфейса if_name_
+    char if_name_[IFNAMSIZ] = {};           // интерфейс шаблона фрейма (по маршруту к первой цели)
+    unsigned int next_sequence_ = 0;        // sequence следующего запроса (общий для всех целей)
+    long long deadline_ = 0;                // окончание ожидания ответов после последней отправки (monotonic)
+    unsigned int pending_ = 0;              // запросов в полёте
+};
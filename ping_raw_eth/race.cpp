@@ -0,0 +1,206 @@
+#include <errno.h>
+#include <netinet/ether.h>
+#include <new>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "race.h"
+#include "utils.h"
+
+/* Полоса: сокет, фильтр и кэш соседей одного интерфейса */
+struct InterfaceRace::Lane {
+    EthernetProtocol ether;
+    ArpResolver arp{ether};
+    InterfaceTable::Interface iface;
+};
+
+/*
+ * При создании объекта:
+ * - по таблице интерфейсов считаем рабочие интерфейсы (как EthernetProtocol::GetInterfaceName)
+ * - на каждый заводим полосу: сокет привязывается к интерфейсу, фильтр пропускает ICMP echo reply с нашим
+ *   идентификатором и ARP на адрес интерфейса
+ */
+InterfaceRace::InterfaceRace() noexcept {
+    if (!ifaces_.IsCreated()) {
+        return;
+    }
+    id_ = getpid() & 0xFFFF;
+    int count = 0;
+    for (int i = 0; i < ifaces_.GetCount(); ++i) {
+        const InterfaceTable::Interface* iface = ifaces_.Get(i);
+        if ((iface->flags & IFF_UP) && !(iface->flags & IFF_LOOPBACK) && (iface->ip != 0)) {
+            ++count;
+        }
+    }
+    if (count == 0) {
+        printf("Race. Error. No working interfaces.\n");
+        return;
+    }
+    lanes_ = (Lane*)malloc(sizeof(Lane) * count);
+    pfds_ = (struct pollfd*)malloc(sizeof(struct pollfd) * count);
+    if ((lanes_ == nullptr) || (pfds_ == nullptr)) {
+        printf("Race. Error. Not enough memory.\n");
+        return;
+    }
+    for (int i = 0; i < ifaces_.GetCount(); ++i) {
+        const InterfaceTable::Interface* iface = ifaces_.Get(i);
+        if (!(iface->flags & IFF_UP) || (iface->flags & IFF_LOOPBACK) || (iface->ip == 0)) {
+            continue;
+        }
+        Lane* lane = new (&lanes_[lanes_count_]) Lane();
+        ++lanes_count_;
+        lane->iface = *iface;
+        if (!lane->ether.IsCreated()) {
+            return;
+        }
+        ReplyFilter filter(iface->ip, id_, true);
+        if (!lane->ether.AttachFilter(filter.GetProgram()) || !lane->ether.BindInterface(iface->name)) {
+            return;
+        }
+    }
+    created_ = true;
+}
+
+InterfaceRace::~InterfaceRace() {
+    for (int i = 0; i < lanes_count_; ++i) {
+        lanes_[i].~Lane();
+    }
+    free(lanes_);
+    free(pfds_);
+}
+
+bool InterfaceRace::IsCreated() const noexcept {
+    return created_;
+}
+
+int InterfaceRace::GetLaneCount() const noexcept {
+    return lanes_count_;
+}
+
+EthernetProtocol& InterfaceRace::GetEthernet(int idx) noexcept {
+    return lanes_[idx].ether;
+}
+
+/* Запросы со всех полос уходят до начала ожидания, далее сокеты вычитываются по готовности,
+ * пока первый корректный ответ не завершит раунд */
+int InterfaceRace::Run(in_addr_t ip, unsigned short sequence, Result* result) noexcept {
+    if (!created_) {
+        return -1;
+    }
+    target_ = ip;
+    sequence_ = sequence;
+    result_ = result;
+    done_ = false;
+    sent_ns_ = utils::RealtimeNs();
+    int sent = 0;
+    for (int i = 0; i < lanes_count_; ++i) {
+        pfds_[i].fd = lanes_[i].ether.GetSocket();
+        pfds_[i].events = POLLIN;
+        pfds_[i].revents = 0;
+        if (Send(lanes_[i], ip, sequence)) {
+            ++sent;
+        } else {
+            printf("Race. Error. Request via %s not sent. %s\n", lanes_[i].iface.name, strerror(errno));
+        }
+    }
+    if (sent == 0) {
+        return -1;
+    }
+
+    long long deadline = utils::MonotonicNs() + TIMEOUT_MS * 1000000LL;
+    for (;;) {
+        long long left_ns = deadline - utils::MonotonicNs();
+        if (left_ns <= 0) {
+            return 1;
+        }
+        int res = poll(pfds_, lanes_count_, (int)((left_ns + 999999) / 1000000));
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Race. Error. Poll failed. %s\n", strerror(errno));
+            return -1;
+        }
+        for (int i = 0; (i < lanes_count_) && (res > 0); ++i) {
+            if (pfds_[i].revents == 0) {
+                continue;
+            }
+            current_ = &lanes_[i];
+            if (lanes_[i].ether.RcvFrames(HandleFrame, this, RCV_BATCH) < 0) {
+                return -1;
+            }
+            if (done_) {
+                return 0;
+            }
+        }
+    }
+}
+
+/* Echo request уходит на известный MAC адрес соседа, иначе широковещательным фреймом.
+ * Для адреса из сети интерфейса вместе с ним в той же пачке уходит ARP запрос */
+bool InterfaceRace::Send(Lane& lane, in_addr_t ip, unsigned short sequence) noexcept {
+    unsigned char echo[Ping::PING_PKT_SIZE];
+    Ping::BuildEchoRequest(echo, sizeof(echo), id_, sequence);
+    FrameTemplate tmpl;
+    if (!tmpl.Init(lane.iface, IPPROTO_ICMP, echo, sizeof(echo))) {
+        errno = EINVAL;
+        return false;
+    }
+    unsigned char mac[ETH_ALEN];
+    bool known = false;
+    in_addr_t mask = (lane.iface.prefix_len == 0) ? 0 : htonl(~(0xFFFFFFFFu >> lane.iface.prefix_len));
+    if (((ip ^ lane.iface.ip) & mask) == 0) {
+        known = lane.arp.LookupOrQueue(ip, lane.iface.name, mac);
+    }
+    unsigned char* slot = lane.ether.ReserveFrame(lane.iface.index);
+    if (slot == nullptr) {
+        return false;
+    }
+    tmpl.Write(slot, ip, known ? mac : nullptr);
+    lane.ether.CommitFrame(tmpl.GetLength());
+    return lane.ether.FlushRequests() >= 0;
+}
+
+/* Разбор фрейма полосы current_: ARP пакет от адреса цели либо echo reply от цели на запрос текущего раунда */
+void InterfaceRace::HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    InterfaceRace* self = (InterfaceRace*)ctx;
+    if (self->done_) {
+        return;
+    }
+    Lane* lane = self->current_;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        in_addr_t sender_ip;
+        const unsigned char* sender_mac;
+        if (lane->arp.HandlePacket(frame + ETH_HLEN, len - ETH_HLEN, &sender_ip, &sender_mac) &&
+            (sender_ip == self->target_)) {
+            self->Finish(*lane, sender_mac, true);
+        }
+        return;
+    }
+    if (eth_h->ether_type != htons(ETH_P_IP)) {
+        return;
+    }
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + ETH_HLEN, len - ETH_HLEN, &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP) || (ip_h->saddr != self->target_)) {
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if ((icmp_h != nullptr) && (icmp_h->un.echo.id == self->id_) && (icmp_h->un.echo.sequence == self->sequence_)) {
+        self->Finish(*lane, eth_h->ether_shost, false);
+    }
+}
+
+void InterfaceRace::Finish(const Lane& lane, const unsigned char* mac, bool arp) noexcept {
+    long long rx_ns = lane.ether.GetRxTimestamp().software;
+    strncpy(result_->if_name, lane.iface.name, IFNAMSIZ);
+    memcpy(result_->mac, mac, ETH_ALEN);
+    result_->arp = arp;
+    result_->rtt_ns = ((rx_ns != 0) ? rx_ns : utils::RealtimeNs()) - sent_ns_;
+    done_ = true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+/*
+ * Класс одновременного опроса IPv4 адреса через все рабочие интерфейсы: побеждает первый ответ
+ *
+ * На многодомном хосте маршрут может вести не в тот сегмент, а перебор интерфейсов по одному стоит
+ * таймаут ответа на каждый интерфейс. Здесь на каждый рабочий интерфейс (поднят, не loopback, есть IPv4 адрес)
+ * заводится своя полоса: свой AF_PACKET сокет, привязанный к интерфейсу, со своим BPF фильтром и кэшем соседей.
+ * Запросы уходят со всех интерфейсов сразу, ответы ждутся одним poll по сокетам всех полос:
+ * - ICMP echo request широковещательным фреймом, адрес источника - адрес интерфейса
+ * - ARP запрос, если адрес входит в сеть интерфейса
+ * Первый корректный ответ (echo reply от адреса с нашими идентификатором и sequence, либо ARP ответ от адреса)
+ * определяет MAC адрес и интерфейс. Время разрешения в худшем случае - один RTT ответившего сегмента,
+ * а не количество интерфейсов, умноженное на таймаут.
+ *
+ * USAGE:
+ * InterfaceRace race;  // если успешно создан, то IsCreated вернёт true
+ * InterfaceRace::Result result;
+ * if (race.Run(inet_addr("192.168.1.1"), htons(1), &result) == 0) { ... result.if_name, result.mac ... }
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+#include "icmp.h"
+
+class InterfaceRace {
+public:
+    static constexpr unsigned int TIMEOUT_MS = 1000;    // ожидание первого ответа в одном раунде
+    static constexpr int RCV_BATCH = 64;                // максимум фреймов полосы за одно пробуждение
+
+    /* Победивший ответ */
+    struct Result {
+        char if_name[IFNAMSIZ];             // интерфейс, на который пришёл ответ
+        unsigned char mac[ETH_ALEN];
+        bool arp;                           // ответ - ARP (иначе ICMP echo reply)
+        long long rtt_ns;
+    };
+
+    InterfaceRace() noexcept;
+    ~InterfaceRace();
+
+    bool IsCreated() const noexcept;
+
+    /* Количество полос (рабочих интерфейсов) */
+    int GetLaneCount() const noexcept;
+
+    /* Ethernet уровень полосы - для подключения io_uring и приёмника копий принятых фреймов */
+    EthernetProtocol& GetEthernet(int idx) noexcept;
+
+    /* Один раунд: запросы со всех интерфейсов и ожидание первого ответа не дольше TIMEOUT_MS
+     * - ip, sequence - адрес и sequence echo request (в сетевом порядке байт)
+     * возвращает:
+     * - 0 - получен ответ, result заполнен
+     * - 1 - ответа нет, имеет смысл повторить
+     * - -1 - запрос не отправлен ни с одного интерфейса, либо ошибка приёма */
+    int Run(in_addr_t ip, unsigned short sequence, Result* result) noexcept;
+
+private:
+    struct Lane;
+
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len);
+    bool Send(Lane& lane, in_addr_t ip, unsigned short sequence) noexcept;
+    void Finish(const Lane& lane, const unsigned char* mac, bool arp) noexcept;
+
+    bool created_ = false;
+    InterfaceTable ifaces_;
+    Lane* lanes_ = nullptr;
+    struct pollfd* pfds_ = nullptr;
+    int lanes_count_ = 0;
+    unsigned short id_ = 0;                 // идентификатор echo запросов (в том виде, как записан в запрос)
+
+    // состояние текущего раунда
+    in_addr_t target_ = 0;
+    unsigned short sequence_ = 0;
+    long long sent_ns_ = 0;
+    Lane* current_ = nullptr;               // полоса, фреймы которой разбираются
+    Result* result_ = nullptr;
+    bool done_ = false;
+};
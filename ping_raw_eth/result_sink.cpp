@@ -0,0 +1,195 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "result_sink.h"
+
+/* Кольцо канала. Индексы производителя и потока записи - в разных строках кэша,
+ * чтобы запись одного не сбрасывала строку другого */
+struct ResultSink::Channel {
+    ResultSink::Record* records;
+    alignas(64) unsigned int head;          // следующая запись производителя, меняется только атомарно
+    unsigned long long stalls;              // ожидания свободного места, меняется только производителем
+    alignas(64) unsigned int tail;          // следующая запись потока записи, меняется только атомарно
+};
+
+ResultSink::ResultSink(Format format, int fd, unsigned int channels) noexcept : format_(format), fd_(fd) {
+    channels_ = (Channel*)aligned_alloc(alignof(Channel), sizeof(Channel) * channels);
+    buf_ = (char*)malloc(WRITE_BUF_SIZE);
+    if ((channels_ == nullptr) || (buf_ == nullptr)) {
+        printf("Results. Error. Not enough memory.\n");
+        return;
+    }
+    memset(channels_, 0, sizeof(Channel) * channels);
+    for (; channels_count_ < channels; ++channels_count_) {
+        channels_[channels_count_].records = (Record*)malloc(sizeof(Record) * RING_SIZE);
+        if (channels_[channels_count_].records == nullptr) {
+            printf("Results. Error. Not enough memory.\n");
+            return;
+        }
+    }
+}
+
+ResultSink::~ResultSink() {
+    Stop();
+    if (channels_ != nullptr) {
+        for (unsigned int i = 0; i < channels_count_; ++i) {
+            free(channels_[i].records);
+        }
+        free(channels_);
+    }
+    free(buf_);
+}
+
+bool ResultSink::IsCreated() const noexcept {
+    return (buf_ != nullptr) && (channels_ != nullptr) && (channels_count_ > 0) &&
+           (channels_[channels_count_ - 1].records != nullptr);
+}
+
+bool ResultSink::ParseFormat(const char* name, Format* format) noexcept {
+    if (strcmp(name, "text") == 0) {
+        *format = Format::TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        *format = Format::JSON;
+    } else if (strcmp(name, "binary") == 0) {
+        *format = Format::BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ResultSink::Start() noexcept {
+    if (started_) {
+        return true;
+    }
+    int err = pthread_create(&thread_, nullptr, WriterMain, this);
+    if (err != 0) {
+        printf("Results. Error. Can't start writer thread. %s\n", strerror(err));
+        return false;
+    }
+    started_ = true;
+    return true;
+}
+
+/* Запись кладётся в слот и только затем публикуется продвижением головы (release):
+ * поток записи, увидевший новую голову (acquire), видит и содержимое слота */
+void ResultSink::Push(unsigned int channel, const Record& record) noexcept {
+    Channel& ch = channels_[channel];
+    unsigned int head = ch.head;
+    while (head - __atomic_load_n(&ch.tail, __ATOMIC_ACQUIRE) >= RING_SIZE) {
+        ++ch.stalls;
+        sched_yield();
+    }
+    ch.records[head & (RING_SIZE - 1)] = record;
+    __atomic_store_n(&ch.head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool ResultSink::Stop() noexcept {
+    if (started_) {
+        __atomic_store_n(&stop_, true, __ATOMIC_RELEASE);
+        pthread_join(thread_, nullptr);
+        started_ = false;
+    }
+    return !write_failed_;
+}
+
+unsigned long long ResultSink::GetWritten() const noexcept {
+    return written_;
+}
+
+unsigned long long ResultSink::GetStalls() const noexcept {
+    unsigned long long stalls = 0;
+    for (unsigned int i = 0; i < channels_count_; ++i) {
+        stalls += channels_[i].stalls;
+    }
+    return stalls;
+}
+
+void* ResultSink::WriterMain(void* arg) {
+    ((ResultSink*)arg)->WriterLoop();
+    return nullptr;
+}
+
+/* Признак остановки читается до обхода колец: после остановки выполняется ещё один полный обход,
+ * поэтому записи, опубликованные до Stop, не теряются. Буфер отдаётся, когда заполнен или когда новых записей нет */
+void ResultSink::WriterLoop() noexcept {
+    for (;;) {
+        bool stopping = __atomic_load_n(&stop_, __ATOMIC_ACQUIRE);
+        unsigned int taken = 0;
+        for (unsigned int i = 0; i < channels_count_; ++i) {
+            Channel& ch = channels_[i];
+            unsigned int head = __atomic_load_n(&ch.head, __ATOMIC_ACQUIRE);
+            unsigned int tail = ch.tail;
+            for (; tail != head; ++tail) {
+                Append(ch.records[tail & (RING_SIZE - 1)]);
+                ++taken;
+            }
+            __atomic_store_n(&ch.tail, tail, __ATOMIC_RELEASE);
+        }
+        written_ += taken;
+        if (taken > 0) {
+            continue;
+        }
+        Flush();
+        if (stopping) {
+            return;
+        }
+        struct timespec ts{0, IDLE_SLEEP_NS};
+        nanosleep(&ts, nullptr);
+    }
+}
+
+void ResultSink::Append(const Record& record) noexcept {
+    if (buf_len_ + ((format_ == Format::BINARY) ? sizeof(Record) : MAX_RECORD_TEXT) > WRITE_BUF_SIZE) {
+        Flush();
+    }
+    if (format_ == Format::BINARY) {
+        memcpy(buf_ + buf_len_, &record, sizeof(Record));
+        buf_len_ += sizeof(Record);
+        return;
+    }
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &record.ip, addr, sizeof(addr));
+    const unsigned char* hw = record.mac;
+    int len;
+    if (format_ == Format::TEXT) {
+        len = snprintf(buf_ + buf_len_, MAX_RECORD_TEXT, "%s %02x:%02x:%02x:%02x:%02x:%02x\n",
+                       addr, hw[0], hw[1], hw[2], hw[3], hw[4], hw[5]);
+    } else {
+        // неизвестный RTT - null
+        char rtt[32] = "null";
+        if (record.rtt_ns >= 0) {
+            snprintf(rtt, sizeof(rtt), "%.3f", record.rtt_ns / 1e3);
+        }
+        len = snprintf(buf_ + buf_len_, MAX_RECORD_TEXT,
+                       "{\"ip\":\"%s\",\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"if\":\"%.*s\",\"rtt_us\":%s,\"ts\":%lld}\n",
+                       addr, hw[0], hw[1], hw[2], hw[3], hw[4], hw[5], IFNAMSIZ, record.if_name, rtt, record.ts_ns);
+    }
+    if (len > 0) {
+        buf_len_ += ((unsigned int)len < MAX_RECORD_TEXT) ? len : MAX_RECORD_TEXT - 1;
+    }
+}
+
+/* После ошибки записи вывод отбрасывается: ошибка выводится один раз, итог - в Stop */
+void ResultSink::Flush() noexcept {
+    unsigned int done = 0;
+    while ((done < buf_len_) && !write_failed_) {
+        ssize_t res = write(fd_, buf_ + done, buf_len_ - done);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Results. Error writing results. %s\n", strerror(errno));
+            write_failed_ = true;
+            break;
+        }
+        done += res;
+    }
+    buf_len_ = 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+/*
+ * Вывод результатов опроса через отдельный поток записи
+ *
+ * Поток приёма не форматирует строки и не делает системных вызовов на каждый ответ: он кладёт запись
+ * фиксированного размера (Record) в своё кольцо - канал с одним писателем и одним читателем (SPSC),
+ * без блокировок, только атомарные индексы головы и хвоста. Поток записи обходит кольца всех каналов,
+ * форматирует записи в буфер WRITE_BUF_SIZE и отдаёт его одним write: при высокой скорости ответов - большими
+ * порциями, в простое - не позже IDLE_SLEEP_NS после последнего ответа.
+ * Если кольцо канала заполнено, поток приёма ждёт освобождения места (записи не теряются),
+ * такие ожидания подсчитываются.
+ *
+ * Форматы:
+ * - TEXT - строка "<IPv4> <MAC>", как при выводе через printf
+ * - JSON - JSON Lines: {"ip":"<IPv4>","mac":"<MAC>","if":"<интерфейс>","rtt_us":<RTT>,"ts":<наносекунды>}
+ * - BINARY - записи Record как есть, по 48 байт, порядок байт хоста, IPv4 - в сетевом порядке байт
+ *
+ * USAGE:
+ * ResultSink sink(ResultSink::Format::JSON, STDOUT_FILENO, workers); // если успешно создан, то IsCreated вернёт true
+ * sink.Start();
+ * sink.Push(worker_index, record);   // из потока worker_index
+ * sink.Stop();                       // после завершения потоков приёма: дописывает остаток
+ */
+#include <linux/if.h>
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+class ResultSink {
+public:
+    static constexpr unsigned int RING_SIZE = 4096;            // записей в кольце канала (степень двойки)
+    static constexpr unsigned int WRITE_BUF_SIZE = 64 * 1024;   // буфер форматированного вывода
+    static constexpr long IDLE_SLEEP_NS = 1000000;             // сон потока записи, когда кольца пусты (1 мс)
+    static constexpr unsigned int MAX_RECORD_TEXT = 160;        // максимальная длина записи в текстовых форматах
+
+    enum class Format : unsigned char {
+        TEXT = 0,
+        JSON,
+        BINARY
+    };
+
+    /* Результат одной цели, он же запись двоичного формата */
+    struct Record {
+        long long ts_ns;                    // время приёма ответа (CLOCK_REALTIME)
+        long long rtt_ns;                   // -1 - неизвестно
+        in_addr_t ip;                       // в сетевом порядке байт
+        unsigned char mac[ETH_ALEN];
+        unsigned char reserved[6];
+        char if_name[IFNAMSIZ];             // интерфейс приёма
+    };
+    static_assert(sizeof(Record) == 48, "binary record layout");
+
+    /* - format - формат вывода
+     * - fd - дескриптор вывода, закрывается вызывающей стороной
+     * - channels - количество каналов (потоков приёма) */
+    ResultSink(Format format, int fd, unsigned int channels) noexcept;
+    ~ResultSink();
+
+    bool IsCreated() const noexcept;
+
+    /* Разбор имени формата: text, json, binary. Возвращает false при неизвестном имени */
+    static bool ParseFormat(const char* name, Format* format) noexcept;
+
+    /* Запуск потока записи, возвращает true при успехе */
+    bool Start() noexcept;
+
+    /* Передача записи в канал channel, вызывается только из потока - владельца канала
+     * Если кольцо заполнено, ждёт, пока поток записи освободит место */
+    void Push(unsigned int channel, const Record& record) noexcept;
+
+    /* Остановка потока записи после того, как все каналы вычитаны, и запись остатка буфера
+     * Вызывается после завершения всех потоков приёма. Возвращает false, если были ошибки записи */
+    bool Stop() noexcept;
+
+    /* Итоги: записано записей, ожиданий свободного места в кольцах */
+    unsigned long long GetWritten() const noexcept;
+    unsigned long long GetStalls() const noexcept;
+
+private:
+    struct Channel;
+
+    static void* WriterMain(void* arg);
+    void WriterLoop() noexcept;
+    void Append(const Record& record) noexcept;
+    void Flush() noexcept;
+
+    Format format_;
+    int fd_;
+    Channel* channels_ = nullptr;
+    unsigned int channels_count_ = 0;
+    char* buf_ = nullptr;
+    unsigned int buf_len_ = 0;
+    pthread_t thread_;
+    bool started_ = false;
+    bool stop_ = false;                     // меняется только атомарно
+    bool write_failed_ = false;
+    unsigned long long written_ = 0;
+};
@@ -0,0 +1,382 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "route.h"
+
+namespace {
+constexpr int NL_BUF_SIZE = 32768;
+constexpr unsigned long TBL24_SIZE = (1UL << 24) * sizeof(unsigned short);
+constexpr unsigned int TBL8_GROUP = 256;
+
+struct DumpRequest {
+    struct nlmsghdr hdr;
+    struct rtmsg rtm;
+};
+}
+
+/* Порядок построения: от коротких префиксов к длинным (длинные перезаписывают короткие),
+ * маршруты на одну сеть с разными метриками оказываются рядом */
+int RouteTable::CompareRoutes(const void* a, const void* b) {
+    const Route* lhs = (const Route*)a;
+    const Route* rhs = (const Route*)b;
+    if (lhs->prefix_len != rhs->prefix_len) {
+        return (lhs->prefix_len < rhs->prefix_len) ? -1 : 1;
+    }
+    return (lhs->dst < rhs->dst) ? -1 : ((lhs->dst > rhs->dst) ? 1 : 0);
+}
+
+/*
+ * При создании объекта:
+ * - открываем netlink сокет и подписываемся на изменения маршрутов IPv4 (до дампа, чтобы не пропустить изменения)
+ * - читаем основную таблицу маршрутов дампом и строим структуру поиска
+ */
+RouteTable::RouteTable() noexcept {
+    nl_fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl_fd_ < 0) {
+        printf("Routes. Error. Netlink socket not received!\n");
+        return;
+    }
+    unsigned int group = RTNLGRP_IPV4_ROUTE;
+    if (setsockopt(nl_fd_, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+        printf("Routes. Error subscribing to netlink group %u.\n", group);
+        return;
+    }
+    if (Dump()) {
+        created_ = true;
+    }
+}
+
+RouteTable::~RouteTable() {
+    if (nl_fd_ >= 0) {
+        close(nl_fd_);
+    }
+    if (tbl24_ != nullptr) {
+        munmap(tbl24_, TBL24_SIZE);
+    }
+    free(tbl8_);
+    free(hops_);
+    free(routes_);
+}
+
+bool RouteTable::IsCreated() const noexcept {
+    return created_;
+}
+
+int RouteTable::GetSocket() const noexcept {
+    return nl_fd_;
+}
+
+int RouteTable::GetCount() const noexcept {
+    return count_;
+}
+
+bool RouteTable::Dump() noexcept {
+    count_ = 0;
+    DumpRequest req{};
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    req.hdr.nlmsg_type = RTM_GETROUTE;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.hdr.nlmsg_seq = ++seq_;
+    req.rtm.rtm_family = AF_INET;
+    if (send(nl_fd_, &req, req.hdr.nlmsg_len, 0) < 0) {
+        printf("Routes. Error sending netlink dump request. %s\n", strerror(errno));
+        return false;
+    }
+
+    char* buf = (char*)malloc(NL_BUF_SIZE);
+    if (buf == nullptr) {
+        printf("Routes. Error. Not enough memory.\n");
+        return false;
+    }
+    int done = 0;
+    bool changed = false;
+    while (done == 0) {
+        int len = recv(nl_fd_, buf, NL_BUF_SIZE, 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Routes. Error receiving netlink dump. %s\n", strerror(errno));
+            done = -1;
+            break;
+        }
+        done = ProcessMessages(buf, len, &changed);
+    }
+    free(buf);
+    return (done > 0) && Rebuild();
+}
+
+bool RouteTable::Update() noexcept {
+    char buf[NL_BUF_SIZE];
+    bool changed = false;
+    for (;;) {
+        int len = recv(nl_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                // уведомления потеряны - состояние таблицы неизвестно, перечитываем
+                return Dump();
+            }
+            printf("Routes. Error receiving netlink notification. %s\n", strerror(errno));
+            return false;
+        }
+        if (ProcessMessages(buf, len, &changed) < 0) {
+            return false;
+        }
+    }
+    return !changed || Rebuild();
+}
+
+int RouteTable::ProcessMessages(const char* buf, int len, bool* changed) noexcept {
+    for (const struct nlmsghdr* nh = (const struct nlmsghdr*)buf; NLMSG_OK(nh, (unsigned int)len); nh = NLMSG_NEXT(nh, len)) {
+        switch (nh->nlmsg_type) {
+        case NLMSG_DONE:
+            return 1;
+        case NLMSG_ERROR: {
+            const struct nlmsgerr* err = (const struct nlmsgerr*)NLMSG_DATA(nh);
+            if (err->error != 0) {
+                printf("Routes. Netlink error. %s\n", strerror(-err->error));
+                return -1;
+            }
+            break;
+        }
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+            if (OnRoute(nh)) {
+                *changed = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Учитываются только маршруты основной таблицы. Для маршрутов с несколькими следующими узлами
+ * используется первый узел. Возвращает true, если список маршрутов изменился */
+bool RouteTable::OnRoute(const struct nlmsghdr* nh) noexcept {
+    const struct rtmsg* rtm = (const struct rtmsg*)NLMSG_DATA(nh);
+    if ((rtm->rtm_family != AF_INET) || (rtm->rtm_dst_len > 32)) {
+        return false;
+    }
+    Route route{};
+    route.prefix_len = rtm->rtm_dst_len;
+    unsigned int table = rtm->rtm_table;
+    in_addr_t dst = 0;
+
+    int attr_len = RTM_PAYLOAD(nh);
+    for (const struct rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        switch (rta->rta_type) {
+        case RTA_TABLE:
+            table = *(const unsigned int*)RTA_DATA(rta);
+            break;
+        case RTA_DST:
+            memcpy(&dst, RTA_DATA(rta), sizeof(dst));
+            break;
+        case RTA_OIF:
+            route.hop.oif = *(const int*)RTA_DATA(rta);
+            break;
+        case RTA_GATEWAY:
+            memcpy(&route.hop.gateway, RTA_DATA(rta), sizeof(in_addr_t));
+            break;
+        case RTA_PRIORITY:
+            route.priority = *(const unsigned int*)RTA_DATA(rta);
+            break;
+        case RTA_MULTIPATH: {
+            const struct rtnexthop* nhop = (const struct rtnexthop*)RTA_DATA(rta);
+            if ((route.hop.oif == 0) && RTNH_OK(nhop, (int)RTA_PAYLOAD(rta))) {
+                route.hop.oif = nhop->rtnh_ifindex;
+                int nh_attr_len = nhop->rtnh_len - sizeof(*nhop);
+                for (const struct rtattr* nh_rta = RTNH_DATA(nhop); RTA_OK(nh_rta, nh_attr_len);
+                     nh_rta = RTA_NEXT(nh_rta, nh_attr_len)) {
+                    if (nh_rta->rta_type == RTA_GATEWAY) {
+                        memcpy(&route.hop.gateway, RTA_DATA(nh_rta), sizeof(in_addr_t));
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (table != RT_TABLE_MAIN) {
+        return false;
+    }
+    switch (rtm->rtm_type) {
+    case RTN_UNICAST:
+        if (route.hop.oif == 0) {
+            return false;
+        }
+        break;
+    case RTN_UNREACHABLE:
+    case RTN_BLACKHOLE:
+    case RTN_PROHIBIT:
+        route.hop.oif = 0;
+        route.hop.gateway = 0;
+        break;
+    default:
+        return false;
+    }
+    unsigned int mask = (route.prefix_len == 0) ? 0 : (0xFFFFFFFFu << (32 - route.prefix_len));
+    route.dst = ntohl(dst) & mask;
+
+    int idx = 0;
+    while ((idx < count_) && !((routes_[idx].dst == route.dst) && (routes_[idx].prefix_len == route.prefix_len) &&
+                               (routes_[idx].priority == route.priority))) {
+        ++idx;
+    }
+    if (nh->nlmsg_type == RTM_DELROUTE) {
+        if (idx == count_) {
+            return false;
+        }
+        routes_[idx] = routes_[--count_];
+        return true;
+    }
+    if (idx == count_) {
+        if (count_ == capacity_) {
+            int capacity = (capacity_ == 0) ? 16 : capacity_ * 2;
+            Route* routes = (Route*)realloc(routes_, capacity * sizeof(Route));
+            if (routes == nullptr) {
+                printf("Routes. Error. Not enough memory.\n");
+                return false;
+            }
+            routes_ = routes;
+            capacity_ = capacity;
+        }
+        ++count_;
+    }
+    routes_[idx] = route;
+    return true;
+}
+
+/* Номер следующего узла, одинаковые узлы разных маршрутов разделяют один номер
+ * возвращает 0 при неудаче */
+unsigned short RouteTable::AddHop(const NextHop& hop) noexcept {
+    for (unsigned int i = 1; i < hops_count_; ++i) {
+        if ((hops_[i].oif == hop.oif) && (hops_[i].gateway == hop.gateway)) {
+            return i;
+        }
+    }
+    if (hops_count_ == MAX_HOPS) {
+        printf("Routes. Error. Too many next hops.\n");
+        return 0;
+    }
+    if (hops_count_ == hops_capacity_) {
+        unsigned int capacity = (hops_capacity_ == 0) ? 16 : hops_capacity_ * 2;
+        NextHop* hops = (NextHop*)realloc(hops_, capacity * sizeof(NextHop));
+        if (hops == nullptr) {
+            printf("Routes. Error. Not enough memory.\n");
+            return 0;
+        }
+        hops_ = hops;
+        hops_capacity_ = capacity;
+    }
+    hops_[hops_count_] = hop;
+    return hops_count_++;
+}
+
+bool RouteTable::Insert(const Route& route, unsigned short hop) noexcept {
+    if (route.prefix_len == 0) {
+        default_hop_ = hop;
+        return true;
+    }
+    if (tbl24_ == nullptr) {
+        void* tbl = mmap(nullptr, TBL24_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (tbl == MAP_FAILED) {
+            printf("Routes. Error. Not enough memory.\n");
+            return false;
+        }
+        tbl24_ = (unsigned short*)tbl;
+    }
+    if (route.prefix_len <= 24) {
+        unsigned int first = route.dst >> 8;
+        unsigned int count = 1u << (24 - route.prefix_len);
+        for (unsigned int i = 0; i < count; ++i) {
+            tbl24_[first + i] = hop;
+        }
+        return true;
+    }
+
+    unsigned short& entry = tbl24_[route.dst >> 8];
+    if (!(entry & TBL8_FLAG)) {
+        if (tbl8_count_ == MAX_TBL8) {
+            printf("Routes. Error. Too many routes longer than /24.\n");
+            return false;
+        }
+        if (tbl8_count_ == tbl8_capacity_) {
+            unsigned int capacity = (tbl8_capacity_ == 0) ? 16 : tbl8_capacity_ * 2;
+            unsigned short* tbl8 = (unsigned short*)realloc(tbl8_, capacity * TBL8_GROUP * sizeof(unsigned short));
+            if (tbl8 == nullptr) {
+                printf("Routes. Error. Not enough memory.\n");
+                return false;
+            }
+            tbl8_ = tbl8;
+            tbl8_capacity_ = capacity;
+        }
+        // группа наследует маршрут, покрывавший её /24
+        unsigned short* group = tbl8_ + tbl8_count_ * TBL8_GROUP;
+        for (unsigned int i = 0; i < TBL8_GROUP; ++i) {
+            group[i] = entry;
+        }
+        entry = TBL8_FLAG | tbl8_count_++;
+    }
+    unsigned short* group = tbl8_ + (entry & ~TBL8_FLAG) * TBL8_GROUP;
+    unsigned int first = route.dst & 0xFF;
+    unsigned int count = 1u << (32 - route.prefix_len);
+    for (unsigned int i = 0; i < count; ++i) {
+        group[first + i] = hop;
+    }
+    return true;
+}
+
+/* Полное перестроение структуры поиска. tbl24 обнуляется через MADV_DONTNEED:
+ * страницы возвращаются системе и при следующем обращении читаются как нулевые */
+bool RouteTable::Rebuild() noexcept {
+    if (tbl24_ != nullptr) {
+        madvise(tbl24_, TBL24_SIZE, MADV_DONTNEED);
+    }
+    tbl8_count_ = 0;
+    default_hop_ = 0;
+    if (hops_ == nullptr) {
+        hops_ = (NextHop*)malloc(16 * sizeof(NextHop));
+        if (hops_ == nullptr) {
+            printf("Routes. Error. Not enough memory.\n");
+            return false;
+        }
+        hops_capacity_ = 16;
+    }
+    hops_[0] = NextHop{};       // номер 0 - нет маршрута
+    hops_count_ = 1;
+
+    qsort(routes_, count_, sizeof(Route), CompareRoutes);
+    for (int i = 0; i < count_; ++i) {
+        // из маршрутов с одинаковым префиксом выигрывает маршрут с наименьшей метрикой
+        int best = i;
+        while ((i + 1 < count_) && (routes_[i + 1].prefix_len == routes_[best].prefix_len) && (routes_[i + 1].dst == routes_[best].dst)) {
+            ++i;
+            if (routes_[i].priority < routes_[best].priority) {
+                best = i;
+            }
+        }
+        unsigned short hop = AddHop(routes_[best].hop);
+        if ((hop == 0) || !Insert(routes_[best], hop)) {
+            return false;
+        }
+    }
+    return true;
+}
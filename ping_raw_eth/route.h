@@ -0,0 +1,98 @@
+#pragma once
+/*
+ * Таблица маршрутов IPv4 (основная таблица ядра, RT_TABLE_MAIN)
+ *
+ * Загружается дампом rtnetlink (RTM_GETROUTE) и поддерживается в актуальном состоянии по уведомлениям
+ * группы RTNLGRP_IPV4_ROUTE. Для поиска по наибольшему совпадению префикса строится структура DIR-24-8:
+ * - tbl24 - 2^24 элементов по 16 бит, индексируется старшими 24 битами адреса. Элемент - номер следующего узла,
+ *   либо (старший бит) номер группы tbl8
+ * - tbl8 - группы по 256 элементов для префиксов длиннее /24
+ * - маршрут по умолчанию хранится отдельно и в tbl24 не записывается: пустой элемент означает "маршрут по умолчанию"
+ * tbl24 отображается в память анонимно и без резервирования: физические страницы выделяются только под
+ * диапазоны, покрытые маршрутами. Поиск - одно или два обращения к памяти, без системных вызовов.
+ *
+ * Уведомления обрабатываются в Update(): сокет таблицы можно добавить в цикл событий (GetSocket).
+ *
+ * USAGE:
+ * RouteTable routes; // если успешно создана, то IsCreated вернёт true
+ * auto* hop = routes.Lookup(inet_addr("8.8.8.8"));
+ */
+#include <netinet/in.h>
+
+class RouteTable {
+public:
+    struct NextHop {
+        int oif;                            // индекс интерфейса, 0 - адрес недостижим (unreachable/blackhole/prohibit)
+        in_addr_t gateway;                  // шлюз в сетевом порядке байт, 0 - адресат в сети интерфейса
+    };
+
+    RouteTable() noexcept;
+    ~RouteTable();
+
+    bool IsCreated() const noexcept;
+
+    /* Обработка накопившихся уведомлений без блокировки, при изменениях структура поиска перестраивается
+     * возвращает true при успехе */
+    bool Update() noexcept;
+
+    /* Сокет уведомлений - для добавления в цикл событий */
+    int GetSocket() const noexcept;
+
+    /* Поиск маршрута для ip (в сетевом порядке байт)
+     * возвращает следующий узел (действителен до следующего вызова Update), либо nullptr, если маршрута нет
+     * или адрес недостижим */
+    const NextHop* Lookup(in_addr_t ip) const noexcept {
+        unsigned int host = ntohl(ip);
+        unsigned int hop = 0;
+        if (tbl24_ != nullptr) {
+            hop = tbl24_[host >> 8];
+            if (hop & TBL8_FLAG) {
+                hop = tbl8_[((hop & ~TBL8_FLAG) << 8) | (host & 0xFF)];
+            }
+        }
+        if (hop == 0) {
+            hop = default_hop_;
+        }
+        return ((hop != 0) && (hops_[hop].oif != 0)) ? &hops_[hop] : nullptr;
+    }
+
+    /* Количество маршрутов */
+    int GetCount() const noexcept;
+
+private:
+    static constexpr unsigned short TBL8_FLAG = 0x8000;
+    static constexpr unsigned int MAX_HOPS = TBL8_FLAG;         // индексы следующих узлов 1..MAX_HOPS-1
+    static constexpr unsigned int MAX_TBL8 = TBL8_FLAG;
+
+    struct Route {
+        unsigned int dst;                   // в порядке байт хоста
+        unsigned char prefix_len;
+        unsigned int priority;              // метрика, меньше - предпочтительнее
+        NextHop hop;
+    };
+
+    static int CompareRoutes(const void* a, const void* b);
+    bool Dump() noexcept;
+    int ProcessMessages(const char* buf, int len, bool* changed) noexcept;
+    bool OnRoute(const struct nlmsghdr* nh) noexcept;
+    bool Rebuild() noexcept;
+    unsigned short AddHop(const NextHop& hop) noexcept;
+    bool Insert(const Route& route, unsigned short hop) noexcept;
+
+    bool created_ = false;
+    int nl_fd_ = -1;
+    unsigned int seq_ = 0;
+
+    Route* routes_ = nullptr;
+    int count_ = 0;
+    int capacity_ = 0;
+
+    unsigned short* tbl24_ = nullptr;       // отображается при первом маршруте длиннее /0
+    unsigned short* tbl8_ = nullptr;
+    unsigned int tbl8_count_ = 0;
+    unsigned int tbl8_capacity_ = 0;
+    NextHop* hops_ = nullptr;               // hops_[0] не используется
+    unsigned int hops_count_ = 0;
+    unsigned int hops_capacity_ = 0;
+    unsigned short default_hop_ = 0;
+};
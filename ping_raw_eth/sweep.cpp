@@ -0,0 +1,681 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <netinet/ether.h>
+#include <new>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sweep.h"
+#include "utils.h"
+
+Sweeper::Sweeper(unsigned int rate, unsigned int wait_sec, bool arp) noexcept
+    : rate_(rate == 0 ? DEFAULT_RATE : rate), wait_sec_(wait_sec), arp_(arp) {
+    id_ = getpid() & 0xFFFF;
+    SetWorkers(1, PACKET_FANOUT_HASH, false);
+}
+
+Sweeper::~Sweeper() {
+    DestroyWorkers(0);
+    free(replied_);
+    free(sent_us_);
+}
+
+bool Sweeper::IsCreated() const noexcept {
+    if (workers_count_ == 0) {
+        return false;
+    }
+    for (unsigned int i = 0; i < workers_count_; ++i) {
+        if (!workers_[i]->IsCreated()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Удаление потоков с номерами from и выше */
+void Sweeper::DestroyWorkers(unsigned int from) noexcept {
+    for (unsigned int i = from; i < workers_count_; ++i) {
+        workers_[i]->~SweepWorker();
+        free(workers_[i]);
+        workers_[i] = nullptr;
+    }
+    if (workers_count_ > from) {
+        workers_count_ = from;
+    }
+}
+
+/* Каждый поток - со своим сокетом, кольцами и таблицами интерфейсов и маршрутов.
+ * Уже созданные потоки сохраняются, недостающие создаются, лишние удаляются */
+bool Sweeper::SetWorkers(unsigned int count, int fanout_type, bool pin) noexcept {
+    if (count == 0) {
+        cpu_set_t allowed;
+        count = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) ? CPU_COUNT(&allowed) : 1;
+    }
+    if (count > MAX_WORKERS) {
+        count = MAX_WORKERS;
+    }
+    DestroyWorkers(count);
+    fanout_type_ = fanout_type;
+    pin_ = pin;
+    for (unsigned int i = workers_count_; i < count; ++i) {
+        void* mem = malloc(sizeof(SweepWorker));
+        if (mem == nullptr) {
+            printf("Sweep. Error. Not enough memory for workers.\n");
+            return false;
+        }
+        workers_[i] = new (mem) SweepWorker(*this, i);
+        ++workers_count_;
+        if (!workers_[i]->IsCreated()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Процессор для потока index: index-й по счёту (по кругу) из доступных процессу */
+bool Sweeper::GetWorkerCpu(unsigned int index, cpu_set_t* cpus) const noexcept {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return false;
+    }
+    int count = CPU_COUNT(&allowed);
+    if (count == 0) {
+        return false;
+    }
+    int n = index % count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && (n-- == 0)) {
+            CPU_ZERO(cpus);
+            CPU_SET(cpu, cpus);
+            return true;
+        }
+    }
+    return false;
+}
+
+void* Sweeper::WorkerMain(void* arg) {
+    SweepWorker* worker = (SweepWorker*)arg;
+    return worker->Run(-1) ? arg : nullptr;
+}
+
+void Sweeper::SetOutput(ResultSink::Format format, int fd) noexcept {
+    format_ = format;
+    output_fd_ = fd;
+}
+
+void Sweeper::SetMetrics(MetricsRegion* region) noexcept {
+    metrics_ = region;
+}
+
+void Sweeper::SetUring(bool enable) noexcept {
+    uring_ = enable;
+}
+
+void Sweeper::SetCursor(const char* path) noexcept {
+    cursor_path_ = path;
+}
+
+bool Sweeper::AddTarget(const char* spec) noexcept {
+    return targets_.Add(spec, MIN_PREFIX_LEN);
+}
+
+bool Sweeper::ExcludeTarget(const char* spec) noexcept {
+    return targets_.Exclude(spec);
+}
+
+/* Объединение целей в интервалы с вычетом исключений, биты ответов и порядок обхода: сохранённый
+ * в файле состояния либо новый случайный */
+bool Sweeper::PrepareTargets() noexcept {
+    if (!targets_.Build()) {
+        return false;
+    }
+    const unsigned long long count = targets_.GetCount();
+    if (count == 0) {
+        printf("Sweep. Error. No targets.\n");
+        return false;
+    }
+    free(replied_);
+    free(sent_us_);
+    sent_us_ = nullptr;
+    replied_ = (unsigned long long*)calloc((count + 63) / 64, sizeof(unsigned long long));
+    if (arp_) {
+        sent_us_ = (unsigned int*)calloc(count, sizeof(unsigned int));
+    }
+    if ((replied_ == nullptr) || (arp_ && (sent_us_ == nullptr))) {
+        printf("Sweep. Error. Not enough memory for targets.\n");
+        return false;
+    }
+
+    TargetOrder::Cursor cursor;
+    if ((cursor_path_ != nullptr) && TargetOrder::Load(cursor_path_, &cursor)) {
+        if ((cursor.count != count) || !order_.Restore(cursor)) {
+            printf("Sweep. Error. Cursor file %s doesn't match targets.\n", cursor_path_);
+            return false;
+        }
+        fprintf(stderr, "Sweep resumed at step %llu of %llu\n", order_.GetPosition(), order_.GetLength());
+        return true;
+    }
+    if ((cursor_path_ != nullptr) && (errno != ENOENT)) {
+        return false;
+    }
+    unsigned int seed = (unsigned int)utils::MonotonicNs() ^ ((unsigned int)getpid() << 16);
+    return order_.Init(count, (seed == 0) ? 1 : seed);
+}
+
+/* Отметка ответа цели index, возвращает true для первого ответа */
+bool Sweeper::SetReplied(unsigned long long index) noexcept {
+    unsigned long long bit = 1ULL << (index % 64);
+    return (__atomic_fetch_or(&replied_[index / 64], bit, __ATOMIC_ACQ_REL) & bit) == 0;
+}
+
+bool Sweeper::IsReplied(unsigned long long index) const noexcept {
+    return (__atomic_load_n(&replied_[index / 64], __ATOMIC_ACQUIRE) & (1ULL << (index % 64))) != 0;
+}
+
+/* Потоки идут по своим шагам обхода примерно вровень: продолжение - с самого отстающего потока,
+ * запросы, которые другие потоки успели отправить дальше него, будут отправлены повторно */
+bool Sweeper::SaveCursor() const noexcept {
+    unsigned long long position = order_.GetLength();
+    for (unsigned int i = 0; i < workers_count_; ++i) {
+        unsigned long long next = workers_[i]->GetNextPosition();
+        position = (next < position) ? next : position;
+    }
+    // позиции потоков - со смещением номера потока, продолжение с позиции кратной шагу сохраняет разбиение
+    position -= position % workers_count_;
+    return TargetOrder::Save(cursor_path_, order_.GetCursor(position));
+}
+
+
+SweepWorker::SweepWorker(Sweeper& sweeper, unsigned int index) noexcept
+    : sweeper_(sweeper), index_(index) {
+}
+
+bool SweepWorker::IsCreated() const noexcept {
+    return ip_proto_.IsCreated();
+}
+
+unsigned int SweepWorker::GetSent() const noexcept {
+    return sent_;
+}
+
+unsigned int SweepWorker::GetReplies() const noexcept {
+    return replies_;
+}
+
+unsigned int SweepWorker::GetUnroutable() const noexcept {
+    return unroutable_;
+}
+
+bool SweepWorker::GetStatistics(EthernetProtocol::RxStatistics* stats) noexcept {
+    return ip_proto_.GetEthernet().GetStatistics(stats);
+}
+
+bool SweepWorker::IsRxRingEnabled() noexcept {
+    return ip_proto_.GetEthernet().IsRxRingEnabled();
+}
+
+bool SweepWorker::IsUringEnabled() noexcept {
+    return ip_proto_.GetEthernet().IsUringEnabled();
+}
+
+unsigned long long SweepWorker::GetNextPosition() const noexcept {
+    return __atomic_load_n(&next_position_, __ATOMIC_RELAXED);
+}
+
+/* Переход к следующей цели своей части обхода */
+void SweepWorker::Advance() noexcept {
+    unsigned long long position;
+    has_next_ = walker_.Next(&next_, &position);
+    __atomic_store_n(&next_position_, has_next_ ? position : walker_.GetPosition(), __ATOMIC_RELAXED);
+}
+
+/* Скорость и память колец делятся между потоками поровну.
+ * Все потоки принимают со всех интерфейсов (сокеты группы fanout одинаково не привязаны к интерфейсу):
+ * ответы целей за другими интерфейсами приходят туда же. Шаблон фрейма - для интерфейса маршрута к первой цели */
+bool SweepWorker::Prepare(int* fanout_id) noexcept {
+    static constexpr unsigned int MIN_RX_BLOCKS = 8;
+    unsigned int workers = sweeper_.workers_count_;
+    rate_ = sweeper_.rate_ / workers + ((index_ < sweeper_.rate_ % workers) ? 1 : 0);
+    if (rate_ == 0) {
+        rate_ = 1;
+    }
+
+    Ping::BuildEchoRequest(echo_template_, sizeof(echo_template_), sweeper_.id_, 0);
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    if (sweeper_.metrics_ != nullptr) {
+        char name[Metrics::NAME_SIZE];
+        snprintf(name, sizeof(name), "sweep.%u", index_);
+        ether.SetMetrics(sweeper_.metrics_->Acquire(name));
+    }
+    const unsigned long long count = sweeper_.targets_.GetCount();
+    if (sweeper_.arp_ && !ip_proto_.GetArp().GetCache().Reserve((unsigned int)(count / workers + 1))) {
+        return false;
+    }
+    walker_ = TargetOrder::Walker(sweeper_.order_, index_, workers);
+    Advance();
+    if (sweeper_.uring_) {
+        // кольца io_uring несовместимы с PACKET_RX_RING/PACKET_TX_RING, epoll ждёт дескриптор кольца приёма
+        if (!ether.EnableUring()) {
+            return false;
+        }
+    } else {
+        unsigned int rx_blocks = EthernetProtocol::RX_BLOCK_COUNT / workers;
+        if (!ether.EnableRxRing(EthernetProtocol::RX_BLOCK_SIZE, (rx_blocks < MIN_RX_BLOCKS) ? MIN_RX_BLOCKS : rx_blocks)) {
+            ether.SetRcvBufSize(Sweeper::RCV_BUF_SIZE);
+        }
+        ether.EnableTxRing();
+    }
+    // шаблон фрейма и ARP запросы - для интерфейса, через который уходит маршрут к первой цели
+    in_addr_t next_hop;
+    const char* if_name = ip_proto_.GetRouteInterface(htonl(sweeper_.targets_.Get(0)), &next_hop);
+    if (if_name == nullptr) {
+        return false;
+    }
+    strncpy(if_name_, if_name, IFNAMSIZ - 1);
+    const InterfaceTable::Interface* iface = ether.GetInterfaces().FindByName(if_name_);
+    if (!sweeper_.arp_ && ((iface == nullptr) ||
+                           !frame_template_.Init(*iface, IPPROTO_ICMP, echo_template_, sizeof(echo_template_)))) {
+        printf("Sweep. Error. Can't build frame template for interface %s.\n", if_name_);
+        return false;
+    }
+    if (!ip_proto_.SetReplyFilter(sweeper_.id_) || !ether.BindAllInterfaces()) {
+        return false;
+    }
+    return (fanout_id == nullptr) || ether.JoinFanout(fanout_id, sweeper_.fanout_type_);
+}
+
+/* Отправка очередной порции запросов
+ * Кредит копится пропорционально прошедшим тикам, но не более MAX_BURST пакетов,
+ * чтобы после задержки процесса не отправлять запросы пачкой */
+bool SweepWorker::OnTick(unsigned long long expirations) noexcept {
+    credit_ += expirations * rate_ * Sweeper::TICK_NS / 1000000;
+    if (credit_ > Sweeper::MAX_BURST * 1000ULL) {
+        credit_ = Sweeper::MAX_BURST * 1000ULL;
+    }
+
+    // вся порция уходит разом, поэтому время отправки у её запросов общее
+    const unsigned int now_us = (unsigned int)((utils::MonotonicNs() - sweeper_.start_ns_) / 1000);
+    unsigned int queued = 0;
+    while ((credit_ >= 1000) && has_next_) {
+        bool res;
+        in_addr_t ip = htonl(sweeper_.targets_.Get(next_));
+        if (sweeper_.arp_) {
+            __atomic_store_n(&sweeper_.sent_us_[next_], now_us + 1, __ATOMIC_RELAXED);
+            res = ip_proto_.GetArp().QueueRequest(ip, if_name_);
+        } else {
+            res = Ping::QueueEchoRequest(ip_proto_, frame_template_, echo_template_, sizeof(echo_template_), ip,
+                                         htons(next_ & 0xFFFF), now_us);
+        }
+        if (!res) {
+            if ((errno == ENOBUFS) || (errno == EAGAIN)) {
+                // очередь передачи переполнена - повторим на следующем тике
+                break;
+            }
+            if (errno != ENETUNREACH) {
+                return false;
+            }
+            // маршрута нет - цель пропускается
+            ++unroutable_;
+            __atomic_add_fetch(&sweeper_.issued_, 1, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&sweeper_.completed_, 1, __ATOMIC_RELEASE);
+            Advance();
+            continue;
+        }
+        Advance();
+        ++queued;
+        credit_ -= 1000;
+    }
+    sent_ += queued;
+    __atomic_add_fetch(&sweeper_.issued_, queued, __ATOMIC_RELEASE);
+    // вся порция тика уходит одним системным вызовом
+    if ((queued > 0) && (ip_proto_.FlushRequests() < 0) && (errno != ENOBUFS) && (errno != EAGAIN)) {
+        return false;
+    }
+    return true;
+}
+
+void SweepWorker::HandleFrame(void* ctx, const unsigned char* frame, int len) {
+    SweepWorker* self = (SweepWorker*)ctx;
+    const bool arp = self->sweeper_.arp_;
+    const struct ether_header* eth_h = (const struct ether_header*)frame;
+    if (eth_h->ether_type == htons(ETH_P_ARP)) {
+        // ARP ответы пополняют кэш соседей в любом режиме, целью считаются только в режиме ARP
+        in_addr_t sender_ip;
+        const unsigned char* sender_mac;
+        if (self->ip_proto_.GetArp().HandlePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &sender_ip, &sender_mac) &&
+            arp) {
+            self->OnReply(sender_ip, sender_mac, -1);
+        }
+        return;
+    }
+    Metrics& metrics = self->ip_proto_.GetEthernet().GetMetrics();
+    if ((eth_h->ether_type != htons(ETH_P_IP)) || arp) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+
+    const struct iphdr* ip_h;
+    int icmp_len;
+    const unsigned char* icmp_data = IPProtocol::ParsePacket(frame + sizeof(*eth_h), len - sizeof(*eth_h), &ip_h, &icmp_len);
+    if ((icmp_data == nullptr) || (ip_h->protocol != IPPROTO_ICMP) || !self->ip_proto_.IsLocalAddress(ip_h->daddr)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+    const struct icmphdr* icmp_h = Ping::ParseEchoReply(icmp_data, icmp_len);
+    if ((icmp_h == nullptr) || (icmp_h->un.echo.id != self->sweeper_.id_)) {
+        metrics.Add(Metrics::RX_FILTERED);
+        return;
+    }
+
+    unsigned int stamp;
+    self->OnReply(ip_h->saddr, eth_h->ether_shost,
+                  Ping::GetEchoStamp(icmp_data, icmp_len, &stamp) ? (long long)stamp : -1);
+}
+
+/* Ответ цели ip (в сетевом порядке байт): в вывод попадает только первый ответ
+ * - sent_us - время отправки из метки ответа (от начала опроса), -1 - метки нет: в режиме ARP время
+ *   берётся из записи цели, цель без записи в этом запуске не опрашивалась
+ * Ответ может прийти в любой поток - первенство определяется атомарной установкой бита ответа цели.
+ * Запись результата уходит в кольцо этого потока, форматирует и выводит её поток записи */
+void SweepWorker::OnReply(in_addr_t ip, const unsigned char* mac, long long sent_us) noexcept {
+    Metrics& metrics = ip_proto_.GetEthernet().GetMetrics();
+    unsigned long long index;
+    if (!sweeper_.targets_.IndexOf(ntohl(ip), &index)) {
+        metrics.Add(Metrics::UNMATCHED);
+        return;
+    }
+    if (sweeper_.sent_us_ != nullptr) {
+        unsigned int sent = __atomic_load_n(&sweeper_.sent_us_[index], __ATOMIC_RELAXED);
+        if (sent == 0) {
+            metrics.Add(Metrics::UNMATCHED);
+            return;
+        }
+        sent_us = sent - 1;
+    }
+    if (!sweeper_.SetReplied(index)) {
+        metrics.Add(Metrics::UNMATCHED);
+        return;
+    }
+    metrics.Add(Metrics::REPLIES);
+    ++replies_;
+    __atomic_add_fetch(&sweeper_.completed_, 1, __ATOMIC_RELEASE);
+
+    ResultSink::Record record;
+    record.ts_ns = utils::RealtimeNs();
+    // метка - 32-битные микросекунды: разность по модулю 2^32 верна и после переполнения
+    const long long elapsed_ns = utils::MonotonicNs() - sweeper_.start_ns_;
+    const unsigned int now_us = (unsigned int)(elapsed_ns / 1000);
+    record.rtt_ns = (sent_us >= 0) ? (long long)(now_us - (unsigned int)sent_us) * 1000 + elapsed_ns % 1000 : -1;
+    record.ip = ip;
+    memcpy(record.mac, mac, ETH_ALEN);
+    memset(record.reserved, 0, sizeof(record.reserved));
+    // интерфейс приёма ответа; у фреймов из источника (pcap) его нет - интерфейс маршрута к первой цели
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    const InterfaceTable::Interface* iface = ether.GetInterfaces().FindByIndex(ether.GetRxInterface());
+    memcpy(record.if_name, (iface != nullptr) ? iface->name : if_name_, IFNAMSIZ);
+    sweeper_.sink_->Push(index_, record);
+}
+
+/* Опрос завершён, если все потоки отправили свои цели и ответили (или пропущены) все отправленные,
+ * либо истекло ожидание после отправки. Срок ожидания назначает последний закончивший отправку поток.
+ * После SIGINT/SIGTERM опрос завершается сразу, ответы не дожидаются */
+bool SweepWorker::IsFinished() noexcept {
+    if (__atomic_load_n(&sweeper_.stop_, __ATOMIC_ACQUIRE) || __atomic_load_n(&sweeper_.interrupted_, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    if (!sending_done_) {
+        if (has_next_) {
+            return false;
+        }
+        sending_done_ = true;
+        if (__atomic_add_fetch(&sweeper_.workers_sent_, 1, __ATOMIC_ACQ_REL) == sweeper_.workers_count_) {
+            __atomic_store_n(&sweeper_.deadline_, utils::MonotonicNs() + sweeper_.wait_sec_ * 1000000000LL, __ATOMIC_RELEASE);
+        }
+    }
+    if ((__atomic_load_n(&sweeper_.workers_sent_, __ATOMIC_ACQUIRE) == sweeper_.workers_count_) &&
+        (__atomic_load_n(&sweeper_.completed_, __ATOMIC_ACQUIRE) >= __atomic_load_n(&sweeper_.issued_, __ATOMIC_ACQUIRE))) {
+        return true;
+    }
+    long long deadline = __atomic_load_n(&sweeper_.deadline_, __ATOMIC_ACQUIRE);
+    return (deadline != 0) && (utils::MonotonicNs() >= deadline);
+}
+
+/* Поток с signal_fd (поток 0) ещё и сохраняет состояние обхода: раз в CURSOR_PERIOD_NS и при прерывании */
+bool SweepWorker::Run(int signal_fd) noexcept {
+    EthernetProtocol& ether = ip_proto_.GetEthernet();
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        printf("Sweep. Error. Can't create epoll.\n");
+        __atomic_store_n(&sweeper_.stop_, true, __ATOMIC_RELEASE);
+        return false;
+    }
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        printf("Sweep. Error. Can't create timer.\n");
+        close(epoll_fd);
+        __atomic_store_n(&sweeper_.stop_, true, __ATOMIC_RELEASE);
+        return false;
+    }
+    struct itimerspec timer_spec{{0, Sweeper::TICK_NS}, {0, Sweeper::TICK_NS}};
+    timerfd_settime(timer_fd, 0, &timer_spec, nullptr);
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = ether.GetSocket();
+    bool ok = (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ether.GetSocket(), &ev) == 0);
+    ev.data.fd = timer_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == 0);
+    int ifaces_fd = ether.GetInterfaces().GetSocket();
+    ev.data.fd = ifaces_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ifaces_fd, &ev) == 0);
+    int routes_fd = ip_proto_.GetRoutes().GetSocket();
+    ev.data.fd = routes_fd;
+    ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, routes_fd, &ev) == 0);
+    if (signal_fd >= 0) {
+        ev.data.fd = signal_fd;
+        ok = ok && (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) == 0);
+    }
+    if (!ok) {
+        printf("Sweep. Error. Can't configure epoll.\n");
+    }
+
+    const bool save_cursor = (signal_fd >= 0) && (sweeper_.cursor_path_ != nullptr);
+    long long save_ns = utils::MonotonicNs() + Sweeper::CURSOR_PERIOD_NS;
+    while (ok && !IsFinished()) {
+        struct epoll_event events[5];
+        int n = epoll_wait(epoll_fd, events, 5, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Sweep. Error. epoll_wait failed.\n");
+            ok = false;
+            break;
+        }
+        for (int i = 0; (i < n) && ok; ++i) {
+            if (events[i].data.fd == timer_fd) {
+                unsigned long long expirations = 0;
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    ok = OnTick(expirations);
+                }
+                if (ok && save_cursor && !sending_done_ && (utils::MonotonicNs() >= save_ns)) {
+                    save_ns += Sweeper::CURSOR_PERIOD_NS;
+                    ok = sweeper_.SaveCursor();
+                }
+            } else if (events[i].data.fd == signal_fd) {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    __atomic_store_n(&sweeper_.interrupted_, true, __ATOMIC_RELEASE);
+                }
+            } else if (events[i].data.fd == ifaces_fd) {
+                // изменения интерфейсов и адресов применяются к следующим отправкам, смена адресов
+                // пересобирает фильтр ядра
+                ok = ip_proto_.UpdateInterfaces();
+            } else if (events[i].data.fd == routes_fd) {
+                ok = ip_proto_.GetRoutes().Update();
+            } else if (ether.RcvFrames(HandleFrame, this, Sweeper::RCV_BATCH) < 0) {
+                ok = false;
+            }
+        }
+    }
+
+    close(timer_fd);
+    close(epoll_fd);
+    if (!ok) {
+        __atomic_store_n(&sweeper_.stop_, true, __ATOMIC_RELEASE);
+        return false;
+    }
+    // не ответившие цели своей части - потери в счётчиках потока, в режиме ARP ещё и отрицательные записи
+    // в кэше соседей потока. Отправленная часть проходится обходом заново - с начала этого запуска до текущего шага
+    Metrics& metrics = ether.GetMetrics();
+    long long now = utils::MonotonicNs();
+    TargetOrder::Walker walker(sweeper_.order_, index_, sweeper_.workers_count_);
+    unsigned long long index;
+    unsigned long long position;
+    while (walker.Next(&index, &position) && (position < next_position_)) {
+        if (!sweeper_.IsReplied(index)) {
+            metrics.Add(Metrics::TIMEOUTS);
+            if (sweeper_.arp_) {
+                ip_proto_.GetArp().GetCache().SetFailed(htonl(sweeper_.targets_.Get(index)), now);
+            }
+        }
+    }
+    return true;
+}
+
+/* Потоки 1..N-1 запускаются отдельно, поток 0 работает в вызывающем потоке.
+ * Сокеты всех потоков готовятся заранее, до начала отправки: иначе ответы на первые запросы
+ * могли бы прийти до вступления остальных сокетов в группу fanout.
+ * SIGINT/SIGTERM блокируются до запуска потоков (маска наследуется) и принимаются потоком 0 через signalfd */
+int Sweeper::Run() noexcept {
+    if (!IsCreated() || !PrepareTargets()) {
+        return -1;
+    }
+
+    int fanout_id = -1;
+    for (unsigned int i = 0; i < workers_count_; ++i) {
+        if (!workers_[i]->Prepare((workers_count_ > 1) ? &fanout_id : nullptr)) {
+            return -1;
+        }
+    }
+    sigset_t signals;
+    sigset_t saved_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &saved_signals);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        printf("Sweep. Error. Can't create signal descriptor.\n");
+        pthread_sigmask(SIG_SETMASK, &saved_signals, nullptr);
+        return -1;
+    }
+    // канал вывода на каждый поток: у кольца канала один производитель
+    ResultSink sink(format_, output_fd_, workers_count_);
+    if (!sink.IsCreated() || !sink.Start()) {
+        close(signal_fd);
+        pthread_sigmask(SIG_SETMASK, &saved_signals, nullptr);
+        return -1;
+    }
+    sink_ = &sink;
+    start_ns_ = utils::MonotonicNs();
+
+    bool ok = true;
+    pthread_t threads[MAX_WORKERS];
+    unsigned int started = 1;
+    for (unsigned int i = 1; i < workers_count_; ++i) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        cpu_set_t cpus;
+        if (pin_ && GetWorkerCpu(i, &cpus)) {
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+        int err = pthread_create(&threads[i], &attr, WorkerMain, workers_[i]);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            printf("Sweep. Error. Can't start worker thread. %s\n", strerror(err));
+            __atomic_store_n(&stop_, true, __ATOMIC_RELEASE);
+            ok = false;
+            break;
+        }
+        ++started;
+    }
+    cpu_set_t saved_cpus;
+    bool restore_cpus = false;
+    if (ok && pin_) {
+        cpu_set_t cpus;
+        restore_cpus = (sched_getaffinity(0, sizeof(saved_cpus), &saved_cpus) == 0) && GetWorkerCpu(0, &cpus) &&
+                       (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0);
+    }
+    if (ok) {
+        ok = workers_[0]->Run(signal_fd);
+    }
+    for (unsigned int i = 1; i < started; ++i) {
+        void* res = nullptr;
+        pthread_join(threads[i], &res);
+        ok = ok && (res != nullptr);
+    }
+    if (restore_cpus) {
+        pthread_setaffinity_np(pthread_self(), sizeof(saved_cpus), &saved_cpus);
+    }
+    ok = sink.Stop() && ok;
+    sink_ = nullptr;
+    close(signal_fd);
+    pthread_sigmask(SIG_SETMASK, &saved_signals, nullptr);
+
+    // прерванный опрос сохраняет шаг продолжения, после отправки всех целей файл состояния не нужен
+    // (при ошибке в файле остаётся последнее периодическое сохранение)
+    const bool all_sent = (__atomic_load_n(&workers_sent_, __ATOMIC_ACQUIRE) == workers_count_);
+    if (ok && (cursor_path_ != nullptr)) {
+        if (!all_sent) {
+            ok = SaveCursor();
+            if (ok) {
+                fprintf(stderr, "Sweep state saved to %s\n", cursor_path_);
+            }
+        } else if ((unlink(cursor_path_) < 0) && (errno != ENOENT)) {
+            printf("Sweep. Error removing cursor file %s. %s\n", cursor_path_, strerror(errno));
+        }
+    }
+
+    unsigned int sent = 0;
+    unsigned int replies = 0;
+    unsigned int unroutable = 0;
+    EthernetProtocol::RxStatistics total{};
+    bool stats_ok = true;
+    for (unsigned int i = 0; i < workers_count_; ++i) {
+        sent += workers_[i]->GetSent();
+        replies += workers_[i]->GetReplies();
+        unroutable += workers_[i]->GetUnroutable();
+        EthernetProtocol::RxStatistics stats{};
+        if (workers_[i]->GetStatistics(&stats)) {
+            total.packets += stats.packets;
+            total.drops += stats.drops;
+            total.freeze_q_cnt += stats.freeze_q_cnt;
+        } else {
+            stats_ok = false;
+        }
+        if (workers_count_ > 1) {
+            fprintf(stderr, "Worker %u: %u requests sent, %u replies received, %llu frames, %llu dropped by kernel\n",
+                    i, workers_[i]->GetSent(), workers_[i]->GetReplies(), stats.packets, stats.drops);
+        }
+    }
+    fprintf(stderr, "Sweep %s: %llu targets, %u %s requests sent, %u replies, %u without route\n",
+            all_sent ? "finished" : "interrupted", targets_.GetCount(), sent, arp_ ? "ARP" : "ICMP", replies, unroutable);
+    if (stats_ok) {
+        fprintf(stderr, "Receive (%s, %u %s): %llu frames, %llu dropped by kernel, %llu queue freezes\n",
+                workers_[0]->IsRxRingEnabled() ? "rx ring" : (workers_[0]->IsUringEnabled() ? "io_uring" : "recvfrom"), workers_count_,
+                (workers_count_ > 1) ? "workers" : "worker", total.packets, total.drops, total.freeze_q_cnt);
+    }
+    fprintf(stderr, "Results: %llu records written, %llu waits for ring space\n", sink.GetWritten(), sink.GetStalls());
+    return ok ? (int)replies : -1;
+}
@@ -0,0 +1,202 @@
+#pragma once
+/*
+ * Класс массового опроса (sweep) множества IPv4 адресов
+ *
+ * Запросы отправляются через один AF_PACKET сокет (на поток опроса), ответы принимаются асинхронно
+ * и сопоставляются с целями по IP адресу отправителя. Интерфейс отправки каждой цели выбирается по таблице
+ * маршрутов, приём идёт со всех интерфейсов.
+ *
+ * Цели (адреса, сети, диапазоны за вычетом исключений) хранятся интервалами (TargetSet) и обходятся
+ * в псевдослучайном порядке циклической группы (TargetOrder), без списка адресов и массива перестановки.
+ * На цель опрос хранит только бит ответа; время отправки echo request возвращается в метке данных ответа
+ * (в режиме ARP метки нет - время отправки хранится на цель). Состояние обхода сохраняется в файл
+ * (SetCursor): прерванный по SIGINT/SIGTERM опрос продолжается следующим запуском с того же места.
+ * Цикл событий построен на epoll + timerfd:
+ * - timerfd тикает раз в TICK_NS и выдаёт "кредит" на отправку согласно заданной скорости (пакетов в секунду)
+ * - сокет вычитывается по готовности, не дожидаясь окончания отправки
+ * Таким образом время опроса определяется скоростью отправки, а не RTT * количество целей.
+ *
+ * Фрейм echo request (Ethernet + IP + ICMP) размечается один раз в шаблон. Для каждой цели шаблон копируется
+ * прямо в слот очереди отправки, где правятся адреса получателя, sequence и контрольные суммы (инкрементально).
+ *
+ * В режиме ARP вместо ICMP echo request отправляются ARP запросы - для целей из сети интерфейса
+ * MAC адрес получается без ICMP, ответы пополняют кэш соседей. Не ответившие цели попадают
+ * в кэш как отрицательные записи.
+ *
+ * Результаты (адрес, MAC, интерфейс, RTT, время ответа) не печатаются из потока приёма: запись фиксированного
+ * размера передаётся через кольцо потока в ResultSink, отдельный поток записи форматирует их (текст, JSON Lines,
+ * двоичные записи) и выводит большими порциями (SetOutput).
+ *
+ * Многопоточный режим (SetWorkers): каждый поток (SweepWorker) работает со своим сокетом, кольцами и таблицами
+ * и отправляет свою часть целей - каждый N-й шаг обхода, начиная со своего номера. Сокеты потоков объединены в группу
+ * PACKET_FANOUT: ядро распределяет принятые фреймы между ними (по хэшу потока или по номеру процессора),
+ * поэтому ответ может прийти в любой поток. Результаты сводятся без блокировок: бит ответа цели
+ * ставится атомарной операцией, счётчики завершения - атомарные. Потоки можно закрепить за процессорами.
+ *
+ * USAGE:
+ * Sweeper sweeper(rate, wait_sec, arp); // если успешно создан, то IsCreated вернёт true
+ * sweeper.SetWorkers(4, PACKET_FANOUT_HASH, true); // необязательно
+ * sweeper.SetOutput(ResultSink::Format::JSON, fd);  // необязательно, по умолчанию текст в stdout
+ * sweeper.SetMetrics(&region);                       // необязательно
+ * sweeper.SetUring(true);                             // необязательно, io_uring вместо колец
+ * sweeper.SetCursor("sweep.cursor");                  // необязательно, продолжение прерванного опроса
+ * sweeper.AddTarget("10.0.0.0/8");
+ * sweeper.ExcludeTarget("10.1.0.0-10.1.255.255");
+ * sweeper.Run(); // выведет IP и MAC адреса ответивших и вернёт количество ответов
+ */
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <sched.h>
+
+#include "icmp.h"
+#include "metrics.h"
+#include "result_sink.h"
+#include "target_set.h"
+
+class Sweeper;
+
+/* Поток опроса: свой сокет и таблицы, своя часть целей */
+class SweepWorker {
+public:
+    SweepWorker(Sweeper& sweeper, unsigned int index) noexcept;
+
+    bool IsCreated() const noexcept;
+
+    /* Подготовка к опросу: кольца, фильтр, приём со всех интерфейсов, вход в группу fanout
+     * - fanout_id - идентификатор группы, -1 - группу создаёт этот поток (идентификатор записывается в fanout_id)
+     * возвращает true при успехе */
+    bool Prepare(int* fanout_id) noexcept;
+
+    /* Цикл событий до завершения опроса, возвращает false при ошибке
+     * - signal_fd - signalfd SIGINT/SIGTERM, -1 - поток сигналы не принимает */
+    bool Run(int signal_fd) noexcept;
+
+    /* Шаг обхода, с которого поток продолжит отправку (читается из других потоков) */
+    unsigned long long GetNextPosition() const noexcept;
+
+    /* Итоги потока */
+    unsigned int GetSent() const noexcept;
+    unsigned int GetReplies() const noexcept;
+    unsigned int GetUnroutable() const noexcept;
+    bool GetStatistics(EthernetProtocol::RxStatistics* stats) noexcept;
+    bool IsRxRingEnabled() noexcept;
+    bool IsUringEnabled() noexcept;
+
+private:
+    bool OnTick(unsigned long long expirations) noexcept;
+    void Advance() noexcept;
+    bool IsFinished() noexcept;
+    static void HandleFrame(void* ctx, const unsigned char* frame, int len);
+    void OnReply(in_addr_t ip, const unsigned char* mac, long long sent_us) noexcept;
+
+    Sweeper& sweeper_;
+    unsigned int index_;                    // номер потока, он же номер первой цели потока
+    IPProtocol ip_proto_;
+    unsigned int rate_ = 0;                 // доля потока в общей скорости
+
+    unsigned char echo_template_[Ping::PING_PKT_SIZE];  // echo request, в котором меняются sequence и метка
+    FrameTemplate frame_template_;          // фрейм echo request для интерфейса if_name_
+    TargetOrder::Walker walker_;            // обход своей части целей
+    unsigned long long next_ = 0;           // номер следующей цели для отправки
+    unsigned long long next_position_ = 0;  // её шаг обхода, меняется только атомарно
+    bool has_next_ = false;                 // есть цель для отправки
+    unsigned long long credit_ = 0;         // накопленный кредит отправки (в тысячных долях пакета)
+    bool sending_done_ = false;             // все цели потока отправлены
+    unsigned int sent_ = 0;
+    unsigned int replies_ = 0;              // ответы, принятые этим потоком (в том числе на чужие запросы)
+    unsigned int unroutable_ = 0;           // цели, пропущенные из-за отсутствия маршрута
+    char if_name_[IFNAMSIZ] = {};           // интерфейс шаблона фрейма и ARP запросов (по маршруту к первой цели)
+};
+
+class Sweeper {
+public:
+    static constexpr unsigned int DEFAULT_RATE = 10000;         // пакетов в секунду
+    static constexpr unsigned int DEFAULT_WAIT = 1;             // ожидание ответов после последней отправки (в секундах)
+    static constexpr long TICK_NS = 1000000;                    // период таймера отправки (1 мс)
+    static constexpr unsigned int MAX_BURST = 256;              // максимум пакетов за один тик
+    static constexpr int RCV_BATCH = 1024;                      // максимум фреймов за одно пробуждение
+    static constexpr int RCV_BUF_SIZE = 8 * 1024 * 1024;        // размер приёмного буфера сокета
+    static constexpr int MIN_PREFIX_LEN = 8;                    // самая большая допустимая сеть /8
+    static constexpr unsigned int MAX_WORKERS = 64;             // максимум потоков опроса
+    static constexpr long long CURSOR_PERIOD_NS = 1000000000;   // период сохранения состояния обхода
+
+    Sweeper(unsigned int rate, unsigned int wait_sec, bool arp = false) noexcept;
+    ~Sweeper();
+
+    bool IsCreated() const noexcept;
+
+    /* Многопоточный опрос
+     * - count - количество потоков (1..MAX_WORKERS), 0 - по количеству доступных процессоров
+     * - fanout_type - распределение принятых фреймов между потоками (PACKET_FANOUT_HASH, PACKET_FANOUT_CPU)
+     * - pin - закрепить потоки за процессорами
+     * возвращает false, если потоки не удалось создать */
+    bool SetWorkers(unsigned int count, int fanout_type, bool pin) noexcept;
+
+    /* Формат и дескриптор вывода результатов (дескриптор закрывает вызывающая сторона) */
+    void SetOutput(ResultSink::Format format, int fd) noexcept;
+
+    /* Счётчики потоков в разделяемой памяти: каждый поток берёт свой блок "sweep.<номер>" (живёт дольше Run) */
+    void SetMetrics(MetricsRegion* region) noexcept;
+
+    /* Приём и пакетная отправка потоков через io_uring (EthernetProtocol::EnableUring) вместо колец
+     * PACKET_RX_RING/PACKET_TX_RING, у каждого потока - свои кольца io_uring */
+    void SetUring(bool enable) noexcept;
+
+    /* Файл состояния обхода: если он есть, опрос продолжается с сохранённого шага (множество целей должно
+     * совпадать), состояние сохраняется раз в CURSOR_PERIOD_NS и при прерывании; после полного опроса файл
+     * удаляется */
+    void SetCursor(const char* path) noexcept;
+
+    /* Добавление цели: IPv4 адрес (a.b.c.d), сеть (a.b.c.d/n) либо диапазон (a.b.c.d-e.f.g.h)
+     * Для сетей короче /31 адреса сети и broadcast пропускаются
+     * возвращает false при некорректной записи */
+    bool AddTarget(const char* spec) noexcept;
+
+    /* Исключение адреса, сети (целиком) или диапазона из целей */
+    bool ExcludeTarget(const char* spec) noexcept;
+
+    /* Выполнение опроса
+     * возвращает количество ответивших целей, либо -1 при неудаче */
+    int Run() noexcept;
+
+private:
+    friend class SweepWorker;
+
+    bool PrepareTargets() noexcept;
+    bool SetReplied(unsigned long long index) noexcept;
+    bool IsReplied(unsigned long long index) const noexcept;
+    bool SaveCursor() const noexcept;
+    void DestroyWorkers(unsigned int from) noexcept;
+    static void* WorkerMain(void* arg);
+    bool GetWorkerCpu(unsigned int index, cpu_set_t* cpus) const noexcept;
+
+    unsigned int rate_;
+    unsigned int wait_sec_;
+    bool arp_;                              // опрос ARP запросами
+    unsigned short id_;
+    ResultSink::Format format_ = ResultSink::Format::TEXT;
+    int output_fd_ = 1;                     // stdout
+    ResultSink* sink_ = nullptr;            // на время Run
+    MetricsRegion* metrics_ = nullptr;
+    bool uring_ = false;                    // io_uring вместо колец в потоках
+    long long start_ns_ = 0;                // начало опроса (CLOCK_MONOTONIC), от него отсчитывается sent_us
+
+    TargetSet targets_;
+    TargetOrder order_;
+    const char* cursor_path_ = nullptr;
+    unsigned long long* replied_ = nullptr; // биты ответов целей, меняются только атомарно
+    unsigned int* sent_us_ = nullptr;       // режим ARP: время отправки цели от начала опроса + 1, 0 - не отправлялась
+
+    SweepWorker* workers_[MAX_WORKERS] = {};
+    unsigned int workers_count_ = 0;
+    int fanout_type_ = 0;
+    bool pin_ = false;
+
+    // общее состояние потоков, меняется только атомарно
+    unsigned long long issued_ = 0;         // цели, отправленные или пропущенные из-за отсутствия маршрута
+    unsigned long long completed_ = 0;      // из них ответившие или пропущенные
+    unsigned int workers_sent_ = 0;         // потоки, отправившие все свои цели
+    long long deadline_ = 0;                // окончание ожидания ответов (после отправки всеми потоками)
+    bool stop_ = false;                     // ошибка в одном из потоков - остальные завершаются
+    bool interrupted_ = false;              // SIGINT/SIGTERM - отправка прекращается, состояние обхода сохраняется
+};
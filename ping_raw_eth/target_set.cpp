@@ -0,0 +1,401 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "target_set.h"
+#include "utils.h"
+
+namespace {
+constexpr unsigned int CURSOR_VERSION = 1;
+
+int CompareIntervals(const void* a, const void* b) {
+    in_addr_t lhs = *(const in_addr_t*)a;
+    in_addr_t rhs = *(const in_addr_t*)b;
+    return (lhs < rhs) ? -1 : ((lhs > rhs) ? 1 : 0);
+}
+
+/* Следующее значение генератора xorshift32, seed - не 0 */
+unsigned int NextRandom(unsigned int* seed) {
+    unsigned int x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+}
+
+TargetSet::~TargetSet() {
+    free(includes_.items);
+    free(excludes_.items);
+}
+
+/* Диапазон - два адреса через '-', остальное - адрес или сеть (utils::ParseNetwork) */
+bool TargetSet::Parse(const char* spec, int min_prefix_len, in_addr_t* first, in_addr_t* last) noexcept {
+    const char* dash = strchr(spec, '-');
+    if (dash == nullptr) {
+        return utils::ParseNetwork(spec, min_prefix_len, first, last);
+    }
+    char addr[INET_ADDRSTRLEN];
+    size_t addr_len = (size_t)(dash - spec);
+    struct in_addr from;
+    struct in_addr to;
+    bool ok = (addr_len < sizeof(addr));
+    if (ok) {
+        memcpy(addr, spec, addr_len);
+        addr[addr_len] = 0;
+        ok = (inet_pton(AF_INET, addr, &from) > 0) && (inet_pton(AF_INET, dash + 1, &to) > 0);
+    }
+    if (!ok) {
+        printf("Error. IPv4 address is not correct\n");
+        return false;
+    }
+    *first = ntohl(from.s_addr);
+    *last = ntohl(to.s_addr);
+    if (*first > *last) {
+        printf("Error. IPv4 range is not correct (first address is greater than last)\n");
+        return false;
+    }
+    return true;
+}
+
+bool TargetSet::Append(List& list, in_addr_t first, in_addr_t last) noexcept {
+    if (list.count == list.capacity) {
+        unsigned int capacity = (list.capacity == 0) ? 16 : list.capacity * 2;
+        Interval* items = (Interval*)realloc(list.items, capacity * sizeof(Interval));
+        if (items == nullptr) {
+            printf("Targets. Error. Not enough memory for targets.\n");
+            return false;
+        }
+        list.items = items;
+        list.capacity = capacity;
+    }
+    list.items[list.count++] = Interval{first, last, 0};
+    return true;
+}
+
+bool TargetSet::Add(const char* spec, int min_prefix_len) noexcept {
+    in_addr_t first;
+    in_addr_t last;
+    return Parse(spec, min_prefix_len, &first, &last) && Append(includes_, first, last);
+}
+
+/* Сеть исключается целиком, вместе с адресами сети и broadcast */
+bool TargetSet::Exclude(const char* spec) noexcept {
+    in_addr_t first;
+    in_addr_t last;
+    if (!Parse(spec, 0, &first, &last)) {
+        return false;
+    }
+    const char* slash = strchr(spec, '/');
+    if ((slash != nullptr) && (strchr(spec, '-') == nullptr) && (atoi(slash + 1) < 31)) {
+        --first;
+        ++last;
+    }
+    return Append(excludes_, first, last);
+}
+
+/* Сортировка по началу и слияние пересекающихся и смежных интервалов */
+void TargetSet::Merge(List& list) noexcept {
+    if (list.count == 0) {
+        return;
+    }
+    qsort(list.items, list.count, sizeof(Interval), CompareIntervals);
+    unsigned int merged = 1;
+    for (unsigned int i = 1; i < list.count; ++i) {
+        Interval& tail = list.items[merged - 1];
+        const Interval& next = list.items[i];
+        if ((unsigned long long)next.first <= (unsigned long long)tail.last + 1) {
+            if (next.last > tail.last) {
+                tail.last = next.last;
+            }
+        } else {
+            list.items[merged++] = next;
+        }
+    }
+    list.count = merged;
+}
+
+/* Вычитание исключений - один проход по двум отсортированным спискам. Исключение может разрезать
+ * интервал на два, поэтому результат собирается в новом массиве */
+bool TargetSet::Build() noexcept {
+    Merge(includes_);
+    Merge(excludes_);
+    List result;
+    unsigned int e = 0;
+    for (unsigned int i = 0; i < includes_.count; ++i) {
+        unsigned long long first = includes_.items[i].first;
+        const unsigned long long last = includes_.items[i].last;
+        while ((e < excludes_.count) && (excludes_.items[e].last < first)) {
+            ++e;
+        }
+        for (unsigned int x = e; (x < excludes_.count) && (excludes_.items[x].first <= last); ++x) {
+            if (excludes_.items[x].first > first) {
+                if (!Append(result, (in_addr_t)first, excludes_.items[x].first - 1)) {
+                    free(result.items);
+                    return false;
+                }
+            }
+            first = (unsigned long long)excludes_.items[x].last + 1;
+        }
+        if ((first <= last) && !Append(result, (in_addr_t)first, (in_addr_t)last)) {
+            free(result.items);
+            return false;
+        }
+    }
+    free(includes_.items);
+    includes_ = result;
+
+    count_ = 0;
+    for (unsigned int i = 0; i < includes_.count; ++i) {
+        includes_.items[i].before = count_;
+        count_ += (unsigned long long)includes_.items[i].last - includes_.items[i].first + 1;
+    }
+    return true;
+}
+
+unsigned long long TargetSet::GetCount() const noexcept {
+    return count_;
+}
+
+unsigned int TargetSet::GetIntervalCount() const noexcept {
+    return includes_.count;
+}
+
+in_addr_t TargetSet::Get(unsigned long long index) const noexcept {
+    // последний интервал, у которого before <= index
+    unsigned int lo = 0;
+    unsigned int hi = includes_.count;
+    while (hi - lo > 1) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (includes_.items[mid].before <= index) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const Interval& interval = includes_.items[lo];
+    return interval.first + (in_addr_t)(index - interval.before);
+}
+
+bool TargetSet::IndexOf(in_addr_t ip, unsigned long long* index) const noexcept {
+    // первый интервал, у которого last >= ip
+    unsigned int lo = 0;
+    unsigned int hi = includes_.count;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (includes_.items[mid].last < ip) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if ((lo == includes_.count) || (includes_.items[lo].first > ip)) {
+        return false;
+    }
+    *index = includes_.items[lo].before + (ip - includes_.items[lo].first);
+    return true;
+}
+
+
+/* p < 2^33, произведение помещается в 128 бит */
+unsigned long long TargetOrder::MulMod(unsigned long long a, unsigned long long b, unsigned long long p) noexcept {
+    return (unsigned long long)((unsigned __int128)a * b % p);
+}
+
+unsigned long long TargetOrder::PowMod(unsigned long long a, unsigned long long e, unsigned long long p) noexcept {
+    unsigned long long result = 1 % p;
+    a %= p;
+    while (e > 0) {
+        if (e & 1) {
+            result = MulMod(result, a, p);
+        }
+        a = MulMod(a, a, p);
+        e >>= 1;
+    }
+    return result;
+}
+
+/* Перебор делителей до корня: n < 2^33, не больше ~100 тысяч делений, выполняется один раз на обход */
+bool TargetOrder::IsPrime(unsigned long long n) noexcept {
+    if (n < 4) {
+        return n >= 2;
+    }
+    if ((n % 2 == 0) || (n % 3 == 0)) {
+        return false;
+    }
+    for (unsigned long long d = 5; d * d <= n; d += 6) {
+        if ((n % d == 0) || (n % (d + 2) == 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned long long TargetOrder::NextPrime(unsigned long long n) noexcept {
+    unsigned long long p = n + 1;
+    while (!IsPrime(p)) {
+        ++p;
+    }
+    return p;
+}
+
+/* g - образующий группы по модулю p, если g^((p-1)/q) != 1 для каждого простого делителя q числа p - 1 */
+bool TargetOrder::IsGenerator(unsigned long long g, unsigned long long p) noexcept {
+    if ((g == 0) || (g >= p)) {
+        return false;
+    }
+    unsigned long long order = p - 1;
+    unsigned long long rest = order;
+    for (unsigned long long q = 2; q * q <= rest; ++q) {
+        if (rest % q != 0) {
+            continue;
+        }
+        if (PowMod(g, order / q, p) == 1) {
+            return false;
+        }
+        while (rest % q == 0) {
+            rest /= q;
+        }
+    }
+    return (rest == 1) || (PowMod(g, order / rest, p) != 1);
+}
+
+bool TargetOrder::Init(unsigned long long count, unsigned int seed) noexcept {
+    if ((count == 0) || (count > (1ULL << 32))) {
+        return false;
+    }
+    count_ = count;
+    prime_ = NextPrime(count);
+    if (seed == 0) {
+        seed = 1;
+    }
+    // доля образующих в группе - не меньше нескольких процентов, случайный кандидат подходит за несколько попыток
+    do {
+        unsigned long long r = ((unsigned long long)NextRandom(&seed) << 32) | NextRandom(&seed);
+        generator_ = (prime_ > 3) ? 2 + r % (prime_ - 3) : prime_ - 1;
+    } while (!IsGenerator(generator_, prime_));
+    unsigned long long r = ((unsigned long long)NextRandom(&seed) << 32) | NextRandom(&seed);
+    first_ = 1 + r % (prime_ - 1);
+    position_ = 0;
+    return true;
+}
+
+bool TargetOrder::Restore(const Cursor& cursor) noexcept {
+    if ((cursor.count == 0) || (cursor.count > (1ULL << 32))) {
+        return false;
+    }
+    unsigned long long prime = NextPrime(cursor.count);
+    if ((cursor.first == 0) || (cursor.first >= prime) || (cursor.position > prime - 1) ||
+        !IsGenerator(cursor.generator, prime)) {
+        return false;
+    }
+    count_ = cursor.count;
+    prime_ = prime;
+    generator_ = cursor.generator;
+    first_ = cursor.first;
+    position_ = cursor.position;
+    return true;
+}
+
+TargetOrder::Cursor TargetOrder::GetCursor(unsigned long long position) const noexcept {
+    return Cursor{count_, generator_, first_, (position < prime_ - 1) ? position : prime_ - 1};
+}
+
+unsigned long long TargetOrder::GetPosition() const noexcept {
+    return position_;
+}
+
+unsigned long long TargetOrder::GetLength() const noexcept {
+    return prime_ - 1;
+}
+
+bool TargetOrder::Save(const char* path, const Cursor& cursor) noexcept {
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+        printf("Targets. Error. Cursor file path is too long.\n");
+        return false;
+    }
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        printf("Targets. Error writing cursor file %s. %s\n", tmp_path, strerror(errno));
+        return false;
+    }
+    char line[128];
+    int len = snprintf(line, sizeof(line), "ping2-cursor %u %llu %llu %llu %llu\n", CURSOR_VERSION, cursor.count,
+                       cursor.generator, cursor.first, cursor.position);
+    bool ok = (write(fd, line, len) == len);
+    if (!ok) {
+        printf("Targets. Error writing cursor file %s. %s\n", tmp_path, strerror(errno));
+    }
+    close(fd);
+    if (ok && (rename(tmp_path, path) < 0)) {
+        printf("Targets. Error writing cursor file %s. %s\n", path, strerror(errno));
+        ok = false;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+bool TargetOrder::Load(const char* path, Cursor* cursor) noexcept {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            printf("Targets. Error reading cursor file %s. %s\n", path, strerror(errno));
+        }
+        return false;
+    }
+    char line[128];
+    ssize_t len = read(fd, line, sizeof(line) - 1);
+    int err = errno;
+    close(fd);
+    if (len < 0) {
+        printf("Targets. Error reading cursor file %s. %s\n", path, strerror(err));
+        errno = err;
+        return false;
+    }
+    line[len] = 0;
+    unsigned int version = 0;
+    if ((sscanf(line, "ping2-cursor %u %llu %llu %llu %llu", &version, &cursor->count, &cursor->generator,
+                &cursor->first, &cursor->position) != 5) || (version != CURSOR_VERSION)) {
+        printf("Targets. Error. Cursor file %s has unknown format.\n", path);
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+
+TargetOrder::Walker::Walker(const TargetOrder& order, unsigned int offset, unsigned int stride) noexcept
+    : prime_(order.prime_), count_(order.count_), length_(order.prime_ - 1), position_(order.position_ + offset),
+      stride_(stride) {
+    multiplier_ = PowMod(order.generator_, stride, prime_);
+    element_ = MulMod(order.first_, PowMod(order.generator_, position_ % length_, prime_), prime_);
+}
+
+bool TargetOrder::Walker::Next(unsigned long long* index, unsigned long long* position) noexcept {
+    while (position_ < length_) {
+        unsigned long long element = element_;
+        element_ = MulMod(element_, multiplier_, prime_);
+        position_ += stride_;
+        if (element <= count_) {
+            *index = element - 1;
+            if (position != nullptr) {
+                *position = position_ - stride_;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long long TargetOrder::Walker::GetPosition() const noexcept {
+    return (position_ < length_) ? position_ : length_;
+}
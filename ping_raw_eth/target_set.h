@@ -0,0 +1,150 @@
+#pragma once
+/*
+ * Множество целей опроса и псевдослучайный порядок его обхода
+ *
+ * TargetSet - множество IPv4 адресов в виде отсортированных непересекающихся интервалов: адреса, сети
+ * (a.b.c.d/n) и диапазоны (a.b.c.d-e.f.g.h) добавляются интервалами, исключения вычитаются из них при Build.
+ * Память пропорциональна количеству интервалов, а не адресов: сеть /8 - один интервал.
+ * Цели пронумерованы по порядку адресов: адрес по номеру и номер по адресу - двоичный поиск по интервалам.
+ *
+ * TargetOrder - обход номеров 0..count-1 в псевдослучайном порядке без массива перестановки (как в ZMap):
+ * элементы мультипликативной группы по модулю простого p (наименьшего простого больше count) перебираются
+ * умножением на случайный образующий g, начиная со случайного элемента. Группа циклическая, поэтому за p - 1
+ * шагов каждый элемент x встречается ровно один раз; номер цели - x - 1, элементы больше count пропускаются
+ * (их меньше, чем промежуток до следующего простого). Соседние шаги попадают в далёкие друг от друга адреса -
+ * запросы не идут подряд в одну подсеть и через один порт коммутатора.
+ * Состояние обхода (Cursor) - четыре числа: продолжить обход можно с любого сохранённого шага.
+ * Потоки обходят цикл с шагом stride, каждый со своего смещения (Walker) - части потоков не пересекаются.
+ *
+ * USAGE:
+ * TargetSet targets;
+ * targets.Add("10.0.0.0/8", 8);                      // возвращает false при некорректной записи
+ * targets.Exclude("10.1.0.0-10.1.255.255");
+ * targets.Build();                                    // возвращает false, если не хватило памяти
+ *
+ * TargetOrder order;
+ * order.Init(targets.GetCount(), seed);               // либо Restore(cursor) для продолжения
+ * TargetOrder::Walker walker(order, 0, 1);
+ * unsigned long long index;
+ * while (walker.Next(&index)) { ... targets.Get(index) ... }
+ */
+#include <netinet/in.h>
+
+class TargetSet {
+public:
+    TargetSet() noexcept = default;
+    ~TargetSet();
+
+    /* Добавление адреса (a.b.c.d), сети (a.b.c.d/n, n не меньше min_prefix_len) или диапазона (a.b.c.d-e.f.g.h)
+     * Для сетей короче /31 адреса сети и broadcast пропускаются
+     * возвращает false при некорректной записи или нехватке памяти */
+    bool Add(const char* spec, int min_prefix_len) noexcept;
+
+    /* Исключение адреса, сети (любой длины префикса, целиком) или диапазона - в тех же форматах */
+    bool Exclude(const char* spec) noexcept;
+
+    /* Объединение пересекающихся и смежных интервалов и вычитание исключений
+     * После Build доступны GetCount, Get и IndexOf; добавлять цели снова можно - до следующего Build
+     * возвращает false, если не хватило памяти */
+    bool Build() noexcept;
+
+    /* Количество адресов и интервалов */
+    unsigned long long GetCount() const noexcept;
+    unsigned int GetIntervalCount() const noexcept;
+
+    /* Адрес цели с номером index (меньше GetCount), в порядке байт хоста */
+    in_addr_t Get(unsigned long long index) const noexcept;
+
+    /* Номер цели с адресом ip (в порядке байт хоста)
+     * возвращает false, если адреса нет в множестве */
+    bool IndexOf(in_addr_t ip, unsigned long long* index) const noexcept;
+
+private:
+    struct Interval {
+        in_addr_t first;                    // в порядке байт хоста, включительно
+        in_addr_t last;
+        unsigned long long before;          // адресов в предыдущих интервалах (после Build)
+    };
+
+    struct List {
+        Interval* items = nullptr;
+        unsigned int count = 0;
+        unsigned int capacity = 0;
+    };
+
+    static bool Parse(const char* spec, int min_prefix_len, in_addr_t* first, in_addr_t* last) noexcept;
+    static bool Append(List& list, in_addr_t first, in_addr_t last) noexcept;
+    static void Merge(List& list) noexcept;
+
+    List includes_;
+    List excludes_;
+    unsigned long long count_ = 0;
+};
+
+class TargetOrder {
+public:
+    /* Состояние обхода: по нему обход продолжается с того же места (в том числе другим процессом) */
+    struct Cursor {
+        unsigned long long count;           // количество целей - продолжать можно только то же множество
+        unsigned long long generator;       // образующий группы
+        unsigned long long first;           // элемент на шаге 0
+        unsigned long long position;        // пройдено шагов цикла (от 0 до p - 1)
+    };
+
+    /* Обход count (от 1 до 2^32) номеров со случайными образующим и началом
+     * - seed - начальное значение генератора (не 0)
+     * возвращает false при недопустимом count */
+    bool Init(unsigned long long count, unsigned int seed) noexcept;
+
+    /* Продолжение обхода с сохранённого состояния
+     * возвращает false, если состояние не соответствует обходу count номеров */
+    bool Restore(const Cursor& cursor) noexcept;
+
+    /* Состояние обхода с шага position (позицию назначает вызывающая сторона - по потокам) */
+    Cursor GetCursor(unsigned long long position) const noexcept;
+
+    /* Шаг, с которого начинается (продолжается) обход, и количество шагов цикла (p - 1) */
+    unsigned long long GetPosition() const noexcept;
+    unsigned long long GetLength() const noexcept;
+
+    /* Состояние обхода в текстовом файле (запись - через временный файл и rename, файл всегда целый)
+     * возвращают false при ошибке, Load - и при отсутствии файла (errno = ENOENT, без вывода ошибки) */
+    static bool Save(const char* path, const Cursor& cursor) noexcept;
+    static bool Load(const char* path, Cursor* cursor) noexcept;
+
+    /* Обход части цикла: шаги GetPosition() + offset, + offset + stride, ... */
+    class Walker {
+    public:
+        Walker() noexcept = default;
+        Walker(const TargetOrder& order, unsigned int offset, unsigned int stride) noexcept;
+
+        /* Следующий номер цели, false - часть обойдена
+         * - position - шаг цикла, на котором встретилась цель (если не nullptr) */
+        bool Next(unsigned long long* index, unsigned long long* position = nullptr) noexcept;
+
+        /* Шаг цикла, с которого продолжится обход */
+        unsigned long long GetPosition() const noexcept;
+
+    private:
+        unsigned long long prime_ = 0;
+        unsigned long long count_ = 0;
+        unsigned long long length_ = 0;
+        unsigned long long multiplier_ = 0; // g^stride mod p
+        unsigned long long element_ = 0;    // элемент на шаге position_
+        unsigned long long position_ = 0;
+        unsigned int stride_ = 1;
+    };
+
+private:
+    static unsigned long long MulMod(unsigned long long a, unsigned long long b, unsigned long long p) noexcept;
+    static unsigned long long PowMod(unsigned long long a, unsigned long long e, unsigned long long p) noexcept;
+    static bool IsPrime(unsigned long long n) noexcept;
+    static unsigned long long NextPrime(unsigned long long n) noexcept;
+    static bool IsGenerator(unsigned long long g, unsigned long long p) noexcept;
+
+    unsigned long long count_ = 0;
+    unsigned long long prime_ = 0;
+    unsigned long long generator_ = 0;
+    unsigned long long first_ = 0;
+    unsigned long long position_ = 0;
+};
@@ -0,0 +1,100 @@
+#include "timer_wheel.h"
+
+namespace {
+constexpr unsigned long long MAX_DELTA = (1ULL << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) - 1;
+}
+
+TimerWheel::TimerWheel(unsigned long long now) noexcept : now_(now) {
+    for (unsigned int level = 0; level < LEVELS; ++level) {
+        for (unsigned int slot = 0; slot < SLOTS; ++slot) {
+            slots_[level][slot].next = &slots_[level][slot];
+            slots_[level][slot].prev = &slots_[level][slot];
+        }
+    }
+}
+
+/* Уровень выбирается по удалённости срока от текущего тика, слот - по абсолютному сроку:
+ * тогда слот старшего уровня осыпается ровно тогда, когда начинается его диапазон */
+void TimerWheel::Insert(Timer* timer) noexcept {
+    unsigned long long delta = timer->expires - now_;
+    unsigned int level = 0;
+    while ((level + 1 < LEVELS) && (delta >= (1ULL << (SLOT_BITS * (level + 1))))) {
+        ++level;
+    }
+    Timer* head = &slots_[level][(timer->expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void TimerWheel::Schedule(Timer* timer, unsigned long long expires) noexcept {
+    Cancel(timer);
+    if (expires <= now_) {
+        expires = now_ + 1;
+    } else if (expires - now_ > MAX_DELTA) {
+        expires = now_ + MAX_DELTA;
+    }
+    timer->expires = expires;
+    Insert(timer);
+    ++count_;
+}
+
+void TimerWheel::Cancel(Timer* timer) noexcept {
+    if (timer->prev == nullptr) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = nullptr;
+    timer->prev = nullptr;
+    --count_;
+}
+
+/* Перекладывание таймеров слота старшего уровня на младшие уровни */
+void TimerWheel::Cascade(unsigned int level, unsigned int slot) noexcept {
+    Timer* head = &slots_[level][slot];
+    Timer* timer = head->next;
+    head->next = head;
+    head->prev = head;
+    while (timer != head) {
+        Timer* next = timer->next;
+        Insert(timer);
+        timer = next;
+    }
+}
+
+unsigned int TimerWheel::Advance(unsigned long long now, Handler handler, void* ctx) noexcept {
+    unsigned int fired = 0;
+    while (now_ < now) {
+        if (count_ == 0) {
+            // пустое колесо - прокручивать тики незачем
+            now_ = now;
+            break;
+        }
+        ++now_;
+        // начало оборота уровня 0 - осыпается очередной слот уровня 1, начало его оборота - слот уровня 2 и т.д.
+        for (unsigned int level = 1; level < LEVELS; ++level) {
+            if ((now_ & ((1ULL << (SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            Cascade(level, (now_ >> (SLOT_BITS * level)) & (SLOTS - 1));
+        }
+        Timer* head = &slots_[0][now_ & (SLOTS - 1)];
+        while (head->next != head) {
+            Timer* timer = head->next;
+            Cancel(timer);
+            ++fired;
+            handler(ctx, timer);
+        }
+    }
+    return fired;
+}
+
+unsigned long long TimerWheel::GetNow() const noexcept {
+    return now_;
+}
+
+unsigned int TimerWheel::GetCount() const noexcept {
+    return count_;
+}
@@ -0,0 +1,67 @@
+#pragma once
+/*
+ * Иерархическое колесо таймеров (hierarchical timing wheel)
+ *
+ * Время измеряется в тиках. Колесо состоит из LEVELS уровней по SLOTS слотов:
+ * - уровень 0 - слоты по одному тику (ближайшие SLOTS тиков)
+ * - уровень k - слоты по SLOTS^k тиков
+ * Таймер кладётся в слот того уровня, в диапазон которого попадает его срок. Когда младший уровень
+ * проходит полный оборот, очередной слот старшего уровня "осыпается" (cascade): его таймеры
+ * перекладываются на младшие уровни. Постановка и снятие таймера - O(1), продвижение на тик - O(1)
+ * в среднем (плюс обработка сработавших таймеров). Горизонт - SLOTS^LEVELS тиков,
+ * более далёкие сроки ограничиваются горизонтом.
+ *
+ * Таймеры интрузивные: узел Timer встраивается в структуру владельца, колесо память не выделяет.
+ *
+ * USAGE:
+ * TimerWheel wheel(now_tick);
+ * wheel.Schedule(&target->timer, now_tick + 1000);
+ * wheel.Advance(MonotonicNs() / TICK_NS, OnTimer, ctx); // OnTimer вызывается для каждого истёкшего таймера
+ */
+
+class TimerWheel {
+public:
+    static constexpr unsigned int SLOT_BITS = 8;
+    static constexpr unsigned int SLOTS = 1 << SLOT_BITS;
+    static constexpr unsigned int LEVELS = 4;
+
+    /* Узел таймера, встраивается в структуру владельца */
+    struct Timer {
+        Timer* next = nullptr;
+        Timer* prev = nullptr;              // nullptr - таймер не запланирован
+        unsigned long long expires = 0;     // срок в тиках
+    };
+
+    /* Обработчик истёкшего таймера: таймер уже снят с колеса и может быть запланирован заново */
+    using Handler = void (*)(void* ctx, Timer* timer);
+
+    explicit TimerWheel(unsigned long long now = 0) noexcept;
+
+    /* Постановка таймера на срок expires (в тиках). Запланированный таймер переставляется.
+     * Срок в прошлом срабатывает на следующем тике */
+    void Schedule(Timer* timer, unsigned long long expires) noexcept;
+
+    /* Снятие таймера (незапланированный таймер игнорируется) */
+    void Cancel(Timer* timer) noexcept;
+
+    static bool IsScheduled(const Timer* timer) noexcept {
+        return timer->prev != nullptr;
+    }
+
+    /* Продвижение времени до now (в тиках) с вызовом handler для истёкших таймеров
+     * возвращает количество сработавших таймеров */
+    unsigned int Advance(unsigned long long now, Handler handler, void* ctx) noexcept;
+
+    unsigned long long GetNow() const noexcept;
+
+    /* Количество запланированных таймеров */
+    unsigned int GetCount() const noexcept;
+
+private:
+    void Insert(Timer* timer) noexcept;
+    void Cascade(unsigned int level, unsigned int slot) noexcept;
+
+    Timer slots_[LEVELS][SLOTS];            // головы кольцевых списков слотов
+    unsigned long long now_;                // последний обработанный тик
+    unsigned int count_ = 0;
+};
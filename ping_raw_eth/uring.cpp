@@ -0,0 +1,223 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+namespace {
+int SysSetup(unsigned int entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int SysEnter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags, void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+int SysRegister(int fd, unsigned int opcode, void* arg, unsigned int nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+}
+
+/*
+ * При создании объекта:
+ * - создаём кольцо (io_uring_setup), при отказе ядра в IORING_SETUP_SUBMIT_ALL - без него
+ * - отображаем в память очереди отправки и завершений и массив запросов
+ * - массив индексов очереди отправки заполняется один раз: i-й элемент указывает на i-й запрос
+ */
+Uring::Uring(unsigned int entries, unsigned int cq_entries) noexcept {
+    struct io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = cq_entries;
+    fd_ = SysSetup(entries, &params);
+    if ((fd_ < 0) && (errno == EINVAL)) {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+        fd_ = SysSetup(entries, &params);
+    }
+    if (fd_ < 0) {
+        printf("Uring. Error. io_uring_setup failed. %s\n", strerror(errno));
+        return;
+    }
+    ext_arg_ = (params.features & IORING_FEAT_EXT_ARG) != 0;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = (sq_ring_size_ > cq_ring_size_) ? sq_ring_size_ : cq_ring_size_;
+        cq_ring_size_ = sq_ring_size_;
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+    } else if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        cq_ring_ = (cq_ring_ == MAP_FAILED) ? nullptr : cq_ring_;
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    sqes_ = (sqes == MAP_FAILED) ? nullptr : (struct io_uring_sqe*)sqes;
+    if ((sq_ring_ == nullptr) || (cq_ring_ == nullptr) || (sqes_ == nullptr)) {
+        printf("Uring. Error mapping rings. %s\n", strerror(errno));
+        return;
+    }
+
+    unsigned char* sq = (unsigned char*)sq_ring_;
+    sq_head_ = (unsigned int*)(sq + params.sq_off.head);
+    sq_tail_ = (unsigned int*)(sq + params.sq_off.tail);
+    sq_mask_ = *(unsigned int*)(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+    unsigned int* array = (unsigned int*)(sq + params.sq_off.array);
+    for (unsigned int i = 0; i < sq_entries_; ++i) {
+        array[i] = i;
+    }
+    unsigned char* cq = (unsigned char*)cq_ring_;
+    cq_head_ = (unsigned int*)(cq + params.cq_off.head);
+    cq_tail_ = (unsigned int*)(cq + params.cq_off.tail);
+    cq_mask_ = *(unsigned int*)(cq + params.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+}
+
+Uring::~Uring() {
+    if (buf_ring_ != nullptr) {
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+    }
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if ((cq_ring_ != nullptr) && (cq_ring_ != sq_ring_)) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool Uring::IsCreated() const noexcept {
+    return (fd_ >= 0) && (sqes_ != nullptr) && (cq_ring_ != nullptr);
+}
+
+int Uring::GetFd() const noexcept {
+    return fd_;
+}
+
+struct io_uring_sqe* Uring::GetSqe() noexcept {
+    unsigned int head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_local_tail_ - head >= sq_entries_) {
+        return nullptr;
+    }
+    struct io_uring_sqe* sqe = &sqes_[sq_local_tail_ & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    ++sq_local_tail_;
+    return sqe;
+}
+
+/* Хвост очереди отправки публикуется перед вызовом: ядро забирает все запросы от своей головы до хвоста.
+ * Без ожидания и без новых запросов вызов всё равно выполняется - ядро доделывает отложенную работу
+ * (завершения многоразовых запросов) и кладёт её результаты в очередь завершений */
+int Uring::Submit(unsigned int wait_nr, long long timeout_ns) noexcept {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    unsigned int to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned int flags = IORING_ENTER_GETEVENTS;
+    struct __kernel_timespec ts{timeout_ns / 1000000000LL, timeout_ns % 1000000000LL};
+    struct io_uring_getevents_arg arg{};
+    void* enter_arg = nullptr;
+    size_t enter_argsz = 0;
+    if ((wait_nr > 0) && (timeout_ns > 0) && ext_arg_) {
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (unsigned long long)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        enter_arg = &arg;
+        enter_argsz = sizeof(arg);
+    }
+    for (;;) {
+        int res = SysEnter(fd_, to_submit, wait_nr, flags, enter_arg, enter_argsz);
+        if (res >= 0) {
+            return res;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+const struct io_uring_cqe* Uring::PeekCqe() const noexcept {
+    unsigned int head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &cqes_[head & cq_mask_];
+}
+
+void Uring::SeenCqe() noexcept {
+    __atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+}
+
+bool Uring::RegisterBuffer(void* addr, unsigned long len) noexcept {
+    struct iovec iov{addr, len};
+    if (SysRegister(fd_, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+        printf("Uring. Error registering buffers. %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool Uring::SetupBufferRing(unsigned short group, unsigned char* base, unsigned int buf_size, unsigned int count) noexcept {
+    buf_ring_size_ = count * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        printf("Uring. Error. Not enough memory for buffer ring.\n");
+        return false;
+    }
+    struct io_uring_buf_reg reg{};
+    reg.ring_addr = (unsigned long long)ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (SysRegister(fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        printf("Uring. Error registering buffer ring. %s\n", strerror(errno));
+        munmap(ring, buf_ring_size_);
+        return false;
+    }
+    buf_ring_ = (struct io_uring_buf_ring*)ring;
+    buf_base_ = base;
+    buf_size_ = buf_size;
+    buf_mask_ = count - 1;
+    buf_tail_ = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        ReturnBuffer(i);
+    }
+    return true;
+}
+
+/* Буфер записывается в хвост кольца, новый хвост публикуется для ядра.
+ * Элементы адресуются от начала кольца, а не через bufs: в C++ __DECLARE_FLEX_ARRAY из заголовков ядра
+ * добавляет перед массивом пустую структуру размером 1 байт и сдвигает его на 8 байт */
+void Uring::ReturnBuffer(unsigned short id) noexcept {
+    struct io_uring_buf* buf = (struct io_uring_buf*)buf_ring_ + (buf_tail_ & buf_mask_);
+    buf->addr = (unsigned long long)(buf_base_ + (unsigned long)id * buf_size_);
+    buf->len = buf_size_;
+    buf->bid = id;
+    ++buf_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+unsigned char* Uring::GetBuffer(unsigned short id) const noexcept {
+    return buf_base_ + (unsigned long)id * buf_size_;
+}
@@ -0,0 +1,92 @@
+#pragma once
+/*
+ * Кольцо io_uring на системных вызовах io_uring_setup / io_uring_enter / io_uring_register (без liburing)
+ *
+ * Очередь отправки (SQ) и очередь завершений (CQ) отображаются в память процесса: запросы записываются
+ * в SQ без системных вызовов и отдаются ядру пачкой одним io_uring_enter (Submit), завершения читаются
+ * прямо из CQ (PeekCqe + SeenCqe).
+ *
+ * Дополнительно:
+ * - RegisterBuffer - регистрация (закрепление) области памяти для запросов IORING_OP_*_FIXED
+ * - SetupBufferRing - кольцо предоставленных буферов: для приёма с IOSQE_BUFFER_SELECT ядро само выбирает
+ *   свободный буфер, пользователь возвращает его после обработки (ReturnBuffer)
+ * Ожидание завершений ограничивается по времени через IORING_ENTER_EXT_ARG.
+ *
+ * USAGE:
+ * Uring ring(256, 4096); // если успешно создано, то IsCreated вернёт true
+ * struct io_uring_sqe* sqe = ring.GetSqe();
+ * ... заполнение sqe ...
+ * ring.Submit(1, 0);
+ * const struct io_uring_cqe* cqe = ring.PeekCqe();
+ * ring.SeenCqe();
+ */
+#include <linux/io_uring.h>
+
+class Uring {
+public:
+    /* - entries - размер очереди отправки
+     * - cq_entries - размер очереди завершений (многоразовые запросы дают много завершений на один запрос) */
+    Uring(unsigned int entries, unsigned int cq_entries) noexcept;
+    ~Uring();
+
+    bool IsCreated() const noexcept;
+
+    /* Дескриптор кольца - готов к чтению (poll/epoll), когда в очереди завершений есть записи */
+    int GetFd() const noexcept;
+
+    /* Следующий свободный (обнулённый) элемент очереди отправки, nullptr если очередь заполнена */
+    struct io_uring_sqe* GetSqe() noexcept;
+
+    /* Отдача ядру подготовленных запросов и ожидание не менее wait_nr завершений
+     * - timeout_ns - предел ожидания в наносекундах, 0 - без ограничения
+     * возвращает количество отданных запросов, либо -1 при неудаче (errno = ETIME - истёк предел ожидания) */
+    int Submit(unsigned int wait_nr, long long timeout_ns) noexcept;
+
+    /* Первое необработанное завершение, nullptr если завершений нет
+     * Указатель действителен до SeenCqe */
+    const struct io_uring_cqe* PeekCqe() const noexcept;
+
+    /* Завершение, полученное PeekCqe, обработано */
+    void SeenCqe() noexcept;
+
+    /* Регистрация области памяти addr длиной len как буфера с индексом 0, возвращает true при успехе */
+    bool RegisterBuffer(void* addr, unsigned long len) noexcept;
+
+    /* Кольцо предоставленных буферов группы group: count буферов (степень двойки) по buf_size байт подряд от base
+     * Все буферы сразу отдаются ядру, возвращает true при успехе */
+    bool SetupBufferRing(unsigned short group, unsigned char* base, unsigned int buf_size, unsigned int count) noexcept;
+
+    /* Возврат ядру буфера id кольца предоставленных буферов */
+    void ReturnBuffer(unsigned short id) noexcept;
+
+    /* Начало буфера id кольца предоставленных буферов */
+    unsigned char* GetBuffer(unsigned short id) const noexcept;
+
+private:
+    int fd_ = -1;
+    bool ext_arg_ = false;                  // ядро поддерживает предел ожидания (IORING_FEAT_EXT_ARG)
+
+    void* sq_ring_ = nullptr;               // отображение очереди отправки
+    unsigned long sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;               // отображение очереди завершений (может совпадать с sq_ring_)
+    unsigned long cq_ring_size_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    unsigned long sqes_size_ = 0;
+
+    unsigned int* sq_head_ = nullptr;
+    unsigned int* sq_tail_ = nullptr;
+    unsigned int sq_mask_ = 0;
+    unsigned int sq_entries_ = 0;
+    unsigned int sq_local_tail_ = 0;        // хвост с учётом ещё не опубликованных запросов
+    unsigned int* cq_head_ = nullptr;
+    unsigned int* cq_tail_ = nullptr;
+    unsigned int cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+
+    struct io_uring_buf_ring* buf_ring_ = nullptr;
+    unsigned long buf_ring_size_ = 0;
+    unsigned char* buf_base_ = nullptr;
+    unsigned int buf_size_ = 0;
+    unsigned int buf_mask_ = 0;
+    unsigned short buf_tail_ = 0;
+};
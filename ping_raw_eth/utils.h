@@ -1,21 +1,66 @@
 #pragma once
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 namespace utils {
 
-/* Вычисляем контрольную сумму (RFC 1071)
- * - len - длина в байтах */
-unsigned short Checksum(void *b, int len) {
-    unsigned short *buf = (unsigned short*)b;
-    unsigned int sum = 0;
+/* Монотонное время в наносекундах */
+inline long long MonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Время CLOCK_REALTIME в наносекундах - в тех же часах, что и программные метки времени ядра */
+inline long long RealtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Разбор цели: IPv4 адрес (a.b.c.d) либо сеть (a.b.c.d/n, не короче min_prefix_len)
+ * - first, last - первый и последний адрес диапазона в порядке байт хоста.
+ *   Для сетей короче /31 адреса сети и broadcast исключаются
+ * возвращает false (с выводом ошибки) при некорректной записи */
+inline bool ParseNetwork(const char* spec, int min_prefix_len, in_addr_t* first, in_addr_t* last) {
+    char addr[INET_ADDRSTRLEN];
+    int prefix_len = 32;
 
-    for (; len > 1; len -= 2) {
-        sum += *buf++;
+    const char* slash = strchr(spec, '/');
+    size_t addr_len = (slash != nullptr) ? (size_t)(slash - spec) : strlen(spec);
+    if (addr_len >= sizeof(addr)) {
+        printf("Error. IPv4 address is not correct\n");
+        return false;
     }
-    if (len == 1) {
-        sum += *(unsigned char *)buf;
+    memcpy(addr, spec, addr_len);
+    addr[addr_len] = 0;
+
+    struct in_addr in;
+    if (inet_pton(AF_INET, addr, &in) <= 0) {
+        printf("Error. IPv4 address is not correct\n");
+        return false;
+    }
+    if (slash != nullptr) {
+        char* end = nullptr;
+        prefix_len = strtol(slash + 1, &end, 10);
+        if ((end == slash + 1) || (*end != 0) || (prefix_len < min_prefix_len) || (prefix_len > 32)) {
+            printf("Error. Network prefix length is not correct (/%d../32 allowed)\n", min_prefix_len);
+            return false;
+        }
+    }
+
+    in_addr_t mask = (prefix_len == 0) ? 0 : (0xFFFFFFFFu << (32 - prefix_len));
+    *first = ntohl(in.s_addr) & mask;
+    *last = *first | ~mask;
+    if (prefix_len < 31) {
+        ++*first;
+        --*last;
     }
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
-    return ~sum;
+    return true;
 }
 
 }